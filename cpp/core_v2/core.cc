@@ -29,6 +29,10 @@ namespace connections {
 constexpr absl::Duration Core::kWaitForDisconnect;
 
 Core::~Core() {
+  // The client waits for its callbacks to return as it is destroyed.
+  if (client_.IsCalledFromListener()) {
+    NEARBY_LOG(FATAL, "Core must not be destroyed from its listeners");
+  }
   CountDownLatch latch(1);
   router_.ClientDisconnecting(
       &client_, {
@@ -119,6 +123,8 @@ void Core::StopAllEndpoints(ResultCallback callback) {
   router_.StopAllEndpoints(&client_, callback);
 }
 
+MetricsSnapshot Core::GetMetrics() { return client_.GetMetrics().Snapshot(); }
+
 }  // namespace connections
 }  // namespace nearby
 }  // namespace location
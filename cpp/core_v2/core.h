@@ -18,6 +18,7 @@
 #include <string>
 
 #include "core_v2/internal/client_proxy.h"
+#include "core_v2/internal/metrics.h"
 #include "core_v2/internal/offline_service_controller.h"
 #include "core_v2/internal/service_controller.h"
 #include "core_v2/internal/service_controller_router.h"
@@ -37,6 +38,7 @@ class Core {
   explicit Core(std::function<ServiceController*()> factory =
                     []() { return new OfflineServiceController; })
       : router_(factory) {}
+  // Must not be called from a listener of this Core; that is fatal.
   ~Core();
   Core(Core&&) = default;
   Core& operator=(Core&&) = default;
@@ -211,6 +213,17 @@ class Core {
   void InitiateBandwidthUpgrade(absl::string_view endpoint_id,
                                 ResultCallback callback);
 
+  // Returns the performance metrics of this client, and of each endpoint it
+  // is connected to: bytes and frames sent and received, and distributions of
+  // the time spent encrypting, decrypting, blocked on writes, handling
+  // incoming frames and paused for bandwidth upgrades. For the client as a
+  // whole, also the time spent in UKEY2 handshakes, and how many of its tasks
+  // are waiting in queues.
+  //
+  // Only endpoints that are connected are reported. May be called from any
+  // thread; it does not block on the connections.
+  MetricsSnapshot GetMetrics();
+
  private:
   static constexpr absl::Duration kWaitForDisconnect = absl::Milliseconds(5000);
 
@@ -14,6 +14,9 @@
 
 #include "core_v2/core.h"
 
+#include <type_traits>
+#include <utility>
+
 #include "core_v2/internal/client_proxy.h"
 #include "core_v2/internal/mock_service_controller.h"
 #include "core_v2/internal/service_controller.h"
@@ -32,6 +35,25 @@ TEST(CoreTest, ConstructorDestructorWorks) {
   Core core{[&mock]() { return &mock; }};
 }
 
+TEST(CoreTest, CanBeMoved) {
+  static_assert(std::is_move_constructible<Core>::value, "");
+  static_assert(std::is_move_assignable<Core>::value, "");
+  MockServiceController mock;
+  Core core{[&mock]() { return &mock; }};
+  Core moved{std::move(core)};
+}
+
+TEST(CoreTest, GetMetricsReportsNothingBeforeConnecting) {
+  MockServiceController mock;
+  Core core{[&mock]() { return &mock; }};
+
+  MetricsSnapshot metrics = core.GetMetrics();
+
+  EXPECT_TRUE(metrics.endpoints.empty());
+  EXPECT_EQ(metrics.payload_queue.current, 0);
+  EXPECT_EQ(metrics.endpoint_manager_queue.current, 0);
+}
+
 TEST(CoreTest, DestructorReportsFatalFailure) {
   MockServiceController mock;
   ON_CALL(mock, StopDiscovery).WillByDefault([](ClientProxy* client) {
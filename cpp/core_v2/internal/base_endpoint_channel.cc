@@ -15,8 +15,11 @@
 #include "core_v2/internal/base_endpoint_channel.h"
 
 #include <cassert>
+#include <string>
 
+#include "core_v2/internal/buffer_pool.h"
 #include "core_v2/internal/offline_frames.h"
+#include "core_v2/internal/tracing.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/exception.h"
 #include "platform_v2/public/logging.h"
@@ -54,26 +57,24 @@ ByteArray IntToBytes(std::int32_t value) {
   return ByteArray(int_bytes, sizeof(int_bytes));
 }
 
+// Reads straight into a buffer from BufferPool::Default().
 ExceptionOr<ByteArray> ReadExactly(InputStream* reader, std::int64_t size) {
-  ByteArray buffer(size);
-  std::int64_t current_pos = 0;
+  std::string buffer = BufferPool::Default().Acquire(size);
+  buffer.resize(size);
 
+  std::int64_t current_pos = 0;
   while (current_pos < size) {
-    ExceptionOr<ByteArray> read_bytes = reader->Read(size - current_pos);
-    if (!read_bytes.ok()) {
-      return read_bytes;
+    ExceptionOr<std::int64_t> read_count =
+        reader->ReadInto(&buffer[current_pos], size - current_pos);
+    if (!read_count.ok() || read_count.result() == 0) {
+      BufferPool::Default().Release(std::move(buffer));
+      return ExceptionOr<ByteArray>(
+          read_count.ok() ? Exception::kIo : read_count.exception());
     }
-    ByteArray result = read_bytes.result();
-
-    if (result.Empty()) {
-      return ExceptionOr<ByteArray>(Exception::kIo);
-    }
-
-    buffer.CopyAt(current_pos, result);
-    current_pos += result.size();
+    current_pos += read_count.result();
   }
 
-  return ExceptionOr<ByteArray>(std::move(buffer));
+  return ExceptionOr<ByteArray>(ByteArray(std::move(buffer)));
 }
 
 ExceptionOr<std::int32_t> ReadInt(InputStream* reader) {
@@ -109,6 +110,8 @@ ExceptionOr<ByteArray> BaseEndpointChannel::Read() {
       return ExceptionOr<ByteArray>(Exception::kIo);
     }
 
+    // The length is there, so the frame is on its way; time its arrival.
+    TraceSpan span("ReadFrame");
     ExceptionOr<ByteArray> read_bytes = ReadExactly(reader_, read_int.result());
     if (!read_bytes.ok()) {
       return read_bytes;
@@ -116,15 +119,30 @@ ExceptionOr<ByteArray> BaseEndpointChannel::Read() {
     result = std::move(read_bytes.result());
   }
 
+  std::shared_ptr<EndpointMetrics> metrics = GetMetrics();
+  if (metrics) {
+    metrics->frames_received.Add();
+    metrics->bytes_received.Add(sizeof(std::int32_t) + result.size());
+  }
+
   {
     MutexLock crypto_lock(&crypto_mutex_);
     if (IsEncryptionEnabledLocked()) {
       // If encryption is enabled, decode the message.
       std::string input(std::move(result));
-      std::unique_ptr<std::string> decrypted_data =
-          crypto_context_->DecodeMessageFromPeer(input);
+      absl::Time decrypt_start = SystemClock::ElapsedRealtime();
+      std::unique_ptr<std::string> decrypted_data;
+      {
+        TraceSpan span("DecryptFrame");
+        decrypted_data = crypto_context_->DecodeMessageFromPeer(input);
+      }
+      if (metrics) {
+        metrics->decrypt_time.Record(SystemClock::ElapsedRealtime() -
+                                     decrypt_start);
+      }
       if (decrypted_data) {
         result = ByteArray(std::move(*decrypted_data));
+        BufferPool::Default().Release(std::move(input));
       } else {
         // It could be a protocol race, where remote party sends a KEEP_ALIVE
         // before encryption is setup on their side, and we receive it after
@@ -138,6 +156,7 @@ ExceptionOr<ByteArray> BaseEndpointChannel::Read() {
             parser::GetFrameType(parsed.result()) == V1Frame::KEEP_ALIVE) {
           result = ByteArray(input);
         }
+        BufferPool::Default().Release(std::move(input));
       }
       if (result.Empty()) {
         return ExceptionOr<ByteArray>(Exception::kInvalidProtocolBuffer);
@@ -149,16 +168,41 @@ ExceptionOr<ByteArray> BaseEndpointChannel::Read() {
     MutexLock lock(&last_read_mutex_);
     last_read_timestamp_ = SystemClock::ElapsedRealtime();
   }
-  return ExceptionOr<ByteArray>(result);
+  return ExceptionOr<ByteArray>(std::move(result));
 }
 
 Exception BaseEndpointChannel::Write(const ByteArray& data) {
+  return Write(data, Payload::Priority::kNormal);
+}
+
+Exception BaseEndpointChannel::Write(const ByteArray& data,
+                                     Payload::Priority priority) {
+  return WriteFrame(data, priority, absl::nullopt);
+}
+
+Exception BaseEndpointChannel::WritePing() {
+  std::int32_t seq_num = link_monitor_.OnPingQueued();
+  Exception exception =
+      WriteFrame(parser::ForKeepAlive(seq_num, /*ack=*/false),
+                 Payload::Priority::kInteractive, seq_num);
+  if (!exception.Ok()) link_monitor_.OnPingFailed(seq_num);
+  return exception;
+}
+
+Exception BaseEndpointChannel::WriteFrame(
+    const ByteArray& data, Payload::Priority priority,
+    absl::optional<std::int32_t> ping_seq_num) {
+  std::shared_ptr<EndpointMetrics> metrics = GetMetrics();
+  absl::Time pause_start = SystemClock::ElapsedRealtime();
   {
     MutexLock pause_lock(&is_paused_mutex_);
     if (is_paused_) {
+      TraceSpan span("WaitForResume");
       BlockUntilUnpaused();
     }
   }
+  PriorityGateLock turn(&write_gate_, priority);
+  absl::Duration blocked = SystemClock::ElapsedRealtime() - pause_start;
 
   ByteArray encrypted_data;
   const ByteArray* data_to_write = &data;
@@ -166,31 +210,60 @@ Exception BaseEndpointChannel::Write(const ByteArray& data) {
     MutexLock crypto_lock(&crypto_mutex_);
     if (IsEncryptionEnabledLocked()) {
       // If encryption is enabled, encode the message.
-      std::unique_ptr<std::string> encrypted =
-          crypto_context_->EncodeMessageToPeer(std::string(data));
+      absl::Time encrypt_start = SystemClock::ElapsedRealtime();
+      std::unique_ptr<std::string> encrypted;
+      {
+        TraceSpan span("EncryptFrame");
+        std::string plaintext = BufferPool::Default().Acquire(data.size());
+        plaintext.append(data.data(), data.size());
+        encrypted = crypto_context_->EncodeMessageToPeer(plaintext);
+        BufferPool::Default().Release(std::move(plaintext));
+      }
+      if (metrics) {
+        metrics->encrypt_time.Record(SystemClock::ElapsedRealtime() -
+                                     encrypt_start);
+      }
       if (!encrypted) return {Exception::kIo};
       encrypted_data = ByteArray(std::move(*encrypted));
       data_to_write = &encrypted_data;
     }
   }
 
+  absl::Time write_start = SystemClock::ElapsedRealtime();
+  link_monitor_.OnWriteStarted(sizeof(std::int32_t) + data_to_write->size(),
+                               write_start);
+  if (ping_seq_num.has_value()) {
+    link_monitor_.OnPingSent(*ping_seq_num, write_start);
+  }
+  Exception write_exception;
   {
+    TraceSpan span("WriteFrame");
     MutexLock lock(&writer_mutex_);
-    Exception write_exception =
+    write_exception =
         WriteInt(writer_, static_cast<std::int32_t>(data_to_write->size()));
-    if (write_exception.Raised()) {
-      return write_exception;
+    if (!write_exception.Raised()) {
+      write_exception = writer_->Write(*data_to_write);
     }
-    write_exception = writer_->Write(*data_to_write);
-    if (write_exception.Raised()) {
-      return write_exception;
-    }
-    Exception flush_exception = writer_->Flush();
-    if (flush_exception.Raised()) {
-      return flush_exception;
+    if (!write_exception.Raised()) {
+      write_exception = writer_->Flush();
     }
   }
+  link_monitor_.OnWriteFinished(SystemClock::ElapsedRealtime());
+  if (write_exception.Raised()) {
+    return write_exception;
+  }
+
+  {
+    MutexLock lock(&last_write_mutex_);
+    last_write_timestamp_ = SystemClock::ElapsedRealtime();
+  }
 
+  if (metrics) {
+    blocked += SystemClock::ElapsedRealtime() - write_start;
+    metrics->write_blocked_time.Record(blocked);
+    metrics->frames_sent.Add();
+    metrics->bytes_sent.Add(sizeof(std::int32_t) + data_to_write->size());
+  }
   return {Exception::kSuccess};
 }
 
@@ -280,6 +353,21 @@ absl::Time BaseEndpointChannel::GetLastReadTimestamp() const {
   return last_read_timestamp_;
 }
 
+absl::Time BaseEndpointChannel::GetLastWriteTimestamp() const {
+  MutexLock lock(&last_write_mutex_);
+  return last_write_timestamp_;
+}
+
+void BaseEndpointChannel::SetMetrics(std::shared_ptr<EndpointMetrics> metrics) {
+  MutexLock lock(&metrics_mutex_);
+  metrics_ = std::move(metrics);
+}
+
+std::shared_ptr<EndpointMetrics> BaseEndpointChannel::GetMetrics() const {
+  MutexLock lock(&metrics_mutex_);
+  return metrics_;
+}
+
 bool BaseEndpointChannel::IsEncryptionEnabledLocked() const {
   return crypto_context_ != nullptr;
 }
@@ -20,6 +20,10 @@
 #include <string>
 
 #include "core_v2/internal/endpoint_channel.h"
+#include "core_v2/internal/link_monitor.h"
+#include "core_v2/internal/metrics.h"
+#include "core_v2/internal/priority_gate.h"
+#include "core_v2/payload.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/input_stream.h"
 #include "platform_v2/base/output_stream.h"
@@ -30,6 +34,7 @@
 #include "proto/connections_enums.pb.h"
 #include "securegcm/d2d_connection_context_v1.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/types/optional.h"
 
 namespace location {
 namespace nearby {
@@ -45,9 +50,13 @@ class BaseEndpointChannel : public EndpointChannel {
       ABSL_LOCKS_EXCLUDED(reader_mutex_, crypto_mutex_,
                           last_read_mutex_) override;
 
+  // Writes with Payload::Priority::kNormal.
   Exception Write(const ByteArray& data)
       ABSL_LOCKS_EXCLUDED(writer_mutex_, crypto_mutex_) override;
 
+  Exception Write(const ByteArray& data, Payload::Priority priority)
+      ABSL_LOCKS_EXCLUDED(writer_mutex_, crypto_mutex_) override;
+
   // Closes this EndpointChannel, without tracking the closure in analytics.
   void Close() ABSL_LOCKS_EXCLUDED(is_paused_mutex_) override;
 
@@ -82,6 +91,21 @@ class BaseEndpointChannel : public EndpointChannel {
   absl::Time GetLastReadTimestamp() const
       ABSL_LOCKS_EXCLUDED(last_read_mutex_) override;
 
+  // Returns the timestamp (returned by ElapsedRealtime) of the last write to
+  // this endpoint, or -1 if no writes have occurred.
+  absl::Time GetLastWriteTimestamp() const
+      ABSL_LOCKS_EXCLUDED(last_write_mutex_) override;
+
+  void SetMetrics(std::shared_ptr<EndpointMetrics> metrics)
+      ABSL_LOCKS_EXCLUDED(metrics_mutex_) override;
+
+  // Tracks the round trip time and write throughput of this EndpointChannel;
+  // writes are reported to it as they happen.
+  LinkMonitor* GetLinkMonitor() override { return &link_monitor_; }
+
+  Exception WritePing()
+      ABSL_LOCKS_EXCLUDED(writer_mutex_, crypto_mutex_) override;
+
  protected:
   virtual void CloseImpl() = 0;
 
@@ -89,17 +113,28 @@ class BaseEndpointChannel : public EndpointChannel {
   // Used to sanity check that our frame sizes are reasonable.
   static constexpr std::int32_t kMaxAllowedReadBytes = 1048576;  // 1MB
 
+  // Writes data; if it is the KeepAlive frame ping_seq_num, tells
+  // link_monitor_ when it goes out.
+  Exception WriteFrame(const ByteArray& data, Payload::Priority priority,
+                       absl::optional<std::int32_t> ping_seq_num)
+      ABSL_LOCKS_EXCLUDED(writer_mutex_, crypto_mutex_);
   bool IsEncryptionEnabledLocked() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(crypto_mutex_);
   void UnblockPausedWriter() ABSL_EXCLUSIVE_LOCKS_REQUIRED(is_paused_mutex_);
   void BlockUntilUnpaused() ABSL_EXCLUSIVE_LOCKS_REQUIRED(is_paused_mutex_);
   void CloseIo() ABSL_NO_THREAD_SAFETY_ANALYSIS;
+  std::shared_ptr<EndpointMetrics> GetMetrics() const
+      ABSL_LOCKS_EXCLUDED(metrics_mutex_);
 
   // We need a separate mutex to pritect read timestamp, because if a read
   // blocks on IO, we don't want timestamp read access to block too.
   mutable Mutex last_read_mutex_;
   absl::Time last_read_timestamp_ ABSL_GUARDED_BY(last_read_mutex_) =
       absl::InfinitePast();
+  // Same for the write timestamp, while a write blocks on IO.
+  mutable Mutex last_write_mutex_;
+  absl::Time last_write_timestamp_ ABSL_GUARDED_BY(last_write_mutex_) =
+      absl::InfinitePast();
   const std::string channel_name_;
 
   // The reader and writer are synchronized independently since we can't have
@@ -110,6 +145,10 @@ class BaseEndpointChannel : public EndpointChannel {
   Mutex writer_mutex_;
   OutputStream* writer_ ABSL_PT_GUARDED_BY(writer_mutex_);
 
+  // Orders concurrent writes by priority. Held from encryption through the
+  // end of the write, so that frames go out in the order they are encrypted.
+  PriorityGate write_gate_;
+
   // An encryptor/decryptor. May be null.
   mutable Mutex crypto_mutex_;
   std::shared_ptr<EncryptionContext> crypto_context_
@@ -119,6 +158,12 @@ class BaseEndpointChannel : public EndpointChannel {
   ConditionVariable is_paused_cond_{&is_paused_mutex_};
   // If true, writes should block until this has been set to false.
   bool is_paused_ ABSL_GUARDED_BY(is_paused_mutex_) = false;
+
+  LinkMonitor link_monitor_;
+
+  // Where traffic is recorded. May be null.
+  mutable Mutex metrics_mutex_;
+  std::shared_ptr<EndpointMetrics> metrics_ ABSL_GUARDED_BY(metrics_mutex_);
 };
 
 }  // namespace connections
@@ -25,6 +25,7 @@
 #include "platform_v2/public/multi_thread_executor.h"
 #include "platform_v2/public/pipe.h"
 #include "platform_v2/public/single_thread_executor.h"
+#include "platform_v2/public/system_clock.h"
 #include "proto/connections_enums.pb.h"
 #include "proto/connections_enums.pb.h"
 #include "securegcm/d2d_connection_context_v1.h"
@@ -170,6 +171,47 @@ TEST(BaseEndpointChannelTest, ReadWrite) {
   EXPECT_EQ(rx_message, tx_message);
 }
 
+TEST(BaseEndpointChannelTest, WriteUpdatesLastWriteTimestamp) {
+  Pipe pipe;
+  TestEndpointChannel channel(&pipe.GetInputStream(),
+                              &pipe.GetOutputStream());
+  EXPECT_EQ(channel.GetLastWriteTimestamp(), absl::InfinitePast());
+
+  absl::Time before = SystemClock::ElapsedRealtime();
+  EXPECT_TRUE(channel.Write(ByteArray{"data message"}).Ok());
+  EXPECT_GE(channel.GetLastWriteTimestamp(), before);
+  EXPECT_EQ(channel.GetLastReadTimestamp(), absl::InfinitePast());
+}
+
+TEST(BaseEndpointChannelTest, ReadWriteAreRecordedInMetrics) {
+  Pipe pipe_a;  // channel_a writes to pipe_a, reads from pipe_b.
+  Pipe pipe_b;  // channel_b writes to pipe_b, reads from pipe_a.
+  TestEndpointChannel channel_a(&pipe_b.GetInputStream(),
+                                &pipe_a.GetOutputStream());
+  TestEndpointChannel channel_b(&pipe_a.GetInputStream(),
+                                &pipe_b.GetOutputStream());
+  auto metrics_a = std::make_shared<EndpointMetrics>();
+  auto metrics_b = std::make_shared<EndpointMetrics>();
+  channel_a.SetMetrics(metrics_a);
+  channel_b.SetMetrics(metrics_b);
+
+  ByteArray tx_message{"data message"};
+  channel_a.Write(tx_message);
+  channel_a.Write(tx_message);
+  channel_b.Read();
+  channel_b.Read();
+
+  // Each frame is preceded by its 4-byte length.
+  EXPECT_EQ(metrics_a->frames_sent.Value(), 2);
+  EXPECT_EQ(metrics_a->bytes_sent.Value(), 2 * (4 + tx_message.size()));
+  EXPECT_EQ(metrics_a->write_blocked_time.Snapshot().count, 2);
+  EXPECT_EQ(metrics_b->frames_received.Value(), 2);
+  EXPECT_EQ(metrics_b->bytes_received.Value(), 2 * (4 + tx_message.size()));
+  // Nothing is encrypted yet.
+  EXPECT_EQ(metrics_a->encrypt_time.Snapshot().count, 0);
+  EXPECT_EQ(metrics_b->decrypt_time.Snapshot().count, 0);
+}
+
 TEST(BaseEndpointChannelTest, NotEncryptedReadWriteCanBeIntercepted) {
   // Not encrypted IO; MITM scenario.
 
@@ -19,12 +19,18 @@
 #include <cstdlib>
 #include <limits>
 #include <memory>
+#include <string>
+#include <utility>
 
+#include "core_v2/internal/buffer_pool.h"
 #include "core_v2/internal/offline_frames.h"
 #include "core_v2/internal/pcp_handler.h"
 #include "core_v2/options.h"
 #include "platform_v2/base/bluetooth_utils.h"
+#include "platform_v2/public/condition_variable.h"
 #include "platform_v2/public/logging.h"
+#include "platform_v2/public/mutex.h"
+#include "platform_v2/public/mutex_lock.h"
 #include "platform_v2/public/system_clock.h"
 #include "securegcm/d2d_connection_context_v1.h"
 #include "securegcm/ukey2_handshake.h"
@@ -41,6 +47,8 @@ using ::securegcm::UKey2Handshake;
 
 constexpr absl::Duration BasePcpHandler::kConnectionRequestReadTimeout;
 constexpr absl::Duration BasePcpHandler::kRejectedConnectionCloseDelay;
+constexpr absl::Duration BasePcpHandler::kConnectionAttemptStagger;
+constexpr int BasePcpHandler::kMaxConcurrentAdmissions;
 
 BasePcpHandler::BasePcpHandler(Mediums* mediums,
                                EndpointManager* endpoint_manager,
@@ -60,6 +68,8 @@ BasePcpHandler::~BasePcpHandler() {
   NEARBY_LOGS(INFO) << "BasePcpHandler: bringing down executors; strategy="
                     << strategy_.GetName();
   serial_executor_.Shutdown();
+  connect_executor_.Shutdown();
+  admission_executor_.Shutdown();
   alarm_executor_.Shutdown();
   NEARBY_LOGS(INFO) << "BasePcpHandler: is down; strategy="
                     << strategy_.GetName();
@@ -131,7 +141,10 @@ Status BasePcpHandler::StartDiscovery(ClientProxy* client,
         // Now that we've succeeded, mark the client as discovering and clear
         // out any old endpoints we had discovered.
         discovery_options_ = discovery_options;
-        discovered_endpoints_.clear();
+        discovered_endpoints_.RemoveServiceId(discovery_service_id_);
+        discovery_service_id_ = service_id;
+        discovered_endpoints_.SetMediumsByPriority(
+            GetConnectionMediumsByPriority());
         client->StartedDiscovery(service_id, GetStrategy(), listener,
                                  absl::MakeSpan(result.mediums));
         response.Set({Status::kSuccess});
@@ -336,40 +349,36 @@ Status BasePcpHandler::RequestConnection(ClientProxy* client,
     if (AppendWebRTCEndpoint(endpoint_id))
       NEARBY_LOGS(INFO) << "Appended Web RTC endpoint.";
 
-    auto discovered_endpoints = GetDiscoveredEndpoints(endpoint_id);
-    std::unique_ptr<EndpointChannel> channel;
-    ConnectImplResult connect_impl_result;
-
-    for (auto connect_endpoint : discovered_endpoints) {
-      connect_impl_result = ConnectImpl(client, connect_endpoint);
-      if (connect_impl_result.status.Ok()) {
-        channel = std::move(connect_impl_result.endpoint_channel);
-        break;
-      }
-    }
-
-    if (channel == nullptr) {
-      NEARBY_LOG(INFO, "Endpoint channel not available: id=%s",
-                 endpoint_id.c_str());
-      ProcessPreConnectionInitiationFailure(
-          endpoint_id, channel.get(), connect_impl_result.status, &result);
-      return;
-    }
+    // Medium availability may have changed since discovery started; this is
+    // a no-op if it did not.
+    discovered_endpoints_.SetMediumsByPriority(
+        GetConnectionMediumsByPriority());
+    auto discovered_endpoints = discovered_endpoints_.GetAllShared(endpoint_id);
 
-    NEARBY_LOG(INFO, "Sending connection request: id=%s", endpoint_id.c_str());
     // Generate the nonce to use for this connection.
     std::int32_t nonce = prng_.NextInt32();
 
     // The first message we have to send, after connecting, is to tell the
-    // endpoint about ourselves.
-    Exception write_exception = WriteConnectionRequestFrame(
-        channel.get(), client->GetLocalEndpointId(), info.endpoint_info, nonce,
-        GetConnectionMediumsByPriority());
-    if (!write_exception.Ok()) {
-      NEARBY_LOG(INFO, "Failed to send connection request: id=%s",
+    // endpoint about ourselves. The first channel to get it across wins.
+    ConnectImplResult connect_impl_result = RaceConnectImpl(
+        client, discovered_endpoints,
+        [endpoint_id, local_endpoint_id = client->GetLocalEndpointId(),
+         local_endpoint_info = info.endpoint_info, nonce,
+         mediums = GetConnectionMediumsByPriority()](
+            EndpointChannel* channel) {
+          NEARBY_LOG(INFO, "Sending connection request: id=%s",
+                     endpoint_id.c_str());
+          return WriteConnectionRequestFrame(
+              channel, local_endpoint_id, local_endpoint_info, nonce, mediums);
+        });
+    std::unique_ptr<EndpointChannel> channel =
+        std::move(connect_impl_result.endpoint_channel);
+
+    if (channel == nullptr) {
+      NEARBY_LOG(INFO, "Endpoint channel not available: id=%s",
                  endpoint_id.c_str());
       ProcessPreConnectionInitiationFailure(
-          endpoint_id, channel.get(), {Status::kEndpointIoError}, &result);
+          endpoint_id, channel.get(), connect_impl_result.status, &result);
       return;
     }
 
@@ -414,28 +423,123 @@ Status BasePcpHandler::RequestConnection(ClientProxy* client,
   return status;
 }
 
-// Get any single discovered endpoint for a given endpoint_id.
+struct BasePcpHandler::ConnectRace {
+  explicit ConnectRace(int attempts)
+      : attempts(attempts), statuses(attempts, {Status::kError}) {}
+
+  const int attempts;
+  const absl::Time start_time = SystemClock::ElapsedRealtime();
+  Mutex mutex;
+  ConditionVariable changed{&mutex};
+  // Attempts that gave up without winning.
+  int failed ABSL_GUARDED_BY(mutex) = 0;
+  // True while some attempt runs the handshake.
+  bool handshaking ABSL_GUARDED_BY(mutex) = false;
+  // Set once an attempt wins; then, winner holds its result.
+  bool decided ABSL_GUARDED_BY(mutex) = false;
+  ConnectImplResult winner ABSL_GUARDED_BY(mutex);
+  std::vector<Status> statuses ABSL_GUARDED_BY(mutex);
+  // Set once the race is decided, to stop the attempts still connecting.
+  CancellationFlag cancellation_flag;
+};
+
+void BasePcpHandler::StopConnectAttempts() { connect_executor_.Shutdown(); }
+
+BasePcpHandler::ConnectImplResult BasePcpHandler::RaceConnectImpl(
+    ClientProxy* client,
+    const std::vector<std::shared_ptr<DiscoveredEndpoint>>& endpoints,
+    std::function<Exception(EndpointChannel*)> handshake) {
+  if (endpoints.empty()) return {};
+  auto race = std::make_shared<ConnectRace>(endpoints.size());
+  for (int i = 0; i < race->attempts; i++) {
+    // Attempts that lose may still be connecting after we return, so they
+    // keep the endpoint alive.
+    connect_executor_.Execute(
+        [this, client, endpoint = endpoints[i], i, race, handshake]() {
+          RunConnectAttempt(client, endpoint.get(), i, race, handshake);
+        });
+  }
+
+  MutexLock lock(&race->mutex);
+  while (!race->decided && race->failed < race->attempts) {
+    race->changed.Wait();
+  }
+  if (race->decided) return std::move(race->winner);
+  return ConnectImplResult{
+      .medium = endpoints.back()->medium,
+      .status = race->statuses.back(),
+  };
+}
+
+void BasePcpHandler::RunConnectAttempt(
+    ClientProxy* client, DiscoveredEndpoint* endpoint, int index,
+    std::shared_ptr<ConnectRace> race,
+    const std::function<Exception(EndpointChannel*)>& handshake) {
+  {
+    MutexLock lock(&race->mutex);
+    absl::Time turn = race->start_time + index * kConnectionAttemptStagger;
+    while (!race->decided && race->failed < index) {
+      absl::Duration wait = turn - SystemClock::ElapsedRealtime();
+      if (wait <= absl::ZeroDuration()) break;
+      race->changed.Wait(wait);
+    }
+    if (race->decided) {
+      race->failed++;
+      return;
+    }
+  }
+
+  NEARBY_LOG(INFO, "Connecting: id=%s; medium=%d",
+             endpoint->endpoint_id.c_str(), endpoint->medium);
+  ConnectImplResult result =
+      ConnectImpl(client, endpoint, &race->cancellation_flag);
+  bool can_handshake = result.status.Ok();
+  if (can_handshake) {
+    MutexLock lock(&race->mutex);
+    while (!race->decided && race->handshaking) race->changed.Wait();
+    can_handshake = !race->decided;
+    race->handshaking = can_handshake;
+  }
+
+  bool won = false;
+  if (can_handshake) {
+    won = handshake(result.endpoint_channel.get()).Ok();
+    if (!won) result.status = {Status::kEndpointIoError};
+  }
+
+  std::unique_ptr<EndpointChannel> lost_channel;
+  {
+    MutexLock lock(&race->mutex);
+    if (can_handshake) race->handshaking = false;
+    if (won) {
+      race->decided = true;
+      race->winner = std::move(result);
+    } else {
+      race->failed++;
+      race->statuses[index] = result.status;
+      lost_channel = std::move(result.endpoint_channel);
+    }
+    race->changed.Notify();
+  }
+  if (won) race->cancellation_flag.Cancel();
+  if (lost_channel != nullptr) {
+    NEARBY_LOG(INFO, "Connection attempt lost: id=%s; medium=%d",
+               endpoint->endpoint_id.c_str(), endpoint->medium);
+    lost_channel->Close();
+  }
+}
+
 BasePcpHandler::DiscoveredEndpoint* BasePcpHandler::GetDiscoveredEndpoint(
     const std::string& endpoint_id) {
-  auto it = discovered_endpoints_.find(endpoint_id);
-  if (it == discovered_endpoints_.end()) {
-    return nullptr;
-  }
-  return it->second.get();
+  return discovered_endpoints_.GetBest(endpoint_id);
 }
 
 std::vector<BasePcpHandler::DiscoveredEndpoint*>
 BasePcpHandler::GetDiscoveredEndpoints(const std::string& endpoint_id) {
-  std::vector<BasePcpHandler::DiscoveredEndpoint*> result;
-  auto it = discovered_endpoints_.equal_range(endpoint_id);
-  for (auto item = it.first; item != it.second; item++) {
-    result.push_back(item->second.get());
-  }
-  std::sort(result.begin(), result.end(),
-            [this](DiscoveredEndpoint* a, DiscoveredEndpoint* b) -> bool {
-              return IsPreferred(*a, *b);
-            });
-  return result;
+  // Medium availability may have changed since discovery started; this is a
+  // no-op if it did not.
+  discovered_endpoints_.SetMediumsByPriority(GetConnectionMediumsByPriority());
+  return discovered_endpoints_.GetAll(endpoint_id);
 }
 
 void BasePcpHandler::PendingConnectionInfo::SetCryptoContext(
@@ -701,53 +805,41 @@ ConnectionOptions BasePcpHandler::GetDiscoveryOptions() const {
 
 void BasePcpHandler::OnEndpointFound(
     ClientProxy* client, std::shared_ptr<DiscoveredEndpoint> endpoint) {
-  // Check if we've seen this endpoint ID before.
-  std::string& endpoint_id = endpoint->endpoint_id;
+  // Check if we've seen this endpoint ID over this medium before.
+  std::string endpoint_id = endpoint->endpoint_id;
   NEARBY_LOG(INFO, "OnEndpointFound: id='%s' [enter]", endpoint_id.c_str());
 
-  auto range = discovered_endpoints_.equal_range(endpoint->endpoint_id);
-
-  DiscoveredEndpoint* owned_endpoint = nullptr;
-  for (auto& item = range.first; item != range.second; ++item) {
-    auto& discovered_endpoint = item->second;
-    if (discovered_endpoint->medium != endpoint->medium) continue;
-    // Check if there was a info change. If there was, report the previous
-    // endpoint as lost.
-    if (discovered_endpoint->endpoint_info != endpoint->endpoint_info) {
-      OnEndpointLost(client, *discovered_endpoint);
-      discovered_endpoint = endpoint;  // Replace endpoint.
-      OnEndpointFound(client, std::move(endpoint));
-      return;
-    } else {
-      owned_endpoint = endpoint.get();
-      break;
-    }
-  }
-
-  if (!owned_endpoint) {
-    owned_endpoint =
-        discovered_endpoints_.emplace(endpoint_id, std::move(endpoint))
-            ->second.get();
+  const DiscoveredEndpoint* discovered_endpoint =
+      discovered_endpoints_.Get(endpoint_id, endpoint->medium);
+  // Check if there was a info change. If there was, report the previous
+  // endpoint as lost.
+  if (discovered_endpoint != nullptr &&
+      discovered_endpoint->endpoint_info != endpoint->endpoint_info) {
+    OnEndpointLost(client, *discovered_endpoint);
+    OnEndpointFound(client, std::move(endpoint));
+    return;
   }
 
-  // Range is empty: this is the first endpoint we discovered so far.
-  // Report this endpoint_id to client.
-  if (range.first == range.second) {
+  // Sightings of an endpoint over other mediums, or repeated sightings over
+  // the same one, only update our cache.
+  const DiscoveredEndpoint& owned_endpoint = *endpoint;
+  if (discovered_endpoints_.Put(std::move(endpoint))) {
     NEARBY_LOG(INFO, "Adding new endpoint: id=%s", endpoint_id.c_str());
     // And, as it's the first time, report it to the client.
     client->OnEndpointFound(
-        owned_endpoint->service_id, owned_endpoint->endpoint_id,
-        owned_endpoint->endpoint_info, owned_endpoint->medium);
-  } else {
+        owned_endpoint.service_id, owned_endpoint.endpoint_id,
+        owned_endpoint.endpoint_info, owned_endpoint.medium);
+  } else if (discovered_endpoint == nullptr) {
     NEARBY_LOGS(INFO) << "Adding new medium for endpoint: id=" << endpoint_id
-                      << "; medium=" << owned_endpoint->medium;
+                      << "; medium=" << owned_endpoint.medium;
   }
 }
 
 void BasePcpHandler::OnEndpointLost(
     ClientProxy* client, const BasePcpHandler::DiscoveredEndpoint& endpoint) {
-  // Look up the DiscoveredEndpoint we have in our cache.
-  const auto* discovered_endpoint = GetDiscoveredEndpoint(endpoint.endpoint_id);
+  // Look up the DiscoveredEndpoint we have in our cache for this medium.
+  const auto* discovered_endpoint =
+      discovered_endpoints_.Get(endpoint.endpoint_id, endpoint.medium);
   if (discovered_endpoint == nullptr) {
     NEARBY_LOG(INFO, "No previous endpoint (nothing to lose): id=%s",
                endpoint.endpoint_id.c_str());
@@ -766,40 +858,24 @@ void BasePcpHandler::OnEndpointLost(
     return;
   }
 
-  auto item = discovered_endpoints_.extract(endpoint.endpoint_id);
-  if (!discovered_endpoints_.count(endpoint.endpoint_id)) {
-    client->OnEndpointLost(endpoint.service_id, endpoint.endpoint_id);
+  // endpoint may be the cached instance, which Remove() destroys.
+  std::string service_id = endpoint.service_id;
+  std::string endpoint_id = endpoint.endpoint_id;
+  // Only report the endpoint lost once it is gone from all mediums.
+  if (discovered_endpoints_.Remove(endpoint_id, endpoint.medium)) {
+    client->OnEndpointLost(service_id, endpoint_id);
   }
 }
 
-bool BasePcpHandler::IsPreferred(
-    const BasePcpHandler::DiscoveredEndpoint& new_endpoint,
-    const BasePcpHandler::DiscoveredEndpoint& old_endpoint) {
-  std::vector<proto::connections::Medium> mediums =
-      GetConnectionMediumsByPriority();
-  // As we iterate through the list of mediums, we see if we run into the new
-  // endpoint's medium or the old endpoint's medium first.
-  for (const auto& medium : mediums) {
-    if (medium == new_endpoint.medium) {
-      // The new endpoint's medium came first. It's preferred!
-      return true;
-    }
-
-    if (medium == old_endpoint.medium) {
-      // The old endpoint's medium came first. Stick with the old endpoint!
-      return false;
-    }
-  }
-  std::string medium_string;
-  for (const auto& medium : mediums) {
-    absl::StrAppend(&medium_string, medium, "; ");
-  }
-  NEARBY_LOG(FATAL,
-             "Failed to determine preferred medium; bailing out; mediums=%s; "
-             "new=%d; old=%d",
-             medium_string.c_str(), new_endpoint.medium, old_endpoint.medium);
-  return false;
-}
+struct BasePcpHandler::IncomingAdmission {
+  ClientProxy* client;
+  ByteArray remote_endpoint_info;
+  std::unique_ptr<EndpointChannel> channel;
+  absl::Time start_time;
+  // Set once the connection request has been read.
+  absl::Time read_time{absl::InfinitePast()};
+  ExceptionOr<OfflineFrame> frame{Exception::kIo};
+};
 
 Exception BasePcpHandler::OnIncomingConnection(
     ClientProxy* client, const ByteArray& remote_endpoint_info,
@@ -818,50 +894,96 @@ Exception BasePcpHandler::OnIncomingConnection(
     return {Exception::kIo};
   }
 
+  if (admissions_in_progress_ >= kMaxConcurrentAdmissions) {
+    NEARBY_LOG(WARNING,
+               "Shedding incoming connection; client_id=0x%" PRIX64
+               "; device=%s",
+               client->GetClientId(),
+               absl::BytesToHexString(remote_endpoint_info.data()).c_str());
+    client->GetMetrics().incoming_connections_shed.Add();
+    channel->Close();
+    return {Exception::kIo};
+  }
+
   // Endpoints connecting to us will always tell us about themselves first.
-  ExceptionOr<OfflineFrame> wrapped_frame =
-      ReadConnectionRequestFrame(channel.get());
+  // Waiting for that must not hold up the PcpHandler thread.
+  auto admission = std::make_shared<IncomingAdmission>(IncomingAdmission{
+      .client = client,
+      .remote_endpoint_info = remote_endpoint_info,
+      .channel = std::move(channel),
+      .start_time = start_time,
+  });
+  admissions_in_progress_++;
+  client->GetMetrics().incoming_admissions.Add(1);
+  admission_executor_.Execute(
+      [this, admission]() { ReadIncomingConnectionRequest(admission); });
+  return {Exception::kSuccess};
+}
 
-  if (!wrapped_frame.ok()) {
-    if (wrapped_frame.exception()) {
-      NEARBY_LOG(
-          ERROR,
-          "Failed to parse incoming connection request; client_id=0x%" PRIX64
-          "; device=%s",
-          client->GetClientId(),
-          absl::BytesToHexString(remote_endpoint_info.data()).c_str());
-      ProcessPreConnectionInitiationFailure("", channel.get(), {Status::kError},
-                                            nullptr);
-      return {Exception::kSuccess};
-    }
-    return wrapped_frame.GetException();
+void BasePcpHandler::ReadIncomingConnectionRequest(
+    std::shared_ptr<IncomingAdmission> admission) {
+  admission->frame = ReadConnectionRequestFrame(admission->channel.get());
+  admission->read_time = SystemClock::ElapsedRealtime();
+  admission->client->GetMetrics().admission_read_time.Record(
+      admission->read_time - admission->start_time);
+  RunOnPcpHandlerThread(
+      [this, admission]() { OnIncomingConnectionRequest(admission); });
+}
+
+void BasePcpHandler::OnIncomingConnectionRequest(
+    std::shared_ptr<IncomingAdmission> admission) {
+  ClientProxy* client = admission->client;
+  admissions_in_progress_--;
+  client->GetMetrics().incoming_admissions.Add(-1);
+  client->GetMetrics().admission_dispatch_time.Record(
+      SystemClock::ElapsedRealtime() - admission->read_time);
+  std::unique_ptr<EndpointChannel> channel = std::move(admission->channel);
+
+  if (!admission->frame.ok()) {
+    NEARBY_LOG(
+        ERROR,
+        "Failed to parse incoming connection request; client_id=0x%" PRIX64
+        "; device=%s",
+        client->GetClientId(),
+        absl::BytesToHexString(admission->remote_endpoint_info.data())
+            .c_str());
+    ProcessPreConnectionInitiationFailure("", channel.get(), {Status::kError},
+                                          nullptr);
+    return;
   }
 
-  OfflineFrame& frame = wrapped_frame.result();
+  // The client may have stopped advertising while we were waiting.
+  if (!client->IsAdvertising()) {
+    channel->Close();
+    return;
+  }
+
+  OfflineFrame& frame = admission->frame.result();
   const ConnectionRequestFrame& connection_request =
       frame.v1().connection_request();
   NEARBY_LOG(INFO,
              "Incoming connection request; client_id=0x%" PRIX64
              "; device=%s; id=%s",
              client->GetClientId(),
-             absl::BytesToHexString(remote_endpoint_info.data()).c_str(),
+             absl::BytesToHexString(admission->remote_endpoint_info.data())
+                 .c_str(),
              connection_request.endpoint_id().c_str());
   if (client->IsConnectedToEndpoint(connection_request.endpoint_id())) {
-    return {Exception::kIo};
+    return;
   }
 
   // If we've already sent out a connection request to this endpoint, then this
   // is where we need to decide which connection to break.
   if (BreakTie(client, connection_request.endpoint_id(),
                connection_request.nonce(), channel.get())) {
-    return {Exception::kSuccess};
+    return;
   }
 
   // If our child class says we can't accept any more incoming connections,
   // listen to them.
   if (ShouldEnforceTopologyConstraints() &&
       !CanReceiveIncomingConnection(client)) {
-    return {Exception::kIo};
+    return;
   }
 
   // The ConnectionRequest frame has two fields that both contain the
@@ -884,7 +1006,7 @@ Exception BasePcpHandler::OnIncomingConnection(
                        .remote_endpoint_info = endpoint_info,
                        .nonce = connection_request.nonce(),
                        .is_incoming = true,
-                       .start_time = start_time,
+                       .start_time = admission->start_time,
                        .listener = advertising_listener_,
                        .supported_mediums =
                            parser::ConnectionRequestMediumsToMediums(
@@ -896,7 +1018,6 @@ Exception BasePcpHandler::OnIncomingConnection(
   // Next, we'll set up encryption.
   encryption_runner_.StartServer(client, connection_request.endpoint_id(),
                                  owned_channel, GetResultListener());
-  return {Exception::kSuccess};
 }
 
 bool BasePcpHandler::BreakTie(ClientProxy* client,
@@ -1001,19 +1122,17 @@ bool BasePcpHandler::AppendRemoteBluetoothMacAddressEndpoint(
     return false;
   }
 
-  auto it = discovered_endpoints_.equal_range(endpoint_id);
-  if (it.first == it.second) {
+  auto endpoint = discovered_endpoints_.GetBest(endpoint_id);
+  if (endpoint == nullptr) {
     return false;
   }
-  auto endpoint = it.first->second.get();
-  for (auto item = it.first; item != it.second; item++) {
-    if (item->second->medium == proto::connections::Medium::BLUETOOTH) {
-      NEARBY_LOGS(INFO)
-          << "Cannot append remote Bluetooth MAC Address endpoint, because the "
-             "endpoint has already been found over Bluetooth "
-          << "[" << remote_bluetooth_mac_address << "]";
-      return false;
-    }
+  if (discovered_endpoints_.Get(endpoint_id,
+                                proto::connections::Medium::BLUETOOTH)) {
+    NEARBY_LOGS(INFO)
+        << "Cannot append remote Bluetooth MAC Address endpoint, because the "
+           "endpoint has already been found over Bluetooth "
+        << "[" << remote_bluetooth_mac_address << "]";
+    return false;
   }
 
   auto remote_bluetooth_device =
@@ -1039,7 +1158,7 @@ bool BasePcpHandler::AppendRemoteBluetoothMacAddressEndpoint(
           remote_bluetooth_device,
       });
 
-  discovered_endpoints_.emplace(endpoint_id, std::move(bluetooth_endpoint));
+  discovered_endpoints_.Put(std::move(bluetooth_endpoint));
   return true;
 }
 
@@ -1048,12 +1167,19 @@ bool BasePcpHandler::AppendWebRTCEndpoint(const std::string& endpoint_id) {
     return false;
   }
 
+  // Already appended by an earlier connection request; keep that entry, as
+  // callers may still point to it.
+  if (discovered_endpoints_.Get(endpoint_id,
+                                proto::connections::Medium::WEB_RTC)) {
+    return false;
+  }
+
   bool should_connect_web_rtc = false;
-  auto it = discovered_endpoints_.equal_range(endpoint_id);
-  if (it.first == it.second) return false;
-  auto endpoint = it.first->second.get();
-  for (auto item = it.first; item != it.second; item++) {
-    if (item->second->web_rtc_state != WebRtcState::kUnconnectable) {
+  auto endpoints = discovered_endpoints_.GetAll(endpoint_id);
+  if (endpoints.empty()) return false;
+  auto endpoint = endpoints.front();
+  for (const auto* item : endpoints) {
+    if (item->web_rtc_state != WebRtcState::kUnconnectable) {
       should_connect_web_rtc = true;
       break;
     }
@@ -1075,7 +1201,7 @@ bool BasePcpHandler::AppendWebRTCEndpoint(const std::string& endpoint_id) {
               endpoint->endpoint_info),
       });
 
-  discovered_endpoints_.emplace(endpoint_id, std::move(webrtc_endpoint));
+  discovered_endpoints_.Put(std::move(webrtc_endpoint));
   return true;
 }
 
@@ -1188,6 +1314,7 @@ ExceptionOr<OfflineFrame> BasePcpHandler::ReadConnectionRequestFrame(
 
   ByteArray bytes = std::move(wrapped_bytes.result());
   ExceptionOr<OfflineFrame> wrapped_frame = parser::FromBytes(bytes);
+  BufferPool::Default().Release(std::string(std::move(bytes)));
   if (wrapped_frame.GetException().Raised(Exception::kInvalidProtocolBuffer)) {
     return ExceptionOr<OfflineFrame>(Exception::kIo);
   }
@@ -16,15 +16,16 @@
 #define CORE_V2_INTERNAL_BASE_PCP_HANDLER_H_
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
-#include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/time/time.h"
 #include "core_v2/internal/bwu_manager.h"
 #include "core_v2/internal/client_proxy.h"
+#include "core_v2/internal/discovered_endpoint_store.h"
 #include "core_v2/internal/encryption_runner.h"
 #include "core_v2/internal/endpoint_channel_manager.h"
 #include "core_v2/internal/endpoint_manager.h"
@@ -36,12 +37,14 @@
 #include "core_v2/options.h"
 #include "core_v2/status.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/base/prng.h"
 #include "platform_v2/public/atomic_boolean.h"
 #include "platform_v2/public/atomic_reference.h"
 #include "platform_v2/public/cancelable_alarm.h"
 #include "platform_v2/public/count_down_latch.h"
 #include "platform_v2/public/future.h"
+#include "platform_v2/public/multi_thread_executor.h"
 #include "platform_v2/public/scheduled_executor.h"
 #include "platform_v2/public/single_thread_executor.h"
 #include "platform_v2/public/system_clock.h"
@@ -250,6 +253,12 @@ class BasePcpHandler : public PcpHandler,
   // @PcpHandlerThread
   void OnEndpointLost(ClientProxy* client, const DiscoveredEndpoint& endpoint);
 
+  // Admits a channel that a remote endpoint opened to us. Its connection
+  // request is read off the PcpHandlerThread; once it arrives, the connection
+  // goes on as a pending incoming one. Fails if the client is not advertising,
+  // or if kMaxConcurrentAdmissions connections are being admitted already; the
+  // channel is closed then.
+  // @PcpHandlerThread
   Exception OnIncomingConnection(
       ClientProxy* client, const ByteArray& remote_endpoint_info,
       std::unique_ptr<EndpointChannel> endpoint_channel,
@@ -277,22 +286,41 @@ class BasePcpHandler : public PcpHandler,
   // @PcpHandlerThread
   virtual Status StopDiscoveryImpl(ClientProxy* client) = 0;
 
-  // @PcpHandlerThread
-  virtual ConnectImplResult ConnectImpl(ClientProxy* client,
-                                        DiscoveredEndpoint* endpoint) = 0;
+  // Connection attempts over different mediums of an endpoint are raced, so
+  // this may be called concurrently, once per medium, and off the
+  // PcpHandlerThread. It must only use state that is safe to use from any
+  // thread: endpoint, which does not change once discovered and outlives the
+  // call, and whatever guards itself, such as the mediums. Once another
+  // attempt wins, cancellation_flag is set; ConnectImpl() hands it to the
+  // medium, so that an attempt that lost gives up, and frees its thread,
+  // instead of connecting for nothing.
+  // @ConnectExecutorThread
+  virtual ConnectImplResult ConnectImpl(
+      ClientProxy* client, DiscoveredEndpoint* endpoint,
+      CancellationFlag* cancellation_flag) = 0;
 
   virtual std::vector<proto::connections::Medium>
   GetConnectionMediumsByPriority() = 0;
   virtual proto::connections::Medium GetDefaultUpgradeMedium() = 0;
 
-  // Returns the first discovered endpoint for the given endpoint_id.
+  // Returns the discovered endpoint for the given endpoint_id over its most
+  // preferred medium.
   DiscoveredEndpoint* GetDiscoveredEndpoint(const std::string& endpoint_id);
 
+  // Waits for the connection attempts still running, and starts no more.
+  // Subclasses that implement ConnectImpl() call it from their destructor,
+  // before the state ConnectImpl() uses goes away.
+  void StopConnectAttempts();
+
   // Returns a vector of discovered endpoints, sorted in order of decreasing
   // preference.
   std::vector<BasePcpHandler::DiscoveredEndpoint*> GetDiscoveredEndpoints(
       const std::string& endpoint_id);
 
+  // Incoming connections that may wait for their connection request at once.
+  // More are shed, so that slow peers can not hold up the others for long.
+  static constexpr int kMaxConcurrentAdmissions = 8;
+
   mediums::PeerId CreatePeerIdFromAdvertisement(const string& service_id,
                                                 const string& endpoint_id,
                                                 const ByteArray& endpoint_info);
@@ -378,16 +406,19 @@ class BasePcpHandler : public PcpHandler,
 
   static constexpr absl::Duration kConnectionRequestReadTimeout =
       absl::Seconds(2);
+  // How long a connection attempt gets before the next medium is raced
+  // against it.
+  static constexpr absl::Duration kConnectionAttemptStagger =
+      absl::Milliseconds(250);
+  // Attempts that lost are cancelled, but keep a thread until their medium
+  // notices.
+  static constexpr int kMaxConcurrentConnectAttempts = 8;
   static constexpr absl::Duration kRejectedConnectionCloseDelay =
       absl::Seconds(2);
 
   void OnConnectionResponse(ClientProxy* client, const std::string& endpoint_id,
                             const OfflineFrame& frame);
 
-  // Returns true if the new endpoint is preferred over the old endpoint.
-  bool IsPreferred(const BasePcpHandler::DiscoveredEndpoint& new_endpoint,
-                   const BasePcpHandler::DiscoveredEndpoint& old_endpoint);
-
   // Returns true, if connection party should respect the specified topology.
   bool ShouldEnforceTopologyConstraints() const;
 
@@ -433,6 +464,36 @@ class BasePcpHandler : public PcpHandler,
   // discovered_endpoints_ with key endpoint_id.
   bool AppendWebRTCEndpoint(const std::string& endpoint_id);
 
+  struct ConnectRace;
+  struct IncomingAdmission;
+
+  // @AdmissionExecutorThread
+  // Waits for the connection request of an admitted incoming connection.
+  void ReadIncomingConnectionRequest(
+      std::shared_ptr<IncomingAdmission> admission);
+  // @PcpHandlerThread
+  // Goes on with an incoming connection once its request has been read.
+  void OnIncomingConnectionRequest(
+      std::shared_ptr<IncomingAdmission> admission);
+
+  // Calls ConnectImpl() for each of endpoints, most preferred first. Each
+  // attempt starts kConnectionAttemptStagger after the one before it, or as
+  // soon as all attempts before it have failed. Returns the first channel
+  // that handshake() succeeds on; handshake() is never run over two channels
+  // at once, attempts still connecting are then cancelled, and channels that
+  // lose are closed. If all attempts fail, returns the result of the least
+  // preferred one.
+  // @PcpHandlerThread
+  ConnectImplResult RaceConnectImpl(
+      ClientProxy* client,
+      const std::vector<std::shared_ptr<DiscoveredEndpoint>>& endpoints,
+      std::function<Exception(EndpointChannel*)> handshake);
+  // @ConnectExecutorThread
+  void RunConnectAttempt(ClientProxy* client, DiscoveredEndpoint* endpoint,
+                         int index, std::shared_ptr<ConnectRace> race,
+                         const std::function<Exception(EndpointChannel*)>&
+                             handshake);
+
   void ProcessPreConnectionInitiationFailure(const std::string& endpoint_id,
                                              EndpointChannel* channel,
                                              Status status,
@@ -463,6 +524,13 @@ class BasePcpHandler : public PcpHandler,
   AtomicReference<Medium> bwu_medium_{Medium::UNKNOWN_MEDIUM};
   ScheduledExecutor alarm_executor_;
   SingleThreadExecutor serial_executor_;
+  // Runs the connection attempts of RaceConnectImpl().
+  MultiThreadExecutor connect_executor_{kMaxConcurrentConnectAttempts};
+  // Waits for connection requests of incoming connections.
+  MultiThreadExecutor admission_executor_{kMaxConcurrentAdmissions};
+  // Incoming connections handed to admission_executor_ and not done yet.
+  // @PcpHandlerThread
+  int admissions_in_progress_ = 0;
 
   // A map of endpoint id -> PendingConnectionInfo. Entries in this map imply
   // that there is an active connection to the endpoint and we're waiting for
@@ -470,9 +538,12 @@ class BasePcpHandler : public PcpHandler,
   // the connection is decided (either accepted or rejected), it should be
   // removed from this map.
   absl::flat_hash_map<std::string, PendingConnectionInfo> pending_connections_;
-  // A map of endpoint id -> DiscoveredEndpoint.
-  absl::btree_multimap<std::string, std::shared_ptr<DiscoveredEndpoint>>
-      discovered_endpoints_;
+  // Endpoint id -> DiscoveredEndpoint, one per medium the endpoint was
+  // discovered over.
+  DiscoveredEndpointStore<DiscoveredEndpoint> discovered_endpoints_;
+  // Service id of the last discovery started. Like discovery_options_, it
+  // outlives the discovery, as do the endpoints it found.
+  std::string discovery_service_id_;
   // A map of endpoint id -> alarm. These alarms delay closing the
   // EndpointChannel to give the other side enough time to read the rejection
   // message. It's expected that the other side will close the connection
@@ -16,6 +16,7 @@
 
 #include <atomic>
 #include <memory>
+#include <vector>
 
 #include "core_v2/internal/base_endpoint_channel.h"
 #include "core_v2/internal/bwu_manager.h"
@@ -27,6 +28,7 @@
 #include "core_v2/params.h"
 #include "proto/connections/offline_wire_formats.pb.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/public/count_down_latch.h"
 #include "platform_v2/public/pipe.h"
 #include "proto/connections_enums.pb.h"
@@ -94,11 +96,13 @@ class MockPcpHandler : public BasePcpHandler {
   MockPcpHandler(Mediums* m, EndpointManager* em, EndpointChannelManager* ecm,
                  BwuManager* bwu)
       : BasePcpHandler(m, em, ecm, bwu, Pcp::kP2pCluster) {}
+  ~MockPcpHandler() override { StopConnectAttempts(); }
 
   // Expose protected inner types of a base type for mocking.
   using BasePcpHandler::ConnectImplResult;
   using BasePcpHandler::DiscoveredEndpoint;
   using BasePcpHandler::StartOperationResult;
+  using BasePcpHandler::kMaxConcurrentAdmissions;
 
   MOCK_METHOD(Strategy, GetStrategy, (), (const override));
   MOCK_METHOD(Pcp, GetPcp, (), (const override));
@@ -126,7 +130,9 @@ class MockPcpHandler : public BasePcpHandler {
               (override));
   MOCK_METHOD(Status, StopDiscoveryImpl, (ClientProxy * client), (override));
   MOCK_METHOD(ConnectImplResult, ConnectImpl,
-              (ClientProxy * client, DiscoveredEndpoint* endpoint), (override));
+              (ClientProxy * client, DiscoveredEndpoint* endpoint,
+               CancellationFlag* cancellation_flag),
+              (override));
   MOCK_METHOD(proto::connections::Medium, GetDefaultUpgradeMedium, (),
               (override));
 
@@ -143,6 +149,23 @@ class MockPcpHandler : public BasePcpHandler {
   void OnEndpointLost(ClientProxy* client, const DiscoveredEndpoint& endpoint) {
     BasePcpHandler::OnEndpointLost(client, endpoint);
   }
+  Exception OnIncomingConnection(ClientProxy* client,
+                                 const ByteArray& remote_endpoint_info,
+                                 std::unique_ptr<EndpointChannel> channel,
+                                 proto::connections::Medium medium) {
+    Exception result{Exception::kFailed};
+    CountDownLatch latch(1);
+    RunOnPcpHandlerThread([this, client, &remote_endpoint_info,
+                           raw_channel = channel.release(), medium, &result,
+                           &latch]() {
+      result = BasePcpHandler::OnIncomingConnection(
+          client, remote_endpoint_info,
+          std::unique_ptr<EndpointChannel>(raw_channel), medium);
+      latch.CountDown();
+    });
+    latch.Await();
+    return result;
+  }
   std::vector<BasePcpHandler::DiscoveredEndpoint*> GetDiscoveredEndpoints(
       const std::string& endpoint_id) {
     return BasePcpHandler::GetDiscoveredEndpoints(endpoint_id);
@@ -321,7 +344,8 @@ class BasePcpHandlerTest
     EXPECT_CALL(*pcp_handler, ConnectImpl)
         .WillOnce(Invoke([&channel_a, connect_medium](
                              ClientProxy* client,
-                             MockPcpHandler::DiscoveredEndpoint* endpoint) {
+                             MockPcpHandler::DiscoveredEndpoint* endpoint,
+                             CancellationFlag* cancellation_flag) {
           return MockPcpHandler::ConnectImplResult{
               .medium = connect_medium,
               .status = {Status::kSuccess},
@@ -461,6 +485,121 @@ TEST_P(BasePcpHandlerTest, RequestConnectionChangesState) {
   pcp_handler.DisconnectFromEndpointManager();
 }
 
+TEST_P(BasePcpHandlerTest, RequestConnectionDoesNotWaitForSlowMedium) {
+  if (GetParam().Count(true) < 2) {
+    // Ignore single-medium test cases, and implicit "all mediums" case.
+    SUCCEED();
+    return;
+  }
+  constexpr absl::Duration kSlowConnectTimeout = absl::Seconds(5);
+  std::string endpoint_id{"1234"};
+  ClientProxy client;
+  Mediums m;
+  EndpointChannelManager ecm;
+  EndpointManager em(&ecm);
+  BwuManager bwu(m, em, ecm, {}, {});
+  MockPcpHandler pcp_handler(&m, &em, &ecm, &bwu);
+  StartDiscovery(&client, &pcp_handler);
+  auto mediums = pcp_handler.GetDiscoveryMediums();
+  auto slow_medium = mediums[0];
+  auto connect_medium = mediums[1];
+  auto channel_pair = SetupConnection(pipe_a_, pipe_b_, connect_medium);
+  auto& channel_a = channel_pair.first;
+  auto& channel_b = channel_pair.second;
+  EXPECT_CALL(*channel_a, CloseImpl).Times(1);
+  EXPECT_CALL(*channel_b, CloseImpl).Times(1);
+  EXPECT_CALL(mock_connection_listener_.rejected_cb, Call).Times(AtLeast(0));
+  EXPECT_CALL(mock_discovery_listener_.endpoint_found_cb, Call);
+  EXPECT_CALL(pcp_handler, CanSendOutgoingConnection)
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(pcp_handler, GetStrategy)
+      .WillRepeatedly(Return(Strategy::kP2pCluster));
+  EXPECT_CALL(mock_connection_listener_.initiated_cb, Call).Times(1);
+  // The preferred medium takes its time to fail, unless it is cancelled.
+  auto release = std::make_shared<CountDownLatch>(1);
+  EXPECT_CALL(pcp_handler, ConnectImpl)
+      .Times(2)
+      .WillRepeatedly(Invoke(
+          [&channel_a, release, slow_medium, connect_medium](
+              ClientProxy* client, MockPcpHandler::DiscoveredEndpoint* endpoint,
+              CancellationFlag* cancellation_flag) {
+            if (endpoint->medium == slow_medium) {
+              CancellationFlagListener listener(
+                  cancellation_flag, [release]() { release->CountDown(); });
+              release->Await(kSlowConnectTimeout);
+              return MockPcpHandler::ConnectImplResult{
+                  .status = {Status::kError},
+              };
+            }
+            return MockPcpHandler::ConnectImplResult{
+                .medium = connect_medium,
+                .status = {Status::kSuccess},
+                .endpoint_channel = std::move(channel_a),
+            };
+          }));
+  ConnectionRequestInfo info{
+      .endpoint_info = ByteArray{"ABCD"},
+      .listener = connection_listener_,
+  };
+  for (const auto& discovered_medium : mediums) {
+    pcp_handler.OnEndpointFound(
+        &client,
+        std::make_shared<MockDiscoveredEndpoint>(MockDiscoveredEndpoint{
+            {
+                endpoint_id,
+                info.endpoint_info,
+                "service",
+                discovered_medium,
+                WebRtcState::kUndefined,
+            },
+            MockContext{},
+        }));
+  }
+  ClientProxy other_client;
+  EncryptionRunner encryption_runner;
+  encryption_runner.StartServer(&other_client, endpoint_id, channel_b.get(),
+                                {});
+
+  absl::Time start_time = absl::Now();
+  EXPECT_EQ(pcp_handler.RequestConnection(&client, endpoint_id, info, {}),
+            Status{Status::kSuccess});
+  EXPECT_LT(absl::Now() - start_time, kSlowConnectTimeout);
+  // Once the faster medium wins, the slow attempt is cancelled.
+  EXPECT_TRUE(release->Await(kSlowConnectTimeout).result());
+  channel_b->Close();
+  pcp_handler.DisconnectFromEndpointManager();
+}
+
+TEST_P(BasePcpHandlerTest, IncomingConnectionsBeyondLimitAreShed) {
+  constexpr int kAdmissions = MockPcpHandler::kMaxConcurrentAdmissions;
+  // Nothing is ever written to these; every read waits until it times out.
+  std::vector<std::unique_ptr<Pipe>> pipes;
+  ClientProxy client;
+  Mediums m;
+  EndpointChannelManager ecm;
+  EndpointManager em(&ecm);
+  BwuManager bwu(m, em, ecm, {}, {});
+  MockPcpHandler pcp_handler(&m, &em, &ecm, &bwu);
+  StartAdvertising(&client, &pcp_handler);
+  for (int i = 0; i <= kAdmissions; i++) {
+    pipes.push_back(std::make_unique<Pipe>());
+    auto channel = std::make_unique<MockEndpointChannel>(pipes.back().get(),
+                                                         pipes.back().get());
+    EXPECT_CALL(*channel, Read())
+        .WillRepeatedly(Invoke(
+            [channel = channel.get()]() { return channel->DoRead(); }));
+    EXPECT_CALL(*channel, CloseImpl).Times(AtLeast(1));
+    Exception admitted = pcp_handler.OnIncomingConnection(
+        &client, ByteArray{"remote"}, std::move(channel), Medium::BLUETOOTH);
+    EXPECT_EQ(admitted.Ok(), i < kAdmissions);
+  }
+
+  MetricsSnapshot metrics = client.GetMetrics().Snapshot();
+  EXPECT_EQ(metrics.incoming_connections_shed, 1);
+  EXPECT_EQ(metrics.incoming_admissions.current, kAdmissions);
+  pcp_handler.DisconnectFromEndpointManager();
+}
+
 TEST_P(BasePcpHandlerTest, AcceptConnectionChangesState) {
   std::string endpoint_id{"1234"};
   ClientProxy client;
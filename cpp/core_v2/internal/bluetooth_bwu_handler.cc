@@ -0,0 +1,172 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/bluetooth_bwu_handler.h"
+
+#include <string>
+
+#include "core_v2/internal/bluetooth_endpoint_channel.h"
+#include "core_v2/internal/client_proxy.h"
+#include "core_v2/internal/mediums/utils.h"
+#include "core_v2/internal/offline_frames.h"
+#include "platform_v2/public/logging.h"
+#include "absl/functional/bind_front.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+BluetoothBwuHandler::BluetoothBwuHandler(
+    Mediums& mediums, EndpointChannelManager& channel_manager,
+    BwuNotifications notifications)
+    : BaseBwuHandler(channel_manager, std::move(notifications)),
+      mediums_(mediums) {}
+
+void BluetoothBwuHandler::Revert() {
+  for (const std::string& upgrade_service_id : active_service_ids_) {
+    bluetooth_medium_.StopAcceptingConnections(upgrade_service_id);
+  }
+  active_service_ids_.clear();
+
+  NEARBY_LOG(INFO, "BluetoothBwuHandler successfully reverted state.");
+}
+
+// Accept Connection Callback.
+// Notifies that the remote party called BluetoothClassic::Connect()
+// for this socket.
+void BluetoothBwuHandler::OnIncomingBluetoothConnection(
+    ClientProxy* client, const std::string& upgrade_service_id,
+    BluetoothSocket socket) {
+  std::string service_id = Utils::UnwrapUpgradeServiceId(upgrade_service_id);
+  auto channel = std::make_unique<BluetoothEndpointChannel>(service_id, socket);
+  auto bluetooth_socket =
+      std::make_unique<BluetoothIncomingSocket>(service_id, socket);
+  std::unique_ptr<IncomingSocketConnection> connection(
+      new IncomingSocketConnection{std::move(bluetooth_socket),
+                                   std::move(channel)});
+
+  bwu_notifications_.incoming_connection_cb(client, std::move(connection));
+}
+
+// Called by BWU initiator. BT Medium is set up, and BWU request is prepared,
+// with necessary info (service name, MAC address) for remote party to connect.
+ByteArray BluetoothBwuHandler::InitializeUpgradedMediumForEndpoint(
+    ClientProxy* client, const std::string& service_id,
+    const std::string& endpoint_id) {
+  // Use wrapped service ID, so as not to share the server socket of
+  // advertising, which the client may not have stopped yet.
+  std::string upgrade_service_id = Utils::WrapUpgradeServiceId(service_id);
+
+  std::string mac_address = bluetooth_medium_.GetMacAddress();
+  if (mac_address.empty()) {
+    NEARBY_LOG(ERROR,
+               "BluetoothBwuHandler couldn't initiate the BLUETOOTH upgrade "
+               "for endpoint %s because the local MAC address is unknown.",
+               endpoint_id.c_str());
+    return {};
+  }
+
+  if (!bluetooth_medium_.IsAcceptingConnections(upgrade_service_id)) {
+    if (!bluetooth_medium_.StartAcceptingConnections(
+            upgrade_service_id,
+            {
+                .accepted_cb = absl::bind_front(
+                    &BluetoothBwuHandler::OnIncomingBluetoothConnection, this,
+                    client, upgrade_service_id),
+            })) {
+      NEARBY_LOG(ERROR,
+                 "BluetoothBwuHandler couldn't initiate the BLUETOOTH upgrade "
+                 "for endpoint %s because it failed to start listening for "
+                 "incoming Bluetooth connections.",
+                 endpoint_id.c_str());
+      return {};
+    }
+    NEARBY_LOG(INFO,
+               "BluetoothBwuHandler successfully started listening for "
+               "incoming Bluetooth connections while upgrading endpoint %s",
+               endpoint_id.c_str());
+  }
+
+  // cache service ID to revert
+  active_service_ids_.emplace(upgrade_service_id);
+
+  return parser::ForBwuBluetoothPathAvailable(upgrade_service_id, mac_address);
+}
+
+// Called by BWU target. Retrieves a new medium info from incoming message,
+// and establishes connection over Bluetooth using this info.
+std::unique_ptr<EndpointChannel>
+BluetoothBwuHandler::CreateUpgradedEndpointChannel(
+    ClientProxy* client, const std::string& service_id,
+    const std::string& endpoint_id, const UpgradePathInfo& upgrade_path_info) {
+  if (!upgrade_path_info.has_bluetooth_credentials()) {
+    NEARBY_LOG(ERROR,
+               "BluetoothBwuHandler failed to parse UpgradePathInfo on "
+               "endpoint %s, aborting upgrade.",
+               endpoint_id.c_str());
+    return nullptr;
+  }
+  const UpgradePathInfo::BluetoothCredentials& bluetooth_credentials =
+      upgrade_path_info.bluetooth_credentials();
+  const std::string& service_name = bluetooth_credentials.service_name();
+  const std::string& mac_address = bluetooth_credentials.mac_address();
+
+  NEARBY_LOG(INFO,
+             "BluetoothBwuHandler is attempting to connect to service %s on "
+             "remote device %s",
+             service_name.c_str(), mac_address.c_str());
+
+  BluetoothDevice device = bluetooth_medium_.GetRemoteDevice(mac_address);
+  if (!device.IsValid()) {
+    NEARBY_LOG(ERROR,
+               "BluetoothBwuHandler failed to derive a valid Bluetooth device "
+               "from MAC address %s on endpoint %s, aborting upgrade.",
+               mac_address.c_str(), endpoint_id.c_str());
+    return nullptr;
+  }
+
+  BluetoothSocket socket = bluetooth_medium_.Connect(device, service_name);
+  if (!socket.IsValid()) {
+    NEARBY_LOG(ERROR,
+               "BluetoothBwuHandler failed to connect to remote device (%s) "
+               "on endpoint %s, aborting upgrade.",
+               mac_address.c_str(), endpoint_id.c_str());
+    return nullptr;
+  }
+
+  NEARBY_LOG(INFO,
+             "BluetoothBwuHandler successfully connected to remote device "
+             "(%s) while upgrading endpoint %s.",
+             mac_address.c_str(), endpoint_id.c_str());
+
+  return std::make_unique<BluetoothEndpointChannel>(service_id, socket);
+}
+
+void BluetoothBwuHandler::OnEndpointDisconnect(ClientProxy* client,
+                                               const std::string& endpoint_id) {
+}
+
+BluetoothBwuHandler::BluetoothIncomingSocket::BluetoothIncomingSocket(
+    const std::string& name, BluetoothSocket socket)
+    : name_(name), socket_(socket) {}
+
+void BluetoothBwuHandler::BluetoothIncomingSocket::Close() { socket_.Close(); }
+
+std::string BluetoothBwuHandler::BluetoothIncomingSocket::ToString() {
+  return name_;
+}
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,233 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/buffer_pool.h"
+
+#include <utility>
+#include <vector>
+
+#include "platform_v2/public/mutex.h"
+#include "platform_v2/public/mutex_lock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+constexpr std::size_t BufferPool::kMinBufferSize;
+constexpr std::size_t BufferPool::kMaxBufferSize;
+constexpr std::size_t BufferPool::kThreadCacheBytes;
+constexpr std::size_t BufferPool::kMaxSharedBytes;
+
+namespace {
+
+// 4KB, 8KB, ..., 1MB.
+constexpr int kSizeClasses = 9;
+static_assert(BufferPool::kMinBufferSize << (kSizeClasses - 1) ==
+                  BufferPool::kMaxBufferSize,
+              "Size classes must span kMinBufferSize to kMaxBufferSize");
+
+constexpr int kRegistryShards = 8;
+
+std::size_t ClassSize(int size_class) {
+  return BufferPool::kMinBufferSize << size_class;
+}
+
+// Returns the smallest size class that holds size bytes, or -1 if buffers of
+// that size are not pooled.
+int SizeClassOf(std::size_t size) {
+  if (size < BufferPool::kMinBufferSize || size > BufferPool::kMaxBufferSize) {
+    return -1;
+  }
+  int size_class = 0;
+  while (ClassSize(size_class) < size) size_class++;
+  return size_class;
+}
+
+// Free buffers of size_class a thread keeps to itself.
+std::size_t ThreadFreeListCapacity(int size_class) {
+  return BufferPool::kThreadCacheBytes / ClassSize(size_class);
+}
+
+}  // namespace
+
+struct BufferPool::State {
+  // Returns false if the shared free lists are full.
+  bool PutShared(int size_class, std::string& buffer)
+      ABSL_LOCKS_EXCLUDED(mutex);
+  // Returns false if there is no free buffer of size_class.
+  bool TakeShared(int size_class, std::string& buffer)
+      ABSL_LOCKS_EXCLUDED(mutex);
+
+  Mutex mutex;
+  std::vector<std::string> free_lists[kSizeClasses] ABSL_GUARDED_BY(mutex);
+  std::size_t free_bytes ABSL_GUARDED_BY(mutex) = 0;
+
+  // Buffers handed out, by the address of their data, with their size class;
+  // that is how buffers from elsewhere are told apart on Release(). Sharded,
+  // so that threads releasing different buffers rarely wait for each other.
+  struct alignas(64) RegistryShard {
+    Mutex mutex;
+    absl::flat_hash_map<const char*, int> size_classes ABSL_GUARDED_BY(mutex);
+  };
+  RegistryShard registry[kRegistryShards];
+
+  RegistryShard& GetRegistryShard(const char* data) {
+    return registry[absl::Hash<const char*>{}(data) % kRegistryShards];
+  }
+
+  Counter hits;
+  Counter misses;
+  Gauge outstanding_bytes;
+  Gauge cached_bytes;
+};
+
+bool BufferPool::State::PutShared(int size_class, std::string& buffer) {
+  MutexLock lock(&mutex);
+  if (free_bytes + ClassSize(size_class) > kMaxSharedBytes) return false;
+  free_bytes += ClassSize(size_class);
+  free_lists[size_class].push_back(std::move(buffer));
+  cached_bytes.Add(ClassSize(size_class));
+  return true;
+}
+
+bool BufferPool::State::TakeShared(int size_class, std::string& buffer) {
+  MutexLock lock(&mutex);
+  std::vector<std::string>& free_list = free_lists[size_class];
+  if (free_list.empty()) return false;
+  buffer = std::move(free_list.back());
+  free_list.pop_back();
+  free_bytes -= ClassSize(size_class);
+  cached_bytes.Add(-static_cast<std::int64_t>(ClassSize(size_class)));
+  return true;
+}
+
+// Free buffers of one thread, for every pool it used. Given back to the
+// shared free lists of their pool when the thread exits.
+class BufferPool::ThreadCaches {
+ public:
+  ~ThreadCaches() {
+    for (Entry& entry : entries_) {
+      for (int size_class = 0; size_class < kSizeClasses; size_class++) {
+        for (std::string& buffer : entry.free_lists[size_class]) {
+          entry.state->cached_bytes.Add(
+              -static_cast<std::int64_t>(ClassSize(size_class)));
+          entry.state->PutShared(size_class, buffer);
+        }
+      }
+    }
+  }
+
+  std::vector<std::string>* GetFreeList(const std::shared_ptr<State>& state,
+                                        int size_class) {
+    for (Entry& entry : entries_) {
+      if (entry.state == state) return &entry.free_lists[size_class];
+    }
+    entries_.emplace_back();
+    entries_.back().state = state;
+    return &entries_.back().free_lists[size_class];
+  }
+
+ private:
+  struct Entry {
+    std::shared_ptr<State> state;
+    std::vector<std::string> free_lists[kSizeClasses];
+  };
+  std::vector<Entry> entries_;
+};
+
+BufferPool::BufferPool() : state_(std::make_shared<State>()) {}
+
+BufferPool& BufferPool::Default() {
+  static BufferPool* pool = new BufferPool();
+  return *pool;
+}
+
+std::vector<std::string>* BufferPool::GetThreadFreeList(int size_class) {
+  if (ThreadFreeListCapacity(size_class) == 0) return nullptr;
+  thread_local ThreadCaches thread_caches;
+  return thread_caches.GetFreeList(state_, size_class);
+}
+
+std::string BufferPool::Acquire(std::size_t size) {
+  std::string buffer;
+  int size_class = SizeClassOf(size);
+  if (size_class < 0) {
+    buffer.reserve(size);
+    return buffer;
+  }
+
+  std::vector<std::string>* free_list = GetThreadFreeList(size_class);
+  if (free_list != nullptr && !free_list->empty()) {
+    buffer = std::move(free_list->back());
+    free_list->pop_back();
+    state_->cached_bytes.Add(-static_cast<std::int64_t>(ClassSize(size_class)));
+    state_->hits.Add();
+  } else if (state_->TakeShared(size_class, buffer)) {
+    state_->hits.Add();
+  } else {
+    buffer.reserve(ClassSize(size_class));
+    state_->misses.Add();
+  }
+  buffer.clear();
+
+  State::RegistryShard& shard = state_->GetRegistryShard(buffer.data());
+  {
+    MutexLock lock(&shard.mutex);
+    shard.size_classes[buffer.data()] = size_class;
+  }
+  state_->outstanding_bytes.Add(ClassSize(size_class));
+  return buffer;
+}
+
+void BufferPool::Release(std::string buffer) {
+  if (buffer.capacity() < kMinBufferSize) return;
+
+  int size_class;
+  State::RegistryShard& shard = state_->GetRegistryShard(buffer.data());
+  {
+    MutexLock lock(&shard.mutex);
+    auto item = shard.size_classes.find(buffer.data());
+    if (item == shard.size_classes.end()) return;
+    size_class = item->second;
+    shard.size_classes.erase(item);
+  }
+  state_->outstanding_bytes.Add(
+      -static_cast<std::int64_t>(ClassSize(size_class)));
+
+  std::vector<std::string>* free_list = GetThreadFreeList(size_class);
+  if (free_list != nullptr &&
+      free_list->size() < ThreadFreeListCapacity(size_class)) {
+    free_list->push_back(std::move(buffer));
+    state_->cached_bytes.Add(ClassSize(size_class));
+    return;
+  }
+  state_->PutShared(size_class, buffer);
+}
+
+BufferPoolSnapshot BufferPool::Snapshot() const {
+  BufferPoolSnapshot snapshot;
+  snapshot.hits = state_->hits.Value();
+  snapshot.misses = state_->misses.Value();
+  snapshot.outstanding_bytes = state_->outstanding_bytes.Value();
+  snapshot.max_outstanding_bytes = state_->outstanding_bytes.Max();
+  snapshot.cached_bytes = state_->cached_bytes.Value();
+  return snapshot;
+}
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,85 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_V2_INTERNAL_BUFFER_POOL_H_
+#define CORE_V2_INTERNAL_BUFFER_POOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core_v2/internal/metrics.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+// Reuses the large buffers that frames are encoded, encrypted and read into,
+// instead of allocating a new one for every chunk of every payload.
+//
+// Buffers come in power-of-two size classes, from kMinBufferSize to
+// kMaxBufferSize. Every thread keeps a few free buffers of each class to
+// itself, and only goes to the free lists shared by all threads, under a lock,
+// once its own are empty or full.
+//
+// Thread-safe.
+class BufferPool {
+ public:
+  // Smaller and larger buffers are allocated as usual, and not kept.
+  static constexpr std::size_t kMinBufferSize = 4 * 1024;
+  static constexpr std::size_t kMaxBufferSize = 1024 * 1024;
+  // Free buffers of one size class a thread keeps to itself, in bytes;
+  // buffers of larger classes go straight to the shared free lists.
+  static constexpr std::size_t kThreadCacheBytes = 256 * 1024;
+  // Free buffers kept in the shared free lists, in bytes, at most; beyond
+  // that, released buffers are freed.
+  static constexpr std::size_t kMaxSharedBytes = 16 * 1024 * 1024;
+
+  BufferPool();
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  // The pool that the send and receive paths share.
+  static BufferPool& Default();
+
+  // Returns an empty buffer that holds at least size bytes without
+  // allocating.
+  std::string Acquire(std::size_t size);
+
+  // Takes back a buffer from Acquire(), to hand out again. It must not have
+  // grown past its capacity since. Buffers from elsewhere are freed as usual,
+  // so any buffer may be released, whatever its origin.
+  void Release(std::string buffer);
+
+  BufferPoolSnapshot Snapshot() const;
+
+ private:
+  struct State;
+  class ThreadCaches;
+
+  // Free list of size_class of the calling thread, or null if buffers of
+  // size_class are not kept by threads.
+  std::vector<std::string>* GetThreadFreeList(int size_class);
+
+  // Shared with the ThreadCaches of the threads that used this pool, which
+  // give their buffers back as they exit.
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+#endif  // CORE_V2_INTERNAL_BUFFER_POOL_H_
@@ -0,0 +1,153 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/buffer_pool.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "platform_v2/base/byte_array.h"
+#include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/single_thread_executor.h"
+#include "gtest/gtest.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+constexpr std::size_t kChunkSize = 64 * 1024;
+
+TEST(BufferPoolTest, AcquiredBufferIsEmptyAndHoldsSize) {
+  BufferPool pool;
+  std::string buffer = pool.Acquire(kChunkSize + 1);
+
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_GE(buffer.capacity(), 2 * kChunkSize);
+}
+
+TEST(BufferPoolTest, ReleasedBufferIsReused) {
+  BufferPool pool;
+  std::string buffer = pool.Acquire(kChunkSize);
+  buffer.assign(kChunkSize, 'a');
+  const char* data = buffer.data();
+  pool.Release(std::move(buffer));
+
+  std::string reused = pool.Acquire(kChunkSize);
+
+  EXPECT_EQ(reused.data(), data);
+  EXPECT_TRUE(reused.empty());
+  BufferPoolSnapshot snapshot = pool.Snapshot();
+  EXPECT_EQ(snapshot.hits, 1);
+  EXPECT_EQ(snapshot.misses, 1);
+  EXPECT_DOUBLE_EQ(snapshot.HitRate(), 0.5);
+}
+
+TEST(BufferPoolTest, BufferIsReusedAfterGoingThroughByteArray) {
+  BufferPool pool;
+  std::string buffer = pool.Acquire(kChunkSize);
+  buffer.assign(kChunkSize, 'a');
+  const char* data = buffer.data();
+  ByteArray bytes(std::move(buffer));
+  pool.Release(std::string(std::move(bytes)));
+
+  EXPECT_EQ(pool.Acquire(kChunkSize).data(), data);
+}
+
+TEST(BufferPoolTest, TracksOutstandingAndCachedBytes) {
+  BufferPool pool;
+  std::string first = pool.Acquire(kChunkSize);
+  std::string second = pool.Acquire(kChunkSize);
+  pool.Release(std::move(first));
+
+  BufferPoolSnapshot snapshot = pool.Snapshot();
+  EXPECT_EQ(snapshot.outstanding_bytes, kChunkSize);
+  EXPECT_EQ(snapshot.max_outstanding_bytes, 2 * kChunkSize);
+  EXPECT_EQ(snapshot.cached_bytes, kChunkSize);
+}
+
+TEST(BufferPoolTest, BuffersFromElsewhereAreNotKept) {
+  BufferPool pool;
+  pool.Release(std::string(kChunkSize, 'a'));
+
+  BufferPoolSnapshot snapshot = pool.Snapshot();
+  EXPECT_EQ(snapshot.outstanding_bytes, 0);
+  EXPECT_EQ(snapshot.cached_bytes, 0);
+}
+
+TEST(BufferPoolTest, SmallAndLargeBuffersAreNotPooled) {
+  BufferPool pool;
+  std::string small = pool.Acquire(BufferPool::kMinBufferSize - 1);
+  std::string large = pool.Acquire(BufferPool::kMaxBufferSize + 1);
+  EXPECT_GE(large.capacity(), BufferPool::kMaxBufferSize + 1);
+  pool.Release(std::move(small));
+  pool.Release(std::move(large));
+
+  BufferPoolSnapshot snapshot = pool.Snapshot();
+  EXPECT_EQ(snapshot.hits + snapshot.misses, 0);
+  EXPECT_EQ(snapshot.cached_bytes, 0);
+}
+
+TEST(BufferPoolTest, SharedFreeListsAreBounded) {
+  BufferPool pool;
+  std::vector<std::string> buffers;
+  for (std::size_t i = 0;
+       i <= BufferPool::kMaxSharedBytes / BufferPool::kMaxBufferSize; i++) {
+    buffers.push_back(pool.Acquire(BufferPool::kMaxBufferSize));
+  }
+  for (std::string& buffer : buffers) {
+    pool.Release(std::move(buffer));
+  }
+
+  BufferPoolSnapshot snapshot = pool.Snapshot();
+  EXPECT_EQ(snapshot.outstanding_bytes, 0);
+  EXPECT_EQ(snapshot.cached_bytes, BufferPool::kMaxSharedBytes);
+}
+
+TEST(BufferPoolTest, LargeBuffersAreSharedBetweenThreads) {
+  BufferPool pool;
+  std::string buffer = pool.Acquire(BufferPool::kMaxBufferSize);
+  const char* data = buffer.data();
+  CountDownLatch latch(1);
+  SingleThreadExecutor executor;
+  executor.Execute([&pool, &buffer, &latch]() {
+    pool.Release(std::move(buffer));
+    latch.CountDown();
+  });
+  latch.Await();
+
+  EXPECT_EQ(pool.Acquire(BufferPool::kMaxBufferSize).data(), data);
+}
+
+TEST(BufferPoolTest, ThreadGivesBuffersBackOnExit) {
+  BufferPool pool;
+  const char* data = nullptr;
+  {
+    SingleThreadExecutor executor;
+    executor.Execute([&pool, &data]() {
+      std::string buffer = pool.Acquire(kChunkSize);
+      data = buffer.data();
+      pool.Release(std::move(buffer));
+    });
+  }
+
+  EXPECT_EQ(pool.Snapshot().cached_bytes, kChunkSize);
+  EXPECT_EQ(pool.Acquire(kChunkSize).data(), data);
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
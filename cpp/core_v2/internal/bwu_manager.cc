@@ -16,12 +16,18 @@
 
 #include <algorithm>
 #include <memory>
+#include <string>
 
+#include "core_v2/internal/bluetooth_bwu_handler.h"
+#include "core_v2/internal/buffer_pool.h"
 #include "core_v2/internal/bwu_handler.h"
+#include "core_v2/internal/link_monitor.h"
+#include "core_v2/internal/metrics.h"
 #include "core_v2/internal/offline_frames.h"
 #include "core_v2/internal/webrtc_bwu_handler.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/system_clock.h"
 #include "proto/connections_enums.pb.h"
 #include "absl/functional/bind_front.h"
 #include "absl/time/time.h"
@@ -48,6 +54,12 @@ BwuManager::BwuManager(
   if (config_.bandwidth_upgrade_retry_max_delay == absl::ZeroDuration()) {
     config_.bandwidth_upgrade_retry_max_delay = absl::Seconds(10);
   }
+  if (config_.medium_migration_check_interval == absl::ZeroDuration()) {
+    config_.medium_migration_check_interval = absl::Seconds(1);
+  }
+  if (config_.min_time_between_medium_changes == absl::ZeroDuration()) {
+    config_.min_time_between_medium_changes = absl::Seconds(30);
+  }
   if (config_.allow_upgrade_to.All(false)) {
     config_.allow_upgrade_to.web_rtc = true;
   }
@@ -73,6 +85,11 @@ void BwuManager::InitBwuHandlers() {
                       std::make_unique<WebrtcBwuHandler>(
                           *mediums_, *channel_manager_, notifications));
   }
+  if (config_.allow_upgrade_to.bluetooth) {
+    handlers_.emplace(Medium::BLUETOOTH,
+                      std::make_unique<BluetoothBwuHandler>(
+                          *mediums_, *channel_manager_, notifications));
+  }
 }
 
 void BwuManager::Shutdown() {
@@ -91,6 +108,10 @@ void BwuManager::Shutdown() {
     }
 
     CancelAllRetryUpgradeAlarms();
+    for (auto& item : health_check_alarms_) {
+      item.second.Cancel();
+    }
+    health_check_alarms_.clear();
     medium_ = Medium::UNKNOWN_MEDIUM;
     for (auto& item : handlers_) {
       BwuHandler& handler = *item.second;
@@ -198,6 +219,10 @@ void BwuManager::OnEndpointDisconnect(ClientProxy* client,
                                       const std::string& endpoint_id,
                                       CountDownLatch* barrier) {
   RunOnBwuManagerThread([this, client, endpoint_id, barrier]() {
+    CancelChannelHealthCheck(endpoint_id);
+    initiated_upgrades_.erase(endpoint_id);
+    medium_change_timestamps_.erase(endpoint_id);
+
     if (medium_ == Medium::UNKNOWN_MEDIUM) {
       barrier->CountDown();
       return;
@@ -216,6 +241,7 @@ void BwuManager::OnEndpointDisconnect(ClientProxy* client,
       }
     }
     in_progress_upgrades_.erase(endpoint_id);
+    pause_timestamps_.erase(endpoint_id);
     CancelRetryUpgradeAlarm(endpoint_id);
 
     successfully_upgraded_endpoints_.erase(endpoint_id);
@@ -224,8 +250,12 @@ void BwuManager::OnEndpointDisconnect(ClientProxy* client,
     //
     // a) revert all the changes for currentBwuMedium.
     // b) reset currentBwuMedium.
+    // c) revert the mediums endpoints migrated away from.
     if (channel_manager_->GetConnectedEndpointsCount() <= 1) {
       Revert();
+      for (auto& item : handlers_) {
+        item.second->Revert();
+      }
     }
     barrier->CountDown();
   });
@@ -307,6 +337,7 @@ void BwuManager::OnIncomingConnection(
     }
 
     CHECK(client == mapped_client);
+    initiated_upgrades_.insert(endpoint_id);
 
     // Use the introductory client information sent over to run the upgrade
     // protocol.
@@ -333,6 +364,7 @@ void BwuManager::RunUpgradeProtocol(
   new_channel->Pause();
   auto old_channel = channel_manager_->GetChannelForEndpoint(endpoint_id);
   if (!old_channel) return;
+  pause_timestamps_[endpoint_id] = SystemClock::ElapsedRealtime();
   channel_manager_->ReplaceChannelForEndpoint(client, endpoint_id,
                                               std::move(new_channel));
 
@@ -365,9 +397,13 @@ void BwuManager::ProcessBwuPathAvailableEvent(
       parser::UpgradePathInfoMediumToMedium(upgrade_path_info.medium());
   if (medium_ == Medium::UNKNOWN_MEDIUM) {
     SetCurrentBwuHandler(medium);
+  } else if (medium != medium_ &&
+             channel_manager_->GetConnectedEndpointsCount() <= 1) {
+    // The initiator is migrating our only endpoint to another medium.
+    SetCurrentBwuHandler(medium);
   }
   // Check for the correct medium so we don't process an incorrect OfflineFrame.
-  if (medium != medium_) {
+  if (medium != medium_ || handler_ == nullptr) {
     RunUpgradeFailedProtocol(client, endpoint_id, upgrade_path_info);
     return;
   }
@@ -469,6 +505,7 @@ bool BwuManager::ReadClientIntroductionFrame(EndpointChannel* channel,
   auto data = channel->Read();
   if (!data.ok()) return false;
   auto transfer(parser::FromBytes(data.result()));
+  BufferPool::Default().Release(std::string(std::move(data).result()));
   if (!transfer.ok()) return false;
   OfflineFrame frame = transfer.result();
   if (!frame.has_v1() || !frame.v1().has_bandwidth_upgrade_negotiation())
@@ -573,6 +610,22 @@ void BwuManager::ProcessSafeToClosePriorChannelEvent(
 
   channel->Resume();
 
+  std::shared_ptr<EndpointMetrics> metrics =
+      client->GetMetrics().ForEndpoint(endpoint_id);
+  auto pause = pause_timestamps_.extract(endpoint_id);
+  if (metrics != nullptr) {
+    if (!pause.empty()) {
+      metrics->bwu_pause_time.Record(SystemClock::ElapsedRealtime() -
+                                     pause.mapped());
+    }
+    metrics->bandwidth_upgrades.Add();
+  }
+
+  medium_change_timestamps_[endpoint_id] = SystemClock::ElapsedRealtime();
+  if (initiated_upgrades_.contains(endpoint_id)) {
+    ScheduleChannelHealthCheck(client, endpoint_id);
+  }
+
   // Report the success to the client
   client->OnBandwidthChanged(endpoint_id, channel->GetMedium());
 }
@@ -775,6 +828,114 @@ void BwuManager::CancelAllRetryUpgradeAlarms() {
   }
 }
 
+void BwuManager::ScheduleChannelHealthCheck(ClientProxy* client,
+                                            const std::string& endpoint_id) {
+  CancelChannelHealthCheck(endpoint_id);
+  // A link that stops delivering is degraded half way to being stalled, and
+  // then closed by EndpointManager once it is; check often enough to migrate
+  // the endpoint in between, while the link may still carry the negotiation.
+  absl::Duration delay = config_.medium_migration_check_interval;
+  auto channel = channel_manager_->GetChannelForEndpoint(endpoint_id);
+  LinkMonitor* link_monitor =
+      channel == nullptr ? nullptr : channel->GetLinkMonitor();
+  if (link_monitor != nullptr) {
+    delay = std::min(delay, link_monitor->GetStallTimeout() /
+                                LinkMonitor::kStallRoundTrips);
+  }
+  CancelableAlarm alarm(
+      "BWU health check alarm",
+      [this, client, endpoint_id]() {
+        RunOnBwuManagerThread([this, client, endpoint_id]() {
+          CheckChannelHealth(client, endpoint_id);
+        });
+      },
+      delay, &alarm_executor_);
+  health_check_alarms_.emplace(endpoint_id, std::move(alarm));
+}
+
+void BwuManager::CancelChannelHealthCheck(const std::string& endpoint_id) {
+  auto item = health_check_alarms_.extract(endpoint_id);
+  if (item.empty()) return;
+  item.mapped().Cancel();
+}
+
+void BwuManager::CheckChannelHealth(ClientProxy* client,
+                                    const std::string& endpoint_id) {
+  if (!client->IsConnectedToEndpoint(endpoint_id)) {
+    health_check_alarms_.erase(endpoint_id);
+    return;
+  }
+  ScheduleChannelHealthCheck(client, endpoint_id);
+
+  // Leave the endpoint alone while it changes medium, and for a while after.
+  if (in_progress_upgrades_.contains(endpoint_id) ||
+      previous_endpoint_channels_.contains(endpoint_id)) {
+    return;
+  }
+  absl::Time now = SystemClock::ElapsedRealtime();
+  auto changed = medium_change_timestamps_.find(endpoint_id);
+  if (changed != medium_change_timestamps_.end() &&
+      now - changed->second < config_.min_time_between_medium_changes) {
+    return;
+  }
+
+  auto channel = channel_manager_->GetChannelForEndpoint(endpoint_id);
+  if (channel == nullptr) return;
+  LinkMonitor* link_monitor = channel->GetLinkMonitor();
+  if (link_monitor == nullptr ||
+      !link_monitor->IsDegraded(now, channel->GetLastReadTimestamp())) {
+    return;
+  }
+
+  // As in ProcessUpgradeFailureEvent(), the upgrade medium can only change
+  // without disrupting our other connected peers if there are none.
+  if (channel_manager_->GetConnectedEndpointsCount() > 1) {
+    NEARBY_LOG_EVERY_N_SEC(
+        INFO, 10,
+        "EndpointChannel of endpoint %s degraded, but we have other connected "
+        "endpoints and can't migrate it to a new medium.",
+        endpoint_id.c_str());
+    return;
+  }
+
+  Medium current_medium = channel->GetMedium();
+  Medium medium = ChooseMigrationMedium(client, endpoint_id, current_medium);
+  if (medium == Medium::UNKNOWN_MEDIUM) {
+    NEARBY_LOG_EVERY_N_SEC(
+        INFO, 10,
+        "EndpointChannel of endpoint %s degraded, but there is no other "
+        "medium to migrate it to.",
+        endpoint_id.c_str());
+    return;
+  }
+
+  NEARBY_LOG(INFO,
+             "EndpointChannel of endpoint %s degraded; rtt=%s; "
+             "throughput=%.0f (peak %.0f); migrating it from %d to %d.",
+             endpoint_id.c_str(),
+             absl::FormatDuration(link_monitor->GetRtt()).c_str(),
+             link_monitor->GetThroughput(),
+             link_monitor->GetPeakThroughput(now), current_medium, medium);
+  medium_change_timestamps_[endpoint_id] = now;
+  InitiateBwuForEndpoint(client, endpoint_id, medium);
+}
+
+// Returns the most preferred medium, other than the current one, that we can
+// set up a new EndpointChannel over, whether it is better or worse. Payloads
+// in flight carry on over the new EndpointChannel from where they were, since
+// every chunk is written to whatever EndpointChannel the endpoint has then.
+Medium BwuManager::ChooseMigrationMedium(ClientProxy* client,
+                                         const std::string& endpoint_id,
+                                         Medium current_medium) {
+  for (Medium medium : StripOutUnavailableMediums(
+           client->GetUpgradeMediums(endpoint_id).GetMediums(true))) {
+    if (medium != current_medium && handlers_.contains(medium)) {
+      return medium;
+    }
+  }
+  return Medium::UNKNOWN_MEDIUM;
+}
+
 Medium BwuManager::GetEndpointMedium(const std::string& endpoint_id) {
   auto channel = channel_manager_->GetChannelForEndpoint(endpoint_id);
   return channel == nullptr ? Medium::UNKNOWN_MEDIUM : channel->GetMedium();
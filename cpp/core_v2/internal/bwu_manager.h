@@ -59,14 +59,29 @@ namespace connections {
 //   - Both then wait to receive
 //     BANDWIDTH_UPGRADE_NEGOTIATION.SAFE_TO_CLOSE_PRIOR_CHANNEL from the
 //     other, and upon doing so, close the prior EndpointChannel.
+//
+// The same protocol migrates an endpoint off an upgraded EndpointChannel that
+// has degraded, to any other medium the endpoint supports and we may upgrade
+// to (including the one it came from). The initiator of the upgrade checks on
+// the EndpointChannel, and initiates the migration. A link that stops
+// delivering degrades before it is given up on, and is migrated off while it
+// may still carry the negotiation; one that fails outright cannot, and its
+// endpoint disconnects.
 class BwuManager : public EndpointManager::FrameProcessor {
  public:
   using UpgradePathInfo = BwuHandler::UpgradePathInfo;
 
   struct Config {
+    // Mediums endpoints are upgraded and migrated to; only WebRTC if none.
+    // Bluetooth has to be asked for.
     BooleanMediumSelector allow_upgrade_to;
     absl::Duration bandwidth_upgrade_retry_delay;
     absl::Duration bandwidth_upgrade_retry_max_delay;
+    // How often an upgraded EndpointChannel is checked for degradation.
+    absl::Duration medium_migration_check_interval;
+    // An endpoint is not migrated again within this time of changing medium,
+    // so that it does not flap between mediums.
+    absl::Duration min_time_between_medium_changes;
   };
 
   BwuManager(Mediums& mediums, EndpointManager& endpoint_manager,
@@ -99,6 +114,7 @@ class BwuManager : public EndpointManager::FrameProcessor {
   void Shutdown();
 
  private:
+  friend class BwuManagerWithHandlersTest;
   BwuHandler* SetCurrentBwuHandler(Medium medium);
   void InitBwuHandlers();
   void RunOnBwuManagerThread(std::function<void()> runnable);
@@ -157,6 +173,13 @@ class BwuManager : public EndpointManager::FrameProcessor {
   absl::Duration CalculateNextRetryDelay(const std::string& endpoint_id);
   void RetryUpgradesAfterDelay(ClientProxy* client,
                                const std::string& endpoint_id);
+  void ScheduleChannelHealthCheck(ClientProxy* client,
+                                  const std::string& endpoint_id);
+  void CancelChannelHealthCheck(const std::string& endpoint_id);
+  void CheckChannelHealth(ClientProxy* client, const std::string& endpoint_id);
+  Medium ChooseMigrationMedium(ClientProxy* client,
+                               const std::string& endpoint_id,
+                               Medium current_medium);
 
   Config config_;
 
@@ -181,8 +204,16 @@ class BwuManager : public EndpointManager::FrameProcessor {
   absl::flat_hash_map<std::string, ClientProxy*> in_progress_upgrades_;
   // Maps endpointId -> timestamp of when the SAFE_TO_CLOSE message was written.
   absl::flat_hash_map<std::string, absl::Time> safe_to_close_write_timestamps_;
+  // Maps endpointId -> timestamp of when writes to its new EndpointChannel
+  // were paused, until they resume.
+  absl::flat_hash_map<std::string, absl::Time> pause_timestamps_;
   absl::flat_hash_map<std::string, std::pair<CancelableAlarm, absl::Duration>>
       retry_upgrade_alarms_;
+  // Endpoints whose upgrade we initiated; we initiate their migrations too.
+  absl::flat_hash_set<std::string> initiated_upgrades_;
+  // Maps endpointId -> timestamp of when it last changed medium.
+  absl::flat_hash_map<std::string, absl::Time> medium_change_timestamps_;
+  absl::flat_hash_map<std::string, CancelableAlarm> health_check_alarms_;
 };
 
 }  // namespace connections
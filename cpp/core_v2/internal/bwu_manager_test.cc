@@ -14,20 +14,252 @@
 
 #include "core_v2/internal/bwu_manager.h"
 
+#include <memory>
 #include <string>
 
+#include "core_v2/internal/bwu_handler.h"
 #include "core_v2/internal/client_proxy.h"
+#include "core_v2/internal/endpoint_channel.h"
 #include "core_v2/internal/endpoint_channel_manager.h"
 #include "core_v2/internal/endpoint_manager.h"
+#include "core_v2/internal/link_monitor.h"
 #include "core_v2/internal/mediums/mediums.h"
+#include "core_v2/internal/offline_frames.h"
+#include "core_v2/listeners.h"
+#include "core_v2/options.h"
+#include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/exception.h"
+#include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/system_clock.h"
+#include "proto/connections_enums.pb.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/time/time.h"
 
 namespace location {
 namespace nearby {
 namespace connections {
 namespace {
 
+using ::location::nearby::proto::connections::DisconnectionReason;
+using ::location::nearby::proto::connections::Medium;
+using ::testing::_;
+using ::testing::AtLeast;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+class MockEndpointChannel : public EndpointChannel {
+ public:
+  MOCK_METHOD(ExceptionOr<ByteArray>, Read, (), (override));
+  MOCK_METHOD(Exception, Write, (const ByteArray& data), (override));
+  MOCK_METHOD(void, Close, (), (override));
+  MOCK_METHOD(void, Close, (DisconnectionReason reason), (override));
+  MOCK_METHOD(std::string, GetType, (), (const override));
+  MOCK_METHOD(std::string, GetName, (), (const override));
+  MOCK_METHOD(Medium, GetMedium, (), (const override));
+  MOCK_METHOD(void, EnableEncryption,
+              (std::shared_ptr<EncryptionContext> context), (override));
+  MOCK_METHOD(bool, IsPaused, (), (const override));
+  MOCK_METHOD(void, Pause, (), (override));
+  MOCK_METHOD(void, Resume, (), (override));
+  MOCK_METHOD(absl::Time, GetLastReadTimestamp, (), (const override));
+  MOCK_METHOD(absl::Time, GetLastWriteTimestamp, (), (const override));
+  MOCK_METHOD(void, SetMetrics, (std::shared_ptr<EndpointMetrics> metrics),
+              (override));
+  MOCK_METHOD(LinkMonitor*, GetLinkMonitor, (), (override));
+};
+
+class MockBwuHandler : public BwuHandler {
+ public:
+  explicit MockBwuHandler(Medium medium) {
+    ON_CALL(*this, GetUpgradeMedium()).WillByDefault(Return(medium));
+  }
+
+  MOCK_METHOD(ByteArray, InitializeUpgradedMediumForEndpoint,
+              (ClientProxy * client, const std::string& service_id,
+               const std::string& endpoint_id),
+              (override));
+  MOCK_METHOD(void, Revert, (), (override));
+  MOCK_METHOD(std::unique_ptr<EndpointChannel>, CreateUpgradedEndpointChannel,
+              (ClientProxy * client, const std::string& service_id,
+               const std::string& endpoint_id,
+               const UpgradePathInfo& upgrade_path_info),
+              (override));
+  MOCK_METHOD(Medium, GetUpgradeMedium, (), (const override));
+  MOCK_METHOD(void, OnEndpointDisconnect,
+              (ClientProxy * client, const std::string& endpoint_id),
+              (override));
+};
+
+class FakeIncomingSocket : public BwuHandler::IncomingSocket {
+ public:
+  std::string ToString() override { return "socket"; }
+  void Close() override {}
+};
+
+std::unique_ptr<NiceMock<MockEndpointChannel>> CreateChannel(Medium medium) {
+  auto channel = std::make_unique<NiceMock<MockEndpointChannel>>();
+  ON_CALL(*channel, GetMedium()).WillByDefault(Return(medium));
+  ON_CALL(*channel, Write(_))
+      .WillByDefault(Return(Exception{Exception::kSuccess}));
+  return channel;
+}
+
+}  // namespace
+
+// Sets up a BwuManager with WEB_RTC and BLUETOOTH handlers, for endpoint_id_,
+// connected over BLE.
+// This class must be in the same namespace as BwuManager for friend class to
+// work.
+class BwuManagerWithHandlersTest : public ::testing::Test {
+ protected:
+  BwuManagerWithHandlersTest() {
+    absl::flat_hash_map<Medium, std::unique_ptr<BwuHandler>> handlers;
+    handlers.emplace(Medium::WEB_RTC, std::unique_ptr<BwuHandler>(web_rtc_));
+    handlers.emplace(Medium::BLUETOOTH,
+                     std::unique_ptr<BwuHandler>(bluetooth_));
+    bwu_manager_ = std::make_unique<BwuManager>(
+        mediums_, em_, ecm_, std::move(handlers),
+        BwuManager::Config{
+            .medium_migration_check_interval = absl::Milliseconds(10),
+            .min_time_between_medium_changes = absl::Nanoseconds(1),
+        });
+    ecm_.RegisterChannelForEndpoint(&client_, endpoint_id_,
+                                    CreateChannel(Medium::BLE));
+  }
+
+  ~BwuManagerWithHandlersTest() override { bwu_manager_->Shutdown(); }
+
+  void OnPathAvailable(const ByteArray& bytes) {
+    OfflineFrame frame = parser::FromBytes(bytes).result();
+    bwu_manager_->OnIncomingFrame(frame, endpoint_id_, &client_,
+                                  Medium::BLE);
+  }
+
+  // Connects client_ to our endpoint, allowing it to upgrade to mediums.
+  void Connect(const BooleanMediumSelector& mediums) {
+    client_.OnConnectionInitiated(endpoint_id_,
+                                  {
+                                      .remote_endpoint_info = ByteArray{"name"},
+                                      .authentication_token = "token",
+                                      .raw_authentication_token =
+                                          ByteArray{"token"},
+                                      .is_incoming_connection = false,
+                                  },
+                                  {.allowed = mediums}, {});
+    client_.LocalEndpointAcceptedConnection(endpoint_id_, {});
+    client_.RemoteEndpointAcceptedConnection(endpoint_id_);
+    client_.OnConnectionAccepted(endpoint_id_);
+  }
+
+  // Has the responder connect to us over channel, as the initiator.
+  void OnIncomingConnection(std::unique_ptr<EndpointChannel> channel) {
+    auto connection = std::make_unique<BwuHandler::IncomingSocketConnection>();
+    connection->socket = std::make_unique<FakeIncomingSocket>();
+    connection->channel = std::move(channel);
+    bwu_manager_->OnIncomingConnection(&client_, std::move(connection));
+  }
+
+  // Has our endpoint upgraded to WEB_RTC, as the responder.
+  void UpgradeToWebRtc() {
+    EXPECT_CALL(*web_rtc_, CreateUpgradedEndpointChannel)
+        .WillOnce([](ClientProxy*, const std::string&, const std::string&,
+                     const BwuHandler::UpgradePathInfo&) {
+          return CreateChannel(Medium::WEB_RTC);
+        });
+    OnPathAvailable(parser::ForBwuWebrtcPathAvailable("peer_id"));
+  }
+
+  ClientProxy client_;
+  std::string endpoint_id_ = "EP_A";
+  Mediums mediums_;
+  EndpointChannelManager ecm_;
+  EndpointManager em_{&ecm_};
+  // Owned by bwu_manager_.
+  NiceMock<MockBwuHandler>* web_rtc_ =
+      new NiceMock<MockBwuHandler>(Medium::WEB_RTC);
+  NiceMock<MockBwuHandler>* bluetooth_ =
+      new NiceMock<MockBwuHandler>(Medium::BLUETOOTH);
+  // Of the EndpointChannels that have one.
+  LinkMonitor link_monitor_;
+  std::unique_ptr<BwuManager> bwu_manager_;
+};
+
+namespace {
+
+TEST_F(BwuManagerWithHandlersTest, ResponderMigratesOnlyEndpoint) {
+  UpgradeToWebRtc();
+
+  EXPECT_CALL(*bluetooth_, CreateUpgradedEndpointChannel)
+      .WillOnce([](ClientProxy*, const std::string&, const std::string&,
+                   const BwuHandler::UpgradePathInfo&) {
+        return CreateChannel(Medium::BLUETOOTH);
+      });
+  OnPathAvailable(
+      parser::ForBwuBluetoothPathAvailable("service", "00:11:22:33:44:55"));
+
+  EXPECT_EQ(ecm_.GetChannelForEndpoint(endpoint_id_)->GetMedium(),
+            Medium::BLUETOOTH);
+}
+
+TEST_F(BwuManagerWithHandlersTest, ResponderKeepsMediumOfOtherEndpoints) {
+  UpgradeToWebRtc();
+  ecm_.RegisterChannelForEndpoint(&client_, "EP_B",
+                                  CreateChannel(Medium::WEB_RTC));
+
+  EXPECT_CALL(*bluetooth_, CreateUpgradedEndpointChannel).Times(0);
+  OnPathAvailable(
+      parser::ForBwuBluetoothPathAvailable("service", "00:11:22:33:44:55"));
+
+  EXPECT_EQ(ecm_.GetChannelForEndpoint(endpoint_id_)->GetMedium(),
+            Medium::WEB_RTC);
+}
+
+TEST_F(BwuManagerWithHandlersTest, LastEndpointDisconnectRevertsAllMediums) {
+  UpgradeToWebRtc();
+
+  EXPECT_CALL(*web_rtc_, Revert()).Times(AtLeast(1));
+  EXPECT_CALL(*bluetooth_, Revert()).Times(AtLeast(1));
+  CountDownLatch barrier(1);
+  bwu_manager_->OnEndpointDisconnect(&client_, endpoint_id_, &barrier);
+  barrier.Await();
+  ::testing::Mock::VerifyAndClearExpectations(web_rtc_);
+  ::testing::Mock::VerifyAndClearExpectations(bluetooth_);
+}
+
+TEST_F(BwuManagerWithHandlersTest, InitiatorMigratesDegradedEndpoint) {
+  Connect({.bluetooth = true, .web_rtc = true});
+  EXPECT_CALL(*web_rtc_, InitializeUpgradedMediumForEndpoint)
+      .WillOnce(Return(parser::ForBwuWebrtcPathAvailable("peer_id")));
+  bwu_manager_->InitiateBwuForEndpoint(&client_, endpoint_id_,
+                                       Medium::WEB_RTC);
+
+  // The responder connects over a link that stopped delivering a while ago,
+  // but has not stalled yet.
+  link_monitor_.OnPingSent(
+      link_monitor_.OnPingQueued(),
+      SystemClock::ElapsedRealtime() - LinkMonitor::kMaxStallTimeout * 2 / 3);
+  auto channel = CreateChannel(Medium::WEB_RTC);
+  ON_CALL(*channel, Read())
+      .WillByDefault(
+          Return(ExceptionOr<ByteArray>(parser::ForBwuIntroduction("EP_A"))));
+  ON_CALL(*channel, GetLinkMonitor()).WillByDefault(Return(&link_monitor_));
+  OnIncomingConnection(std::move(channel));
+
+  // The upgrade completes, and the health check migrates the endpoint.
+  CountDownLatch migrated(1);
+  EXPECT_CALL(*bluetooth_, InitializeUpgradedMediumForEndpoint)
+      .WillOnce([&migrated](ClientProxy*, const std::string&,
+                            const std::string&) {
+        migrated.CountDown();
+        return parser::ForBwuBluetoothPathAvailable("service",
+                                                    "00:11:22:33:44:55");
+      });
+  OnPathAvailable(parser::ForBwuLastWrite());
+  OnPathAvailable(parser::ForBwuSafeToClose());
+  EXPECT_TRUE(migrated.Await(absl::Seconds(10)).result());
+}
+
 TEST(BwuManagerTest, CanCreateInstance) {
   Mediums mediums;
   EndpointChannelManager ecm;
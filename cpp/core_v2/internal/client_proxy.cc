@@ -26,6 +26,7 @@
 #include "proto/connections_enums.pb.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
 
@@ -33,9 +34,25 @@ namespace location {
 namespace nearby {
 namespace connections {
 
-ClientProxy::ClientProxy() : client_id_(Prng().NextInt64()) {}
+namespace {
 
-ClientProxy::~ClientProxy() { Reset(); }
+// Most notifications delivered at once, about as many different endpoints.
+constexpr int kMaxConcurrentNotifications = 4;
+
+}  // namespace
+
+ClientProxy::ClientProxy()
+    : client_id_(Prng().NextInt64()),
+      state_(std::make_shared<State>()),
+      metrics_(absl::make_unique<MetricsRegistry>(client_id_)),
+      notifications_(
+          absl::make_unique<KeyedExecutor>(kMaxConcurrentNotifications)) {}
+
+ClientProxy::~ClientProxy() {
+  // A moved-from client has no state to reset.
+  if (!state_) return;
+  Reset();
+}
 
 std::int64_t ClientProxy::GetClientId() const { return client_id_; }
 
@@ -71,36 +88,35 @@ void ClientProxy::StartedAdvertising(
     absl::Span<proto::connections::Medium> mediums) {
   MutexLock lock(&mutex_);
 
-  if (connections_.empty()) local_endpoint_id_.clear();
-  advertising_info_ = {service_id, listener};
+  if (GetState()->connections.empty()) local_endpoint_id_.clear();
+  UpdateState([&service_id, &listener](State& state) {
+    state.advertising_info = {service_id, listener};
+  });
 }
 
 void ClientProxy::StoppedAdvertising() {
   MutexLock lock(&mutex_);
 
   if (IsAdvertising()) {
-    advertising_info_.Clear();
+    UpdateState([](State& state) { state.advertising_info.Clear(); });
   }
-  if (connections_.empty()) local_endpoint_id_.clear();
+  if (GetState()->connections.empty()) local_endpoint_id_.clear();
 }
 
 bool ClientProxy::IsAdvertising() const {
-  MutexLock lock(&mutex_);
-
-  return !advertising_info_.IsEmpty();
+  return !GetState()->advertising_info.IsEmpty();
 }
 
 std::string ClientProxy::GetAdvertisingServiceId() const {
-  MutexLock lock(&mutex_);
-  return advertising_info_.service_id;
+  return GetState()->advertising_info.service_id;
 }
 
 std::string ClientProxy::GetServiceId() const {
-  MutexLock lock(&mutex_);
-  if (IsAdvertising())
-    return advertising_info_.service_id;
-  if (IsDiscovering())
-    return discovery_info_.service_id;
+  std::shared_ptr<const State> state = GetState();
+  if (!state->advertising_info.IsEmpty())
+    return state->advertising_info.service_id;
+  if (!state->discovery_info.IsEmpty())
+    return state->discovery_info.service_id;
   return "idle_service_id";
 }
 
@@ -110,8 +126,10 @@ void ClientProxy::StartedDiscovery(
     absl::Span<proto::connections::Medium> mediums) {
   MutexLock lock(&mutex_);
 
-  if (connections_.empty()) local_endpoint_id_.clear();
-  discovery_info_ = DiscoveryInfo{service_id, listener};
+  if (GetState()->connections.empty()) local_endpoint_id_.clear();
+  UpdateState([&service_id, &listener](State& state) {
+    state.discovery_info = DiscoveryInfo{service_id, listener};
+  });
 }
 
 void ClientProxy::StoppedDiscovery() {
@@ -119,27 +137,23 @@ void ClientProxy::StoppedDiscovery() {
 
   if (IsDiscovering()) {
     discovered_endpoint_ids_.clear();
-    discovery_info_.Clear();
+    UpdateState([](State& state) { state.discovery_info.Clear(); });
   }
-  if (connections_.empty()) local_endpoint_id_.clear();
+  if (GetState()->connections.empty()) local_endpoint_id_.clear();
 }
 
 bool ClientProxy::IsDiscoveringServiceId(const std::string& service_id) const {
-  MutexLock lock(&mutex_);
-
-  return IsDiscovering() && service_id == discovery_info_.service_id;
+  std::shared_ptr<const State> state = GetState();
+  return !state->discovery_info.IsEmpty() &&
+         service_id == state->discovery_info.service_id;
 }
 
 bool ClientProxy::IsDiscovering() const {
-  MutexLock lock(&mutex_);
-
-  return !discovery_info_.IsEmpty();
+  return !GetState()->discovery_info.IsEmpty();
 }
 
 std::string ClientProxy::GetDiscoveryServiceId() const {
-  MutexLock lock(&mutex_);
-
-  return discovery_info_.service_id;
+  return GetState()->discovery_info.service_id;
 }
 
 void ClientProxy::OnEndpointFound(const std::string& service_id,
@@ -163,8 +177,11 @@ void ClientProxy::OnEndpointFound(const std::string& service_id,
     return;
   }
   discovered_endpoint_ids_.insert(endpoint_id);
-  discovery_info_.listener.endpoint_found_cb(endpoint_id, endpoint_info,
-                                             service_id);
+  Notify(endpoint_id,
+         [callback = GetState()->discovery_info.listener.endpoint_found_cb,
+          endpoint_id, endpoint_info, service_id]() {
+           callback(endpoint_id, endpoint_info, service_id);
+         });
 }
 
 void ClientProxy::OnEndpointLost(const std::string& service_id,
@@ -175,7 +192,9 @@ void ClientProxy::OnEndpointLost(const std::string& service_id,
   const auto it = discovered_endpoint_ids_.find(endpoint_id);
   if (it == discovered_endpoint_ids_.end()) return;
   discovered_endpoint_ids_.erase(it);
-  discovery_info_.listener.endpoint_lost_cb(endpoint_id);
+  Notify(endpoint_id,
+         [callback = GetState()->discovery_info.listener.endpoint_lost_cb,
+          endpoint_id]() { callback(endpoint_id); });
 }
 
 void ClientProxy::OnConnectionInitiated(const std::string& endpoint_id,
@@ -187,27 +206,33 @@ void ClientProxy::OnConnectionInitiated(const std::string& endpoint_id,
   // Whether this is incoming or outgoing, the local and remote endpoints both
   // still need to accept this connection, so set its establishment status to
   // PENDING.
-  auto result = connections_.emplace(
-      endpoint_id, Connection{
-                       .is_incoming = info.is_incoming_connection,
-                       .connection_listener = listener,
-                       .connection_options = options,
-                   });
-  // Instead of using structured binding which is nice, but banned
-  // (can not use c++17 features, until chromium does) we unpack manually.
-  auto& pair_iter = result.first;
-  bool inserted = result.second;
+  bool inserted = false;
+  std::shared_ptr<const ConnectionListener> connection_listener;
+  UpdateState([&](State& state) {
+    auto result = state.connections.emplace(
+        endpoint_id, Connection{
+                         .is_incoming = info.is_incoming_connection,
+                         .connection_listener =
+                             std::make_shared<ConnectionListener>(listener),
+                         .connection_options = options,
+                     });
+    // Instead of using structured binding which is nice, but banned
+    // (can not use c++17 features, until chromium does) we unpack manually.
+    inserted = result.second;
+    connection_listener = result.first->second.connection_listener;
+  });
   NEARBY_LOG(INFO,
              "ClientProxy [Connection Initiated]: add Connection: client=%p, "
              "id=%s; inserted=%d",
              this, endpoint_id.c_str(), inserted);
   DCHECK(inserted);
-  const Connection& item = pair_iter->second;
   // Notify the client.
   //
   // Note: we allow devices to connect to an advertiser even after it stops
   // advertising, so no need to check IsAdvertising() here.
-  item.connection_listener.initiated_cb(endpoint_id, info);
+  Notify(endpoint_id, [connection_listener, endpoint_id, info]() {
+    connection_listener->initiated_cb(endpoint_id, info);
+  });
 }
 
 void ClientProxy::OnConnectionAccepted(const std::string& endpoint_id) {
@@ -220,11 +245,18 @@ void ClientProxy::OnConnectionAccepted(const std::string& endpoint_id) {
     return;
   }
 
-  // Notify the client.
-  Connection* item = LookupConnection(endpoint_id);
+  const Connection* item = LookupConnection(*GetState(), endpoint_id);
   if (item != nullptr) {
-    item->connection_listener.accepted_cb(endpoint_id);
-    item->status = Connection::kConnected;
+    std::shared_ptr<const ConnectionListener> connection_listener =
+        item->connection_listener;
+    // Update the state first, so that the client sees the endpoint as
+    // connected from within its callback.
+    UpdateState([&endpoint_id](State& state) {
+      state.connections[endpoint_id].status = Connection::kConnected;
+    });
+    Notify(endpoint_id, [connection_listener, endpoint_id]() {
+      connection_listener->accepted_cb(endpoint_id);
+    });
   }
 }
 
@@ -239,42 +271,54 @@ void ClientProxy::OnConnectionRejected(const std::string& endpoint_id,
     return;
   }
 
-  // Notify the client.
-  const Connection* item = LookupConnection(endpoint_id);
+  const Connection* item = LookupConnection(*GetState(), endpoint_id);
   if (item != nullptr) {
-    item->connection_listener.rejected_cb(endpoint_id, status);
+    std::shared_ptr<const ConnectionListener> connection_listener =
+        item->connection_listener;
     OnDisconnected(endpoint_id, false /* notify */);
+    Notify(endpoint_id, [connection_listener, endpoint_id, status]() {
+      connection_listener->rejected_cb(endpoint_id, status);
+    });
   }
 }
 
 void ClientProxy::OnBandwidthChanged(const std::string& endpoint_id,
                                      Medium new_medium) {
+  // Only held to keep the notification ahead of OnDisconnected()'s.
   MutexLock lock(&mutex_);
 
-  const Connection* item = LookupConnection(endpoint_id);
+  const Connection* item = LookupConnection(*GetState(), endpoint_id);
   if (item != nullptr) {
-    item->connection_listener.bandwidth_changed_cb(endpoint_id, new_medium);
+    Notify(endpoint_id, [connection_listener = item->connection_listener,
+                         endpoint_id, new_medium]() {
+      connection_listener->bandwidth_changed_cb(endpoint_id, new_medium);
+    });
   }
 }
 
 void ClientProxy::OnDisconnected(const std::string& endpoint_id, bool notify) {
   MutexLock lock(&mutex_);
 
-  const Connection* item = LookupConnection(endpoint_id);
+  const Connection* item = LookupConnection(*GetState(), endpoint_id);
   if (item != nullptr) {
+    std::shared_ptr<const ConnectionListener> connection_listener =
+        item->connection_listener;
+    UpdateState([&endpoint_id](State& state) {
+      state.connections.erase(endpoint_id);
+    });
+    if (GetState()->connections.empty()) local_endpoint_id_.clear();
     if (notify) {
-      item->connection_listener.disconnected_cb({endpoint_id});
+      Notify(endpoint_id, [connection_listener, endpoint_id]() {
+        connection_listener->disconnected_cb({endpoint_id});
+      });
     }
-    connections_.erase(endpoint_id);
-    if (connections_.empty()) local_endpoint_id_.clear();
   }
+  metrics_->OnEndpointDisconnected(endpoint_id);
 }
 
 bool ClientProxy::ConnectionStatusMatches(const std::string& endpoint_id,
                                           Connection::Status status) const {
-  MutexLock lock(&mutex_);
-
-  const Connection* item = LookupConnection(endpoint_id);
+  const Connection* item = LookupConnection(*GetState(), endpoint_id);
   if (item != nullptr) {
     return item->status == status;
   }
@@ -283,9 +327,8 @@ bool ClientProxy::ConnectionStatusMatches(const std::string& endpoint_id,
 
 BooleanMediumSelector ClientProxy::GetUpgradeMediums(
     const std::string& endpoint_id) const {
-  MutexLock lock(&mutex_);
-
-  const Connection* item = LookupConnection(endpoint_id);
+  std::shared_ptr<const State> state = GetState();
+  const Connection* item = LookupConnection(*state, endpoint_id);
   if (item != nullptr) {
     return item->connection_options.allowed;
   }
@@ -298,11 +341,10 @@ bool ClientProxy::IsConnectedToEndpoint(const std::string& endpoint_id) const {
 
 std::vector<std::string> ClientProxy::GetMatchingEndpoints(
     std::function<bool(const Connection&)> pred) const {
-  MutexLock lock(&mutex_);
-
+  std::shared_ptr<const State> state = GetState();
   std::vector<std::string> connected_endpoints;
 
-  for (const auto& pair : connections_) {
+  for (const auto& pair : state->connections) {
     const auto& endpoint_id = pair.first;
     const auto& connection = pair.second;
     if (pred(connection)) {
@@ -342,9 +384,8 @@ std::int32_t ClientProxy::GetNumIncomingConnections() const {
 
 bool ClientProxy::HasPendingConnectionToEndpoint(
     const std::string& endpoint_id) const {
-  MutexLock lock(&mutex_);
-
-  const Connection* item = LookupConnection(endpoint_id);
+  std::shared_ptr<const State> state = GetState();
+  const Connection* item = LookupConnection(*state, endpoint_id);
   if (item != nullptr) {
     return item->status != Connection::kConnected;
   }
@@ -353,8 +394,6 @@ bool ClientProxy::HasPendingConnectionToEndpoint(
 
 bool ClientProxy::HasLocalEndpointResponded(
     const std::string& endpoint_id) const {
-  MutexLock lock(&mutex_);
-
   return ConnectionStatusesContains(
       endpoint_id,
       static_cast<Connection::Status>(Connection::kLocalEndpointAccepted |
@@ -363,8 +402,6 @@ bool ClientProxy::HasLocalEndpointResponded(
 
 bool ClientProxy::HasRemoteEndpointResponded(
     const std::string& endpoint_id) const {
-  MutexLock lock(&mutex_);
-
   return ConnectionStatusesContains(
       endpoint_id,
       static_cast<Connection::Status>(Connection::kRemoteEndpointAccepted |
@@ -384,10 +421,13 @@ void ClientProxy::LocalEndpointAcceptedConnection(
   }
 
   AppendConnectionStatus(endpoint_id, Connection::kLocalEndpointAccepted);
-  Connection* item = LookupConnection(endpoint_id);
-  if (item != nullptr) {
-    item->payload_listener = listener;
-  }
+  UpdateState([&endpoint_id, &listener](State& state) {
+    auto item = state.connections.find(endpoint_id);
+    if (item != state.connections.end()) {
+      item->second.payload_listener =
+          std::make_shared<PayloadListener>(listener);
+    }
+  });
 }
 
 void ClientProxy::LocalEndpointRejectedConnection(
@@ -436,8 +476,6 @@ void ClientProxy::RemoteEndpointRejectedConnection(
 }
 
 bool ClientProxy::IsConnectionAccepted(const std::string& endpoint_id) const {
-  MutexLock lock(&mutex_);
-
   return ConnectionStatusesContains(endpoint_id,
                                     Connection::kLocalEndpointAccepted) &&
          ConnectionStatusesContains(endpoint_id,
@@ -445,8 +483,6 @@ bool ClientProxy::IsConnectionAccepted(const std::string& endpoint_id) const {
 }
 
 bool ClientProxy::IsConnectionRejected(const std::string& endpoint_id) const {
-  MutexLock lock(&mutex_);
-
   return ConnectionStatusesContains(
       endpoint_id,
       static_cast<Connection::Status>(Connection::kLocalEndpointRejected |
@@ -464,40 +500,73 @@ bool ClientProxy::RemoteConnectionIsAccepted(std::string endpoint_id) const {
 }
 
 void ClientProxy::OnPayload(const std::string& endpoint_id, Payload payload) {
-  MutexLock lock(&mutex_);
-
-  if (IsConnectedToEndpoint(endpoint_id)) {
-    const Connection* item = LookupConnection(endpoint_id);
-    if (item != nullptr) {
-      item->payload_listener.payload_cb(endpoint_id, std::move(payload));
-    }
+  // Only held to keep the notification ahead of OnDisconnected()'s.
+  MutexLock lock(&mutex_);
+
+  std::shared_ptr<const State> state = GetState();
+  const Connection* item = LookupConnection(*state, endpoint_id);
+  if (item != nullptr && item->status == Connection::kConnected) {
+    // Runnable must be copyable; Payload is not.
+    auto shared_payload = std::make_shared<Payload>(std::move(payload));
+    Notify(endpoint_id, [payload_listener = item->payload_listener,
+                         endpoint_id, shared_payload]() {
+      payload_listener->payload_cb(endpoint_id, std::move(*shared_payload));
+    });
   }
 }
 
-const ClientProxy::Connection* ClientProxy::LookupConnection(
-    const std::string& endpoint_id) const {
-  auto item = connections_.find(endpoint_id);
-  return item != connections_.end() ? &item->second : nullptr;
+std::function<PayloadChunkAction(const std::string& endpoint_id,
+                                 const PayloadChunkInfo& chunk)>
+ClientProxy::GetPayloadChunkCallback(const std::string& endpoint_id) const {
+  std::shared_ptr<const State> state = GetState();
+  const Connection* item = LookupConnection(*state, endpoint_id);
+  if (item != nullptr && item->status == Connection::kConnected) {
+    return item->payload_listener->payload_chunk_cb;
+  }
+  return {};
 }
 
-ClientProxy::Connection* ClientProxy::LookupConnection(
-    const std::string& endpoint_id) {
-  auto item = connections_.find(endpoint_id);
-  return item != connections_.end() ? &item->second : nullptr;
+const ClientProxy::Connection* ClientProxy::LookupConnection(
+    const State& state, const std::string& endpoint_id) {
+  auto item = state.connections.find(endpoint_id);
+  return item != state.connections.end() ? &item->second : nullptr;
 }
 
 void ClientProxy::OnPayloadProgress(const std::string& endpoint_id,
                                     const PayloadProgressInfo& info) {
+  // Only held to keep the notification ahead of OnDisconnected()'s.
   MutexLock lock(&mutex_);
 
-  if (IsConnectedToEndpoint(endpoint_id)) {
-    Connection* item = LookupConnection(endpoint_id);
-    if (item != nullptr) {
-      item->payload_listener.payload_progress_cb(endpoint_id, info);
-    }
+  std::shared_ptr<const State> state = GetState();
+  const Connection* item = LookupConnection(*state, endpoint_id);
+  if (item != nullptr && item->status == Connection::kConnected) {
+    Notify(endpoint_id, [payload_listener = item->payload_listener,
+                         endpoint_id, info]() {
+      payload_listener->payload_progress_cb(endpoint_id, info);
+    });
   }
 }
 
+std::shared_ptr<const ClientProxy::State> ClientProxy::GetState() const {
+  return std::atomic_load(&state_);
+}
+
+void ClientProxy::UpdateState(const std::function<void(State&)>& update) {
+  auto state = std::make_shared<State>(*GetState());
+  update(*state);
+  std::atomic_store(&state_, std::shared_ptr<const State>(std::move(state)));
+}
+
+void ClientProxy::Notify(const std::string& endpoint_id,
+                         Runnable&& notification) {
+  notifications_->Execute(endpoint_id, std::move(notification));
+}
+
+bool ClientProxy::IsCalledFromListener() const {
+  // A moved-from client has no executor.
+  return notifications_ != nullptr && notifications_->IsRunningTask();
+}
+
 bool operator==(const ClientProxy& lhs, const ClientProxy& rhs) {
   return lhs.GetClientId() == rhs.GetClientId();
 }
@@ -512,13 +581,16 @@ void ClientProxy::RemoveAllEndpoints() {
   // Note: we may want to notify the client of onDisconnected() for each
   // endpoint, in the case when this is called from stopAllEndpoints(). For now,
   // just remove without notifying.
-  connections_.clear();
+  UpdateState([](State& state) { state.connections.clear(); });
   local_endpoint_id_.clear();
+  // A moved-from client has no metrics.
+  if (metrics_) metrics_->OnAllEndpointsDisconnected();
 }
 
 bool ClientProxy::ConnectionStatusesContains(
     const std::string& endpoint_id, Connection::Status status_to_match) const {
-  const Connection* item = LookupConnection(endpoint_id);
+  std::shared_ptr<const State> state = GetState();
+  const Connection* item = LookupConnection(*state, endpoint_id);
   if (item != nullptr) {
     return (item->status & status_to_match) != 0;
   }
@@ -527,11 +599,13 @@ bool ClientProxy::ConnectionStatusesContains(
 
 void ClientProxy::AppendConnectionStatus(const std::string& endpoint_id,
                                          Connection::Status status_to_append) {
-  Connection* item = LookupConnection(endpoint_id);
-  if (item != nullptr) {
-    item->status =
-        static_cast<Connection::Status>(item->status | status_to_append);
-  }
+  UpdateState([&endpoint_id, status_to_append](State& state) {
+    auto item = state.connections.find(endpoint_id);
+    if (item != state.connections.end()) {
+      item->second.status = static_cast<Connection::Status>(
+          item->second.status | status_to_append);
+    }
+  });
 }
 
 }  // namespace connections
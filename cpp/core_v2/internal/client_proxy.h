@@ -16,15 +16,19 @@
 #define CORE_V2_INTERNAL_CLIENT_PROXY_H_
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "core_v2/internal/keyed_executor.h"
+#include "core_v2/internal/metrics.h"
 #include "core_v2/listeners.h"
 #include "core_v2/options.h"
 #include "core_v2/status.h"
 #include "core_v2/strategy.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/prng.h"
+#include "platform_v2/base/runnable.h"
 #include "platform_v2/public/mutex.h"
 #include "proto/connections_enums.pb.h"
 // Prefer using absl:: versions of a set and a map; they tend to be more
@@ -39,6 +43,17 @@ namespace connections {
 
 // CLientProxy is tracking state of client's connection, and serves as
 // a proxy for notifications sent to this client.
+//
+// The state is published as an immutable snapshot, replaced as a whole on
+// every change; the const accessors read the latest snapshot, and never wait
+// for a change in progress.
+//
+// Notifications are delivered on a private executor, never under the state
+// lock: those about one endpoint in the order they were made, those about
+// different endpoints possibly concurrently. A slow client callback therefore
+// holds up later callbacks about its endpoint only. All pending notifications
+// are delivered before ClientProxy is destroyed, so it must not be destroyed
+// from one of its callbacks; that is fatal.
 class ClientProxy final {
  public:
   static constexpr int kEndpointIdLength = 4;
@@ -52,6 +67,10 @@ class ClientProxy final {
 
   std::string GetLocalEndpointId();
 
+  // Returns true if called from a callback of the client, on the executor
+  // that notifications are delivered on.
+  bool IsCalledFromListener() const;
+
   // Clears all the runtime state of this client.
   void Reset();
 
@@ -150,9 +169,18 @@ class ClientProxy final {
   // Proxies to the client's PayloadListener::OnPayloadProgress() callback.
   void OnPayloadProgress(const std::string& endpoint_id,
                          const PayloadProgressInfo& info);
+  // Returns the client's PayloadListener::payload_chunk_cb for endpoint_id, if
+  // it is connected and has one; otherwise, an empty function. Unlike the
+  // other callbacks, it is to be called directly, on the caller's thread.
+  std::function<PayloadChunkAction(const std::string& endpoint_id,
+                                   const PayloadChunkInfo& chunk)>
+  GetPayloadChunkCallback(const std::string& endpoint_id) const;
   bool LocalConnectionIsAccepted(std::string endpoint_id) const;
   bool RemoteConnectionIsAccepted(std::string endpoint_id) const;
 
+  // Returns the performance metrics of this client and its endpoints.
+  MetricsRegistry& GetMetrics() const { return *metrics_; }
+
  private:
   struct Connection {
     // Status: may be either:
@@ -176,8 +204,11 @@ class ClientProxy final {
     };
     bool is_incoming{false};
     Status status{kPending};
-    ConnectionListener connection_listener;
-    PayloadListener payload_listener;
+    // Shared with the notifications that are on their way.
+    std::shared_ptr<const ConnectionListener> connection_listener{
+        std::make_shared<ConnectionListener>()};
+    std::shared_ptr<const PayloadListener> payload_listener{
+        std::make_shared<PayloadListener>()};
     ConnectionOptions connection_options;
   };
 
@@ -195,33 +226,50 @@ class ClientProxy final {
     bool IsEmpty() const { return service_id.empty(); }
   };
 
+  // A snapshot of the state; never changed once published.
+  struct State {
+    // If not empty, we are currently advertising and accepting connection
+    // requests for the given service_id.
+    AdvertisingInfo advertising_info;
+
+    // If not empty, we are currently discovering for the given service_id.
+    DiscoveryInfo discovery_info;
+
+    // Maps endpoint_id to endpoint connection state.
+    absl::flat_hash_map<std::string, Connection> connections;
+  };
+
+  // Returns the latest snapshot.
+  std::shared_ptr<const State> GetState() const;
+  // Publishes a copy of the latest snapshot, changed by update.
+  // Must be called with mutex_ held.
+  void UpdateState(const std::function<void(State&)>& update);
+
+  // Delivers a notification about endpoint_id, after all the earlier ones
+  // about it.
+  void Notify(const std::string& endpoint_id, Runnable&& notification);
+
   void RemoveAllEndpoints();
   bool ConnectionStatusesContains(const std::string& endpoint_id,
                                   Connection::Status status_to_match) const;
   void AppendConnectionStatus(const std::string& endpoint_id,
                               Connection::Status status_to_append);
 
-  const Connection* LookupConnection(const std::string& endpoint_id) const;
-  Connection* LookupConnection(const std::string& endpoint_id);
+  static const Connection* LookupConnection(const State& state,
+                                            const std::string& endpoint_id);
   bool ConnectionStatusMatches(const std::string& endpoint_id,
                                Connection::Status status) const;
   std::vector<std::string> GetMatchingEndpoints(
       std::function<bool(const Connection&)> pred) const;
 
+  // Serializes changes of the state; readers do not take it.
   mutable RecursiveMutex mutex_;
   std::int64_t client_id_;
   std::string local_endpoint_id_;
   Prng prng_;
 
-  // If not empty, we are currently advertising and accepting connection
-  // requests for the given service_id.
-  AdvertisingInfo advertising_info_;
-
-  // If not empty, we are currently discovering for the given service_id.
-  DiscoveryInfo discovery_info_;
-
-  // Maps endpoint_id to endpoint connection state.
-  absl::flat_hash_map<std::string, Connection> connections_;
+  // Accessed with std::atomic_load() and std::atomic_store() only.
+  std::shared_ptr<const State> state_;
 
   // A cache of endpoint ids that we've already notified the discoverer of. We
   // check this cache before calling onEndpointFound() so that we don't notify
@@ -229,6 +277,10 @@ class ClientProxy final {
   // happen because some mediums (like Bluetooth) repeatedly give us the same
   // endpoints after each scan.
   absl::flat_hash_set<std::string> discovered_endpoint_ids_;
+
+  // Held by pointer to keep ClientProxy movable.
+  std::unique_ptr<MetricsRegistry> metrics_;
+  std::unique_ptr<KeyedExecutor> notifications_;
 };
 
 // Operator overloads when comparing Ptr<ClientProxy>.
@@ -14,15 +14,18 @@
 
 #include "core_v2/internal/client_proxy.h"
 
+#include <memory>
 #include <string>
 
 #include "core_v2/listeners.h"
 #include "core_v2/options.h"
 #include "core_v2/strategy.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/public/count_down_latch.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 
 namespace location {
@@ -369,6 +372,61 @@ TEST_F(ClientProxyTest, OnPayloadProgressChangesState) {
   OnPayloadProgress(&client2_, advertising_endpoint);
 }
 
+TEST_F(ClientProxyTest, SlowPayloadCallbackDoesNotBlockState) {
+  // The callback outlives the test body.
+  auto entered = std::make_shared<CountDownLatch>(1);
+  auto release = std::make_shared<CountDownLatch>(1);
+  payload_listener_.payload_cb = [entered, release](const std::string&,
+                                                    Payload) {
+    entered->CountDown();
+    release->Await();
+  };
+  Endpoint advertising_endpoint =
+      StartAdvertising(&client1_, advertising_connection_listener_);
+  StartDiscovery(&client2_, discovery_listener_);
+  OnDiscoveryEndpointFound(&client2_, advertising_endpoint);
+  OnDiscoveryConnectionInitiated(&client2_, advertising_endpoint);
+  OnDiscoveryConnectionLocalAccepted(&client2_, advertising_endpoint);
+  OnDiscoveryConnectionRemoteAccepted(&client2_, advertising_endpoint);
+  OnDiscoveryConnectionAccepted(&client2_, advertising_endpoint);
+
+  client2_.OnPayload(advertising_endpoint.id, Payload(payload_bytes_));
+  ASSERT_TRUE(entered->Await(absl::Seconds(1)).result());
+
+  // The callback is still running.
+  EXPECT_TRUE(client2_.IsConnectedToEndpoint(advertising_endpoint.id));
+  EXPECT_EQ(client2_.GetConnectedEndpoints().size(), 1);
+  OnDiscoveryConnectionDisconnected(&client2_, advertising_endpoint);
+  EXPECT_FALSE(client2_.IsConnectedToEndpoint(advertising_endpoint.id));
+  release->CountDown();
+}
+
+TEST_F(ClientProxyTest, EndpointIsConnectedInAcceptedCallback) {
+  CountDownLatch accepted(1);
+  bool connected = false;
+  bool called_from_listener = false;
+  discovery_connection_listener_.accepted_cb =
+      [this, &accepted, &connected,
+       &called_from_listener](const std::string& endpoint_id) {
+        connected = client2_.IsConnectedToEndpoint(endpoint_id);
+        called_from_listener = client2_.IsCalledFromListener();
+        accepted.CountDown();
+      };
+  Endpoint advertising_endpoint =
+      StartAdvertising(&client1_, advertising_connection_listener_);
+  StartDiscovery(&client2_, discovery_listener_);
+  OnDiscoveryEndpointFound(&client2_, advertising_endpoint);
+  OnDiscoveryConnectionInitiated(&client2_, advertising_endpoint);
+  OnDiscoveryConnectionLocalAccepted(&client2_, advertising_endpoint);
+  OnDiscoveryConnectionRemoteAccepted(&client2_, advertising_endpoint);
+
+  client2_.OnConnectionAccepted(advertising_endpoint.id);
+  ASSERT_TRUE(accepted.Await(absl::Seconds(1)).result());
+  EXPECT_TRUE(connected);
+  EXPECT_TRUE(called_from_listener);
+  EXPECT_FALSE(client2_.IsCalledFromListener());
+}
+
 }  // namespace
 }  // namespace connections
 }  // namespace nearby
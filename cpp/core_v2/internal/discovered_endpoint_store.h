@@ -0,0 +1,290 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_V2_INTERNAL_DISCOVERED_ENDPOINT_STORE_H_
+#define CORE_V2_INTERNAL_DISCOVERED_ENDPOINT_STORE_H_
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "proto/connections_enums.pb.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+// Keeps the endpoints found by a PCP handler, at most one per
+// (endpoint id, medium) pair.
+//
+// Next to the primary endpoint id index, endpoints are indexed by medium and
+// by service id, and every endpoint id caches its most preferred entry, so
+// that found, lost and best-medium lookups do not depend on the number of
+// endpoints or sightings. Put() and Remove() report the first sighting and
+// the last loss of an endpoint id, which lets callers report an endpoint seen
+// over several mediums to the client only once.
+//
+// Endpoint is expected to have endpoint_id, service_id and medium members, like
+// BasePcpHandler::DiscoveredEndpoint does.
+//
+// Not thread-safe; BasePcpHandler only uses it from its serial executor.
+template <typename Endpoint>
+class DiscoveredEndpointStore {
+ public:
+  using Medium = proto::connections::Medium;
+
+  // Sets the order in which mediums are preferred, best first. Mediums not in
+  // the list are less preferred than any medium in it.
+  void SetMediumsByPriority(const std::vector<Medium>& mediums) {
+    if (mediums == mediums_by_priority_) return;
+    std::vector<std::pair<Medium, int>> previous_ranks;
+    for (const auto& item : endpoint_ids_by_medium_) {
+      previous_ranks.emplace_back(item.first, GetRank(item.first));
+    }
+    mediums_by_priority_ = mediums;
+    medium_ranks_.clear();
+    for (int rank = 0; rank < static_cast<int>(mediums.size()); rank++) {
+      medium_ranks_.emplace(mediums[rank], rank);
+    }
+    // Only endpoints found over a medium that moved may prefer another one.
+    absl::flat_hash_set<std::string> endpoint_ids;
+    for (const auto& item : previous_ranks) {
+      if (GetRank(item.first) == item.second) continue;
+      const auto& ids = endpoint_ids_by_medium_.at(item.first);
+      endpoint_ids.insert(ids.begin(), ids.end());
+    }
+    for (const std::string& endpoint_id : endpoint_ids) {
+      UpdateBestEndpoint(entries_.at(endpoint_id));
+    }
+  }
+
+  // Adds an endpoint, replacing the one previously found for the same
+  // endpoint id and medium, if any. Returns true if this is the first medium
+  // the endpoint id is known over.
+  bool Put(std::shared_ptr<Endpoint> endpoint) {
+    const std::string endpoint_id = endpoint->endpoint_id;
+    const Medium medium = endpoint->medium;
+    Entry& entry = entries_[endpoint_id];
+    bool first_sighting = entry.endpoints.empty();
+    auto& slot = entry.endpoints[medium];
+    std::string replaced_service_id;
+    bool replaced = slot != nullptr;
+    if (replaced) replaced_service_id = slot->service_id;
+    slot = std::move(endpoint);
+
+    endpoint_ids_by_medium_[medium].insert(endpoint_id);
+    endpoint_ids_by_service_id_[slot->service_id].insert(endpoint_id);
+    if (replaced && replaced_service_id != slot->service_id) {
+      MaybeUnindexServiceId(endpoint_id, entry, replaced_service_id);
+    }
+    UpdateBestEndpoint(entry);
+    return first_sighting;
+  }
+
+  // Removes the endpoint found for endpoint_id over medium. Returns true if
+  // that was the last medium the endpoint id was known over.
+  bool Remove(const std::string& endpoint_id, Medium medium) {
+    auto entry_it = entries_.find(endpoint_id);
+    if (entry_it == entries_.end()) return false;
+    Entry& entry = entry_it->second;
+    auto it = entry.endpoints.find(medium);
+    if (it == entry.endpoints.end()) return false;
+
+    std::string service_id = it->second->service_id;
+    entry.endpoints.erase(it);
+    EraseFromIndex(endpoint_ids_by_medium_, medium, endpoint_id);
+    MaybeUnindexServiceId(endpoint_id, entry, service_id);
+    if (entry.endpoints.empty()) {
+      entries_.erase(entry_it);
+      return true;
+    }
+    UpdateBestEndpoint(entry);
+    return false;
+  }
+
+  // Removes the endpoints found for service_id.
+  void RemoveServiceId(const std::string& service_id) {
+    auto index_it = endpoint_ids_by_service_id_.find(service_id);
+    if (index_it == endpoint_ids_by_service_id_.end()) return;
+    absl::flat_hash_set<std::string> endpoint_ids = std::move(index_it->second);
+    endpoint_ids_by_service_id_.erase(index_it);
+
+    for (const std::string& endpoint_id : endpoint_ids) {
+      auto entry_it = entries_.find(endpoint_id);
+      Entry& entry = entry_it->second;
+      for (auto it = entry.endpoints.begin(); it != entry.endpoints.end();) {
+        if (it->second->service_id != service_id) {
+          ++it;
+          continue;
+        }
+        EraseFromIndex(endpoint_ids_by_medium_, it->first, endpoint_id);
+        entry.endpoints.erase(it++);
+      }
+      if (entry.endpoints.empty()) {
+        entries_.erase(entry_it);
+      } else {
+        UpdateBestEndpoint(entry);
+      }
+    }
+  }
+
+  void Clear() {
+    entries_.clear();
+    endpoint_ids_by_medium_.clear();
+    endpoint_ids_by_service_id_.clear();
+  }
+
+  bool Contains(const std::string& endpoint_id) const {
+    return entries_.contains(endpoint_id);
+  }
+
+  // Returns the endpoint found for endpoint_id over medium, or nullptr.
+  Endpoint* Get(const std::string& endpoint_id, Medium medium) const {
+    auto entry_it = entries_.find(endpoint_id);
+    if (entry_it == entries_.end()) return nullptr;
+    auto it = entry_it->second.endpoints.find(medium);
+    if (it == entry_it->second.endpoints.end()) return nullptr;
+    return it->second.get();
+  }
+
+  // Returns the endpoint found for endpoint_id over its most preferred
+  // medium, or nullptr.
+  Endpoint* GetBest(const std::string& endpoint_id) const {
+    auto it = entries_.find(endpoint_id);
+    if (it == entries_.end()) return nullptr;
+    return it->second.best;
+  }
+
+  // Returns all endpoints found for endpoint_id, in order of decreasing
+  // preference.
+  std::vector<Endpoint*> GetAll(const std::string& endpoint_id) const {
+    std::vector<Endpoint*> result;
+    for (const auto& endpoint : GetAllShared(endpoint_id)) {
+      result.push_back(endpoint.get());
+    }
+    return result;
+  }
+
+  // Same as GetAll(), but the endpoints stay valid after they are removed.
+  std::vector<std::shared_ptr<Endpoint>> GetAllShared(
+      const std::string& endpoint_id) const {
+    std::vector<std::shared_ptr<Endpoint>> result;
+    auto it = entries_.find(endpoint_id);
+    if (it == entries_.end()) return result;
+    for (const auto& item : it->second.endpoints) {
+      result.push_back(item.second);
+    }
+    std::sort(result.begin(), result.end(),
+              [this](const std::shared_ptr<Endpoint>& a,
+                     const std::shared_ptr<Endpoint>& b) {
+                return IsPreferred(a->medium, b->medium);
+              });
+    return result;
+  }
+
+  // Returns ids of the endpoints found over medium.
+  const absl::flat_hash_set<std::string>& GetEndpointIdsByMedium(
+      Medium medium) const {
+    return FindInIndex(endpoint_ids_by_medium_, medium);
+  }
+
+  // Returns ids of the endpoints found for service_id.
+  const absl::flat_hash_set<std::string>& GetEndpointIdsByServiceId(
+      const std::string& service_id) const {
+    return FindInIndex(endpoint_ids_by_service_id_, service_id);
+  }
+
+ private:
+  struct Entry {
+    absl::flat_hash_map<Medium, std::shared_ptr<Endpoint>> endpoints;
+    // Entry of endpoints with the most preferred medium.
+    Endpoint* best = nullptr;
+  };
+
+  template <typename Key>
+  using Index = absl::flat_hash_map<Key, absl::flat_hash_set<std::string>>;
+
+  template <typename Key>
+  static const absl::flat_hash_set<std::string>& FindInIndex(
+      const Index<Key>& index, const Key& key) {
+    static const auto* const kEmpty = new absl::flat_hash_set<std::string>();
+    auto it = index.find(key);
+    return it == index.end() ? *kEmpty : it->second;
+  }
+
+  template <typename Key>
+  static void EraseFromIndex(Index<Key>& index, const Key& key,
+                             const std::string& endpoint_id) {
+    auto it = index.find(key);
+    if (it == index.end()) return;
+    it->second.erase(endpoint_id);
+    if (it->second.empty()) index.erase(it);
+  }
+
+  // Returns true if medium a is preferred over medium b. Mediums of equal
+  // rank are ordered by value, so that the order does not depend on the order
+  // of sightings.
+  bool IsPreferred(Medium a, Medium b) const {
+    int rank_a = GetRank(a);
+    int rank_b = GetRank(b);
+    return rank_a != rank_b ? rank_a < rank_b : a < b;
+  }
+
+  int GetRank(Medium medium) const {
+    auto it = medium_ranks_.find(medium);
+    return it == medium_ranks_.end() ? static_cast<int>(medium_ranks_.size())
+                                     : it->second;
+  }
+
+  // Endpoints of one id may in theory be found for different service ids;
+  // the id stays indexed under service_id while any of them uses it.
+  void MaybeUnindexServiceId(const std::string& endpoint_id,
+                             const Entry& entry,
+                             const std::string& service_id) {
+    for (const auto& item : entry.endpoints) {
+      if (item.second->service_id == service_id) return;
+    }
+    EraseFromIndex(endpoint_ids_by_service_id_, service_id, endpoint_id);
+  }
+
+  void UpdateBestEndpoint(Entry& entry) {
+    entry.best = nullptr;
+    for (const auto& item : entry.endpoints) {
+      if (entry.best == nullptr ||
+          IsPreferred(item.first, entry.best->medium)) {
+        entry.best = item.second.get();
+      }
+    }
+  }
+
+  std::vector<Medium> mediums_by_priority_;
+  absl::flat_hash_map<Medium, int> medium_ranks_;
+
+  // Endpoint id -> endpoints found for it, one per medium.
+  absl::flat_hash_map<std::string, Entry> entries_;
+  // Medium -> ids of endpoints found over it.
+  Index<Medium> endpoint_ids_by_medium_;
+  // Service id -> ids of endpoints found for it.
+  Index<std::string> endpoint_ids_by_service_id_;
+};
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+#endif  // CORE_V2_INTERNAL_DISCOVERED_ENDPOINT_STORE_H_
@@ -0,0 +1,169 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/discovered_endpoint_store.h"
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+using ::location::nearby::proto::connections::Medium;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAre;
+
+constexpr char kServiceId[] = "service";
+
+struct TestEndpoint {
+  std::string endpoint_id;
+  std::string service_id;
+  Medium medium;
+};
+
+std::shared_ptr<TestEndpoint> MakeEndpoint(const std::string& endpoint_id,
+                                           Medium medium,
+                                           const std::string& service_id =
+                                               kServiceId) {
+  return std::make_shared<TestEndpoint>(
+      TestEndpoint{endpoint_id, service_id, medium});
+}
+
+std::vector<Medium> GetMediums(const std::vector<TestEndpoint*>& endpoints) {
+  std::vector<Medium> mediums;
+  for (const auto* endpoint : endpoints) mediums.push_back(endpoint->medium);
+  return mediums;
+}
+
+TEST(DiscoveredEndpointStoreTest, ReportsFirstSightingAndLastLoss) {
+  DiscoveredEndpointStore<TestEndpoint> store;
+
+  EXPECT_TRUE(store.Put(MakeEndpoint("ABCD", Medium::BLE)));
+  EXPECT_FALSE(store.Put(MakeEndpoint("ABCD", Medium::BLUETOOTH)));
+  EXPECT_FALSE(store.Put(MakeEndpoint("ABCD", Medium::BLE)));
+
+  EXPECT_FALSE(store.Remove("ABCD", Medium::BLE));
+  EXPECT_FALSE(store.Remove("ABCD", Medium::BLE));
+  EXPECT_TRUE(store.Contains("ABCD"));
+  EXPECT_TRUE(store.Remove("ABCD", Medium::BLUETOOTH));
+  EXPECT_FALSE(store.Contains("ABCD"));
+}
+
+TEST(DiscoveredEndpointStoreTest, KeepsOneEndpointPerMedium) {
+  DiscoveredEndpointStore<TestEndpoint> store;
+  auto endpoint = MakeEndpoint("ABCD", Medium::BLE);
+  store.Put(MakeEndpoint("ABCD", Medium::BLE));
+  store.Put(endpoint);
+
+  EXPECT_EQ(store.Get("ABCD", Medium::BLE), endpoint.get());
+  EXPECT_EQ(store.Get("ABCD", Medium::WIFI_LAN), nullptr);
+  EXPECT_EQ(store.GetAll("ABCD").size(), 1);
+}
+
+TEST(DiscoveredEndpointStoreTest, OrdersEndpointsByMediumPriority) {
+  DiscoveredEndpointStore<TestEndpoint> store;
+  store.SetMediumsByPriority({Medium::WIFI_LAN, Medium::BLUETOOTH});
+  store.Put(MakeEndpoint("ABCD", Medium::BLE));
+  store.Put(MakeEndpoint("ABCD", Medium::BLUETOOTH));
+
+  EXPECT_EQ(store.GetBest("ABCD")->medium, Medium::BLUETOOTH);
+
+  store.Put(MakeEndpoint("ABCD", Medium::WIFI_LAN));
+  EXPECT_EQ(store.GetBest("ABCD")->medium, Medium::WIFI_LAN);
+  EXPECT_THAT(GetMediums(store.GetAll("ABCD")),
+              ElementsAre(Medium::WIFI_LAN, Medium::BLUETOOTH, Medium::BLE));
+
+  store.Remove("ABCD", Medium::WIFI_LAN);
+  EXPECT_EQ(store.GetBest("ABCD")->medium, Medium::BLUETOOTH);
+
+  store.SetMediumsByPriority({Medium::BLE, Medium::BLUETOOTH});
+  EXPECT_EQ(store.GetBest("ABCD")->medium, Medium::BLE);
+  EXPECT_EQ(store.GetBest("EFGH"), nullptr);
+}
+
+TEST(DiscoveredEndpointStoreTest, ReordersOnlyEndpointsOverMovedMediums) {
+  DiscoveredEndpointStore<TestEndpoint> store;
+  store.SetMediumsByPriority({Medium::BLE});
+  store.Put(MakeEndpoint("ABCD", Medium::BLE));
+  store.Put(MakeEndpoint("ABCD", Medium::WEB_RTC));
+  store.Put(MakeEndpoint("EFGH", Medium::WIFI_LAN));
+  store.Put(MakeEndpoint("EFGH", Medium::BLUETOOTH));
+  EXPECT_EQ(store.GetBest("ABCD")->medium, Medium::BLE);
+  EXPECT_EQ(store.GetBest("EFGH")->medium, Medium::BLUETOOTH);
+
+  store.SetMediumsByPriority({Medium::WIFI_LAN, Medium::WEB_RTC});
+  EXPECT_EQ(store.GetBest("ABCD")->medium, Medium::WEB_RTC);
+  EXPECT_EQ(store.GetBest("EFGH")->medium, Medium::WIFI_LAN);
+
+  // Unlisted mediums rank last, and among them, by value.
+  store.SetMediumsByPriority({Medium::WIFI_LAN});
+  EXPECT_EQ(store.GetBest("ABCD")->medium, Medium::BLE);
+  EXPECT_EQ(store.GetBest("EFGH")->medium, Medium::WIFI_LAN);
+}
+
+TEST(DiscoveredEndpointStoreTest, RemovesEndpointsOfServiceId) {
+  DiscoveredEndpointStore<TestEndpoint> store;
+  store.SetMediumsByPriority({Medium::BLE, Medium::WIFI_LAN});
+  store.Put(MakeEndpoint("ABCD", Medium::BLE));
+  store.Put(MakeEndpoint("ABCD", Medium::WIFI_LAN, "other-service"));
+  store.Put(MakeEndpoint("EFGH", Medium::BLE));
+
+  store.RemoveServiceId(kServiceId);
+  EXPECT_FALSE(store.Contains("EFGH"));
+  EXPECT_EQ(store.GetBest("ABCD")->medium, Medium::WIFI_LAN);
+  EXPECT_THAT(store.GetEndpointIdsByMedium(Medium::BLE), IsEmpty());
+  EXPECT_THAT(store.GetEndpointIdsByServiceId(kServiceId), IsEmpty());
+  EXPECT_THAT(store.GetEndpointIdsByServiceId("other-service"),
+              UnorderedElementsAre("ABCD"));
+
+  store.RemoveServiceId("other-service");
+  store.RemoveServiceId("unknown-service");
+  EXPECT_FALSE(store.Contains("ABCD"));
+}
+
+TEST(DiscoveredEndpointStoreTest, IndexesByMediumAndServiceId) {
+  DiscoveredEndpointStore<TestEndpoint> store;
+  store.Put(MakeEndpoint("ABCD", Medium::BLE));
+  store.Put(MakeEndpoint("ABCD", Medium::WIFI_LAN));
+  store.Put(MakeEndpoint("EFGH", Medium::BLE, "other-service"));
+
+  EXPECT_THAT(store.GetEndpointIdsByMedium(Medium::BLE),
+              UnorderedElementsAre("ABCD", "EFGH"));
+  EXPECT_THAT(store.GetEndpointIdsByMedium(Medium::WIFI_LAN),
+              UnorderedElementsAre("ABCD"));
+  EXPECT_THAT(store.GetEndpointIdsByServiceId(kServiceId),
+              UnorderedElementsAre("ABCD"));
+
+  store.Remove("ABCD", Medium::BLE);
+  store.Remove("EFGH", Medium::BLE);
+  EXPECT_THAT(store.GetEndpointIdsByMedium(Medium::BLE), IsEmpty());
+  EXPECT_THAT(store.GetEndpointIdsByServiceId(kServiceId),
+              UnorderedElementsAre("ABCD"));
+  EXPECT_THAT(store.GetEndpointIdsByServiceId("other-service"), IsEmpty());
+
+  store.Clear();
+  EXPECT_THAT(store.GetEndpointIdsByMedium(Medium::WIFI_LAN), IsEmpty());
+  EXPECT_THAT(store.GetEndpointIdsByServiceId(kServiceId), IsEmpty());
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
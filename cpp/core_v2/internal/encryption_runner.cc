@@ -17,12 +17,16 @@
 #include <cinttypes>
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <utility>
 
+#include "core_v2/internal/buffer_pool.h"
 #include "platform_v2/base/base64_utils.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/exception.h"
 #include "platform_v2/public/cancelable_alarm.h"
 #include "platform_v2/public/logging.h"
+#include "platform_v2/public/system_clock.h"
 #include "securegcm/ukey2_handshake.h"
 #include "absl/strings/ascii.h"
 #include "absl/time/clock.h"
@@ -48,7 +52,20 @@ std::string ToHumanReadableString(const ByteArray& token) {
   return result;
 }
 
-bool HandleEncryptionSuccess(const std::string& endpoint_id,
+// Parses a UKEY2 message read from the channel, then gives its buffer back to
+// BufferPool::Default().
+securegcm::UKey2Handshake::ParseResult ParseHandshakeMessage(
+    securegcm::UKey2Handshake* ukey2, ByteArray bytes) {
+  std::string message(std::move(bytes));
+  securegcm::UKey2Handshake::ParseResult parse_result =
+      ukey2->ParseHandshakeMessage(message);
+  BufferPool::Default().Release(std::move(message));
+  return parse_result;
+}
+
+// start is when the handshake started.
+bool HandleEncryptionSuccess(ClientProxy* client,
+                             const std::string& endpoint_id, absl::Time start,
                              std::unique_ptr<securegcm::UKey2Handshake> ukey2,
                              const EncryptionRunner::ResultListener& listener) {
   std::unique_ptr<std::string> verification_string =
@@ -57,6 +74,9 @@ bool HandleEncryptionSuccess(const std::string& endpoint_id,
     return false;
   }
 
+  client->GetMetrics().handshake_time.Record(SystemClock::ElapsedRealtime() -
+                                             start);
+
   ByteArray raw_authentication_token(*verification_string);
 
   listener.on_success_cb(endpoint_id, std::move(ukey2),
@@ -89,6 +109,7 @@ class ServerRunnable final {
         listener_(std::move(listener)) {}
 
   void operator()() const {
+    absl::Time start = SystemClock::ElapsedRealtime();
     CancelableAlarm timeout_alarm(
         "EncryptionRunner.StartServer() timeout",
         [this]() { CancelableAlarmRunnable(client_, endpoint_id_, channel_); },
@@ -111,7 +132,7 @@ class ServerRunnable final {
     }
 
     securegcm::UKey2Handshake::ParseResult parse_result =
-        server->ParseHandshakeMessage(std::string(client_init.result()));
+        ParseHandshakeMessage(server.get(), std::move(client_init).result());
 
     // Java code throws a HandshakeException / AlertException.
     if (!parse_result.success) {
@@ -158,7 +179,7 @@ class ServerRunnable final {
     }
 
     parse_result =
-        server->ParseHandshakeMessage(std::string(client_finish.result()));
+        ParseHandshakeMessage(server.get(), std::move(client_finish).result());
 
     // Java code throws an AlertException or a HandshakeException.
     if (!parse_result.success) {
@@ -175,7 +196,8 @@ class ServerRunnable final {
 
     timeout_alarm.Cancel();
 
-    if (!HandleEncryptionSuccess(endpoint_id_, std::move(server), listener_)) {
+    if (!HandleEncryptionSuccess(client_, endpoint_id_, start,
+                                 std::move(server), listener_)) {
       LogException();
       HandleHandshakeOrIoException(&timeout_alarm);
       return;
@@ -224,6 +246,7 @@ class ClientRunnable final {
         listener_(std::move(listener)) {}
 
   void operator()() const {
+    absl::Time start = SystemClock::ElapsedRealtime();
     CancelableAlarm timeout_alarm(
         "EncryptionRunner.startClient() timeout",
         [this]() { CancelableAlarmRunnable(client_, endpoint_id_, channel_); },
@@ -270,7 +293,7 @@ class ClientRunnable final {
     }
 
     securegcm::UKey2Handshake::ParseResult parse_result =
-        crypto->ParseHandshakeMessage(std::string(server_init.result()));
+        ParseHandshakeMessage(crypto.get(), std::move(server_init).result());
 
     // Java code throws an AlertException or a HandshakeException.
     if (!parse_result.success) {
@@ -309,7 +332,8 @@ class ClientRunnable final {
 
     timeout_alarm.Cancel();
 
-    if (!HandleEncryptionSuccess(endpoint_id_, std::move(crypto), listener_)) {
+    if (!HandleEncryptionSuccess(client_, endpoint_id_, start,
+                                 std::move(crypto), listener_)) {
       LogException();
       HandleHandshakeOrIoException(&timeout_alarm);
       return;
@@ -16,8 +16,12 @@
 #define CORE_V2_INTERNAL_ENDPOINT_CHANNEL_H_
 
 #include <cstdint>
+#include <memory>
 #include <string>
 
+#include "core_v2/internal/link_monitor.h"
+#include "core_v2/internal/metrics.h"
+#include "core_v2/payload.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/exception.h"
 #include "platform_v2/public/mutex.h"
@@ -40,6 +44,13 @@ class EndpointChannel {
 
   virtual Exception Write(const ByteArray& data) = 0;  // throws Exception::IO
 
+  // Same, but concurrent writes are done in the order of their priority,
+  // rather than in the order they arrive.
+  // throws Exception::IO
+  virtual Exception Write(const ByteArray& data, Payload::Priority priority) {
+    return Write(data);
+  }
+
   // Closes this EndpointChannel, without tracking the closure in analytics.
   virtual void Close() = 0;
 
@@ -72,6 +83,27 @@ class EndpointChannel {
   // Returns the timestamp of the last read from this endpoint, or -1 if no
   // reads have occurred.
   virtual absl::Time GetLastReadTimestamp() const = 0;
+
+  // Returns the timestamp of the last write to this endpoint, or -1 if no
+  // writes have occurred.
+  virtual absl::Time GetLastWriteTimestamp() const = 0;
+
+  // Sets the metrics of the endpoint this EndpointChannel is connected to,
+  // that its traffic is recorded in from here on.
+  virtual void SetMetrics(std::shared_ptr<EndpointMetrics> metrics) = 0;
+
+  // Returns the LinkMonitor that tells whether this EndpointChannel still
+  // moves data, or null if it has none; it is then only given up on once
+  // reads time out.
+  virtual LinkMonitor* GetLinkMonitor() { return nullptr; }
+
+  // Writes a KeepAlive frame that asks to be acked, with the next sequence
+  // number of GetLinkMonitor(), at Payload::Priority::kInteractive. The
+  // LinkMonitor is told when the frame actually goes out, so that the round
+  // trip does not include the wait for the frames ahead of it.
+  // Only for EndpointChannels that have a LinkMonitor.
+  // throws Exception::IO
+  virtual Exception WritePing() { return {Exception::kFailed}; }
 };
 
 inline bool operator==(const EndpointChannel& lhs, const EndpointChannel& rhs) {
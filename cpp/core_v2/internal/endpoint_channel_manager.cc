@@ -80,6 +80,8 @@ std::shared_ptr<EndpointChannel> EndpointChannelManager::GetChannelForEndpoint(
 void EndpointChannelManager::SetActiveEndpointChannel(
     ClientProxy* client, const std::string& endpoint_id,
     std::unique_ptr<EndpointChannel> channel) {
+  channel->SetMetrics(client->GetMetrics().OnEndpointConnected(endpoint_id));
+
   // Update the channel first, then encrypt this new channel, if
   // crypto context is present.
   channel_state_.UpdateChannelForEndpoint(endpoint_id, std::move(channel));
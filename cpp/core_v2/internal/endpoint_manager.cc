@@ -14,15 +14,24 @@
 
 #include "core_v2/internal/endpoint_manager.h"
 
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <utility>
 
+#include "core_v2/internal/buffer_pool.h"
 #include "core_v2/internal/endpoint_channel.h"
+#include "core_v2/internal/internal_payload_factory.h"
+#include "core_v2/internal/link_monitor.h"
+#include "core_v2/internal/metrics.h"
 #include "core_v2/internal/offline_frames.h"
+#include "core_v2/internal/tracing.h"
 #include "platform_v2/base/exception.h"
 #include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/future.h"
 #include "platform_v2/public/logging.h"
 #include "proto/connections_enums.pb.h"
+#include "absl/time/time.h"
 
 namespace location {
 namespace nearby {
@@ -48,7 +57,8 @@ constexpr absl::Time EndpointManager::kInvalidTimestamp;
 void EndpointManager::EndpointChannelLoopRunnable(
     const std::string& runnable_name, ClientProxy* client,
     const std::string& endpoint_id, CountDownLatch* barrier,
-    std::function<ExceptionOr<bool>(EndpointChannel*)> handler) {
+    std::function<ExceptionOr<bool>(const std::shared_ptr<EndpointChannel>&)>
+        handler) {
   // EndpointChannelManager will not let multiple channels exist simultaneously
   // for the same endpoint_id; it will be closing "old" channels as new ones
   // come. (There will be a short overlap).
@@ -77,7 +87,7 @@ void EndpointManager::EndpointChannelLoopRunnable(
       break;
     }
 
-    ExceptionOr<bool> keep_using_channel = handler(channel.get());
+    ExceptionOr<bool> keep_using_channel = handler(channel);
 
     if (!keep_using_channel.ok()) {
       Exception exception = keep_using_channel.GetException();
@@ -119,6 +129,8 @@ ExceptionOr<bool> EndpointManager::HandleData(
   // super class will loop back around and try our luck in case there's been
   // a replacement for this endpoint since we last checked with the
   // EndpointChannelManager.
+  std::shared_ptr<EndpointMetrics> metrics =
+      client->GetMetrics().ForEndpoint(endpoint_id);
   while (true) {
     ExceptionOr<ByteArray> bytes = endpoint_channel->Read();
     if (!bytes.ok()) {
@@ -126,7 +138,13 @@ ExceptionOr<bool> EndpointManager::HandleData(
                  bytes.exception());
       return ExceptionOr<bool>(bytes.exception());
     }
-    ExceptionOr<OfflineFrame> wrapped_frame = parser::FromBytes(bytes.result());
+    ExceptionOr<OfflineFrame> wrapped_frame;
+    {
+      TraceSpan span("DecodeFrame");
+      wrapped_frame = parser::FromBytes(bytes.result());
+    }
+    // The frame has its own copy of everything in it.
+    BufferPool::Default().Release(std::string(std::move(bytes).result()));
     if (!wrapped_frame.ok()) {
       if (wrapped_frame.GetException().Raised(
               Exception::kInvalidProtocolBuffer)) {
@@ -149,7 +167,18 @@ ExceptionOr<bool> EndpointManager::HandleData(
       // report messages without handlers, except KEEP_ALIVE, which has
       // no explicit handler.
       if (frame_type == V1Frame::KEEP_ALIVE) {
-        NEARBY_LOG(INFO, "KeepAlive message for: id=%s", endpoint_id.c_str());
+        NEARBY_LOG_EVERY_N_SEC(INFO, 10, "KeepAlive message for: id=%s",
+                               endpoint_id.c_str());
+        const auto& keep_alive = frame.v1().keep_alive();
+        LinkMonitor* link_monitor = endpoint_channel->GetLinkMonitor();
+        if (link_monitor != nullptr && keep_alive.has_seq_num()) {
+          if (keep_alive.ack()) {
+            link_monitor->OnAckReceived(keep_alive.seq_num(),
+                                        SystemClock::ElapsedRealtime());
+          } else {
+            link_monitor->OnPingReceived(keep_alive.seq_num());
+          }
+        }
       } else if (frame_type == V1Frame::DISCONNECTION) {
         NEARBY_LOG(INFO, "Disconnect message for: id=%s", endpoint_id.c_str());
         endpoint_channel->Close();
@@ -160,13 +189,18 @@ ExceptionOr<bool> EndpointManager::HandleData(
       continue;
     }
 
+    absl::Time start = SystemClock::ElapsedRealtime();
     frame_processor->OnIncomingFrame(frame, endpoint_id, client,
                                      endpoint_channel->GetMedium());
+    if (metrics != nullptr) {
+      metrics->frame_processing_time.Record(SystemClock::ElapsedRealtime() -
+                                            start);
+    }
   }
 }
 
 ExceptionOr<bool> EndpointManager::HandleKeepAlive(
-    EndpointChannel* endpoint_channel) {
+    const std::shared_ptr<EndpointChannel>& endpoint_channel) {
   // Check if it has been too long since we received a frame from our
   // endpoint.
   auto last_read_time = endpoint_channel->GetLastReadTimestamp();
@@ -177,12 +211,29 @@ ExceptionOr<bool> EndpointManager::HandleKeepAlive(
     return ExceptionOr<bool>(false);
   }
 
-  // Attempt to send the KeepAlive frame over the endpoint channel - if the
-  // write fails, our super class will loop back around and try our luck again
-  // in case there's been a replacement for this endpoint.
-  Exception write_exception = endpoint_channel->Write(parser::ForKeepAlive());
-  if (!write_exception.Ok()) {
-    return ExceptionOr<bool>(write_exception);
+  LinkMonitor* link_monitor = endpoint_channel->GetLinkMonitor();
+  if (link_monitor != nullptr) {
+    return HandleKeepAlive(endpoint_channel, link_monitor);
+  }
+
+  // Any frame tells our endpoint that we are still here, so a KeepAlive frame
+  // is only needed once nothing else has been written for a while.
+  absl::Duration idle_time = SystemClock::ElapsedRealtime() -
+                            endpoint_channel->GetLastWriteTimestamp();
+  absl::Duration sleep_time = kKeepAliveWriteInterval;
+  if (idle_time < kKeepAliveWriteInterval) {
+    // Check again when the channel would have been idle for long enough.
+    sleep_time = kKeepAliveWriteInterval - idle_time;
+  } else {
+    // Attempt to send the KeepAlive frame over the endpoint channel - if the
+    // write fails, our super class will loop back around and try our luck
+    // again in case there's been a replacement for this endpoint.
+    // It is tiny, and must not be held up by bulk transfers for too long.
+    Exception write_exception = endpoint_channel->Write(
+        parser::ForKeepAlive(), Payload::Priority::kInteractive);
+    if (!write_exception.Ok()) {
+      return ExceptionOr<bool>(write_exception);
+    }
   }
 
   // We sleep as the very last step because we want to minimize the caching of
@@ -190,8 +241,7 @@ ExceptionOr<bool> EndpointManager::HandleKeepAlive(
   // switched out from under us in BandwidthUpgradeManager, our write will
   // trigger an erroneous write to the encryption context that will cascade
   // into all our remote endpoint's future reads failing.
-  Exception sleep_exception =
-      SystemClock::Sleep(EndpointManager::kKeepAliveWriteInterval);
+  Exception sleep_exception = SystemClock::Sleep(sleep_time);
   if (!sleep_exception.Ok()) {
     return ExceptionOr<bool>(sleep_exception);
   }
@@ -199,6 +249,87 @@ ExceptionOr<bool> EndpointManager::HandleKeepAlive(
   return ExceptionOr<bool>(true);
 }
 
+ExceptionOr<bool> EndpointManager::HandleKeepAlive(
+    const std::shared_ptr<EndpointChannel>& endpoint_channel,
+    LinkMonitor* link_monitor) {
+  // A link that stopped delivering is given up on within a few round trips,
+  // rather than once reads time out. Closing the channel fails the writes
+  // blocked on it, and our super class loops back around to pick up a
+  // replacement channel, or discards the endpoint if there is none. Our
+  // writes go through keep_alive_writers_, so that we get here again even
+  // while they are blocked.
+  absl::Time now = SystemClock::ElapsedRealtime();
+  if (link_monitor->IsStalled(now, endpoint_channel->GetLastReadTimestamp())) {
+    NEARBY_LOG(INFO, "Endpoint channel stalled; channel=%s; rtt=%s",
+               endpoint_channel->GetType().c_str(),
+               absl::FormatDuration(link_monitor->GetRtt()).c_str());
+    endpoint_channel->Close();
+    return ExceptionOr<bool>(Exception::kIo);
+  }
+
+  // Any frame tells our endpoint that we are still here, so a KeepAlive frame
+  // is only needed once nothing else has been written for a while, or to
+  // find out whether the link still delivers once nothing has been read for
+  // a while.
+  absl::Duration stall_timeout = link_monitor->GetStallTimeout();
+  // Wake up in time to notice a stall.
+  absl::Duration check_interval = stall_timeout / LinkMonitor::kStallRoundTrips;
+  absl::Duration idle_time = now - endpoint_channel->GetLastWriteTimestamp();
+  absl::Duration silent_time = now - endpoint_channel->GetLastReadTimestamp();
+  absl::Duration sleep_time = kKeepAliveWriteInterval;
+  if (idle_time < kKeepAliveWriteInterval &&
+      (silent_time < stall_timeout || link_monitor->IsPingInFlight())) {
+    sleep_time = kKeepAliveWriteInterval - idle_time;
+  } else if (!link_monitor->IsPingQueued()) {
+    // A ping still waiting to go out is enough.
+    Exception write_exception = WriteKeepAlive(
+        endpoint_channel,
+        [](EndpointChannel* channel) { return channel->WritePing(); },
+        check_interval);
+    if (!write_exception.Ok()) {
+      return ExceptionOr<bool>(write_exception);
+    }
+  }
+
+  // Ack KeepAlive frames of our endpoint as they come; their round trips must
+  // not include our sleep.
+  absl::optional<std::int32_t> owed_ack =
+      link_monitor->TakeOwedAck(std::min(sleep_time, check_interval));
+  if (owed_ack.has_value()) {
+    Exception write_exception = WriteKeepAlive(
+        endpoint_channel,
+        [seq_num = *owed_ack](EndpointChannel* channel) {
+          return channel->Write(parser::ForKeepAlive(seq_num, /*ack=*/true),
+                                Payload::Priority::kInteractive);
+        },
+        check_interval);
+    if (!write_exception.Ok()) {
+      return ExceptionOr<bool>(write_exception);
+    }
+  }
+
+  return ExceptionOr<bool>(true);
+}
+
+Exception EndpointManager::WriteKeepAlive(
+    std::shared_ptr<EndpointChannel> endpoint_channel,
+    std::function<Exception(EndpointChannel*)> write, absl::Duration timeout) {
+  Future<bool> written;
+  keep_alive_writers_.Execute(
+      [endpoint_channel, write = std::move(write), written]() mutable {
+        Exception write_exception = write(endpoint_channel.get());
+        if (write_exception.Ok()) {
+          written.Set(true);
+        } else {
+          written.SetException(write_exception);
+        }
+      });
+  written.Get(timeout);
+  // Still going; if it fails, the channel is found stalled, or fails reads.
+  if (!written.IsSet()) return {Exception::kSuccess};
+  return written.Get().GetException();
+}
+
 bool operator==(const EndpointManager::FrameProcessor& lhs,
                 const EndpointManager::FrameProcessor& rhs) {
   // We're comparing addresses because these objects are callbacks which need to
@@ -239,6 +370,7 @@ EndpointManager::~EndpointManager() {
   // should go last, since workers schedule jobs there even during shutdown.
   handlers_executor_.Shutdown();
   keep_alive_executor_.Shutdown();
+  keep_alive_writers_.Shutdown();
   NEARBY_LOG(INFO, "Bringing down control thread");
   serial_executor_.Shutdown();
   NEARBY_LOG(INFO, "EndpointManager is down");
@@ -345,9 +477,9 @@ void EndpointManager::RegisterEndpoint(ClientProxy* client,
   // Instead, we release() a pointer, and pass a raw pointer, which is copyalbe.
   // We ignore the risk of job not scheduled (and an associated risk of memory
   // leak), because this may only happen during service shutdown.
-  RunOnEndpointManagerThread([this, client, channel = channel.release(),
-                              &endpoint_id, &info, &options, &listener,
-                              &latch]() {
+  RunOnEndpointManagerThread(client, [this, client,
+                                      channel = channel.release(), &endpoint_id,
+                                      &info, &options, &listener, &latch]() {
     // Pass ownership of channel to EndpointChannelManager
     NEARBY_LOG(INFO, "Registering endpoint with channel manager: id=%s",
                endpoint_id.c_str());
@@ -371,8 +503,9 @@ void EndpointManager::RegisterEndpoint(ClientProxy* client,
         [this, client, endpoint_id, barrier = &endpoint_state.barrier]() {
           EndpointChannelLoopRunnable(
               "Read", client, endpoint_id, barrier,
-              [this, client, endpoint_id](EndpointChannel* channel) {
-                return HandleData(endpoint_id, client, channel);
+              [this, client, endpoint_id](
+                  const std::shared_ptr<EndpointChannel>& channel) {
+                return HandleData(endpoint_id, client, channel.get());
               });
         });
 
@@ -390,10 +523,11 @@ void EndpointManager::RegisterEndpoint(ClientProxy* client,
     // for the pong.
     StartEndpointKeepAliveManager([this, client, endpoint_id,
                                    barrier = &endpoint_state.barrier]() {
-      EndpointChannelLoopRunnable("KeepAliveManager", client, endpoint_id,
-                                  barrier, [this](EndpointChannel* channel) {
-                                    return HandleKeepAlive(channel);
-                                  });
+      EndpointChannelLoopRunnable(
+          "KeepAliveManager", client, endpoint_id, barrier,
+          [this](const std::shared_ptr<EndpointChannel>& channel) {
+            return HandleKeepAlive(channel);
+          });
     });
     NEARBY_LOG(INFO, "Workers started, notifying client; id=%s",
                endpoint_id.c_str());
@@ -409,7 +543,7 @@ void EndpointManager::RegisterEndpoint(ClientProxy* client,
 void EndpointManager::UnregisterEndpoint(ClientProxy* client,
                                          const std::string& endpoint_id) {
   CountDownLatch latch(1);
-  RunOnEndpointManagerThread([this, client, endpoint_id, &latch]() {
+  RunOnEndpointManagerThread(client, [this, client, endpoint_id, &latch]() {
     RemoveEndpoint(client, endpoint_id,
                    client->IsConnectedToEndpoint(endpoint_id));
     latch.CountDown();
@@ -422,7 +556,7 @@ void EndpointManager::UnregisterEndpoint(ClientProxy* client,
 // allow synchronous behavior here it will cause a live lock.
 void EndpointManager::DiscardEndpoint(ClientProxy* client,
                                       const std::string& endpoint_id) {
-  RunOnEndpointManagerThread([this, client, endpoint_id]() {
+  RunOnEndpointManagerThread(client, [this, client, endpoint_id]() {
     RemoveEndpoint(client, endpoint_id,
                    /*notify=*/
                    client->IsConnectedToEndpoint(endpoint_id));
@@ -433,12 +567,18 @@ std::vector<std::string> EndpointManager::SendPayloadChunk(
     const PayloadTransferFrame::PayloadHeader& payload_header,
     const PayloadTransferFrame::PayloadChunk& payload_chunk,
     const std::vector<std::string>& endpoint_ids) {
-  ByteArray bytes =
-      parser::ForDataPayloadTransfer(payload_header, payload_chunk);
+  ByteArray bytes;
+  {
+    TraceSpan span("EncodeFrame");
+    bytes = parser::ForDataPayloadTransfer(payload_header, payload_chunk);
+  }
 
-  return SendTransferFrameBytes(endpoint_ids, bytes, payload_header.id(),
-                                /*offset=*/payload_chunk.offset(),
-                                /*packet_type=*/"DATA");
+  std::vector<std::string> failed_endpoint_ids = SendTransferFrameBytes(
+      endpoint_ids, bytes, payload_header.id(),
+      /*offset=*/payload_chunk.offset(),
+      /*packet_type=*/"DATA", PriorityFromProto(payload_header.priority()));
+  BufferPool::Default().Release(std::string(std::move(bytes)));
+  return failed_endpoint_ids;
 }
 
 std::vector<std::string> EndpointManager::SendControlMessage(
@@ -447,9 +587,12 @@ std::vector<std::string> EndpointManager::SendControlMessage(
     const std::vector<std::string>& endpoint_ids) {
   ByteArray bytes = parser::ForControlPayloadTransfer(header, control);
 
+  // Control messages are tiny, and cancel or fail a transfer; they go ahead
+  // of data, whatever the priority of their payload.
   return SendTransferFrameBytes(endpoint_ids, bytes, header.id(),
                                 /*offset=*/control.offset(),
-                                /*packet_type=*/"CONTROL");
+                                /*packet_type=*/"CONTROL",
+                                Payload::Priority::kInteractive);
 }
 
 // @EndpointManagerThread
@@ -515,7 +658,7 @@ void EndpointManager::WaitForEndpointDisconnectionProcessing(
 std::vector<std::string> EndpointManager::SendTransferFrameBytes(
     const std::vector<std::string>& endpoint_ids, const ByteArray& bytes,
     std::int64_t payload_id, std::int64_t offset,
-    const std::string& packet_type) {
+    const std::string& packet_type, Payload::Priority priority) {
   std::vector<std::string> failed_endpoint_ids;
   for (const std::string& endpoint_id : endpoint_ids) {
     std::shared_ptr<EndpointChannel> channel =
@@ -524,16 +667,17 @@ std::vector<std::string> EndpointManager::SendTransferFrameBytes(
     if (channel == nullptr) {
       // We no longer know about this endpoint (it was either explicitly
       // unregistered, or a read/write error made us unregister it internally).
-      NEARBY_LOG(INFO, "Channel not available; id=%s", endpoint_id.c_str());
+      NEARBY_LOG_EVERY_N_SEC(INFO, 1, "Channel not available; id=%s",
+                             endpoint_id.c_str());
       failed_endpoint_ids.push_back(endpoint_id);
       continue;
     }
 
-    Exception write_exception = channel->Write(bytes);
+    Exception write_exception = channel->Write(bytes, priority);
     if (!write_exception.Ok()) {
       failed_endpoint_ids.push_back(endpoint_id);
-      NEARBY_LOG(INFO, "Failed to send packet; endpoint_id=%s",
-                 endpoint_id.c_str());
+      NEARBY_LOG_EVERY_N_SEC(INFO, 1, "Failed to send packet; endpoint_id=%s",
+                             endpoint_id.c_str());
       continue;
     }
   }
@@ -553,6 +697,12 @@ void EndpointManager::RunOnEndpointManagerThread(Runnable runnable) {
   serial_executor_.Execute(std::move(runnable));
 }
 
+void EndpointManager::RunOnEndpointManagerThread(ClientProxy* client,
+                                                 Runnable runnable) {
+  RunOnEndpointManagerThread(CountWhileQueued(
+      client->GetMetrics().endpoint_manager_queue, std::move(runnable)));
+}
+
 }  // namespace connections
 }  // namespace nearby
 }  // namespace location
@@ -16,12 +16,15 @@
 #define CORE_V2_INTERNAL_ENDPOINT_MANAGER_H_
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 
 #include "core_v2/internal/client_proxy.h"
 #include "core_v2/internal/endpoint_channel.h"
 #include "core_v2/internal/endpoint_channel_manager.h"
+#include "core_v2/internal/link_monitor.h"
 #include "core_v2/listeners.h"
+#include "core_v2/payload.h"
 #include "proto/connections/offline_wire_formats.pb.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/runnable.h"
@@ -46,9 +49,11 @@ namespace connections {
 //
 // The sending of outgoing payloads originates in
 // PayloadManager::SendPayload() before control is transferred over to
-// EndpointManager::SendPayloadChunk(). This work happens on one of three
+// EndpointManager::SendPayloadChunk(). This work happens on one of four
 // dedicated writer threads belonging to the PayloadManager. The writer thread
-// that is used depends on the Payload::Type.
+// that is used depends on the Payload::Type, except for interactive Payloads,
+// which have a writer thread of their own. Writers share the EndpointChannel
+// of an endpoint in the order of Payload::Priority.
 //
 // The EndpointManager has one dedicated reader thread for each registered
 // endpoint, and the receiving of every incoming payload (and its subsequent
@@ -154,7 +159,19 @@ class EndpointManager {
                                ClientProxy* client_proxy,
                                EndpointChannel* endpoint_channel);
 
-  ExceptionOr<bool> HandleKeepAlive(EndpointChannel* endpoint_channel);
+  ExceptionOr<bool> HandleKeepAlive(
+      const std::shared_ptr<EndpointChannel>& endpoint_channel);
+  // Same, for a channel that tells whether its link still delivers.
+  ExceptionOr<bool> HandleKeepAlive(
+      const std::shared_ptr<EndpointChannel>& endpoint_channel,
+      LinkMonitor* link_monitor);
+  // Runs write on keep_alive_writers_, so that a write held up by a dead link
+  // does not keep HandleKeepAlive() from noticing. Returns the result of
+  // write, or success if it is still going after timeout.
+  Exception WriteKeepAlive(
+      std::shared_ptr<EndpointChannel> endpoint_channel,
+      std::function<Exception(EndpointChannel*)> write,
+      absl::Duration timeout);
 
   // Waits for a given endpoint EndpointChannelLoopRunnable() workers to
   // terminate.
@@ -166,7 +183,8 @@ class EndpointManager {
   void EndpointChannelLoopRunnable(
       const std::string& runnable_name, ClientProxy* client_proxy,
       const std::string& endpoint_id, CountDownLatch* barrier,
-      std::function<ExceptionOr<bool>(EndpointChannel*)> handler);
+      std::function<ExceptionOr<bool>(const std::shared_ptr<EndpointChannel>&)>
+          handler);
 
   static void WaitForLatch(const std::string& method_name,
                            CountDownLatch* latch);
@@ -197,7 +215,8 @@ class EndpointManager {
   std::vector<std::string> SendTransferFrameBytes(
       const std::vector<std::string>& endpoint_ids,
       const ByteArray& payload_transfer_frame_bytes, std::int64_t payload_id,
-      std::int64_t offset, const std::string& packet_type);
+      std::int64_t offset, const std::string& packet_type,
+      Payload::Priority priority);
 
   // Executes data-handing jobs on a separate thread for each endpoint, on a
   // handlers_executor_.
@@ -213,6 +232,8 @@ class EndpointManager {
 
   // Executes all jobs sequentially, on a serial_executor_.
   void RunOnEndpointManagerThread(Runnable runnable);
+  // Same, for jobs of client; they are counted in its metrics while queued.
+  void RunOnEndpointManagerThread(ClientProxy* client, Runnable runnable);
 
   EndpointChannelManager* channel_manager_;
 
@@ -222,6 +243,8 @@ class EndpointManager {
   absl::flat_hash_map<std::string, EndpointState> endpoints_;
 
   MultiThreadExecutor keep_alive_executor_{kMaxConcurrentEndpoints};
+  // Writes the KeepAlive frames of keep_alive_executor_ workers.
+  MultiThreadExecutor keep_alive_writers_{kMaxConcurrentEndpoints};
   MultiThreadExecutor handlers_executor_{kMaxConcurrentEndpoints};
   SingleThreadExecutor serial_executor_;
 };
@@ -19,6 +19,7 @@
 
 #include "core_v2/internal/client_proxy.h"
 #include "core_v2/internal/endpoint_channel_manager.h"
+#include "core_v2/internal/link_monitor.h"
 #include "core_v2/internal/offline_frames.h"
 #include "core_v2/options.h"
 #include "platform_v2/base/byte_array.h"
@@ -26,6 +27,7 @@
 #include "platform_v2/public/count_down_latch.h"
 #include "platform_v2/public/logging.h"
 #include "platform_v2/public/pipe.h"
+#include "platform_v2/public/system_clock.h"
 #include "proto/connections_enums.pb.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -41,6 +43,7 @@ namespace {
 using ::location::nearby::proto::connections::DisconnectionReason;
 using ::location::nearby::proto::connections::Medium;
 using ::testing::_;
+using ::testing::AnyNumber;
 using ::testing::MockFunction;
 using ::testing::Return;
 using ::testing::StrictMock;
@@ -60,6 +63,11 @@ class MockEndpointChannel : public EndpointChannel {
   MOCK_METHOD(void, Pause, (), (override));
   MOCK_METHOD(void, Resume, (), (override));
   MOCK_METHOD(absl::Time, GetLastReadTimestamp, (), (const override));
+  MOCK_METHOD(absl::Time, GetLastWriteTimestamp, (), (const override));
+  MOCK_METHOD(void, SetMetrics, (std::shared_ptr<EndpointMetrics> metrics),
+              (override));
+  MOCK_METHOD(LinkMonitor*, GetLinkMonitor, (), (override));
+  MOCK_METHOD(Exception, WritePing, (), (override));
 
   bool IsClosed() const {
     absl::MutexLock lock(&mutex_);
@@ -102,6 +110,7 @@ class EndpointManagerTest : public ::testing::Test {
     EXPECT_CALL(*channel, GetMedium()).WillRepeatedly(Return(Medium::BLE));
     EXPECT_CALL(*channel, GetLastReadTimestamp())
         .WillRepeatedly(Return(start_time_));
+    EXPECT_CALL(*channel, GetLastWriteTimestamp()).Times(AnyNumber());
     EXPECT_CALL(mock_listener_.initiated_cb, Call).Times(1);
     em_.RegisterEndpoint(&client_, endpoint_id_, info_, options_,
                          std::move(channel), listener_);
@@ -252,6 +261,98 @@ TEST_F(EndpointManagerTest, SendControlMessageWorks) {
   NEARBY_LOG(INFO, "Will call destructors now");
 }
 
+TEST_F(EndpointManagerTest, KeepAliveIsNotSentWhileChannelIsBusy) {
+  auto endpoint_channel = std::make_unique<MockEndpointChannel>();
+  ON_CALL(*endpoint_channel, Read())
+      .WillByDefault([channel = endpoint_channel.get()]() {
+        absl::SleepFor(absl::Milliseconds(100));
+        if (channel->IsClosed()) return ExceptionOr<ByteArray>(Exception::kIo);
+        return ExceptionOr<ByteArray>(ByteArray{});
+      });
+  ON_CALL(*endpoint_channel, Close(_))
+      .WillByDefault(
+          [channel = endpoint_channel.get()](DisconnectionReason reason) {
+            channel->DoClose();
+          });
+  // Whenever KeepAlive worker looks, something has just been written.
+  ON_CALL(*endpoint_channel, GetLastWriteTimestamp())
+      .WillByDefault([]() { return SystemClock::ElapsedRealtime(); });
+  EXPECT_CALL(*endpoint_channel, Write(_)).Times(0);
+
+  RegisterEndpoint(std::move(endpoint_channel), false);
+  absl::SleepFor(absl::Milliseconds(200));
+  em_.UnregisterEndpoint(&client_, endpoint_id_);
+}
+
+TEST_F(EndpointManagerTest, KeepAliveIsAckedWithLinkMonitor) {
+  auto endpoint_channel = std::make_unique<MockEndpointChannel>();
+  LinkMonitor link_monitor;
+  ON_CALL(*endpoint_channel, GetLinkMonitor())
+      .WillByDefault(Return(&link_monitor));
+  EXPECT_CALL(*endpoint_channel, Read())
+      .WillOnce(Return(
+          ExceptionOr<ByteArray>(parser::ForKeepAlive(7, /*ack=*/false))))
+      .WillRepeatedly([channel = endpoint_channel.get()]() {
+        absl::SleepFor(absl::Milliseconds(100));
+        if (channel->IsClosed()) return ExceptionOr<ByteArray>(Exception::kIo);
+        return ExceptionOr<ByteArray>(ByteArray{});
+      });
+  ON_CALL(*endpoint_channel, Close(_))
+      .WillByDefault(
+          [channel = endpoint_channel.get()](DisconnectionReason reason) {
+            channel->DoClose();
+          });
+  EXPECT_CALL(*endpoint_channel, WritePing())
+      .WillRepeatedly(Return(Exception{Exception::kSuccess}));
+  CountDownLatch acked(1);
+  EXPECT_CALL(*endpoint_channel, Write(parser::ForKeepAlive(7, /*ack=*/true)))
+      .WillOnce([&acked](const ByteArray& data) {
+        acked.CountDown();
+        return Exception{Exception::kSuccess};
+      });
+
+  RegisterEndpoint(std::move(endpoint_channel), false);
+  EXPECT_TRUE(acked.Await(absl::Milliseconds(1000)).result());
+  em_.UnregisterEndpoint(&client_, endpoint_id_);
+}
+
+TEST_F(EndpointManagerTest, StalledChannelIsClosed) {
+  auto endpoint_channel = std::make_unique<MockEndpointChannel>();
+  absl::Time now = SystemClock::ElapsedRealtime();
+  start_time_ = now - absl::Seconds(10);
+  // A quick round trip gives the link the shortest stall timeout; the ping
+  // after it has gone unacked for longer, with nothing read since.
+  LinkMonitor link_monitor;
+  std::int32_t seq_num = link_monitor.OnPingQueued();
+  link_monitor.OnPingSent(seq_num, now - absl::Seconds(8));
+  link_monitor.OnAckReceived(seq_num,
+                             now - absl::Seconds(8) + absl::Milliseconds(10));
+  link_monitor.OnPingSent(link_monitor.OnPingQueued(), now - absl::Seconds(5));
+  ON_CALL(*endpoint_channel, GetLinkMonitor())
+      .WillByDefault(Return(&link_monitor));
+  ON_CALL(*endpoint_channel, Read())
+      .WillByDefault([channel = endpoint_channel.get()]() {
+        absl::SleepFor(absl::Milliseconds(100));
+        if (channel->IsClosed()) return ExceptionOr<ByteArray>(Exception::kIo);
+        return ExceptionOr<ByteArray>(ByteArray{});
+      });
+  CountDownLatch closed(1);
+  EXPECT_CALL(*endpoint_channel, Close())
+      .WillOnce([channel = endpoint_channel.get(), &closed]() {
+        channel->DoClose();
+        closed.CountDown();
+      });
+  ON_CALL(*endpoint_channel, Close(_))
+      .WillByDefault(
+          [channel = endpoint_channel.get()](DisconnectionReason reason) {
+            channel->DoClose();
+          });
+
+  RegisterEndpoint(std::move(endpoint_channel), false);
+  EXPECT_TRUE(closed.Await(absl::Milliseconds(1000)).result());
+  em_.UnregisterEndpoint(&client_, endpoint_id_);
+}
+
 }  // namespace
 }  // namespace connections
 }  // namespace nearby
@@ -19,7 +19,9 @@ namespace nearby {
 namespace connections {
 
 InternalPayload::InternalPayload(Payload payload)
-    : payload_(std::move(payload)), payload_id_(payload_.GetId()) {}
+    : payload_(std::move(payload)),
+      payload_id_(payload_.GetId()),
+      priority_(payload_.GetPriority()) {}
 
 Payload InternalPayload::ReleasePayload() {
   return std::move(payload_);
@@ -27,6 +29,8 @@ Payload InternalPayload::ReleasePayload() {
 
 Payload::Id InternalPayload::GetId() const { return payload_id_; }
 
+Payload::Priority InternalPayload::GetPriority() const { return priority_; }
+
 }  // namespace connections
 }  // namespace nearby
 }  // namespace location
@@ -40,6 +40,8 @@ class InternalPayload {
 
   Payload::Id GetId() const;
 
+  Payload::Priority GetPriority() const;
+
   // Returns the PayloadType of the Payload to which this object is bound.
   //
   // <p>Note that this is supposed to return the type from the OfflineFrame
@@ -86,6 +88,8 @@ class InternalPayload {
   // released to another owner during the lifetime of an incoming
   // InternalPayload.
   Payload::Id payload_id_;
+  // Cached for the same reason.
+  Payload::Priority priority_;
 };
 
 }  // namespace connections
@@ -17,6 +17,7 @@
 #include <cstdint>
 #include <memory>
 
+#include "core_v2/listeners.h"
 #include "core_v2/payload.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/exception.h"
@@ -25,6 +26,7 @@
 #include "platform_v2/public/mutex.h"
 #include "platform_v2/public/pipe.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
 
 namespace location {
 namespace nearby {
@@ -226,6 +228,61 @@ class IncomingFileInternalPayload : public InternalPayload {
   const std::int64_t total_size_;
 };
 
+// Passes the data of an incoming Payload to a sink, rather than collecting it.
+class IncomingSinkInternalPayload : public InternalPayload {
+ public:
+  IncomingSinkInternalPayload(
+      Payload payload, PayloadTransferFrame::PayloadHeader::PayloadType type,
+      std::int64_t total_size, IncomingPayloadSink sink)
+      : InternalPayload(std::move(payload)),
+        type_(type),
+        total_size_(total_size),
+        sink_(std::move(sink)) {}
+
+  PayloadTransferFrame::PayloadHeader::PayloadType GetType() const override {
+    return type_;
+  }
+
+  std::int64_t GetTotalSize() const override { return total_size_; }
+
+  ByteArray DetachNextChunk() override { return {}; }
+
+  Exception AttachNextChunk(const ByteArray& chunk) override {
+    PayloadChunkInfo info{
+        .payload_id = payload_id_,
+        .type = ToPayloadType(type_),
+        .priority = priority_,
+        .total_size = total_size_,
+        .offset = offset_,
+        .data = absl::string_view(chunk.data(), chunk.size()),
+        .is_last = chunk.Empty(),
+    };
+    offset_ += chunk.size();
+    sink_(info);
+    return {Exception::kSuccess};
+  }
+
+ private:
+  static Payload::Type ToPayloadType(
+      PayloadTransferFrame::PayloadHeader::PayloadType type) {
+    switch (type) {
+      case PayloadTransferFrame::PayloadHeader::BYTES:
+        return Payload::Type::kBytes;
+      case PayloadTransferFrame::PayloadHeader::FILE:
+        return Payload::Type::kFile;
+      case PayloadTransferFrame::PayloadHeader::STREAM:
+        return Payload::Type::kStream;
+      default:
+        return Payload::Type::kUnknown;
+    }
+  }
+
+  const PayloadTransferFrame::PayloadHeader::PayloadType type_;
+  const std::int64_t total_size_;
+  IncomingPayloadSink sink_;
+  std::int64_t offset_ = 0;
+};
+
 }  // namespace
 
 std::unique_ptr<InternalPayload> CreateOutgoingInternalPayload(
@@ -259,28 +316,32 @@ std::unique_ptr<InternalPayload> CreateIncomingInternalPayload(
   }
 
   const Payload::Id payload_id = frame.payload_header().id();
+  const Payload::Priority priority =
+      PriorityFromProto(frame.payload_header().priority());
   switch (frame.payload_header().type()) {
     case PayloadTransferFrame::PayloadHeader::BYTES: {
-      return absl::make_unique<BytesInternalPayload>(
-          Payload(payload_id, ByteArray(frame.payload_chunk().body())));
+      Payload payload(payload_id, ByteArray(frame.payload_chunk().body()));
+      payload.SetPriority(priority);
+      return absl::make_unique<BytesInternalPayload>(std::move(payload));
     }
 
     case PayloadTransferFrame::PayloadHeader::STREAM: {
       auto pipe = std::make_shared<Pipe>();
+      Payload payload(payload_id, [pipe]() -> InputStream& {
+        return pipe->GetInputStream();  // NOLINT
+      });
+      payload.SetPriority(priority);
 
       return absl::make_unique<IncomingStreamInternalPayload>(
-          Payload(payload_id,
-                  [pipe]() -> InputStream& {
-                    return pipe->GetInputStream();  // NOLINT
-                  }),
-          pipe->GetOutputStream());
+          std::move(payload), pipe->GetOutputStream());
     }
 
     case PayloadTransferFrame::PayloadHeader::FILE: {
       std::int64_t total_size = frame.payload_header().total_size();
+      Payload payload(payload_id, InputFile(payload_id, total_size));
+      payload.SetPriority(priority);
       return absl::make_unique<IncomingFileInternalPayload>(
-          Payload(payload_id, InputFile(payload_id, total_size)),
-          OutputFile(payload_id), total_size);
+          std::move(payload), OutputFile(payload_id), total_size);
     }
     default:
       DCHECK(false);  // This should never happen.
@@ -288,6 +349,54 @@ std::unique_ptr<InternalPayload> CreateIncomingInternalPayload(
   }
 }
 
+std::unique_ptr<InternalPayload> CreateIncomingInternalPayload(
+    const PayloadTransferFrame& frame, IncomingPayloadSink sink) {
+  if (frame.packet_type() != PayloadTransferFrame::DATA) {
+    return {};
+  }
+
+  const PayloadTransferFrame::PayloadHeader& header = frame.payload_header();
+  switch (header.type()) {
+    case PayloadTransferFrame::PayloadHeader::BYTES:
+    case PayloadTransferFrame::PayloadHeader::STREAM:
+    case PayloadTransferFrame::PayloadHeader::FILE: {
+      // Only carries the id and priority; the data goes to sink.
+      Payload payload(header.id(), ByteArray());
+      payload.SetPriority(PriorityFromProto(header.priority()));
+      return absl::make_unique<IncomingSinkInternalPayload>(
+          std::move(payload), header.type(), header.total_size(),
+          std::move(sink));
+    }
+    default:
+      return {};
+  }
+}
+
+PayloadTransferFrame::PayloadHeader::PayloadPriority PriorityToProto(
+    Payload::Priority priority) {
+  switch (priority) {
+    case Payload::Priority::kInteractive:
+      return PayloadTransferFrame::PayloadHeader::INTERACTIVE;
+    case Payload::Priority::kBulk:
+      return PayloadTransferFrame::PayloadHeader::BULK;
+    case Payload::Priority::kNormal:
+    default:
+      return PayloadTransferFrame::PayloadHeader::NORMAL;
+  }
+}
+
+Payload::Priority PriorityFromProto(
+    PayloadTransferFrame::PayloadHeader::PayloadPriority priority) {
+  switch (priority) {
+    case PayloadTransferFrame::PayloadHeader::INTERACTIVE:
+      return Payload::Priority::kInteractive;
+    case PayloadTransferFrame::PayloadHeader::BULK:
+      return Payload::Priority::kBulk;
+    default:
+      return Payload::Priority::kNormal;
+  }
+}
+
 }  // namespace connections
 }  // namespace nearby
 }  // namespace location
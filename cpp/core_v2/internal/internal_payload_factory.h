@@ -15,7 +15,11 @@
 #ifndef CORE_V2_INTERNAL_INTERNAL_PAYLOAD_FACTORY_H_
 #define CORE_V2_INTERNAL_INTERNAL_PAYLOAD_FACTORY_H_
 
+#include <functional>
+#include <memory>
+
 #include "core_v2/internal/internal_payload.h"
+#include "core_v2/listeners.h"
 #include "core_v2/payload.h"
 #include "proto/connections/offline_wire_formats.pb.h"
 
@@ -31,6 +35,20 @@ std::unique_ptr<InternalPayload> CreateOutgoingInternalPayload(Payload payload);
 std::unique_ptr<InternalPayload> CreateIncomingInternalPayload(
     const PayloadTransferFrame& frame);
 
+// Receives the chunks of an incoming Payload, as they are attached.
+using IncomingPayloadSink = std::function<void(const PayloadChunkInfo& chunk)>;
+
+// Same, but the data of the Payload is passed to sink, chunk by chunk, rather
+// than collected; the Payload of the InternalPayload has no content.
+std::unique_ptr<InternalPayload> CreateIncomingInternalPayload(
+    const PayloadTransferFrame& frame, IncomingPayloadSink sink);
+
+// Converts between Payload priorities and their wire format.
+PayloadTransferFrame::PayloadHeader::PayloadPriority PriorityToProto(
+    Payload::Priority priority);
+Payload::Priority PriorityFromProto(
+    PayloadTransferFrame::PayloadHeader::PayloadPriority priority);
+
 }  // namespace connections
 }  // namespace nearby
 }  // namespace location
@@ -14,6 +14,9 @@
 
 #include "core_v2/internal/internal_payload_factory.h"
 
+#include <string>
+#include <vector>
+
 #include "core_v2/internal/offline_frames.h"
 #include "proto/connections/offline_wire_formats.pb.h"
 #include "platform_v2/base/byte_array.h"
@@ -124,6 +127,46 @@ TEST(InternalPayloadFActoryTest, CanCreateIternalPayloadFromFileMessage) {
   EXPECT_EQ(payload.GetId(), payload.AsFile()->GetPayloadId());
 }
 
+TEST(InternalPayloadFActoryTest, CanCreateIternalPayloadWithSink) {
+  PayloadTransferFrame frame;
+  frame.set_packet_type(PayloadTransferFrame::DATA);
+  auto& header = *frame.mutable_payload_header();
+  header.set_type(PayloadTransferFrame::PayloadHeader::FILE);
+  header.set_id(12345);
+  header.set_total_size(5);
+  header.set_priority(PayloadTransferFrame::PayloadHeader::BULK);
+  std::vector<PayloadChunkInfo> chunks;
+  std::string data;
+  std::unique_ptr<InternalPayload> internal_payload =
+      CreateIncomingInternalPayload(
+          frame, [&chunks, &data](const PayloadChunkInfo& chunk) {
+            chunks.push_back(chunk);
+            data.append(chunk.data.data(), chunk.data.size());
+          });
+  ASSERT_NE(internal_payload, nullptr);
+  EXPECT_EQ(internal_payload->GetType(),
+            PayloadTransferFrame::PayloadHeader::FILE);
+  EXPECT_EQ(internal_payload->GetPriority(), Payload::Priority::kBulk);
+
+  EXPECT_TRUE(internal_payload->AttachNextChunk(ByteArray("abc")).Ok());
+  EXPECT_TRUE(internal_payload->AttachNextChunk(ByteArray("de")).Ok());
+  EXPECT_TRUE(internal_payload->AttachNextChunk(ByteArray()).Ok());
+
+  ASSERT_EQ(chunks.size(), 3u);
+  EXPECT_EQ(data, "abcde");
+  EXPECT_EQ(chunks[0].payload_id, 12345);
+  EXPECT_EQ(chunks[0].type, Payload::Type::kFile);
+  EXPECT_EQ(chunks[0].priority, Payload::Priority::kBulk);
+  EXPECT_EQ(chunks[0].total_size, 5);
+  EXPECT_EQ(chunks[0].offset, 0);
+  EXPECT_EQ(chunks[1].offset, 3);
+  EXPECT_FALSE(chunks[1].is_last);
+  EXPECT_EQ(chunks[2].offset, 5);
+  EXPECT_TRUE(chunks[2].is_last);
+  // No data is kept.
+  EXPECT_EQ(internal_payload->ReleasePayload().AsBytes(), ByteArray());
+}
+
 }  // namespace
 }  // namespace connections
 }  // namespace nearby
@@ -0,0 +1,83 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/keyed_executor.h"
+
+#include <utility>
+
+#include "platform_v2/public/logging.h"
+#include "platform_v2/public/mutex_lock.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+namespace {
+// Executor whose task the current thread is running, if any.
+thread_local const KeyedExecutor* current_executor = nullptr;
+}  // namespace
+
+KeyedExecutor::KeyedExecutor(int max_parallelism)
+    : executor_(max_parallelism) {}
+
+KeyedExecutor::~KeyedExecutor() { Shutdown(); }
+
+void KeyedExecutor::Execute(const std::string& key, Runnable&& runnable) {
+  MutexLock lock(&mutex_);
+  if (shutdown_) return;
+  std::deque<Runnable>& queue = queues_[key];
+  queue.push_back(std::move(runnable));
+  // Otherwise, the key is scheduled already.
+  if (queue.size() == 1) executor_.Execute([this, key]() { RunNext(key); });
+}
+
+void KeyedExecutor::Shutdown() {
+  if (IsRunningTask()) {
+    NEARBY_LOG(FATAL, "KeyedExecutor shut down from one of its tasks");
+  }
+  {
+    MutexLock lock(&mutex_);
+    shutdown_ = true;
+    while (!queues_.empty()) idle_.Wait();
+  }
+  executor_.Shutdown();
+}
+
+void KeyedExecutor::RunNext(const std::string& key) {
+  Runnable runnable;
+  {
+    MutexLock lock(&mutex_);
+    runnable = std::move(queues_[key].front());
+  }
+  const KeyedExecutor* previous_executor = current_executor;
+  current_executor = this;
+  runnable();
+  current_executor = previous_executor;
+
+  MutexLock lock(&mutex_);
+  auto item = queues_.find(key);
+  item->second.pop_front();
+  if (!item->second.empty()) {
+    executor_.Execute([this, key]() { RunNext(key); });
+    return;
+  }
+  queues_.erase(item);
+  if (queues_.empty()) idle_.Notify();
+}
+
+bool KeyedExecutor::IsRunningTask() const { return current_executor == this; }
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,77 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_V2_INTERNAL_KEYED_EXECUTOR_H_
+#define CORE_V2_INTERNAL_KEYED_EXECUTOR_H_
+
+#include <deque>
+#include <string>
+
+#include "platform_v2/base/runnable.h"
+#include "platform_v2/public/condition_variable.h"
+#include "platform_v2/public/multi_thread_executor.h"
+#include "platform_v2/public/mutex.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+// Runs tasks on a fixed number of threads. Tasks of the same key run one at a
+// time, in the order they were submitted; tasks of different keys may run
+// concurrently, so a slow task only holds up tasks of its own key.
+//
+// A key with more tasks waiting goes to the back of the line after each of
+// them, so that a busy key does not starve the others.
+class KeyedExecutor {
+ public:
+  explicit KeyedExecutor(int max_parallelism);
+  // Calls Shutdown().
+  ~KeyedExecutor();
+  KeyedExecutor(const KeyedExecutor&) = delete;
+  KeyedExecutor& operator=(const KeyedExecutor&) = delete;
+
+  // Schedules runnable after all the earlier tasks of key.
+  // Does nothing after Shutdown().
+  void Execute(const std::string& key, Runnable&& runnable)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Waits for all the tasks submitted so far to run, and stops accepting new
+  // ones. Must not be called from a task, since that task would wait for
+  // itself; doing so is fatal.
+  void Shutdown() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns true if called from a task of this executor.
+  bool IsRunningTask() const;
+
+ private:
+  // Runs the first task of key, and schedules the next one, if any.
+  void RunNext(const std::string& key) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  Mutex mutex_;
+  // Signaled when queues_ becomes empty.
+  ConditionVariable idle_{&mutex_};
+  bool shutdown_ ABSL_GUARDED_BY(mutex_) = false;
+  // Tasks of each key that has any; the first one is running, or about to.
+  absl::flat_hash_map<std::string, std::deque<Runnable>> queues_
+      ABSL_GUARDED_BY(mutex_);
+  MultiThreadExecutor executor_;
+};
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+#endif  // CORE_V2_INTERNAL_KEYED_EXECUTOR_H_
@@ -0,0 +1,128 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/keyed_executor.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/mutex.h"
+#include "platform_v2/public/mutex_lock.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+TEST(KeyedExecutorTest, RunsTasksOfOneKeyInOrder) {
+  constexpr int kTasks = 1000;
+  Mutex mutex;
+  std::vector<int> order;
+  {
+    KeyedExecutor executor(4);
+    for (int i = 0; i < kTasks; i++) {
+      executor.Execute("A", [&mutex, &order, i]() {
+        MutexLock lock(&mutex);
+        order.push_back(i);
+      });
+    }
+  }
+
+  ASSERT_EQ(order.size(), kTasks);
+  for (int i = 0; i < kTasks; i++) EXPECT_EQ(order[i], i);
+}
+
+TEST(KeyedExecutorTest, RunsTasksOfOneKeyOneAtATime) {
+  constexpr int kTasks = 100;
+  std::atomic_int running{0};
+  std::atomic_int max_running{0};
+  {
+    KeyedExecutor executor(4);
+    for (int i = 0; i < kTasks; i++) {
+      executor.Execute("A", [&running, &max_running]() {
+        int now = ++running;
+        if (now > max_running) max_running = now;
+        --running;
+      });
+    }
+  }
+
+  EXPECT_EQ(max_running, 1);
+}
+
+TEST(KeyedExecutorTest, SlowKeyDoesNotBlockOthers) {
+  CountDownLatch release(1);
+  CountDownLatch done(1);
+  KeyedExecutor executor(2);
+
+  executor.Execute("slow", [&release]() { release.Await(); });
+  executor.Execute("fast", [&done]() { done.CountDown(); });
+
+  EXPECT_TRUE(done.Await(absl::Seconds(1)).result());
+  release.CountDown();
+}
+
+TEST(KeyedExecutorTest, ShutdownRunsPendingTasksAndDropsLaterOnes) {
+  std::atomic_int runs{0};
+  KeyedExecutor executor(1);
+  for (int i = 0; i < 10; i++) {
+    executor.Execute(std::to_string(i % 3), [&runs]() { runs++; });
+  }
+
+  executor.Shutdown();
+  executor.Execute("A", [&runs]() { runs++; });
+
+  EXPECT_EQ(runs, 10);
+}
+
+TEST(KeyedExecutorTest, KnowsWhetherItRunsTheCaller) {
+  KeyedExecutor executor(2);
+  KeyedExecutor other(1);
+  CountDownLatch done(1);
+  bool running_task = false;
+  bool running_other_task = true;
+  executor.Execute("A", [&]() {
+    running_task = executor.IsRunningTask();
+    running_other_task = other.IsRunningTask();
+    done.CountDown();
+  });
+  ASSERT_TRUE(done.Await(absl::Seconds(1)).result());
+
+  EXPECT_TRUE(running_task);
+  EXPECT_FALSE(running_other_task);
+  EXPECT_FALSE(executor.IsRunningTask());
+}
+
+TEST(KeyedExecutorTest, ShutdownFromTaskIsFatal) {
+  ASSERT_DEATH(
+      {
+        KeyedExecutor executor(1);
+        CountDownLatch done(1);
+        executor.Execute("A", [&]() {
+          executor.Shutdown();
+          done.CountDown();
+        });
+        done.Await(absl::Seconds(1));
+      },
+      "");
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,189 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/link_monitor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "platform_v2/public/mutex_lock.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+constexpr absl::Duration LinkMonitor::kMinStallTimeout;
+constexpr absl::Duration LinkMonitor::kMaxStallTimeout;
+constexpr int LinkMonitor::kStallRoundTrips;
+constexpr absl::Duration LinkMonitor::kMinBlockedWriteTime;
+constexpr absl::Duration LinkMonitor::kThroughputWindow;
+constexpr double LinkMonitor::kDegradedThroughputRatio;
+constexpr absl::Duration LinkMonitor::kPeakThroughputHalfLife;
+
+std::int32_t LinkMonitor::OnPingQueued() {
+  MutexLock lock(&mutex_);
+  ping_queued_ = true;
+  return ++last_ping_seq_num_;
+}
+
+void LinkMonitor::OnPingSent(std::int32_t seq_num, absl::Time now) {
+  MutexLock lock(&mutex_);
+  // A later ping was queued meanwhile; that one is timed instead.
+  if (seq_num != last_ping_seq_num_) return;
+  ping_queued_ = false;
+  last_ping_time_ = now;
+  first_unacked_ping_time_ = std::min(first_unacked_ping_time_, now);
+}
+
+void LinkMonitor::OnPingFailed(std::int32_t seq_num) {
+  MutexLock lock(&mutex_);
+  if (seq_num == last_ping_seq_num_) ping_queued_ = false;
+}
+
+void LinkMonitor::OnAckReceived(std::int32_t seq_num, absl::Time now) {
+  MutexLock lock(&mutex_);
+  // Acks of earlier pings are late; their round trip would look too long.
+  if (seq_num != last_ping_seq_num_ ||
+      first_unacked_ping_time_ == absl::InfiniteFuture()) {
+    return;
+  }
+  first_unacked_ping_time_ = absl::InfiniteFuture();
+  absl::Duration rtt = now - last_ping_time_;
+  if (!has_rtt_) {
+    has_rtt_ = true;
+    smoothed_rtt_ = rtt;
+    rtt_variation_ = rtt / 2;
+  } else {
+    rtt_variation_ =
+        (3 * rtt_variation_ + absl::AbsDuration(smoothed_rtt_ - rtt)) / 4;
+    smoothed_rtt_ = (7 * smoothed_rtt_ + rtt) / 8;
+  }
+}
+
+bool LinkMonitor::IsPingQueued() const {
+  MutexLock lock(&mutex_);
+  return ping_queued_;
+}
+
+bool LinkMonitor::IsPingInFlight() const {
+  MutexLock lock(&mutex_);
+  return first_unacked_ping_time_ != absl::InfiniteFuture();
+}
+
+void LinkMonitor::OnPingReceived(std::int32_t seq_num) {
+  MutexLock lock(&mutex_);
+  owed_ack_ = seq_num;
+  ack_owed_.Notify();
+}
+
+absl::optional<std::int32_t> LinkMonitor::TakeOwedAck(absl::Duration timeout) {
+  MutexLock lock(&mutex_);
+  if (!owed_ack_.has_value() && timeout > absl::ZeroDuration()) {
+    ack_owed_.Wait(timeout);
+  }
+  absl::optional<std::int32_t> owed_ack = owed_ack_;
+  owed_ack_.reset();
+  return owed_ack;
+}
+
+void LinkMonitor::OnWriteStarted(std::size_t size, absl::Time now) {
+  MutexLock lock(&mutex_);
+  write_start_time_ = now;
+  write_size_ = size;
+}
+
+void LinkMonitor::OnWriteFinished(absl::Time now) {
+  MutexLock lock(&mutex_);
+  absl::Duration duration = now - write_start_time_;
+  write_start_time_ = absl::InfiniteFuture();
+  if (duration < kMinBlockedWriteTime) return;
+  window_size_ += write_size_;
+  window_time_ += duration;
+  if (window_time_ < kThroughputWindow) return;
+  double throughput = window_size_ / absl::ToDoubleSeconds(window_time_);
+  window_size_ = 0;
+  window_time_ = absl::ZeroDuration();
+  throughput_ =
+      throughput_ == 0 ? throughput : (7 * throughput_ + throughput) / 8;
+  peak_throughput_ = std::max(GetPeakThroughputLocked(now), throughput_);
+  peak_throughput_time_ = now;
+}
+
+absl::Duration LinkMonitor::GetRtt() const {
+  MutexLock lock(&mutex_);
+  return has_rtt_ ? smoothed_rtt_ : absl::InfiniteDuration();
+}
+
+double LinkMonitor::GetThroughput() const {
+  MutexLock lock(&mutex_);
+  return throughput_;
+}
+
+double LinkMonitor::GetPeakThroughput(absl::Time now) const {
+  MutexLock lock(&mutex_);
+  return GetPeakThroughputLocked(now);
+}
+
+double LinkMonitor::GetPeakThroughputLocked(absl::Time now) const {
+  if (now <= peak_throughput_time_) return peak_throughput_;
+  return peak_throughput_ *
+         std::exp2(-absl::FDivDuration(now - peak_throughput_time_,
+                                       kPeakThroughputHalfLife));
+}
+
+absl::Duration LinkMonitor::GetStallTimeout() const {
+  MutexLock lock(&mutex_);
+  return GetStallTimeoutLocked();
+}
+
+absl::Duration LinkMonitor::GetStallTimeoutLocked() const {
+  if (!has_rtt_) return kMaxStallTimeout;
+  absl::Duration timeout =
+      kStallRoundTrips * (smoothed_rtt_ + 4 * rtt_variation_);
+  return std::min(std::max(timeout, kMinStallTimeout), kMaxStallTimeout);
+}
+
+bool LinkMonitor::IsStalled(absl::Time now, absl::Time last_read) const {
+  MutexLock lock(&mutex_);
+  return IsStalledLocked(now, last_read, GetStallTimeoutLocked());
+}
+
+bool LinkMonitor::IsDegraded(absl::Time now, absl::Time last_read) const {
+  MutexLock lock(&mutex_);
+  if (throughput_ < kDegradedThroughputRatio * GetPeakThroughputLocked(now)) {
+    return true;
+  }
+  return IsStalledLocked(now, last_read, GetStallTimeoutLocked() / 2);
+}
+
+bool LinkMonitor::IsStalledLocked(absl::Time now, absl::Time last_read,
+                                  absl::Duration timeout) const {
+  if (first_unacked_ping_time_ != absl::InfiniteFuture() &&
+      last_read < first_unacked_ping_time_ &&
+      now - first_unacked_ping_time_ > timeout) {
+    return true;
+  }
+  if (write_start_time_ != absl::InfiniteFuture()) {
+    // Give the write twice the time its size takes at the usual throughput.
+    absl::Duration transfer_time =
+        throughput_ > 0 ? absl::Seconds(2 * write_size_ / throughput_)
+                        : kMaxStallTimeout;
+    if (now - write_start_time_ > timeout + transfer_time) return true;
+  }
+  return false;
+}
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,155 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_V2_INTERNAL_LINK_MONITOR_H_
+#define CORE_V2_INTERNAL_LINK_MONITOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "platform_v2/public/condition_variable.h"
+#include "platform_v2/public/mutex.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+// Tells whether the link under an EndpointChannel still moves data, from the
+// round trips of KeepAlive frames, and from how long writes that block take
+// for their size. A link that has not delivered for a few round trips is
+// stalled; that is found out much sooner than by waiting for reads to time
+// out.
+//
+// Until the remote endpoint has acked a KeepAlive frame (older ones never
+// do), the link is given kMaxStallTimeout.
+//
+// Thread-safe.
+class LinkMonitor {
+ public:
+  // Bounds of GetStallTimeout().
+  static constexpr absl::Duration kMinStallTimeout = absl::Seconds(2);
+  static constexpr absl::Duration kMaxStallTimeout = absl::Seconds(30);
+  // Round trips a link may go without delivering before it is stalled.
+  static constexpr int kStallRoundTrips = 4;
+  // A write that returns sooner went into the buffers of the link, not over
+  // it; it tells nothing about throughput.
+  static constexpr absl::Duration kMinBlockedWriteTime = absl::Milliseconds(1);
+  // Throughput is sampled once writes have blocked for this long in all, so
+  // that one write does not make a sample.
+  static constexpr absl::Duration kThroughputWindow = absl::Milliseconds(100);
+  // A link that writes at less than this fraction of its peak throughput has
+  // degraded.
+  static constexpr double kDegradedThroughputRatio = 0.25;
+  // The peak throughput halves over this time, unless the link reaches it
+  // again, so that a link is judged against what it does lately.
+  static constexpr absl::Duration kPeakThroughputHalfLife = absl::Seconds(30);
+
+  // Called when a KeepAlive frame that asks to be acked is handed to the
+  // link. Returns the sequence number to send in it.
+  std::int32_t OnPingQueued() ABSL_LOCKS_EXCLUDED(mutex_);
+  // Called when the KeepAlive frame seq_num actually goes out, after the
+  // frames let through ahead of it; its round trip is timed from here.
+  void OnPingSent(std::int32_t seq_num, absl::Time now)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  // Called when the KeepAlive frame seq_num could not be written.
+  void OnPingFailed(std::int32_t seq_num) ABSL_LOCKS_EXCLUDED(mutex_);
+  // Called when the remote endpoint acks the KeepAlive frame seq_num.
+  void OnAckReceived(std::int32_t seq_num, absl::Time now)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  // Returns true if a KeepAlive frame was queued, and has not gone out yet.
+  bool IsPingQueued() const ABSL_LOCKS_EXCLUDED(mutex_);
+  bool IsPingInFlight() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Called when the remote endpoint asks to ack its KeepAlive frame seq_num.
+  void OnPingReceived(std::int32_t seq_num) ABSL_LOCKS_EXCLUDED(mutex_);
+  // Waits for up to timeout for an ack to be owed to the remote endpoint.
+  // Returns the sequence number to ack, if one is owed.
+  absl::optional<std::int32_t> TakeOwedAck(absl::Duration timeout)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Called around every write of size bytes to the link.
+  void OnWriteStarted(std::size_t size, absl::Time now)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  void OnWriteFinished(absl::Time now) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Smoothed round trip time; InfiniteDuration() until the first ack.
+  absl::Duration GetRtt() const ABSL_LOCKS_EXCLUDED(mutex_);
+  // Smoothed throughput of writes that blocked, in bytes per second; 0 until
+  // known.
+  double GetThroughput() const ABSL_LOCKS_EXCLUDED(mutex_);
+  // Highest smoothed write throughput lately, in bytes per second.
+  double GetPeakThroughput(absl::Time now) const ABSL_LOCKS_EXCLUDED(mutex_);
+  // How long the link may go without delivering before it is stalled.
+  absl::Duration GetStallTimeout() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns true if a KeepAlive frame has gone unacked, with nothing read
+  // since it was sent, or if a write is taking much longer than its size
+  // accounts for; for longer than GetStallTimeout().
+  bool IsStalled(absl::Time now, absl::Time last_read) const
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns true if the throughput of the link collapsed, or if the link is
+  // half way to IsStalled(). The link still works, but is worth moving off
+  // while it does.
+  bool IsDegraded(absl::Time now, absl::Time last_read) const
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  absl::Duration GetStallTimeoutLocked() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  double GetPeakThroughputLocked(absl::Time now) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool IsStalledLocked(absl::Time now, absl::Time last_read,
+                       absl::Duration timeout) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  mutable Mutex mutex_;
+  ConditionVariable ack_owed_{&mutex_};
+
+  // Round trip time estimate, as in RFC 6298.
+  bool has_rtt_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::Duration smoothed_rtt_ ABSL_GUARDED_BY(mutex_);
+  absl::Duration rtt_variation_ ABSL_GUARDED_BY(mutex_);
+
+  std::int32_t last_ping_seq_num_ ABSL_GUARDED_BY(mutex_) = 0;
+  // True from OnPingQueued() until the ping goes out, or fails to.
+  bool ping_queued_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::Time last_ping_time_ ABSL_GUARDED_BY(mutex_);
+  // Time of the first ping not acked since, or InfiniteFuture() if none.
+  absl::Time first_unacked_ping_time_ ABSL_GUARDED_BY(mutex_) =
+      absl::InfiniteFuture();
+
+  absl::optional<std::int32_t> owed_ack_ ABSL_GUARDED_BY(mutex_);
+
+  double throughput_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Peak throughput as of peak_throughput_time_; decays from there.
+  double peak_throughput_ ABSL_GUARDED_BY(mutex_) = 0;
+  absl::Time peak_throughput_time_ ABSL_GUARDED_BY(mutex_);
+  // Start of the write in progress, or InfiniteFuture() if none.
+  absl::Time write_start_time_ ABSL_GUARDED_BY(mutex_) =
+      absl::InfiniteFuture();
+  std::size_t write_size_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Bytes and time of the writes that blocked since the last sample.
+  std::size_t window_size_ ABSL_GUARDED_BY(mutex_) = 0;
+  absl::Duration window_time_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+#endif  // CORE_V2_INTERNAL_LINK_MONITOR_H_
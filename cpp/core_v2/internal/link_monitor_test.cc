@@ -0,0 +1,290 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/link_monitor.h"
+
+#include "platform_v2/public/single_thread_executor.h"
+#include "gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+constexpr absl::Time kStart = absl::UnixEpoch();
+
+// Queues a ping, which goes out at now right away.
+std::int32_t SendPing(LinkMonitor& monitor, absl::Time now) {
+  std::int32_t seq_num = monitor.OnPingQueued();
+  monitor.OnPingSent(seq_num, now);
+  return seq_num;
+}
+
+TEST(LinkMonitorTest, StallTimeoutIsMaxUntilFirstAck) {
+  LinkMonitor monitor;
+
+  EXPECT_EQ(monitor.GetRtt(), absl::InfiniteDuration());
+  EXPECT_EQ(monitor.GetStallTimeout(), LinkMonitor::kMaxStallTimeout);
+}
+
+TEST(LinkMonitorTest, StallTimeoutFollowsRtt) {
+  LinkMonitor monitor;
+  absl::Time now = kStart;
+  for (int i = 0; i < 20; i++) {
+    std::int32_t seq_num = SendPing(monitor, now);
+    now += absl::Seconds(1);
+    monitor.OnAckReceived(seq_num, now);
+    now += absl::Seconds(5);
+  }
+
+  EXPECT_EQ(monitor.GetRtt(), absl::Seconds(1));
+  EXPECT_GT(monitor.GetStallTimeout(), absl::Seconds(4));
+  EXPECT_LT(monitor.GetStallTimeout(), LinkMonitor::kMaxStallTimeout);
+}
+
+TEST(LinkMonitorTest, StallTimeoutIsAtLeastMin) {
+  LinkMonitor monitor;
+  std::int32_t seq_num = SendPing(monitor, kStart);
+  monitor.OnAckReceived(seq_num, kStart + absl::Milliseconds(10));
+
+  EXPECT_EQ(monitor.GetRtt(), absl::Milliseconds(10));
+  EXPECT_EQ(monitor.GetStallTimeout(), LinkMonitor::kMinStallTimeout);
+}
+
+TEST(LinkMonitorTest, LateAckIsIgnored) {
+  LinkMonitor monitor;
+  std::int32_t first = SendPing(monitor, kStart);
+  std::int32_t second = SendPing(monitor, kStart + absl::Seconds(5));
+  monitor.OnAckReceived(first, kStart + absl::Seconds(6));
+
+  EXPECT_TRUE(monitor.IsPingInFlight());
+  EXPECT_EQ(monitor.GetRtt(), absl::InfiniteDuration());
+
+  monitor.OnAckReceived(second, kStart + absl::Seconds(6));
+
+  EXPECT_FALSE(monitor.IsPingInFlight());
+  EXPECT_EQ(monitor.GetRtt(), absl::Seconds(1));
+}
+
+TEST(LinkMonitorTest, PingIsTimedFromWhenItGoesOut) {
+  LinkMonitor monitor;
+  std::int32_t seq_num = monitor.OnPingQueued();
+
+  EXPECT_TRUE(monitor.IsPingQueued());
+  EXPECT_FALSE(monitor.IsPingInFlight());
+
+  // Held up behind other frames for a while.
+  monitor.OnPingSent(seq_num, kStart + absl::Seconds(3));
+
+  EXPECT_FALSE(monitor.IsPingQueued());
+  EXPECT_TRUE(monitor.IsPingInFlight());
+
+  monitor.OnAckReceived(seq_num, kStart + absl::Seconds(4));
+
+  EXPECT_EQ(monitor.GetRtt(), absl::Seconds(1));
+}
+
+TEST(LinkMonitorTest, FailedPingIsNotQueued) {
+  LinkMonitor monitor;
+  std::int32_t seq_num = monitor.OnPingQueued();
+  monitor.OnPingFailed(seq_num);
+
+  EXPECT_FALSE(monitor.IsPingQueued());
+  EXPECT_FALSE(monitor.IsPingInFlight());
+}
+
+TEST(LinkMonitorTest, UnackedPingStallsLinkAfterTimeout) {
+  LinkMonitor monitor;
+  std::int32_t seq_num = SendPing(monitor, kStart);
+  monitor.OnAckReceived(seq_num, kStart + absl::Milliseconds(10));
+  absl::Time ping_time = kStart + absl::Seconds(5);
+  SendPing(monitor, ping_time);
+  absl::Duration timeout = monitor.GetStallTimeout();
+
+  EXPECT_FALSE(monitor.IsStalled(ping_time + timeout / 2, kStart));
+  EXPECT_TRUE(monitor.IsStalled(ping_time + 2 * timeout, kStart));
+}
+
+TEST(LinkMonitorTest, ReadSincePingKeepsLinkAlive) {
+  LinkMonitor monitor;
+  absl::Time ping_time = kStart;
+  SendPing(monitor, ping_time);
+
+  EXPECT_FALSE(monitor.IsStalled(ping_time + absl::Minutes(1),
+                                 ping_time + absl::Seconds(1)));
+}
+
+TEST(LinkMonitorTest, WriteStallsLinkRelativeToThroughput) {
+  LinkMonitor monitor;
+  std::int32_t seq_num = SendPing(monitor, kStart);
+  monitor.OnAckReceived(seq_num, kStart + absl::Milliseconds(10));
+  // 1MB/s.
+  monitor.OnWriteStarted(1 << 20, kStart);
+  monitor.OnWriteFinished(kStart + absl::Seconds(1));
+  EXPECT_DOUBLE_EQ(monitor.GetThroughput(), 1 << 20);
+
+  absl::Time write_time = kStart + absl::Seconds(10);
+  monitor.OnWriteStarted(4 << 20, write_time);
+
+  // Twice the expected transfer time, plus the stall timeout.
+  EXPECT_FALSE(
+      monitor.IsStalled(write_time + absl::Seconds(9), absl::InfinitePast()));
+  EXPECT_TRUE(
+      monitor.IsStalled(write_time + absl::Seconds(11), absl::InfinitePast()));
+
+  monitor.OnWriteFinished(write_time + absl::Seconds(12));
+  EXPECT_FALSE(
+      monitor.IsStalled(write_time + absl::Seconds(12), absl::InfinitePast()));
+}
+
+TEST(LinkMonitorTest, AbsorbedWritesDoNotSampleThroughput) {
+  LinkMonitor monitor;
+  absl::Time now = kStart;
+  for (int i = 0; i < 100; i++) {
+    monitor.OnWriteStarted(64 << 10, now);
+    now += absl::Microseconds(20);
+    monitor.OnWriteFinished(now);
+  }
+
+  EXPECT_EQ(monitor.GetThroughput(), 0);
+}
+
+TEST(LinkMonitorTest, SteadyLinkDoesNotDegradeAfterAbsorbedWrite) {
+  LinkMonitor monitor;
+  absl::Time now = kStart;
+  // The buffers of the link take the first write at once.
+  monitor.OnWriteStarted(64 << 10, now);
+  now += absl::Microseconds(20);
+  monitor.OnWriteFinished(now);
+
+  // 2MB/s.
+  for (int i = 0; i < 1000; i++) {
+    monitor.OnWriteStarted(64 << 10, now);
+    now += absl::Microseconds(31250);
+    monitor.OnWriteFinished(now);
+    EXPECT_FALSE(monitor.IsDegraded(now, now));
+  }
+  EXPECT_DOUBLE_EQ(monitor.GetThroughput(), 2 << 20);
+}
+
+TEST(LinkMonitorTest, ThroughputIsSampledOverWindow) {
+  LinkMonitor monitor;
+  absl::Time now = kStart;
+  // 1MB/s, in writes shorter than the window.
+  monitor.OnWriteStarted(16 << 10, now);
+  now += absl::Microseconds(15625);
+  monitor.OnWriteFinished(now);
+  EXPECT_EQ(monitor.GetThroughput(), 0);
+
+  for (int i = 0; i < 6; i++) {
+    monitor.OnWriteStarted(16 << 10, now);
+    now += absl::Microseconds(15625);
+    monitor.OnWriteFinished(now);
+  }
+  EXPECT_DOUBLE_EQ(monitor.GetThroughput(), 1 << 20);
+}
+
+TEST(LinkMonitorTest, ThroughputCollapseDegradesLink) {
+  LinkMonitor monitor;
+  absl::Time now = kStart;
+  // 1MB/s.
+  monitor.OnWriteStarted(1 << 20, now);
+  now += absl::Seconds(1);
+  monitor.OnWriteFinished(now);
+  EXPECT_FALSE(monitor.IsDegraded(now, now));
+
+  // 64KB/s.
+  for (int i = 0; i < 20; i++) {
+    monitor.OnWriteStarted(64 << 10, now);
+    now += absl::Seconds(1);
+    monitor.OnWriteFinished(now);
+  }
+
+  EXPECT_LT(monitor.GetPeakThroughput(now), 1 << 20);
+  EXPECT_TRUE(monitor.IsDegraded(now, now));
+  EXPECT_FALSE(monitor.IsStalled(now, now));
+}
+
+TEST(LinkMonitorTest, PeakThroughputDecays) {
+  LinkMonitor monitor;
+  absl::Time now = kStart;
+  // 1MB/s.
+  monitor.OnWriteStarted(1 << 20, now);
+  now += absl::Seconds(1);
+  monitor.OnWriteFinished(now);
+
+  EXPECT_DOUBLE_EQ(
+      monitor.GetPeakThroughput(now + LinkMonitor::kPeakThroughputHalfLife),
+      1 << 19);
+}
+
+TEST(LinkMonitorTest, LongGonePeakDoesNotDegradeLink) {
+  LinkMonitor monitor;
+  absl::Time now = kStart;
+  // 1MB/s.
+  monitor.OnWriteStarted(1 << 20, now);
+  now += absl::Seconds(1);
+  monitor.OnWriteFinished(now);
+
+  // 64KB/s, for long enough that the peak decays to it.
+  for (int i = 0; i < 5 * 30; i++) {
+    monitor.OnWriteStarted(64 << 10, now);
+    now += absl::Seconds(1);
+    monitor.OnWriteFinished(now);
+  }
+
+  EXPECT_FALSE(monitor.IsDegraded(now, now));
+}
+
+TEST(LinkMonitorTest, LinkDegradesBeforeItStalls) {
+  LinkMonitor monitor;
+  std::int32_t seq_num = SendPing(monitor, kStart);
+  monitor.OnAckReceived(seq_num, kStart + absl::Milliseconds(10));
+  absl::Time ping_time = kStart + absl::Seconds(5);
+  SendPing(monitor, ping_time);
+  absl::Time now = ping_time + monitor.GetStallTimeout() * 3 / 4;
+
+  EXPECT_TRUE(monitor.IsDegraded(now, kStart));
+  EXPECT_FALSE(monitor.IsStalled(now, kStart));
+}
+
+TEST(LinkMonitorTest, TakeOwedAckTimesOutWhenNoneIsOwed) {
+  LinkMonitor monitor;
+
+  EXPECT_FALSE(monitor.TakeOwedAck(absl::Milliseconds(10)).has_value());
+}
+
+TEST(LinkMonitorTest, TakeOwedAckWakesUpOnPing) {
+  LinkMonitor monitor;
+  SingleThreadExecutor executor;
+  executor.Execute([&monitor]() {
+    absl::SleepFor(absl::Milliseconds(100));
+    monitor.OnPingReceived(7);
+  });
+
+  absl::Time start = absl::Now();
+  absl::optional<std::int32_t> owed_ack = monitor.TakeOwedAck(absl::Seconds(5));
+
+  ASSERT_TRUE(owed_ack.has_value());
+  EXPECT_EQ(*owed_ack, 7);
+  EXPECT_LT(absl::Now() - start, absl::Seconds(5));
+  EXPECT_FALSE(monitor.TakeOwedAck(absl::ZeroDuration()).has_value());
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -305,30 +305,35 @@ bool Ble::IsAcceptingConnectionsLocked(const std::string& service_id) {
 }
 
 BleSocket Ble::Connect(BlePeripheral& peripheral,
-                       const std::string& service_id) {
-  MutexLock lock(&mutex_);
+                       const std::string& service_id,
+                       CancellationFlag* cancellation_flag) {
   NEARBY_LOGS(INFO) << "BLE::Connect: service=" << &peripheral;
   // Socket to return. To allow for NRVO to work, it has to be a single object.
   BleSocket socket;
 
-  if (service_id.empty()) {
-    NEARBY_LOGS(INFO) << "Refusing to create BLE socket with empty service_id.";
-    return socket;
-  }
-
-  if (!radio_.IsEnabled()) {
-    NEARBY_LOGS(INFO) << "Can't create client BLE socket to "
-                      << &peripheral << " because Bluetooth isn't enabled.";
-    return socket;
-  }
-
-  if (!IsAvailableLocked()) {
-    NEARBY_LOGS(INFO) << "Can't create client BLE socket [service_id="
-                      << service_id << "]; BLE isn't available.";
-    return socket;
+  {
+    MutexLock lock(&mutex_);
+    if (service_id.empty()) {
+      NEARBY_LOGS(INFO)
+          << "Refusing to create BLE socket with empty service_id.";
+      return socket;
+    }
+
+    if (!radio_.IsEnabled()) {
+      NEARBY_LOGS(INFO) << "Can't create client BLE socket to "
+                        << &peripheral << " because Bluetooth isn't enabled.";
+      return socket;
+    }
+
+    if (!IsAvailableLocked()) {
+      NEARBY_LOGS(INFO) << "Can't create client BLE socket [service_id="
+                        << service_id << "]; BLE isn't available.";
+      return socket;
+    }
   }
 
-  socket = medium_.Connect(peripheral, service_id);
+  // Connecting may block for long, so it does not hold the mutex.
+  socket = medium_.Connect(peripheral, service_id, cancellation_flag);
   if (!socket.IsValid()) {
     NEARBY_LOGS(INFO) << "Failed to Connect via BLE [service=" << service_id
                       << "]";
@@ -21,6 +21,7 @@
 #include "core_v2/internal/mediums/bluetooth_radio.h"
 #include "core_v2/listeners.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/public/ble.h"
 #include "platform_v2/public/multi_thread_executor.h"
 #include "platform_v2/public/mutex.h"
@@ -95,10 +96,12 @@ class Ble {
 
   // Establishes connection to Ble peripheral that was might be started on
   // another peripheral with StartAcceptingConnections() using the same
-  // service_id. Blocks until connection is established, or server-side is
-  // terminated. Returns socket instance. On success, BleSocket.IsValid() return
+  // service_id. Blocks until connection is established, server-side is
+  // terminated, or cancellation_flag is set; the medium is not locked
+  // meanwhile. Returns socket instance. On success, BleSocket.IsValid() return
   // true.
-  BleSocket Connect(BlePeripheral& peripheral, const std::string& service_id)
+  BleSocket Connect(BlePeripheral& peripheral, const std::string& service_id,
+                    CancellationFlag* cancellation_flag = nullptr)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
  private:
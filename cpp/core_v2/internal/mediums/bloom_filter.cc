@@ -14,8 +14,9 @@
 
 #include "core_v2/internal/mediums/bloom_filter.h"
 
+#include <algorithm>
+
 #include "absl/numeric/int128.h"
-#include "absl/strings/numbers.h"
 #include "smhasher/src/MurmurHash3.h"
 
 namespace location {
@@ -23,74 +24,68 @@ namespace nearby {
 namespace connections {
 namespace mediums {
 
-BloomFilterBase::BloomFilterBase(const ByteArray& bytes, BitSet* bit_set)
-    : bits_(bit_set) {
-  const char* bytes_read_ptr = bytes.data();
-  for (size_t byte_index = 0; byte_index < bytes.size(); byte_index++) {
-    for (size_t bit_index = 0; bit_index < 8; bit_index++) {
-      bits_->Set((byte_index * 8) + bit_index,
-                 (*bytes_read_ptr >> bit_index) & 0x01);
-    }
-    bytes_read_ptr++;
+namespace {
+constexpr size_t kBitsPerWord = 64;
+}  // namespace
+
+void BloomFilterBase::Add(const Hashes& hashes, std::uint64_t* words,
+                          size_t num_bits) {
+  for (std::int32_t hash : hashes) {
+    size_t position = static_cast<size_t>(hash) % num_bits;
+    words[position / kBitsPerWord] |= std::uint64_t{1}
+                                      << (position % kBitsPerWord);
   }
 }
 
-BloomFilterBase::operator ByteArray() const {
-  // Gets a binary string representation of the bitset where the leftmost
-  // character corresponds to bitset position (total size) - 1.
-  //
-  // If the bitset's internal representation is:
-  //     [position 0]     0 0 1 1 0 0 0 1 0 1 0 1     [position 11]
-  // The string representation will be outputted like this:
-  //                     "1 0 1 0 1 0 0 0 1 1 0 0"
-  std::string bitset_binary_string = bits_->ToString();
-
-  ByteArray result_bytes(GetMinBytesForBits());
-  char* result_bytes_write_ptr = result_bytes.data();
-  // We go through the string backwards because the rightmost character
-  // corresponds to position 0 in the bitset.
-  for (size_t i = bits_->Size(); i > 0; i -= 8) {
-    std::string byte_binary_string = bitset_binary_string.substr(i - 8, 8);
-    std::uint32_t byte_value;
-    absl::numbers_internal::safe_strtou32_base(byte_binary_string, &byte_value,
-                                               /* base= */ 2);
-    *result_bytes_write_ptr = static_cast<char>(byte_value & 0x000000FF);
-    result_bytes_write_ptr++;
+bool BloomFilterBase::PossiblyContains(const Hashes& hashes,
+                                       const std::uint64_t* words,
+                                       size_t num_bits) {
+  for (std::int32_t hash : hashes) {
+    size_t position = static_cast<size_t>(hash) % num_bits;
+    if (!((words[position / kBitsPerWord] >> (position % kBitsPerWord)) & 1)) {
+      return false;
+    }
   }
-  return result_bytes;
+  return true;
 }
 
-void BloomFilterBase::Add(const std::string& s) {
-  std::vector<std::int32_t> hashes = GetHashes(s);
-  for (int32_t hash : hashes) {
-    size_t position = static_cast<size_t>(hash) % bits_->Size();
-    bits_->Set(position, true);
+ByteArray BloomFilterBase::ToBytes(const std::uint64_t* words,
+                                   size_t num_bytes) {
+  // Byte n holds bits [8n, 8n + 8) of the filter, lowest bit first; the same
+  // layout as Java's BitSet.toByteArray().
+  ByteArray result_bytes(num_bytes);
+  char* result_bytes_write_ptr = result_bytes.data();
+  for (size_t i = 0; i < num_bytes; i++) {
+    *result_bytes_write_ptr++ =
+        static_cast<char>((words[i / 8] >> ((i % 8) * 8)) & 0xFF);
   }
+  return result_bytes;
 }
 
-bool BloomFilterBase::PossiblyContains(const std::string& s) {
-  std::vector<std::int32_t> hashes = GetHashes(s);
-  for (int32_t hash : hashes) {
-    size_t position = static_cast<size_t>(hash) % bits_->Size();
-    if (!bits_->Test(position)) {
-      return false;
-    }
+void BloomFilterBase::FromBytes(const ByteArray& bytes, std::uint64_t* words,
+                                size_t num_bytes) {
+  const char* bytes_read_ptr = bytes.data();
+  size_t size = std::min(bytes.size(), num_bytes);
+  for (size_t i = 0; i < size; i++) {
+    words[i / 8] |= static_cast<std::uint64_t>(
+                        static_cast<std::uint8_t>(*bytes_read_ptr++))
+                    << ((i % 8) * 8);
   }
-  return true;
 }
 
-std::vector<std::int32_t> BloomFilterBase::GetHashes(const std::string& s) {
-  std::vector<std::int32_t> hashes(kHasherNumberOfRepetitions, 0);
+BloomFilterBase::Hashes BloomFilterBase::GetHashes(absl::string_view s) {
+  Hashes hashes;
 
   absl::uint128 hash128;
   MurmurHash3_x64_128(s.data(), s.size(), 0, &hash128);
   std::uint64_t hash64 =
       absl::Uint128Low64(hash128);  // the lower 64 bits of the 128-bit hash
-  std::int32_t hash1 = static_cast<std::int32_t>(
+  std::uint32_t hash1 = static_cast<std::uint32_t>(
       hash64 & 0x00000000FFFFFFFF);  // the lower 32 bits of the 64-bit hash
-  std::int32_t hash2 = static_cast<std::int32_t>(
+  std::uint32_t hash2 = static_cast<std::uint32_t>(
       (hash64 >> 32) & 0x0FFFFFFFF);  // the upper 32 bits of the 64-bit hash
-  for (size_t i = 1; i <= kHasherNumberOfRepetitions; i++) {
+  for (std::uint32_t i = 1; i <= kHasherNumberOfRepetitions; i++) {
+    // Wraps around like the 32-bit int arithmetic of the Java implementation.
     std::int32_t combinedHash = static_cast<std::int32_t>(hash1 + (i * hash2));
     // Flip all the bits if it's negative (guaranteed positive number)
     if (combinedHash < 0) combinedHash = ~combinedHash;
@@ -15,10 +15,12 @@
 #ifndef CORE_V2_INTERNAL_MEDIUMS_BLOOM_FILTER_H_
 #define CORE_V2_INTERNAL_MEDIUMS_BLOOM_FILTER_H_
 
-#include <bitset>
-#include <vector>
+#include <array>
+#include <cstdint>
 
 #include "platform_v2/base/byte_array.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 namespace location {
 namespace nearby {
@@ -26,71 +28,90 @@ namespace connections {
 namespace mediums {
 
 /**
- * A bloom filter that gives access to the underlying BitSet. The implementation
+ * A bloom filter that gives access to the underlying bits. The implementation
  * is copied from our Java version of Bloom filter, which in turn copies from
  * Guava's BloomFilter.
  *
  * BloomFilter is templatized on the size of the byte array and not the size of
  * the bit set to ensure the bit set's length is a multiple of 8 (and can
  * neatly be returned as a ByteArray).
+ *
+ * Bits are packed in 64-bit words. Bit n of the filter is bit (n % 8) of byte
+ * (n / 8) of its serialized form.
  */
 class BloomFilterBase {
  public:
-  explicit operator ByteArray() const;
-
-  void Add(const std::string& s);
-  bool PossiblyContains(const std::string& s);
-
- protected:
-  class BitSet {
-   public:
-    virtual ~BitSet() = default;
-    virtual std::string ToString() const = 0;
-    virtual void Set(size_t pos, bool value) = 0;
-    virtual bool Test(size_t pos) const = 0;
-    virtual size_t Size() const = 0;
-  };
-
-  BloomFilterBase(const ByteArray& bytes, BitSet* bit_set);
-  virtual ~BloomFilterBase() = default;
-
   constexpr static int kHasherNumberOfRepetitions = 5;
-  std::vector<std::int32_t> GetHashes(const std::string& s);
 
- private:
-  int GetMinBytesForBits() const { return (bits_->Size() + 7) >> 3; }
+  // Hashes of an element. They do not depend on the size of the filter, so an
+  // element may be hashed once, and then added to or looked up in any number
+  // of filters.
+  using Hashes = std::array<std::int32_t, kHasherNumberOfRepetitions>;
+
+  static Hashes GetHashes(absl::string_view s);
 
-  BitSet* bits_;
+ protected:
+  BloomFilterBase() = default;
+  ~BloomFilterBase() = default;
+
+  static void Add(const Hashes& hashes, std::uint64_t* words, size_t num_bits);
+  static bool PossiblyContains(const Hashes& hashes, const std::uint64_t* words,
+                               size_t num_bits);
+  static ByteArray ToBytes(const std::uint64_t* words, size_t num_bytes);
+  static void FromBytes(const ByteArray& bytes, std::uint64_t* words,
+                        size_t num_bytes);
 };
 
 template <size_t CapacityInBytes>
 class BloomFilter final : public BloomFilterBase {
  public:
-  BloomFilter() : BloomFilterBase(ByteArray{}, &bits_) {}
-  explicit BloomFilter(const ByteArray& bytes)
-      : BloomFilterBase(bytes, &bits_) {}
+  BloomFilter() = default;
+  explicit BloomFilter(const ByteArray& bytes) {
+    FromBytes(bytes, words_.data(), CapacityInBytes);
+  }
   BloomFilter(const BloomFilter&) = default;
   BloomFilter& operator=(const BloomFilter&) = default;
-  BloomFilter(BloomFilter&& other) : BloomFilterBase(ByteArray{}, &bits_) {
-    *this = std::move(other);
+  BloomFilter(BloomFilter&&) = default;
+  BloomFilter& operator=(BloomFilter&&) = default;
+  ~BloomFilter() = default;
+
+  explicit operator ByteArray() const {
+    return ToBytes(words_.data(), CapacityInBytes);
   }
-  BloomFilter& operator=(BloomFilter&& other) {
-    std::swap((*this).bits_, other.bits_);
-    return *this;
+
+  void Add(absl::string_view s) { Add(GetHashes(s)); }
+  void Add(const Hashes& hashes) {
+    BloomFilterBase::Add(hashes, words_.data(), kNumBits);
+  }
+
+  bool PossiblyContains(absl::string_view s) const {
+    return PossiblyContains(GetHashes(s));
+  }
+  bool PossiblyContains(const Hashes& hashes) const {
+    return BloomFilterBase::PossiblyContains(hashes, words_.data(), kNumBits);
+  }
+
+  // Looks up many elements at once; results[i] is set to whether elements[i]
+  // is possibly in the filter. results must be as long as elements.
+  void PossiblyContains(absl::Span<const Hashes> elements,
+                        absl::Span<bool> results) const {
+    for (size_t i = 0; i < elements.size(); i++) {
+      results[i] = PossiblyContains(elements[i]);
+    }
+  }
+
+  // Returns true if any of the elements is possibly in the filter.
+  bool PossiblyContainsAny(absl::Span<const Hashes> elements) const {
+    for (const Hashes& hashes : elements) {
+      if (PossiblyContains(hashes)) return true;
+    }
+    return false;
   }
-  ~BloomFilter() override = default;
 
  private:
-  class BitSetImpl final : public BitSet {
-   public:
-    std::string ToString() const override { return bits_.to_string(); }
-    void Set(size_t pos, bool value) override { bits_.set(pos, value); }
-    bool Test(size_t pos) const override { return bits_.test(pos); }
-    size_t Size() const override { return bits_.size(); }
-
-   private:
-    std::bitset<CapacityInBytes * 8> bits_;
-  } bits_;
+  static constexpr size_t kNumBits = CapacityInBytes * 8;
+
+  std::array<std::uint64_t, (CapacityInBytes + 7) / 8> words_{};
 };
 
 }  // namespace mediums
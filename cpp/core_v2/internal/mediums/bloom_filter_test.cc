@@ -15,6 +15,8 @@
 #include "core_v2/internal/mediums/bloom_filter.h"
 
 #include <algorithm>
+#include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -200,6 +202,51 @@ TEST(BloomFilterTest, RandomnessFalsePositiveRate) {
   EXPECT_LE(false_positives, 5);
 }
 
+TEST(BloomFilterTest, SerializationIsStable) {
+  BloomFilter<10> bloom_filter;
+
+  bloom_filter.Add("a");
+  bloom_filter.Add("hello");
+
+  // Bytes produced by earlier versions of the filter; peers depend on them.
+  EXPECT_EQ(std::string(ByteArray(bloom_filter)),
+            std::string("\x28\x00\x82\x40\x10\x20\x80\x20\x00\x40", 10));
+}
+
+TEST(BloomFilterTest, ConstructFromBytes) {
+  BloomFilter<10> bloom_filter;
+  bloom_filter.Add("ELEMENT_1");
+  bloom_filter.Add("ELEMENT_2");
+
+  BloomFilter<10> bloom_filter_copy{ByteArray(bloom_filter)};
+
+  EXPECT_TRUE(bloom_filter_copy.PossiblyContains("ELEMENT_1"));
+  EXPECT_TRUE(bloom_filter_copy.PossiblyContains("ELEMENT_2"));
+  EXPECT_FALSE(bloom_filter_copy.PossiblyContains("ELEMENT_3"));
+  EXPECT_EQ(std::string(ByteArray(bloom_filter_copy)),
+            std::string(ByteArray(bloom_filter)));
+}
+
+TEST(BloomFilterTest, BatchLookup) {
+  BloomFilter<kByteArrayLength> bloom_filter;
+  bloom_filter.Add("ELEMENT_2");
+  std::vector<BloomFilterBase::Hashes> elements = {
+      BloomFilterBase::GetHashes("ELEMENT_1"),
+      BloomFilterBase::GetHashes("ELEMENT_2"),
+      BloomFilterBase::GetHashes("ELEMENT_3"),
+  };
+  bool results[3];
+
+  bloom_filter.PossiblyContains(elements, absl::MakeSpan(results));
+
+  EXPECT_FALSE(results[0]);
+  EXPECT_TRUE(results[1]);
+  EXPECT_FALSE(results[2]);
+  EXPECT_TRUE(bloom_filter.PossiblyContainsAny(elements));
+  EXPECT_FALSE(bloom_filter.PossiblyContainsAny(
+      {BloomFilterBase::GetHashes("ELEMENT_1")}));
+}
+
 }  // namespace
 }  // namespace mediums
 }  // namespace connections
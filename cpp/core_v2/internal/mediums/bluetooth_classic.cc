@@ -345,35 +345,42 @@ bool BluetoothClassic::StopAcceptingConnections(
 }
 
 BluetoothSocket BluetoothClassic::Connect(BluetoothDevice& bluetooth_device,
-                                          const std::string& service_name) {
-  MutexLock lock(&mutex_);
+                                          const std::string& service_name,
+                                          CancellationFlag* cancellation_flag) {
   NEARBY_LOG(INFO, "BluetoothClassic::Connect: device=%p", &bluetooth_device);
   // Socket to return. To allow for NRVO to work, it has to be a single object.
   BluetoothSocket socket;
 
-  if (service_name.empty()) {
-    NEARBY_LOG(
-        INFO,
-        "Refusing to create client BT socket because service_name is empty.");
-    return socket;
-  }
+  {
+    MutexLock lock(&mutex_);
+    if (service_name.empty()) {
+      NEARBY_LOG(
+          INFO,
+          "Refusing to create client BT socket because service_name is empty.");
+      return socket;
+    }
 
-  if (!radio_.IsEnabled()) {
-    NEARBY_LOG(INFO,
-               "Can't create client BT socket [service=%s]: BT isn't enabled.",
-               service_name.c_str());
-    return socket;
-  }
+    if (!radio_.IsEnabled()) {
+      NEARBY_LOG(
+          INFO, "Can't create client BT socket [service=%s]: BT isn't enabled.",
+          service_name.c_str());
+      return socket;
+    }
 
-  if (!IsAvailableLocked()) {
-    NEARBY_LOG(
-        INFO, "Can't create client BT socket [service=%s]; BT isn't available.",
-        service_name.c_str());
-    return socket;
+    if (!IsAvailableLocked()) {
+      NEARBY_LOG(
+          INFO,
+          "Can't create client BT socket [service=%s]; BT isn't available.",
+          service_name.c_str());
+      return socket;
+    }
   }
 
-  socket = medium_.ConnectToService(bluetooth_device,
-                                    GenerateUuidFromString(service_name));
+  // Connecting may block for long, so it does not hold the mutex; other
+  // attempts, discovery and accepting connections go on meanwhile.
+  socket = medium_.ConnectToService(
+      bluetooth_device, GenerateUuidFromString(service_name),
+      cancellation_flag);
   if (!socket.IsValid()) {
     NEARBY_LOG(INFO, "Failed to Connect via BT [service=%s]",
                service_name.c_str());
@@ -21,6 +21,7 @@
 #include "core_v2/internal/mediums/bluetooth_radio.h"
 #include "core_v2/listeners.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/public/bluetooth_adapter.h"
 #include "platform_v2/public/bluetooth_classic.h"
 #include "platform_v2/public/multi_thread_executor.h"
@@ -107,11 +108,13 @@ class BluetoothClassic {
 
   // Establishes connection to BT service that was might be started on another
   // device with StartAcceptingConnections() using the same service_name.
-  // Blocks until connection is established, or server-side is terminated.
+  // Blocks until connection is established, server-side is terminated, or
+  // cancellation_flag is set; the medium is not locked meanwhile.
   // Returns socket instance. On success, BluetoothSocket.IsValid() return true.
   // Called by client.
   BluetoothSocket Connect(BluetoothDevice& bluetooth_device,
-                          const std::string& service_name)
+                          const std::string& service_name,
+                          CancellationFlag* cancellation_flag = nullptr)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
   std::string GetMacAddress() const ABSL_LOCKS_EXCLUDED(mutex_);
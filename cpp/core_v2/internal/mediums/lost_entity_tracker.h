@@ -15,9 +15,15 @@
 #ifndef CORE_V2_INTERNAL_MEDIUMS_LOST_ENTITY_TRACKER_H_
 #define CORE_V2_INTERNAL_MEDIUMS_LOST_ENTITY_TRACKER_H_
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+
 #include "platform_v2/public/mutex.h"
 #include "platform_v2/public/mutex_lock.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/hash/hash.h"
 
 namespace location {
 namespace nearby {
@@ -29,59 +35,75 @@ namespace mediums {
 // of whether a specific entity was rediscovered since the last call to
 // ComputeLostEntities.
 //
-// Note: Entity must overload the < and == operators.
+// Every entity is stamped with the epoch (number of calls to
+// ComputeLostEntities) it was last found in; an entity is lost once its stamp
+// falls behind the current epoch. Entities are spread over shards with their
+// own locks, so recording entities only ever waits for the sweep of a single
+// shard.
+//
+// Note: Entity must be hashable with absl::Hash and overload the == operator.
 template <typename Entity>
 class LostEntityTracker {
  public:
   using EntitySet = absl::flat_hash_set<Entity>;
 
-  LostEntityTracker();
-  ~LostEntityTracker();
+  LostEntityTracker() = default;
+  ~LostEntityTracker() = default;
 
   // Records the given entity as being recently found, whether or not this is
   // our first time discovering the entity.
-  void RecordFoundEntity(const Entity& entity) ABSL_LOCKS_EXCLUDED(mutex_);
+  void RecordFoundEntity(const Entity& entity);
 
   // Computes and returns the set of entities considered lost since the last
   // time this method was called.
-  EntitySet ComputeLostEntities() ABSL_LOCKS_EXCLUDED(mutex_);
+  EntitySet ComputeLostEntities();
 
  private:
-  Mutex mutex_;
-  EntitySet current_entities_ ABSL_GUARDED_BY(mutex_);
-  EntitySet previously_found_entities_ ABSL_GUARDED_BY(mutex_);
-};
+  static constexpr size_t kNumShards = 16;
 
-template <typename Entity>
-LostEntityTracker<Entity>::LostEntityTracker()
-    : current_entities_{}, previously_found_entities_{} {}
+  struct Shard {
+    Mutex mutex;
+    // Entity -> epoch it was last found in.
+    absl::flat_hash_map<Entity, std::uint64_t> last_found_epochs
+        ABSL_GUARDED_BY(mutex);
+  };
 
-template <typename Entity>
-LostEntityTracker<Entity>::~LostEntityTracker() {
-  previously_found_entities_.clear();
-  current_entities_.clear();
-}
+  Shard& GetShard(const Entity& entity) {
+    return shards_[absl::Hash<Entity>()(entity) % kNumShards];
+  }
+
+  std::atomic<std::uint64_t> epoch_{0};
+  std::array<Shard, kNumShards> shards_;
+};
 
 template <typename Entity>
 void LostEntityTracker<Entity>::RecordFoundEntity(const Entity& entity) {
-  MutexLock lock(&mutex_);
+  Shard& shard = GetShard(entity);
+  MutexLock lock(&shard.mutex);
 
-  current_entities_.insert(entity);
+  shard.last_found_epochs[entity] = epoch_.load(std::memory_order_relaxed);
 }
 
 template <typename Entity>
 typename LostEntityTracker<Entity>::EntitySet
 LostEntityTracker<Entity>::ComputeLostEntities() {
-  MutexLock lock(&mutex_);
-
-  // The set of lost entities is the previously found set MINUS the currently
-  // found set.
-  for (const auto& item : current_entities_) {
-    previously_found_entities_.erase(item);
+  // Entities found from now on belong to the next round. The lost ones are
+  // those that were not found during the round that just ended.
+  std::uint64_t epoch = epoch_.fetch_add(1, std::memory_order_relaxed);
+
+  EntitySet lost_entities;
+  for (Shard& shard : shards_) {
+    MutexLock lock(&shard.mutex);
+    for (auto it = shard.last_found_epochs.begin();
+         it != shard.last_found_epochs.end();) {
+      if (it->second < epoch) {
+        lost_entities.insert(it->first);
+        shard.last_found_epochs.erase(it++);
+      } else {
+        ++it;
+      }
+    }
   }
-  auto lost_entities = std::move(previously_found_entities_);
-  previously_found_entities_ = std::move(current_entities_);
-  current_entities_ = {};
 
   return lost_entities;
 }
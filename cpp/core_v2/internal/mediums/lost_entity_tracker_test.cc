@@ -130,6 +130,42 @@ TEST(LostEntityTrackerTest, SameEntityMultipleCopies) {
   EXPECT_TRUE(lost_entities.find(entity_1_copy) != lost_entities.end());
 }
 
+TEST(LostEntityTrackerTest, LostEntitiesAreReportedOnce) {
+  LostEntityTracker<TestEntity> lost_entity_tracker;
+  TestEntity entity_1{1};
+
+  lost_entity_tracker.RecordFoundEntity(entity_1);
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+  EXPECT_EQ(lost_entity_tracker.ComputeLostEntities().size(), 1);
+
+  // Once reported, a lost entity is forgotten until it is found again.
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+  lost_entity_tracker.RecordFoundEntity(entity_1);
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+  EXPECT_EQ(lost_entity_tracker.ComputeLostEntities().size(), 1);
+}
+
+TEST(LostEntityTrackerTest, ManyEntities) {
+  LostEntityTracker<TestEntity> lost_entity_tracker;
+  constexpr int kNumEntities = 1000;
+
+  for (int i = 0; i < kNumEntities; i++) {
+    lost_entity_tracker.RecordFoundEntity(TestEntity{i});
+  }
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+
+  // Rediscover the even entities only.
+  for (int i = 0; i < kNumEntities; i += 2) {
+    lost_entity_tracker.RecordFoundEntity(TestEntity{i});
+  }
+  typename LostEntityTracker<TestEntity>::EntitySet lost_entities =
+      lost_entity_tracker.ComputeLostEntities();
+  EXPECT_EQ(lost_entities.size(), kNumEntities / 2);
+  for (const TestEntity& entity : lost_entities) {
+    EXPECT_EQ(entity.id % 2, 1);
+  }
+}
+
 }  // namespace
 }  // namespace mediums
 }  // namespace connections
@@ -219,28 +219,32 @@ bool WifiLan::IsAcceptingConnectionsLocked(const std::string& service_id) {
 }
 
 WifiLanSocket WifiLan::Connect(WifiLanService& wifi_lan_service,
-                               const std::string& service_id) {
-  MutexLock lock(&mutex_);
+                               const std::string& service_id,
+                               CancellationFlag* cancellation_flag) {
   NEARBY_LOG(INFO, "WifiLan::Connect: service=%p, service_info_name=%s",
              &wifi_lan_service, wifi_lan_service.GetName().c_str());
   // Socket to return. To allow for NRVO to work, it has to be a single object.
   WifiLanSocket socket;
 
-  if (service_id.empty()) {
-    NEARBY_LOG(INFO,
-               "Refusing to create WifiLan socket with empty service_id.");
-    return socket;
-  }
-
-  if (!IsAvailableLocked()) {
-    NEARBY_LOG(INFO,
-               "Can't create client WifiLan socket [service_id=%s]; WifiLan "
-               "isn't available.",
-               service_id.c_str());
-    return socket;
+  {
+    MutexLock lock(&mutex_);
+    if (service_id.empty()) {
+      NEARBY_LOG(INFO,
+                 "Refusing to create WifiLan socket with empty service_id.");
+      return socket;
+    }
+
+    if (!IsAvailableLocked()) {
+      NEARBY_LOG(INFO,
+                 "Can't create client WifiLan socket [service_id=%s]; WifiLan "
+                 "isn't available.",
+                 service_id.c_str());
+      return socket;
+    }
   }
 
-  socket = medium_.Connect(wifi_lan_service, service_id);
+  // Connecting may block for long, so it does not hold the mutex.
+  socket = medium_.Connect(wifi_lan_service, service_id, cancellation_flag);
   if (!socket.IsValid()) {
     NEARBY_LOG(INFO, "Failed to Connect via WifiLan [service_id=%s]",
                service_id.c_str());
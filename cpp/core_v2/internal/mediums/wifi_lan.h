@@ -19,6 +19,7 @@
 #include <string>
 
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/public/multi_thread_executor.h"
 #include "platform_v2/public/mutex.h"
 #include "platform_v2/public/wifi_lan.h"
@@ -77,10 +78,12 @@ class WifiLan {
 
   // Establishes connection to WifiLan service that was might be started on
   // another service with StartAcceptingConnections() using the same service_id.
-  // Blocks until connection is established, or server-side is terminated.
+  // Blocks until connection is established, server-side is terminated, or
+  // cancellation_flag is set; the medium is not locked meanwhile.
   // Returns socket instance. On success, WifiLanSocket.IsValid() return true.
   WifiLanSocket Connect(WifiLanService& wifi_lan_service,
-                        const std::string& service_id)
+                        const std::string& service_id,
+                        CancellationFlag* cancellation_flag = nullptr)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
   WifiLanService GetRemoteWifiLanService(const std::string& ip_address,
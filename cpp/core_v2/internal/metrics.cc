@@ -0,0 +1,225 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "core_v2/internal/buffer_pool.h"
+#include "platform_v2/public/mutex_lock.h"
+#include "absl/numeric/bits.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+namespace {
+
+std::atomic<int> g_next_shard{0};
+
+// Shard of the calling thread; threads are spread over shards round-robin.
+int GetShard(int shards) {
+  thread_local int shard = g_next_shard++;
+  return shard % shards;
+}
+
+void UpdateMax(std::atomic<std::int64_t>& max, std::int64_t value) {
+  std::int64_t current = max.load(std::memory_order_relaxed);
+  while (value > current &&
+         !max.compare_exchange_weak(current, value,
+                                    std::memory_order_relaxed)) {
+  }
+}
+
+QueueDepthSnapshot SnapshotOf(const Gauge& gauge) {
+  return {gauge.Value(), gauge.Max()};
+}
+
+}  // namespace
+
+void Counter::Add(std::int64_t value) {
+  shards_[GetShard(kShards)].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+std::int64_t Counter::Value() const {
+  std::int64_t value = 0;
+  for (const Shard& shard : shards_) {
+    value += shard.value.load(std::memory_order_relaxed);
+  }
+  return value;
+}
+
+void Gauge::Add(std::int64_t delta) {
+  std::int64_t value =
+      value_.fetch_add(delta, std::memory_order_relaxed) + delta;
+  UpdateMax(max_, value);
+}
+
+std::int64_t Gauge::Value() const {
+  return value_.load(std::memory_order_relaxed);
+}
+
+std::int64_t Gauge::Max() const { return max_.load(std::memory_order_relaxed); }
+
+double HistogramSnapshot::Mean() const {
+  return count > 0 ? static_cast<double>(sum) / count : 0;
+}
+
+std::int64_t HistogramSnapshot::Percentile(double q) const {
+  if (count <= 0) return 0;
+  q = std::min(std::max(q, 0.0), 1.0);
+  auto rank = std::max<std::int64_t>(
+      1, static_cast<std::int64_t>(std::ceil(q * count)));
+  std::int64_t seen = 0;
+  for (std::size_t i = 0; i < buckets.size(); i++) {
+    seen += buckets[i];
+    if (seen >= rank) return std::min(Histogram::BucketUpperBound(i), max);
+  }
+  // Buckets and count are read one after the other, and may be a little out
+  // of step under concurrent updates.
+  return max;
+}
+
+void Histogram::Record(std::int64_t value) {
+  value = std::max<std::int64_t>(value, 0);
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  UpdateMax(max_, value);
+}
+
+void Histogram::Record(absl::Duration duration) {
+  Record(absl::ToInt64Microseconds(duration));
+}
+
+HistogramSnapshot Histogram::Snapshot() const {
+  HistogramSnapshot snapshot;
+  snapshot.count = count_.load(std::memory_order_relaxed);
+  snapshot.sum = sum_.load(std::memory_order_relaxed);
+  snapshot.max = max_.load(std::memory_order_relaxed);
+  snapshot.buckets.reserve(kBuckets);
+  for (const auto& bucket : buckets_) {
+    snapshot.buckets.push_back(bucket.load(std::memory_order_relaxed));
+  }
+  return snapshot;
+}
+
+int Histogram::BucketIndex(std::int64_t value) {
+  if (value < kSubBuckets) return std::max<int>(value, 0);
+  // Position of the highest bit set; at least kSubBucketBits here.
+  int exponent = 63 - absl::countl_zero(static_cast<std::uint64_t>(value));
+  int group = exponent - kSubBucketBits + 1;
+  int sub_bucket = (value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+  return group * kSubBuckets + sub_bucket;
+}
+
+std::int64_t Histogram::BucketLowerBound(int index) {
+  if (index < kSubBuckets) return index;
+  int group = index / kSubBuckets;
+  std::uint64_t sub_bucket = index % kSubBuckets;
+  return static_cast<std::int64_t>((kSubBuckets + sub_bucket) << (group - 1));
+}
+
+std::int64_t Histogram::BucketUpperBound(int index) {
+  if (index < kSubBuckets) return index;
+  int group = index / kSubBuckets;
+  return static_cast<std::int64_t>(
+      static_cast<std::uint64_t>(BucketLowerBound(index)) +
+      (std::uint64_t{1} << (group - 1)) - 1);
+}
+
+double BufferPoolSnapshot::HitRate() const {
+  std::int64_t acquired = hits + misses;
+  return acquired > 0 ? static_cast<double>(hits) / acquired : 0;
+}
+
+EndpointMetricsSnapshot EndpointMetrics::Snapshot() const {
+  EndpointMetricsSnapshot snapshot;
+  snapshot.bytes_sent = bytes_sent.Value();
+  snapshot.bytes_received = bytes_received.Value();
+  snapshot.frames_sent = frames_sent.Value();
+  snapshot.frames_received = frames_received.Value();
+  snapshot.bandwidth_upgrades = bandwidth_upgrades.Value();
+  snapshot.encrypt_time = encrypt_time.Snapshot();
+  snapshot.decrypt_time = decrypt_time.Snapshot();
+  snapshot.write_blocked_time = write_blocked_time.Snapshot();
+  snapshot.frame_processing_time = frame_processing_time.Snapshot();
+  snapshot.bwu_pause_time = bwu_pause_time.Snapshot();
+  return snapshot;
+}
+
+std::shared_ptr<EndpointMetrics> MetricsRegistry::OnEndpointConnected(
+    const std::string& endpoint_id) {
+  MutexLock lock(&mutex_);
+  std::shared_ptr<EndpointMetrics>& metrics = endpoints_[endpoint_id];
+  if (!metrics) metrics = std::make_shared<EndpointMetrics>();
+  return metrics;
+}
+
+std::shared_ptr<EndpointMetrics> MetricsRegistry::ForEndpoint(
+    const std::string& endpoint_id) {
+  MutexLock lock(&mutex_);
+  auto item = endpoints_.find(endpoint_id);
+  return item != endpoints_.end() ? item->second : nullptr;
+}
+
+void MetricsRegistry::OnEndpointDisconnected(const std::string& endpoint_id) {
+  MutexLock lock(&mutex_);
+  endpoints_.erase(endpoint_id);
+}
+
+void MetricsRegistry::OnAllEndpointsDisconnected() {
+  MutexLock lock(&mutex_);
+  endpoints_.clear();
+}
+
+MetricsSnapshot MetricsRegistry::Snapshot() {
+  MetricsSnapshot snapshot;
+  snapshot.client_id = client_id_;
+  snapshot.endpoint_manager_queue = SnapshotOf(endpoint_manager_queue);
+  snapshot.payload_queue = SnapshotOf(payload_queue);
+  snapshot.incoming_admissions = SnapshotOf(incoming_admissions);
+  snapshot.incoming_connections_shed = incoming_connections_shed.Value();
+  snapshot.admission_read_time = admission_read_time.Snapshot();
+  snapshot.admission_dispatch_time = admission_dispatch_time.Snapshot();
+  snapshot.handshake_time = handshake_time.Snapshot();
+  snapshot.buffer_pool = BufferPool::Default().Snapshot();
+
+  // Histograms are large; copy them out of the lock.
+  std::vector<std::pair<std::string, std::shared_ptr<EndpointMetrics>>>
+      endpoints;
+  {
+    MutexLock lock(&mutex_);
+    endpoints.assign(endpoints_.begin(), endpoints_.end());
+  }
+  for (const auto& endpoint : endpoints) {
+    snapshot.endpoints[endpoint.first] = endpoint.second->Snapshot();
+  }
+  return snapshot;
+}
+
+std::function<void()> CountWhileQueued(Gauge& queue,
+                                       std::function<void()> runnable) {
+  queue.Add(1);
+  return [&queue, runnable = std::move(runnable)]() {
+    queue.Add(-1);
+    runnable();
+  };
+}
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
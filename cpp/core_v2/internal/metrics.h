@@ -0,0 +1,239 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_V2_INTERNAL_METRICS_H_
+#define CORE_V2_INTERNAL_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "platform_v2/public/mutex.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+// A monotonic count that many threads may add to at once.
+//
+// Every thread adds to one of a few shards, each on a cache line of its own,
+// so that threads sending and receiving on different endpoints do not fight
+// over the same line. Value() sums the shards up.
+class Counter {
+ public:
+  void Add(std::int64_t value = 1);
+  std::int64_t Value() const;
+
+ private:
+  static constexpr int kShards = 8;
+  struct alignas(64) Shard {
+    std::atomic<std::int64_t> value{0};
+  };
+  Shard shards_[kShards];
+};
+
+// A level that goes up and down, such as the length of a queue. Remembers the
+// highest level it has been at.
+class Gauge {
+ public:
+  void Add(std::int64_t delta);
+  std::int64_t Value() const;
+  std::int64_t Max() const;
+
+ private:
+  std::atomic<std::int64_t> value_{0};
+  std::atomic<std::int64_t> max_{0};
+};
+
+// What a Histogram has recorded, as of the time it was taken.
+struct HistogramSnapshot {
+  std::int64_t count = 0;
+  std::int64_t sum = 0;
+  std::int64_t max = 0;
+  // Number of values recorded in each bucket; see Histogram.
+  std::vector<std::int64_t> buckets;
+
+  double Mean() const;
+  // Returns an upper bound of the q-th quantile (0 <= q <= 1) of the values
+  // recorded, that is at most 12.5% above the exact one; 0 if there are none.
+  std::int64_t Percentile(double q) const;
+};
+
+// Distribution of non-negative values, such as durations or sizes.
+//
+// Buckets are log-linear: values below 8 have one bucket each, and every
+// power of two above that is split in 8 equal buckets. That keeps the
+// relative error of any quantile under 12.5% over the whole int64 range,
+// with a fixed number of buckets and no allocation on Record().
+class Histogram {
+ public:
+  static constexpr int kSubBucketBits = 3;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kBuckets = (64 - kSubBucketBits) * kSubBuckets;
+
+  // Records value; negative values are recorded as 0.
+  void Record(std::int64_t value);
+  // Records duration, in microseconds.
+  void Record(absl::Duration duration);
+
+  HistogramSnapshot Snapshot() const;
+
+  static int BucketIndex(std::int64_t value);
+  // Returns the smallest and the largest value that go to bucket index.
+  static std::int64_t BucketLowerBound(int index);
+  static std::int64_t BucketUpperBound(int index);
+
+ private:
+  std::atomic<std::int64_t> count_{0};
+  std::atomic<std::int64_t> sum_{0};
+  std::atomic<std::int64_t> max_{0};
+  std::atomic<std::int64_t> buckets_[kBuckets] = {};
+};
+
+// Snapshot of the metrics of one endpoint. Durations are in microseconds.
+struct EndpointMetricsSnapshot {
+  std::int64_t bytes_sent = 0;
+  std::int64_t bytes_received = 0;
+  std::int64_t frames_sent = 0;
+  std::int64_t frames_received = 0;
+  std::int64_t bandwidth_upgrades = 0;
+  HistogramSnapshot encrypt_time;
+  HistogramSnapshot decrypt_time;
+  HistogramSnapshot write_blocked_time;
+  HistogramSnapshot frame_processing_time;
+  HistogramSnapshot bwu_pause_time;
+};
+
+// Level of a queue: how long it is now, and how long it has ever been.
+struct QueueDepthSnapshot {
+  std::int64_t current = 0;
+  std::int64_t max = 0;
+};
+
+// Snapshot of the buffers of BufferPool::Default(), which all clients share.
+struct BufferPoolSnapshot {
+  // Buffers acquired from free ones, and newly allocated.
+  std::int64_t hits = 0;
+  std::int64_t misses = 0;
+  // Bytes of buffers acquired and not released yet, now and at most.
+  std::int64_t outstanding_bytes = 0;
+  std::int64_t max_outstanding_bytes = 0;
+  // Bytes of free buffers, kept for reuse.
+  std::int64_t cached_bytes = 0;
+
+  // Share of acquired buffers that were reused; 0 if none were acquired.
+  double HitRate() const;
+};
+
+// Snapshot of the metrics of one client and of each of its endpoints.
+struct MetricsSnapshot {
+  std::int64_t client_id = 0;
+  // Tasks of the client waiting for the EndpointManager thread.
+  QueueDepthSnapshot endpoint_manager_queue;
+  // Outgoing payloads of the client waiting for their turn to be sent.
+  QueueDepthSnapshot payload_queue;
+  // Incoming connections waiting for their connection request.
+  QueueDepthSnapshot incoming_admissions;
+  // Incoming connections dropped because too many were being admitted.
+  std::int64_t incoming_connections_shed = 0;
+  HistogramSnapshot admission_read_time;
+  HistogramSnapshot admission_dispatch_time;
+  HistogramSnapshot handshake_time;
+  BufferPoolSnapshot buffer_pool;
+  absl::flat_hash_map<std::string, EndpointMetricsSnapshot> endpoints;
+};
+
+// Metrics of one endpoint, updated by whoever works on it.
+struct EndpointMetrics {
+  // On the wire, including framing and encryption overhead.
+  Counter bytes_sent;
+  Counter bytes_received;
+  Counter frames_sent;
+  Counter frames_received;
+  Counter bandwidth_upgrades;
+  // Time to encrypt, and decrypt, one frame.
+  Histogram encrypt_time;
+  Histogram decrypt_time;
+  // Time a write of one frame spent waiting for the channel to resume, and
+  // then for the medium to take the frame.
+  Histogram write_blocked_time;
+  // Time spent handling one incoming frame, during which nothing else is read
+  // from the endpoint.
+  Histogram frame_processing_time;
+  // Time writes to the endpoint were paused for a bandwidth upgrade.
+  Histogram bwu_pause_time;
+
+  EndpointMetricsSnapshot Snapshot() const;
+};
+
+// Metrics of a client and its endpoints. Owned by the ClientProxy.
+//
+// Recording into metrics never takes a lock; looking up an endpoint and
+// taking a snapshot take one briefly.
+class MetricsRegistry {
+ public:
+  explicit MetricsRegistry(std::int64_t client_id) : client_id_(client_id) {}
+
+  // Starts the metrics of endpoint_id, as it gets a channel, and returns them;
+  // if they were already started, returns those. They may be held on to for
+  // as long as the endpoint is in use.
+  std::shared_ptr<EndpointMetrics> OnEndpointConnected(
+      const std::string& endpoint_id) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns the metrics of endpoint_id, or null if it is not connected.
+  std::shared_ptr<EndpointMetrics> ForEndpoint(const std::string& endpoint_id)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Drops the metrics of endpoint_id, or of all endpoints. They are no longer
+  // in snapshots; whoever still holds on to them may keep updating them.
+  void OnEndpointDisconnected(const std::string& endpoint_id)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  void OnAllEndpointsDisconnected() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  MetricsSnapshot Snapshot() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  Gauge endpoint_manager_queue;
+  Gauge payload_queue;
+  Gauge incoming_admissions;
+  Counter incoming_connections_shed;
+  // Time from accepting an incoming connection until its connection request
+  // was read, and from then until the PcpHandler thread got to it.
+  Histogram admission_read_time;
+  Histogram admission_dispatch_time;
+  // Duration of the UKEY2 handshake of a connection, whether or not it is
+  // accepted afterwards.
+  Histogram handshake_time;
+
+ private:
+  const std::int64_t client_id_;
+  Mutex mutex_;
+  absl::flat_hash_map<std::string, std::shared_ptr<EndpointMetrics>> endpoints_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+// Returns runnable, counted in queue from now until it starts running.
+std::function<void()> CountWhileQueued(Gauge& queue,
+                                       std::function<void()> runnable);
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+#endif  // CORE_V2_INTERNAL_METRICS_H_
@@ -0,0 +1,156 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/metrics.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/multi_thread_executor.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+TEST(MetricsTest, CounterAddsUpAllThreads) {
+  constexpr int kThreads = 4;
+  constexpr int kAdds = 10000;
+  Counter counter;
+  CountDownLatch latch(kThreads);
+  {
+    MultiThreadExecutor executor(kThreads);
+    for (int i = 0; i < kThreads; i++) {
+      executor.Execute([&counter, &latch]() {
+        for (int j = 0; j < kAdds; j++) counter.Add(2);
+        latch.CountDown();
+      });
+    }
+    latch.Await();
+  }
+
+  EXPECT_EQ(counter.Value(), 2 * kThreads * kAdds);
+}
+
+TEST(MetricsTest, GaugeRemembersMax) {
+  Gauge gauge;
+
+  gauge.Add(3);
+  gauge.Add(-2);
+  gauge.Add(1);
+
+  EXPECT_EQ(gauge.Value(), 2);
+  EXPECT_EQ(gauge.Max(), 3);
+}
+
+TEST(MetricsTest, HistogramBucketsCoverAllValues) {
+  for (int i = 0; i < Histogram::kBuckets; i++) {
+    std::int64_t lower = Histogram::BucketLowerBound(i);
+    std::int64_t upper = Histogram::BucketUpperBound(i);
+    EXPECT_LE(lower, upper);
+    EXPECT_EQ(Histogram::BucketIndex(lower), i);
+    EXPECT_EQ(Histogram::BucketIndex(upper), i);
+    if (i > 0) EXPECT_EQ(Histogram::BucketUpperBound(i - 1) + 1, lower);
+    // A bucket is at most 1/8 of its lower bound wide.
+    EXPECT_LE(upper - lower, lower / Histogram::kSubBuckets);
+  }
+  EXPECT_EQ(Histogram::BucketUpperBound(Histogram::kBuckets - 1),
+            std::numeric_limits<std::int64_t>::max());
+}
+
+TEST(MetricsTest, HistogramPercentiles) {
+  Histogram histogram;
+  for (int i = 1; i <= 1000; i++) histogram.Record(i);
+  histogram.Record(-5);
+
+  HistogramSnapshot snapshot = histogram.Snapshot();
+
+  EXPECT_EQ(snapshot.count, 1001);
+  EXPECT_EQ(snapshot.sum, 500500);
+  EXPECT_EQ(snapshot.max, 1000);
+  EXPECT_EQ(snapshot.Percentile(0), 0);
+  EXPECT_GE(snapshot.Percentile(0.5), 500);
+  EXPECT_LE(snapshot.Percentile(0.5), 500 * 1.125);
+  EXPECT_GE(snapshot.Percentile(0.99), 990);
+  EXPECT_LE(snapshot.Percentile(0.99), 1000);
+  EXPECT_EQ(snapshot.Percentile(1), 1000);
+}
+
+TEST(MetricsTest, HistogramRecordsDurationsInMicroseconds) {
+  Histogram histogram;
+
+  histogram.Record(absl::Milliseconds(3));
+
+  EXPECT_EQ(histogram.Snapshot().sum, 3000);
+}
+
+TEST(MetricsTest, RegistryReportsEndpointsUntilDisconnected) {
+  MetricsRegistry registry(42);
+  registry.OnEndpointConnected("A")->bytes_sent.Add(10);
+  registry.ForEndpoint("A")->frames_sent.Add();
+  registry.OnEndpointConnected("B");
+  registry.handshake_time.Record(absl::Milliseconds(1));
+
+  MetricsSnapshot snapshot = registry.Snapshot();
+  EXPECT_EQ(snapshot.client_id, 42);
+  EXPECT_EQ(snapshot.handshake_time.count, 1);
+  ASSERT_EQ(snapshot.endpoints.size(), 2);
+  EXPECT_EQ(snapshot.endpoints["A"].bytes_sent, 10);
+  EXPECT_EQ(snapshot.endpoints["A"].frames_sent, 1);
+
+  // Disconnected endpoints are dropped right away, snapshot or not.
+  registry.OnEndpointDisconnected("A");
+  EXPECT_EQ(registry.ForEndpoint("A"), nullptr);
+  snapshot = registry.Snapshot();
+  EXPECT_EQ(snapshot.endpoints.size(), 1);
+  EXPECT_EQ(snapshot.endpoints.count("A"), 0);
+
+  registry.OnAllEndpointsDisconnected();
+  EXPECT_EQ(registry.ForEndpoint("B"), nullptr);
+  EXPECT_TRUE(registry.Snapshot().endpoints.empty());
+}
+
+TEST(MetricsTest, LookupDoesNotStartEndpoints) {
+  MetricsRegistry registry(42);
+  EXPECT_EQ(registry.ForEndpoint("A"), nullptr);
+  EXPECT_TRUE(registry.Snapshot().endpoints.empty());
+
+  std::shared_ptr<EndpointMetrics> metrics = registry.OnEndpointConnected("A");
+  EXPECT_EQ(registry.OnEndpointConnected("A"), metrics);
+  EXPECT_EQ(registry.ForEndpoint("A"), metrics);
+}
+
+TEST(MetricsTest, CountWhileQueuedCountsUntilRun) {
+  MetricsRegistry registry(1);
+  bool ran = false;
+
+  auto runnable =
+      CountWhileQueued(registry.payload_queue, [&ran]() { ran = true; });
+  EXPECT_EQ(registry.Snapshot().payload_queue.current, 1);
+  runnable();
+
+  EXPECT_TRUE(ran);
+  EXPECT_EQ(registry.Snapshot().payload_queue.current, 0);
+  EXPECT_EQ(registry.Snapshot().payload_queue.max, 1);
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
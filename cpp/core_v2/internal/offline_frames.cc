@@ -15,9 +15,11 @@
 #include "core_v2/internal/offline_frames.h"
 
 #include <memory>
+#include <string>
 #include <utility>
 
 #include "core/internal/message_lite.h"
+#include "core_v2/internal/buffer_pool.h"
 #include "core_v2/status.h"
 #include "proto/connections/offline_wire_formats.pb.h"
 #include "platform_v2/base/byte_array.h"
@@ -38,12 +40,22 @@ ByteArray ToBytes(OfflineFrame&& frame) {
   return bytes;
 }
 
+// Same, in a buffer from BufferPool::Default().
+ByteArray ToPooledBytes(OfflineFrame&& frame) {
+  frame.set_version(OfflineFrame::V1);
+  std::size_t size = frame.ByteSizeLong();
+  std::string buffer = BufferPool::Default().Acquire(size);
+  buffer.resize(size);
+  frame.SerializeToArray(&buffer[0], size);
+  return ByteArray(std::move(buffer));
+}
+
 }  // namespace
 
 ExceptionOrOfflineFrame FromBytes(const ByteArray& bytes) {
   OfflineFrame frame;
 
-  if (frame.ParseFromString(std::string(bytes))) {
+  if (frame.ParseFromArray(bytes.data(), bytes.size())) {
     return ExceptionOrOfflineFrame(std::move(frame));
   } else {
     return ExceptionOrOfflineFrame(Exception::kInvalidProtocolBuffer);
@@ -111,7 +123,7 @@ ByteArray ForDataPayloadTransfer(
   *sub_frame->mutable_payload_header() = header;
   *sub_frame->mutable_payload_chunk() = chunk;
 
-  return ToBytes(std::move(frame));
+  return ToPooledBytes(std::move(frame));
 }
 
 ByteArray ForControlPayloadTransfer(
@@ -276,6 +288,19 @@ ByteArray ForKeepAlive() {
   return ToBytes(std::move(frame));
 }
 
+ByteArray ForKeepAlive(std::int32_t seq_num, bool ack) {
+  OfflineFrame frame;
+
+  frame.set_version(OfflineFrame::V1);
+  auto* v1_frame = frame.mutable_v1();
+  v1_frame->set_type(V1Frame::KEEP_ALIVE);
+  auto* sub_frame = v1_frame->mutable_keep_alive();
+  sub_frame->set_seq_num(seq_num);
+  sub_frame->set_ack(ack);
+
+  return ToBytes(std::move(frame));
+}
+
 ByteArray ForDisconnection() {
   OfflineFrame frame;
 
@@ -49,6 +49,8 @@ ByteArray ForConnectionRequest(
 ByteArray ForConnectionResponse(std::int32_t status);
 
 // Builds Payload transfer messages.
+// Data frames are built in a buffer from BufferPool::Default(), to release to
+// it once they are written.
 ByteArray ForDataPayloadTransfer(
     const PayloadTransferFrame::PayloadHeader& header,
     const PayloadTransferFrame::PayloadChunk& chunk);
@@ -71,6 +73,9 @@ ByteArray ForBwuLastWrite();
 ByteArray ForBwuSafeToClose();
 
 ByteArray ForKeepAlive();
+// A KeepAlive frame that asks the remote endpoint to ack seq_num, or that acks
+// the KeepAlive frame seq_num of the remote endpoint.
+ByteArray ForKeepAlive(std::int32_t seq_num, bool ack);
 
 UpgradePathInfo::Medium MediumToUpgradePathInfoMedium(Medium medium);
 Medium UpgradePathInfoMediumToMedium(UpgradePathInfo::Medium medium);
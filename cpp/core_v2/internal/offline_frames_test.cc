@@ -308,6 +308,21 @@ TEST(OfflineFramesTest, CanGenerateKeepAlive) {
   EXPECT_THAT(message, EqualsProto(kExpected));
 }
 
+TEST(OfflineFramesTest, CanGenerateKeepAliveAck) {
+  constexpr char kExpected[] =
+      R"pb(
+    version: V1
+    v1: <
+      type: KEEP_ALIVE
+      keep_alive: < ack: true seq_num: 3 >
+    >)pb";
+  ByteArray bytes = ForKeepAlive(3, /*ack=*/true);
+  auto response = FromBytes(bytes);
+  ASSERT_TRUE(response.ok());
+  OfflineFrame message = FromBytes(bytes).result();
+  EXPECT_THAT(message, EqualsProto(kExpected));
+}
+
 }  // namespace
 }  // namespace parser
 }  // namespace connections
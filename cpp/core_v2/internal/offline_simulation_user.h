@@ -155,9 +155,9 @@ class OfflineSimulationUser {
   void OnEndpointLost(const std::string& endpoint_id);
 
   // PayloadListener callbacks
-  void OnPayload(const std::string& endpoint_id, Payload payload);
-  void OnPayloadProgress(const std::string& endpoint_id,
-                         const PayloadProgressInfo& info);
+  virtual void OnPayload(const std::string& endpoint_id, Payload payload);
+  virtual void OnPayloadProgress(const std::string& endpoint_id,
+                                 const PayloadProgressInfo& info);
 
   std::string service_id_;
   DiscoveredInfo discovered_;
@@ -19,7 +19,6 @@
 #include "core_v2/internal/ble_endpoint_channel.h"
 #include "core_v2/internal/bluetooth_endpoint_channel.h"
 #include "core_v2/internal/bwu_manager.h"
-#include "core_v2/internal/mediums/utils.h"
 #include "core_v2/internal/mediums/webrtc/webrtc_socket_wrapper.h"
 #include "core_v2/internal/webrtc_endpoint_channel.h"
 #include "core_v2/internal/wifi_lan_endpoint_channel.h"
@@ -33,11 +32,6 @@ namespace location {
 namespace nearby {
 namespace connections {
 
-ByteArray P2pClusterPcpHandler::GenerateHash(const std::string& source,
-                                             size_t size) {
-  return Utils::Sha256Hash(source, size);
-}
-
 bool P2pClusterPcpHandler::ShouldAdvertiseBluetoothMacOverBle(
     PowerLevel power_level) {
   return power_level == PowerLevel::kHighPower;
@@ -54,12 +48,22 @@ P2pClusterPcpHandler::P2pClusterPcpHandler(
     Pcp pcp)
     : BasePcpHandler(mediums, endpoint_manager, endpoint_channel_manager,
                      bwu_manager, pcp),
+      service_id_hashes_({
+          BluetoothDeviceName::kServiceIdHashLength,
+          BleAdvertisement::kServiceIdHashLength,
+          WifiLanServiceInfo::kServiceIdHashLength,
+      }),
       bluetooth_radio_(mediums->GetBluetoothRadio()),
       bluetooth_medium_(mediums->GetBluetoothClassic()),
       ble_medium_(mediums->GetBle()),
       wifi_lan_medium_(mediums->GetWifiLan()),
       webrtc_medium_(mediums->GetWebRtc()) {}
 
+P2pClusterPcpHandler::~P2pClusterPcpHandler() {
+  // Connection attempts that lost a race may still be in ConnectImpl().
+  StopConnectAttempts();
+}
+
 // Returns a vector or mediums sorted in order or decreasing priority for
 // all the supported mediums.
 // Example: WiFi_LAN, WEB_RTC, BT, BLE
@@ -90,6 +94,7 @@ BasePcpHandler::StartOperationResult P2pClusterPcpHandler::StartAdvertisingImpl(
     const std::string& local_endpoint_id, const ByteArray& local_endpoint_info,
     const ConnectionOptions& options) {
   std::vector<proto::connections::Medium> mediums_started_successfully;
+  service_id_hashes_.Add(service_id);
 
   WebRtcState web_rtc_state{WebRtcState::kUnconnectable};
   if (options.allowed.web_rtc) {
@@ -105,8 +110,8 @@ BasePcpHandler::StartOperationResult P2pClusterPcpHandler::StartAdvertisingImpl(
   }
 
   if (options.allowed.wifi_lan) {
-    const ByteArray wifi_lan_hash =
-        GenerateHash(service_id, WifiLanServiceInfo::kServiceIdHashLength);
+    const ByteArray wifi_lan_hash = service_id_hashes_.GetHash(
+        service_id, WifiLanServiceInfo::kServiceIdHashLength);
     proto::connections::Medium wifi_lan_medium = StartWifiLanAdvertising(
         client, service_id, wifi_lan_hash, local_endpoint_id,
         local_endpoint_info, web_rtc_state);
@@ -118,8 +123,8 @@ BasePcpHandler::StartOperationResult P2pClusterPcpHandler::StartAdvertisingImpl(
   }
 
   if (options.allowed.bluetooth) {
-    const ByteArray bluetooth_hash =
-        GenerateHash(service_id, BluetoothDeviceName::kServiceIdHashLength);
+    const ByteArray bluetooth_hash = service_id_hashes_.GetHash(
+        service_id, BluetoothDeviceName::kServiceIdHashLength);
     proto::connections::Medium bluetooth_medium = StartBluetoothAdvertising(
         client, service_id, bluetooth_hash, local_endpoint_id,
         local_endpoint_info, web_rtc_state);
@@ -141,6 +146,7 @@ BasePcpHandler::StartOperationResult P2pClusterPcpHandler::StartAdvertisingImpl(
 
   if (mediums_started_successfully.empty()) {
     NEARBY_LOG(INFO, "P2pClusterPcpHandler::StartAdvertisingImpl: not started");
+    service_id_hashes_.Remove(service_id);
     return {
         .status = {Status::kBluetoothError},
     };
@@ -168,6 +174,7 @@ Status P2pClusterPcpHandler::StopAdvertisingImpl(ClientProxy* client) {
   wifi_lan_medium_.StopAdvertising(client->GetAdvertisingServiceId());
   wifi_lan_medium_.StopAcceptingConnections(client->GetAdvertisingServiceId());
 
+  service_id_hashes_.Remove(client->GetAdvertisingServiceId());
   return {Status::kSuccess};
 }
 
@@ -189,15 +196,12 @@ bool P2pClusterPcpHandler::IsRecognizedBluetoothEndpoint(
     return false;
   }
 
-  ByteArray expected_service_id_hash =
-      GenerateHash(service_id, BluetoothDeviceName::kServiceIdHashLength);
-
-  if (name.GetServiceIdHash() != expected_service_id_hash) {
+  if (!service_id_hashes_.Matches(service_id, name.GetServiceIdHash())) {
     NEARBY_LOG(INFO,
                "P2pClusterPcpHandler::IsRecognizedBluetoothEndpoint: service "
                "id hash is "
-               "not matched; name.service_id_hash=%s, expected=%s",
-               name.GetServiceIdHash().data(), expected_service_id_hash.data());
+               "not matched; name.service_id_hash=%s, service_id=%s",
+               name.GetServiceIdHash().data(), service_id.c_str());
     return false;
   }
 
@@ -287,43 +291,48 @@ void P2pClusterPcpHandler::BluetoothDeviceLostHandler(
 bool P2pClusterPcpHandler::IsRecognizedBleEndpoint(
     const std::string& service_id,
     const BleAdvertisement& advertisement) const {
+  // Scans in a crowded place turn up many advertisements that are not ours;
+  // only log a sample of them.
   if (!advertisement.IsValid()) {
-    NEARBY_LOG(INFO,
-               "P2pClusterPcpHandler::IsRecognizedBleEndpoint: advertisement "
-               "is invalid");
+    NEARBY_LOG_EVERY_N_SEC(
+        INFO, 1,
+        "P2pClusterPcpHandler::IsRecognizedBleEndpoint: advertisement "
+        "is invalid");
     return false;
   }
 
   if (advertisement.GetVersion() != kBleAdvertisementVersion) {
-    NEARBY_LOG(
-        INFO,
-        "P2pClusterPcpHandler::IsRecognizedBluetoothEndpoint: Version is "
+    NEARBY_LOG_EVERY_N_SEC(
+        INFO, 1,
+        "P2pClusterPcpHandler::IsRecognizedBleEndpoint: Version is "
         "not matched; advertisement.Version=%d, Version=%d",
         advertisement.GetVersion(), kBleAdvertisementVersion);
     return false;
   }
 
   if (advertisement.GetPcp() != GetPcp()) {
-    NEARBY_LOG(INFO,
-               "P2pClusterPcpHandler::IsRecognizedBluetoothEndpoint: Pcp is "
-               "not matched; advertisement.Pcp=%d, Pcp=%d",
-               advertisement.GetPcp(), GetPcp());
+    NEARBY_LOG_EVERY_N_SEC(
+        INFO, 1,
+        "P2pClusterPcpHandler::IsRecognizedBleEndpoint: Pcp is "
+        "not matched; advertisement.Pcp=%d, Pcp=%d",
+        advertisement.GetPcp(), GetPcp());
     return false;
   }
 
   // Check ServiceId for normal advertisement.
   // ServiceIdHash is empty for fast advertisement.
   if (!advertisement.IsFastAdvertisement()) {
-    ByteArray expected_service_id_hash =
-        GenerateHash(service_id, BleAdvertisement::kServiceIdHashLength);
-
-    if (advertisement.GetServiceIdHash() != expected_service_id_hash) {
-      NEARBY_LOG(INFO,
-                 "P2pClusterPcpHandler::IsRecognizedBleEndpoint: service "
-                 "id hash is "
-                 "not matched; advertisement.service_id_hash=%s, expected=%s",
-                 advertisement.GetServiceIdHash().data(),
-                 expected_service_id_hash.data());
+    if (!service_id_hashes_.Matches(service_id,
+                                    advertisement.GetServiceIdHash())) {
+      NEARBY_LOG_EVERY_N_SEC(
+          INFO, 1,
+          "P2pClusterPcpHandler::IsRecognizedBleEndpoint: service "
+          "id hash is not matched; advertisement.service_id_hash=%s, "
+          "service_id=%s",
+          absl::BytesToHexString(
+              std::string(advertisement.GetServiceIdHash()))
+              .c_str(),
+          service_id.c_str());
       return false;
     }
   }
@@ -466,16 +475,13 @@ bool P2pClusterPcpHandler::IsRecognizedWifiLanEndpoint(
     return false;
   }
 
-  ByteArray expected_service_id_hash =
-      GenerateHash(service_id, BluetoothDeviceName::kServiceIdHashLength);
-
-  if (service_info.GetServiceIdHash() != expected_service_id_hash) {
+  if (!service_id_hashes_.Matches(service_id,
+                                  service_info.GetServiceIdHash())) {
     NEARBY_LOG(INFO,
                "P2pClusterPcpHandler::IsRecognizedWifiLanEndpoint: service "
                "id hash is "
-               "not matched; name.service_id_hash=%s, expected=%s",
-               service_info.GetServiceIdHash().data(),
-               expected_service_id_hash.data());
+               "not matched; name.service_id_hash=%s, service_id=%s",
+               service_info.GetServiceIdHash().data(), service_id.c_str());
     return false;
   }
 
@@ -568,6 +574,7 @@ BasePcpHandler::StartOperationResult P2pClusterPcpHandler::StartDiscoveryImpl(
     ClientProxy* client, const std::string& service_id,
     const ConnectionOptions& options) {
   std::vector<proto::connections::Medium> mediums_started_successfully;
+  service_id_hashes_.Add(service_id);
 
   if (options.allowed.wifi_lan) {
     proto::connections::Medium wifi_lan_medium = StartWifiLanDiscovery(
@@ -624,6 +631,7 @@ BasePcpHandler::StartOperationResult P2pClusterPcpHandler::StartDiscoveryImpl(
 
   if (mediums_started_successfully.empty()) {
     NEARBY_LOG(INFO, "P2pClusterPcpHandler::StartDiscoveryImpl: nothing added");
+    service_id_hashes_.Remove(service_id);
     return {
         .status = {Status::kBluetoothError},
     };
@@ -639,11 +647,13 @@ Status P2pClusterPcpHandler::StopDiscoveryImpl(ClientProxy* client) {
   wifi_lan_medium_.StopDiscovery(client->GetDiscoveryServiceId());
   bluetooth_medium_.StopDiscovery();
   ble_medium_.StopScanning(client->GetDiscoveryServiceId());
+  service_id_hashes_.Remove(client->GetDiscoveryServiceId());
   return {Status::kSuccess};
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::ConnectImpl(
-    ClientProxy* client, BasePcpHandler::DiscoveredEndpoint* endpoint) {
+    ClientProxy* client, BasePcpHandler::DiscoveredEndpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   if (!endpoint) {
     return BasePcpHandler::ConnectImplResult{
         .status = {Status::kError},
@@ -653,21 +663,23 @@ BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::ConnectImpl(
     case proto::connections::Medium::BLUETOOTH: {
       auto* bluetooth_endpoint = down_cast<BluetoothEndpoint*>(endpoint);
       if (bluetooth_endpoint) {
-        return BluetoothConnectImpl(client, bluetooth_endpoint);
+        return BluetoothConnectImpl(client, bluetooth_endpoint,
+                                    cancellation_flag);
       }
       break;
     }
     case proto::connections::Medium::BLE: {
       auto* ble_endpoint = down_cast<BleEndpoint*>(endpoint);
       if (ble_endpoint) {
-        return BleConnectImpl(client, ble_endpoint);
+        return BleConnectImpl(client, ble_endpoint, cancellation_flag);
       }
       break;
     }
     case proto::connections::Medium::WIFI_LAN: {
       auto* wifi_lan_endpoint = down_cast<WifiLanEndpoint*>(endpoint);
       if (wifi_lan_endpoint) {
-        return WifiLanConnectImpl(client, wifi_lan_endpoint);
+        return WifiLanConnectImpl(client, wifi_lan_endpoint,
+                                  cancellation_flag);
       }
       break;
     }
@@ -796,11 +808,12 @@ proto::connections::Medium P2pClusterPcpHandler::StartBluetoothDiscovery(
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::BluetoothConnectImpl(
-    ClientProxy* client, BluetoothEndpoint* endpoint) {
+    ClientProxy* client, BluetoothEndpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   BluetoothDevice& device = endpoint->bluetooth_device;
 
-  BluetoothSocket bluetooth_socket =
-      bluetooth_medium_.Connect(device, endpoint->service_id);
+  BluetoothSocket bluetooth_socket = bluetooth_medium_.Connect(
+      device, endpoint->service_id, cancellation_flag);
   if (!bluetooth_socket.IsValid()) {
     return BasePcpHandler::ConnectImplResult{
         .status = {Status::kBluetoothError},
@@ -921,8 +934,8 @@ proto::connections::Medium P2pClusterPcpHandler::StartBleAdvertising(
         BleAdvertisement(kBleAdvertisementVersion, GetPcp(), local_endpoint_id,
                          local_endpoint_info, ByteArray{}));
   } else {
-    const ByteArray service_id_hash =
-        GenerateHash(service_id, BleAdvertisement::kServiceIdHashLength);
+    const ByteArray service_id_hash = service_id_hashes_.GetHash(
+        service_id, BleAdvertisement::kServiceIdHashLength);
     std::string bluetooth_mac_address;
     if (bluetooth_medium_.IsAvailable() &&
         ShouldAdvertiseBluetoothMacOverBle(power_level))
@@ -978,10 +991,12 @@ proto::connections::Medium P2pClusterPcpHandler::StartBleScanning(
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::BleConnectImpl(
-    ClientProxy* client, BleEndpoint* endpoint) {
+    ClientProxy* client, BleEndpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   BlePeripheral& peripheral = endpoint->ble_peripheral;
 
-  BleSocket ble_socket = ble_medium_.Connect(peripheral, endpoint->service_id);
+  BleSocket ble_socket =
+      ble_medium_.Connect(peripheral, endpoint->service_id, cancellation_flag);
   if (!ble_socket.IsValid()) {
     return BasePcpHandler::ConnectImplResult{
         .status = {Status::kBleError},
@@ -1101,11 +1116,12 @@ proto::connections::Medium P2pClusterPcpHandler::StartWifiLanDiscovery(
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::WifiLanConnectImpl(
-    ClientProxy* client, WifiLanEndpoint* endpoint) {
+    ClientProxy* client, WifiLanEndpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   WifiLanService& service = endpoint->wifi_lan_service;
 
-  WifiLanSocket wifi_lan_socket =
-      wifi_lan_medium_.Connect(service, endpoint->service_id);
+  WifiLanSocket wifi_lan_socket = wifi_lan_medium_.Connect(
+      service, endpoint->service_id, cancellation_flag);
   if (!wifi_lan_socket.IsValid()) {
     return BasePcpHandler::ConnectImplResult{
         .status = {Status::kWifiLanError},
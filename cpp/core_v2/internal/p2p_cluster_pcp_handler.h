@@ -30,6 +30,7 @@
 #include "core_v2/internal/mediums/webrtc.h"
 #include "core_v2/internal/mediums/webrtc/peer_id.h"
 #include "core_v2/internal/pcp.h"
+#include "core_v2/internal/service_id_hash_table.h"
 #include "core_v2/internal/wifi_lan_service_info.h"
 #include "core_v2/options.h"
 #include "core_v2/strategy.h"
@@ -55,7 +56,7 @@ class P2pClusterPcpHandler : public BasePcpHandler {
                        EndpointChannelManager* channel_manager,
                        BwuManager* bwu_manager,
                        Pcp pcp = Pcp::kP2pCluster);
-  ~P2pClusterPcpHandler() override = default;
+  ~P2pClusterPcpHandler() override;
 
  protected:
   std::vector<proto::connections::Medium> GetConnectionMediumsByPriority()
@@ -80,10 +81,13 @@ class P2pClusterPcpHandler : public BasePcpHandler {
   // @PCPHandlerThread
   Status StopDiscoveryImpl(ClientProxy* client) override;
 
-  // @PCPHandlerThread
+  // Called concurrently for different mediums; see BasePcpHandler. Only uses
+  // the medium of endpoint, which guards its own state, and endpoint itself;
+  // none of the state below.
+  // @ConnectExecutorThread
   BasePcpHandler::ConnectImplResult ConnectImpl(
-      ClientProxy* client,
-      BasePcpHandler::DiscoveredEndpoint* endpoint) override;
+      ClientProxy* client, BasePcpHandler::DiscoveredEndpoint* endpoint,
+      CancellationFlag* cancellation_flag) override;
 
  private:
   struct BluetoothEndpoint : public BasePcpHandler::DiscoveredEndpoint {
@@ -132,7 +136,6 @@ class P2pClusterPcpHandler : public BasePcpHandler {
   static constexpr WifiLanServiceInfo::Version kWifiLanServiceInfoVersion =
       WifiLanServiceInfo::Version::kV1;
 
-  static ByteArray GenerateHash(const std::string& source, size_t size);
   static bool ShouldAdvertiseBluetoothMacOverBle(PowerLevel power_level);
   static bool ShouldAcceptBluetoothConnections(
       const ConnectionOptions& options);
@@ -155,7 +158,8 @@ class P2pClusterPcpHandler : public BasePcpHandler {
       BluetoothDiscoveredDeviceCallback callback, ClientProxy* client,
       const std::string& service_id);
   BasePcpHandler::ConnectImplResult BluetoothConnectImpl(
-      ClientProxy* client, BluetoothEndpoint* endpoint);
+      ClientProxy* client, BluetoothEndpoint* endpoint,
+      CancellationFlag* cancellation_flag);
 
   // Ble
   // Maps a BlePeripheral to its corresponding BleEndpointState.
@@ -178,8 +182,9 @@ class P2pClusterPcpHandler : public BasePcpHandler {
       BleDiscoveredPeripheralCallback callback, ClientProxy* client,
       const std::string& service_id,
       const std::string& fast_advertisement_service_uuid);
-  BasePcpHandler::ConnectImplResult BleConnectImpl(ClientProxy* client,
-                                                   BleEndpoint* endpoint);
+  BasePcpHandler::ConnectImplResult BleConnectImpl(
+      ClientProxy* client, BleEndpoint* endpoint,
+      CancellationFlag* cancellation_flag);
 
   // WifiLan
   bool IsRecognizedWifiLanEndpoint(
@@ -198,7 +203,8 @@ class P2pClusterPcpHandler : public BasePcpHandler {
       WifiLanDiscoveredServiceCallback callback, ClientProxy* client,
       const std::string& service_id);
   BasePcpHandler::ConnectImplResult WifiLanConnectImpl(
-      ClientProxy* client, WifiLanEndpoint* endpoint);
+      ClientProxy* client, WifiLanEndpoint* endpoint,
+      CancellationFlag* cancellation_flag);
 
   // WebRtc
   proto::connections::Medium StartListeningForWebRtcConnections(
@@ -208,6 +214,11 @@ class P2pClusterPcpHandler : public BasePcpHandler {
   BasePcpHandler::ConnectImplResult WebRtcConnectImpl(
       ClientProxy* client, WebRtcEndpoint* webrtc_endpoint);
 
+  // Hashes of the service ids we advertise or discover, for each medium's
+  // hash length. Populated in Start{Advertising,Discovery}Impl(), so that
+  // discovery callbacks match service id hashes with a table lookup.
+  ServiceIdHashTable service_id_hashes_;
+
   BluetoothRadio& bluetooth_radio_;
   BluetoothClassic& bluetooth_medium_;
   Ble& ble_medium_;
@@ -0,0 +1,435 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// End-to-end payload transfer benchmarks.
+//
+// Every benchmark connects two OfflineSimulationUser instances over a single
+// medium, through the whole stack (discovery, UKEY2 encryption, frames), and
+// then repeatedly sends BYTES, FILE or STREAM payloads from one to the other,
+// for a sweep of payload sizes and of payloads sent at once.
+//
+// Linked against the g3 platform, mediums are simulated by MediumEnvironment;
+// linked against the linux platform (payload_benchmark_linux), WifiLan goes
+// through real TCP sockets over loopback. Mediums the platform does not
+// support are skipped. The *_emulated mediums shape simulated sockets with
+// the typical LinkProfile of the medium (bandwidth, delay, jitter, MTU), to
+// show how the stack copes with a real radio; they only apply to the g3
+// platform.
+//
+// Besides time, every run reports:
+//   bytes_per_second - payload bytes received per second.
+//   chunk_p50_us, chunk_p99_us - time from the progress report of a chunk on
+//       the sender to the one for the same offset on the receiver.
+//   cpu_ns_per_byte - CPU time of the whole process, per payload byte.
+//   peak_rss_kb - peak resident set size of the process so far.
+//
+// Use --benchmark_format=json (or --benchmark_out=<file>
+// --benchmark_out_format=json) for machine-readable results.
+//
+// --trace_out=<file> traces every chunk through both stacks (see Tracer), and
+// writes the trace to file in the Chrome trace-event format. Traces are
+// bounded per thread; pick a few runs with --benchmark_filter.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core_v2/internal/offline_simulation_user.h"
+#include "core_v2/internal/tracing.h"
+#include "core_v2/listeners.h"
+#include "core_v2/options.h"
+#include "core_v2/payload.h"
+#include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/input_stream.h"
+#include "platform_v2/base/link_profile.h"
+#include "platform_v2/base/medium_environment.h"
+#include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/file.h"
+#include "platform_v2/public/logging.h"
+#include "platform_v2/public/multi_thread_executor.h"
+#include "platform_v2/public/mutex.h"
+#include "platform_v2/public/mutex_lock.h"
+#include "platform_v2/public/system_clock.h"
+#include "benchmark/benchmark.h"
+#include "absl/base/macros.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+constexpr absl::string_view kServiceId = "payload-benchmark";
+constexpr absl::Duration kConnectTimeout = absl::Seconds(10);
+constexpr absl::Duration kTransferTimeout = absl::Seconds(120);
+// Maximum number of payloads sent at once.
+constexpr int kMaxConcurrency = 8;
+
+struct BenchmarkMedium {
+  const char* name;
+  BooleanMediumSelector selector;
+  // Whether simulated sockets follow the typical link of the medium, rather
+  // than delivering data right away.
+  bool emulated_link;
+};
+
+constexpr BenchmarkMedium kMediums[] = {
+    {"bluetooth", BooleanMediumSelector{.bluetooth = true}, false},
+    {"wifi_lan", BooleanMediumSelector{.wifi_lan = true}, false},
+    {"bluetooth_emulated", BooleanMediumSelector{.bluetooth = true}, true},
+    {"wifi_lan_emulated", BooleanMediumSelector{.wifi_lan = true}, true},
+};
+
+// Largest payload sent over an emulated link; bigger ones take minutes over
+// Bluetooth.
+constexpr int kMaxEmulatedSize = 1024 * 1024;
+
+EnvironmentConfig MakeConfig(const BenchmarkMedium& medium) {
+  EnvironmentConfig config;
+  if (medium.emulated_link) {
+    config.bluetooth_link = LinkProfile::Bluetooth();
+    config.ble_link = LinkProfile::Ble();
+    config.wifi_lan_link = LinkProfile::WifiLan();
+  }
+  return config;
+}
+
+// Produces size bytes of a fixed pattern, so that sending a STREAM payload
+// measures the stack rather than the source.
+class PatternInputStream : public InputStream {
+ public:
+  explicit PatternInputStream(std::int64_t size) : remaining_(size) {}
+
+  ExceptionOr<ByteArray> Read(std::int64_t size) override {
+    size = std::min(size, remaining_);
+    remaining_ -= size;
+    return ExceptionOr<ByteArray>(ByteArray(std::string(size, 'p')));
+  }
+  Exception Close() override { return {Exception::kSuccess}; }
+
+ private:
+  std::int64_t remaining_;
+};
+
+// Progress of the payloads of one iteration, as seen by both users.
+class TransferTracker {
+ public:
+  // Starts an iteration of count payloads.
+  void Start(int count) {
+    MutexLock lock(&mutex_);
+    done_ = std::make_unique<CountDownLatch>(count);
+    failed_ = false;
+  }
+
+  // Waits for the payloads of the iteration to be received. Returns false if
+  // any of them failed, or they timed out.
+  bool Await() {
+    CountDownLatch* done;
+    {
+      MutexLock lock(&mutex_);
+      done = done_.get();
+    }
+    bool completed = done->Await(kTransferTimeout).result();
+    MutexLock lock(&mutex_);
+    return completed && !failed_;
+  }
+
+  void OnProgress(const PayloadProgressInfo& info, bool sender) {
+    absl::Time now = SystemClock::ElapsedRealtime();
+    MutexLock lock(&mutex_);
+    if (info.status == PayloadProgressInfo::Status::kInProgress ||
+        info.status == PayloadProgressInfo::Status::kSuccess) {
+      auto& times = sender ? sent_ : received_;
+      times.emplace(std::make_pair(info.payload_id, info.bytes_transferred),
+                    now);
+    }
+    if (sender || info.status == PayloadProgressInfo::Status::kInProgress) {
+      return;
+    }
+    if (info.status != PayloadProgressInfo::Status::kSuccess) failed_ = true;
+    if (done_) done_->CountDown();
+  }
+
+  // Returns the latencies of chunks seen by both users since the last call,
+  // in microseconds.
+  std::vector<double> TakeLatencies() {
+    MutexLock lock(&mutex_);
+    std::vector<double> latencies;
+    latencies.reserve(received_.size());
+    for (const auto& item : received_) {
+      auto sent = sent_.find(item.first);
+      if (sent == sent_.end()) continue;
+      // Both reports race to their listeners; a receiver reporting first
+      // counts as no latency at all.
+      latencies.push_back(std::max(
+          0.0, absl::ToDoubleMicroseconds(item.second - sent->second)));
+    }
+    sent_.clear();
+    received_.clear();
+    return latencies;
+  }
+
+ private:
+  using ChunkKey = std::pair<Payload::Id, std::int64_t>;
+
+  Mutex mutex_;
+  std::unique_ptr<CountDownLatch> done_;
+  bool failed_ = false;
+  absl::flat_hash_map<ChunkKey, absl::Time> sent_;
+  absl::flat_hash_map<ChunkKey, absl::Time> received_;
+};
+
+class BenchmarkUser : public OfflineSimulationUser {
+ public:
+  BenchmarkUser(absl::string_view device_name, BooleanMediumSelector allowed,
+                TransferTracker& tracker, bool sender)
+      : OfflineSimulationUser(device_name, allowed),
+        tracker_(tracker),
+        sender_(sender) {}
+
+ protected:
+  void OnPayload(const std::string& endpoint_id, Payload payload) override {
+    if (payload.GetType() != Payload::Type::kStream) return;
+    // Drain incoming streams, as an application would.
+    auto shared_payload = std::make_shared<Payload>(std::move(payload));
+    drain_executor_.Execute([shared_payload]() {
+      InputStream* stream = shared_payload->AsStream();
+      while (true) {
+        ExceptionOr<ByteArray> data = stream->Read(64 * 1024);
+        if (!data.ok() || data.result().Empty()) break;
+      }
+    });
+  }
+
+  void OnPayloadProgress(const std::string& endpoint_id,
+                         const PayloadProgressInfo& info) override {
+    tracker_.OnProgress(info, sender_);
+  }
+
+ private:
+  TransferTracker& tracker_;
+  const bool sender_;
+  MultiThreadExecutor drain_executor_{kMaxConcurrency};
+};
+
+// Discovers, connects and accepts the connection between the users. Returns
+// false if the medium does not let them connect.
+bool Connect(BenchmarkUser& receiver, BenchmarkUser& sender) {
+  CountDownLatch discover_latch(1);
+  CountDownLatch connect_latch(2);
+  CountDownLatch accept_latch(2);
+  receiver.StartAdvertising(std::string(kServiceId), &connect_latch);
+  sender.StartDiscovery(std::string(kServiceId), &discover_latch);
+  if (!discover_latch.Await(kConnectTimeout).result()) return false;
+  sender.RequestConnection(&connect_latch);
+  if (!connect_latch.Await(kConnectTimeout).result()) return false;
+  receiver.AcceptConnection(&accept_latch);
+  sender.AcceptConnection(&accept_latch);
+  if (!accept_latch.Await(kConnectTimeout).result()) return false;
+  return receiver.IsConnected() && sender.IsConnected();
+}
+
+Payload MakePayload(Payload::Type type, std::int64_t size) {
+  switch (type) {
+    case Payload::Type::kBytes:
+      return Payload(ByteArray(std::string(size, 'b')));
+    case Payload::Type::kFile: {
+      Payload::Id id = Payload::GenerateId();
+      OutputFile file(id);
+      file.Write(ByteArray(std::string(size, 'f')));
+      file.Close();
+      return Payload(id, InputFile(id, size));
+    }
+    case Payload::Type::kStream: {
+      auto stream = std::make_shared<PatternInputStream>(size);
+      return Payload([stream]() -> InputStream& { return *stream; });
+    }
+    case Payload::Type::kUnknown:
+      break;
+  }
+  return Payload();
+}
+
+absl::Duration GetCpuTime() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return absl::DurationFromTimeval(usage.ru_utime) +
+         absl::DurationFromTimeval(usage.ru_stime);
+}
+
+std::int64_t GetPeakRssKb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+double Percentile(std::vector<double>& values, double percentile) {
+  if (values.empty()) return 0;
+  auto nth = values.begin() + static_cast<std::ptrdiff_t>(
+                                  (values.size() - 1) * percentile);
+  std::nth_element(values.begin(), nth, values.end());
+  return *nth;
+}
+
+// Arguments: index in kMediums, payload size, payloads sent at once.
+void BM_Transfer(benchmark::State& state, Payload::Type type) {
+  const BenchmarkMedium& medium = kMediums[state.range(0)];
+  const std::int64_t size = state.range(1);
+  const int concurrency = state.range(2);
+  state.SetLabel(medium.name);
+
+  MediumEnvironment& env = MediumEnvironment::Instance();
+  env.Start(MakeConfig(medium));
+  TransferTracker tracker;
+  {
+    BenchmarkUser receiver("receiver", medium.selector, tracker,
+                           /*sender=*/false);
+    BenchmarkUser sender("sender", medium.selector, tracker, /*sender=*/true);
+    if (!Connect(receiver, sender)) {
+      state.SkipWithError("Failed to connect; medium not supported?");
+    }
+
+    std::vector<double> latencies;
+    absl::Duration cpu_time;
+    for (auto _ : state) {
+      if (!receiver.IsConnected()) {
+        state.SkipWithError("Endpoints disconnected");
+        break;
+      }
+      state.PauseTiming();
+      std::vector<Payload> payloads;
+      std::vector<Payload::Id> file_ids;
+      for (int i = 0; i < concurrency; i++) {
+        payloads.push_back(MakePayload(type, size));
+        if (type == Payload::Type::kFile) {
+          file_ids.push_back(payloads.back().GetId());
+        }
+      }
+      tracker.Start(concurrency);
+      state.ResumeTiming();
+
+      absl::Duration cpu_start = GetCpuTime();
+      for (auto& payload : payloads) sender.SendPayload(std::move(payload));
+      bool ok = tracker.Await();
+      cpu_time += GetCpuTime() - cpu_start;
+
+      state.PauseTiming();
+      std::vector<double> iteration_latencies = tracker.TakeLatencies();
+      latencies.insert(latencies.end(), iteration_latencies.begin(),
+                       iteration_latencies.end());
+      for (Payload::Id id : file_ids) {
+        // Both ends write to the same file; empty it, so that the sweep does
+        // not fill up the disk.
+        OutputFile(id).Close();
+      }
+      state.ResumeTiming();
+      if (!ok) {
+        state.SkipWithError("Transfer failed or timed out");
+        break;
+      }
+    }
+
+    const std::int64_t bytes = state.iterations() * size * concurrency;
+    state.SetBytesProcessed(bytes);
+    state.counters["chunk_p50_us"] = Percentile(latencies, 0.5);
+    state.counters["chunk_p99_us"] = Percentile(latencies, 0.99);
+    state.counters["cpu_ns_per_byte"] =
+        bytes > 0 ? absl::ToDoubleNanoseconds(cpu_time) / bytes : 0;
+    state.counters["peak_rss_kb"] = GetPeakRssKb();
+
+    receiver.Stop();
+    sender.Stop();
+  }
+  env.Stop();
+}
+
+void BytesArguments(benchmark::internal::Benchmark* benchmark) {
+  for (size_t medium = 0; medium < ABSL_ARRAYSIZE(kMediums); medium++) {
+    for (int size : {1024, 32 * 1024, 1024 * 1024}) {
+      if (kMediums[medium].emulated_link && size > kMaxEmulatedSize) continue;
+      for (int concurrency : {1, kMaxConcurrency}) {
+        benchmark->Args({static_cast<int>(medium), size, concurrency});
+      }
+    }
+  }
+}
+
+void StreamArguments(benchmark::internal::Benchmark* benchmark) {
+  for (size_t medium = 0; medium < ABSL_ARRAYSIZE(kMediums); medium++) {
+    for (int size : {64 * 1024, 1024 * 1024, 16 * 1024 * 1024}) {
+      if (kMediums[medium].emulated_link && size > kMaxEmulatedSize) continue;
+      for (int concurrency : {1, 2, kMaxConcurrency}) {
+        benchmark->Args({static_cast<int>(medium), size, concurrency});
+      }
+    }
+  }
+}
+
+BENCHMARK_CAPTURE(BM_Transfer, Bytes, Payload::Type::kBytes)
+    ->Apply(BytesArguments)
+    ->ArgNames({"medium", "size", "concurrency"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Transfer, File, Payload::Type::kFile)
+    ->Apply(StreamArguments)
+    ->ArgNames({"medium", "size", "concurrency"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Transfer, Stream, Payload::Type::kStream)
+    ->Apply(StreamArguments)
+    ->ArgNames({"medium", "size", "concurrency"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+int main(int argc, char** argv) {
+  using ::location::nearby::connections::Tracer;
+
+  NEARBY_LOG_SET_SEVERITY(WARNING);
+  // Take --trace_out out of the way of the benchmark flags.
+  std::string trace_out;
+  int kept_argc = 1;
+  for (int i = 1; i < argc; i++) {
+    absl::string_view arg = argv[i];
+    if (absl::ConsumePrefix(&arg, "--trace_out=")) {
+      trace_out = std::string(arg);
+    } else {
+      argv[kept_argc++] = argv[i];
+    }
+  }
+  argc = kept_argc;
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  if (!trace_out.empty()) Tracer::Instance().Start();
+  benchmark::RunSpecifiedBenchmarks();
+  if (!trace_out.empty()) {
+    Tracer::Instance().Stop();
+    std::ofstream(trace_out) << Tracer::Instance().ExportChromeTrace();
+  }
+  return 0;
+}
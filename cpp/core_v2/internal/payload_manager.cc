@@ -21,6 +21,8 @@
 #include <utility>
 
 #include "core_v2/internal/internal_payload_factory.h"
+#include "core_v2/internal/metrics.h"
+#include "core_v2/internal/tracing.h"
 #include "platform_v2/public/count_down_latch.h"
 #include "platform_v2/public/mutex_lock.h"
 #include "platform_v2/public/single_thread_executor.h"
@@ -89,8 +91,11 @@ bool PayloadManager::SendPayloadLoop(
 
   // This will block if there is no data to transfer.
   // It will resume when new data arrives, or if Close() is called.
-  ByteArray next_chunk =
-      pending_payload.GetInternalPayload()->DetachNextChunk();
+  ByteArray next_chunk;
+  {
+    TraceSpan span("DetachNextChunk", payload_header.id(), next_chunk_offset);
+    next_chunk = pending_payload.GetInternalPayload()->DetachNextChunk();
+  }
   if (shutdown_.Get()) return false;
   // Save chunk size. We'll need it after we move next_chunk.
   auto next_chunk_size = next_chunk.size();
@@ -108,8 +113,12 @@ bool PayloadManager::SendPayloadLoop(
 
   PayloadTransferFrame::PayloadChunk payload_chunk(
       CreatePayloadChunk(next_chunk_offset, std::move(next_chunk)));
-  const EndpointIds& failed_endpoint_ids = endpoint_manager_->SendPayloadChunk(
-      payload_header, payload_chunk, available_endpoint_ids);
+  EndpointIds failed_endpoint_ids;
+  {
+    TraceSpan span("SendPayloadChunk", payload_header.id(), next_chunk_offset);
+    failed_endpoint_ids = endpoint_manager_->SendPayloadChunk(
+        payload_header, payload_chunk, available_endpoint_ids);
+  }
   // Check whether at least one endpoint failed.
   if (!failed_endpoint_ids.empty()) {
     NEARBY_LOG(INFO,
@@ -269,10 +278,12 @@ PayloadManager::~PayloadManager() {
   bytes_payload_executor_.Shutdown();
   stream_payload_executor_.Shutdown();
   file_payload_executor_.Shutdown();
+  interactive_payload_executor_.Shutdown();
 
   CountDownLatch stop_latch(1);
-  // Clear our tracked pending payloads.
-  RunOnStatusUpdateThread([this, &stop_latch]() {
+  // Clear our tracked pending payloads, once the updates queued ahead of it
+  // are done with them.
+  RunOnStatusUpdateThreadAfterAll([this, &stop_latch]() {
     NEARBY_LOG(INFO, "PayloadManager: stop tracking payloads; self=%p", this);
     MutexLock lock(&mutex_);
     for (const auto& pending_id : pending_payloads_.GetAllPayloads()) {
@@ -305,7 +316,8 @@ void PayloadManager::SendPayload(ClientProxy* client,
   if (shutdown_.Get()) return;
   NEARBY_LOG(INFO, "SendPayload: endpoint_ids={%s}",
              ToString(endpoint_ids).c_str());
-  auto executor = GetOutgoingPayloadExecutor(payload.GetType());
+  auto executor =
+      GetOutgoingPayloadExecutor(payload.GetType(), payload.GetPriority());
   // The |executor| will be null if the payload is of a type we cannot work
   // with. This should never be reached since the ServiceControllerRouter has
   // already checked whether or not we can work with this Payload type.
@@ -317,14 +329,23 @@ void PayloadManager::SendPayload(ClientProxy* client,
     return;
   }
 
-  // Each payload is sent in FCFS order within each Payload type, blocking any
-  // other payload of the same type from even starting until this one is
-  // completely done with. If we ever want to provide isolation across
+  // Each payload is sent in turn with the others of its Payload type, blocking
+  // any of them from even starting until this one is completely done with;
+  // the more urgent ones waiting go first. Interactive payloads are the
+  // exception: they take turns among themselves, whatever their type, so that
+  // they never wait for a transfer in progress. Chunks of payloads being sent
+  // at the same time are interleaved on the wire by priority (see
+  // BaseEndpointChannel::Write()). If we ever want to provide isolation across
   // ClientProxy objects this will need to be significantly re-architected.
   Payload::Type payload_type = payload.GetType();
+  Payload::Priority payload_priority = payload.GetPriority();
   Payload::Id payload_id =
       CreateOutgoingPayload(std::move(payload), endpoint_ids);
-  executor->Execute([this, client, endpoint_ids, payload_id]() {
+  Gauge& queue = client->GetMetrics().payload_queue;
+  queue.Add(1);
+  executor->Execute(payload_priority, [this, client, endpoint_ids, payload_id,
+                                       &queue]() {
+    queue.Add(-1);
     if (shutdown_.Get()) return;
     PendingPayload* pending_payload = GetPayload(payload_id);
     if (!pending_payload) return;
@@ -339,6 +360,7 @@ void PayloadManager::SendPayload(ClientProxy* client,
                                         payload_header, next_chunk_offset);
     }
     RunOnStatusUpdateThread(
+        internal_payload->GetPriority(),
         [this, payload_id]() { DestroyPendingPayload(payload_id); });
   });
   NEARBY_LOG(INFO,
@@ -407,7 +429,9 @@ void PayloadManager::OnEndpointDisconnect(ClientProxy* client,
     if (barrier) barrier->CountDown();
     return;
   }
-  RunOnStatusUpdateThread([this, client, endpoint_id, barrier]() {
+  // Runs after the updates queued ahead of it, so that the endpoint gets no
+  // more of them once barrier is released.
+  RunOnStatusUpdateThreadAfterAll([this, client, endpoint_id, barrier]() {
     // Iterate through all our payloads and look for payloads associated
     // with this endpoint.
     MutexLock lock(&mutex_);
@@ -483,8 +507,13 @@ PayloadProgressInfo::Status PayloadManager::PayloadStatusToTransferUpdateStatus(
   }
 }
 
-SingleThreadExecutor* PayloadManager::GetOutgoingPayloadExecutor(
-    Payload::Type payload_type) {
+PayloadManager::OutgoingPayloadExecutor*
+PayloadManager::GetOutgoingPayloadExecutor(
+    Payload::Type payload_type, Payload::Priority payload_priority) {
+  if (payload_type != Payload::Type::kUnknown &&
+      payload_priority == Payload::Priority::kInteractive) {
+    return &interactive_payload_executor_;
+  }
   switch (payload_type) {
     case Payload::Type::kBytes:
       return &bytes_payload_executor_;
@@ -504,6 +533,7 @@ PayloadTransferFrame::PayloadHeader PayloadManager::CreatePayloadHeader(
   payload_header.set_id(internal_payload.GetId());
   payload_header.set_type(internal_payload.GetType());
   payload_header.set_total_size(internal_payload.GetTotalSize());
+  payload_header.set_priority(PriorityToProto(internal_payload.GetPriority()));
 
   return payload_header;
 }
@@ -525,8 +555,10 @@ PayloadTransferFrame::PayloadChunk PayloadManager::CreatePayloadChunk(
 }
 
 PayloadManager::PendingPayload* PayloadManager::CreateIncomingPayload(
-    const PayloadTransferFrame& frame, const std::string& endpoint_id) {
-  auto internal_payload = CreateIncomingInternalPayload(frame);
+    const PayloadTransferFrame& frame, const std::string& endpoint_id,
+    IncomingPayloadSink sink) {
+  auto internal_payload = sink ? CreateIncomingInternalPayload(frame, sink)
+                               : CreateIncomingInternalPayload(frame);
   if (!internal_payload) {
     return nullptr;
   }
@@ -547,8 +579,11 @@ void PayloadManager::SendClientCallbacksForFinishedOutgoingPayload(
     const PayloadTransferFrame::PayloadHeader& payload_header,
     std::int64_t num_bytes_successfully_transferred,
     proto::connections::PayloadStatus status) {
-  RunOnStatusUpdateThread([this, client, finished_endpoint_ids, payload_header,
-                           num_bytes_successfully_transferred, status]() {
+  Payload::Priority priority = PriorityFromProto(payload_header.priority());
+  RunOnStatusUpdateThread(priority, [this, client, finished_endpoint_ids,
+                                     payload_header,
+                                     num_bytes_successfully_transferred,
+                                     status]() {
     // Make sure we're still tracking this payload.
     PendingPayload* pending_payload = GetPayload(payload_header.id());
     if (!pending_payload) {
@@ -585,6 +620,7 @@ void PayloadManager::SendClientCallbacksForFinishedIncomingPayload(
     const PayloadTransferFrame::PayloadHeader& payload_header,
     std::int64_t offset_bytes, proto::connections::PayloadStatus status) {
   RunOnStatusUpdateThread(
+      PriorityFromProto(payload_header.priority()),
       [this, client, endpoint_id, payload_header, offset_bytes, status]() {
         // Make sure we're still tracking this payload.
         PendingPayload* pending_payload = GetPayload(payload_header.id());
@@ -686,9 +722,10 @@ void PayloadManager::HandleSuccessfulOutgoingChunk(
     const PayloadTransferFrame::PayloadHeader& payload_header,
     std::int32_t payload_chunk_flags, std::int64_t payload_chunk_offset,
     std::int64_t payload_chunk_body_size) {
-  RunOnStatusUpdateThread([this, client, endpoint_id, payload_header,
-                           payload_chunk_flags, payload_chunk_offset,
-                           payload_chunk_body_size]() {
+  Payload::Priority priority = PriorityFromProto(payload_header.priority());
+  RunOnStatusUpdateThread(priority, [this, client, endpoint_id, payload_header,
+                                     payload_chunk_flags, payload_chunk_offset,
+                                     payload_chunk_body_size]() {
     // Make sure we're still tracking this payload and its associated
     // endpoint.
     PendingPayload* pending_payload = GetPayload(payload_header.id());
@@ -748,9 +785,10 @@ void PayloadManager::HandleSuccessfulIncomingChunk(
     const PayloadTransferFrame::PayloadHeader& payload_header,
     std::int32_t payload_chunk_flags, std::int64_t payload_chunk_offset,
     std::int64_t payload_chunk_body_size) {
-  RunOnStatusUpdateThread([this, client, endpoint_id, payload_header,
-                           payload_chunk_flags, payload_chunk_offset,
-                           payload_chunk_body_size]() {
+  Payload::Priority priority = PriorityFromProto(payload_header.priority());
+  RunOnStatusUpdateThread(priority, [this, client, endpoint_id, payload_header,
+                                     payload_chunk_flags, payload_chunk_offset,
+                                     payload_chunk_body_size]() {
     // Make sure we're still tracking this payload.
     PendingPayload* pending_payload = GetPayload(payload_header.id());
     if (!pending_payload) {
@@ -780,11 +818,25 @@ void PayloadManager::ProcessDataPacket(
       *payload_transfer_frame.mutable_payload_header();
   PayloadTransferFrame::PayloadChunk& payload_chunk =
       *payload_transfer_frame.mutable_payload_chunk();
+  TraceSpan packet_span("ProcessDataPacket", payload_header.id(),
+                        payload_chunk.offset());
 
   PendingPayload* pending_payload;
   if (payload_chunk.offset() == 0) {
-    pending_payload =
-        CreateIncomingPayload(payload_transfer_frame, from_endpoint_id);
+    // If the client takes the data as it arrives, pass it straight on from
+    // this thread, without collecting it.
+    IncomingPayloadSink sink;
+    auto chunk_cb = to_client->GetPayloadChunkCallback(from_endpoint_id);
+    if (chunk_cb) {
+      sink = [this, to_client, from_endpoint_id,
+              chunk_cb](const PayloadChunkInfo& chunk) {
+        if (chunk_cb(from_endpoint_id, chunk) == PayloadChunkAction::kCancel) {
+          CancelPayload(to_client, chunk.payload_id);
+        }
+      };
+    }
+    pending_payload = CreateIncomingPayload(payload_transfer_frame,
+                                            from_endpoint_id, std::move(sink));
     if (!pending_payload) {
       // Send the error to the remote endpoint.
       SendControlMessage({from_endpoint_id}, payload_header,
@@ -793,14 +845,20 @@ void PayloadManager::ProcessDataPacket(
       return;
     }
 
-    // Also, let the client know of this new incoming payload.
-    RunOnStatusUpdateThread([to_client, from_endpoint_id, pending_payload]() {
-      NEARBY_LOG(INFO, "ProcessDataPacket [new]: id=%s; payload_id=%" PRIX64,
-                 from_endpoint_id.c_str(), pending_payload->GetId());
-      to_client->OnPayload(
-          from_endpoint_id,
-          pending_payload->GetInternalPayload()->ReleasePayload());
-    });
+    // Also, let the client know of this new incoming payload; the client
+    // already knows, if it takes the data as it arrives.
+    if (!chunk_cb) {
+      RunOnStatusUpdateThread(
+          pending_payload->GetInternalPayload()->GetPriority(),
+          [to_client, from_endpoint_id, pending_payload]() {
+            NEARBY_LOG(INFO,
+                       "ProcessDataPacket [new]: id=%s; payload_id=%" PRIX64,
+                       from_endpoint_id.c_str(), pending_payload->GetId());
+            to_client->OnPayload(
+                from_endpoint_id,
+                pending_payload->GetInternalPayload()->ReleasePayload());
+          });
+    }
   } else {
     pending_payload = GetPayload(payload_header.id());
     if (!pending_payload) {
@@ -833,9 +891,13 @@ void PayloadManager::ProcessDataPacket(
 
   // Save size of packet before we move it.
   std::int64_t payload_body_size = payload_chunk.body().size();
-  if (pending_payload->GetInternalPayload()
-          ->AttachNextChunk(ByteArray(std::move(*payload_chunk.mutable_body())))
-          .Raised()) {
+  Exception attach_exception;
+  {
+    TraceSpan span("AttachNextChunk");
+    attach_exception = pending_payload->GetInternalPayload()->AttachNextChunk(
+        ByteArray(std::move(*payload_chunk.mutable_body())));
+  }
+  if (attach_exception.Raised()) {
     NEARBY_LOG(INFO,
                "ProcessDataPacket: [data: error] id=%s; payload_id=%" PRIX64,
                from_endpoint_id.c_str(), pending_payload->GetId());
@@ -845,6 +907,18 @@ void PayloadManager::ProcessDataPacket(
     return;
   }
 
+  if (pending_payload->IsLocallyCanceled()) {
+    // The client took the chunk, and canceled the payload.
+    NEARBY_LOG(INFO,
+               "ProcessDataPacket: [sink: cancel] id=%s; payload_id=%" PRIX64,
+               from_endpoint_id.c_str(), pending_payload->GetId());
+    HandleFinishedIncomingPayload(
+        to_client, from_endpoint_id, payload_header,
+        payload_chunk.offset() + payload_body_size,
+        proto::connections::PayloadStatus::LOCAL_CANCELLATION);
+    return;
+  }
+
   NEARBY_LOG(INFO, "ProcessDataPacket: [data: ok] id=%s; payload_id=%" PRIX64,
              from_endpoint_id.c_str(), pending_payload->GetId());
   HandleSuccessfulIncomingChunk(to_client, from_endpoint_id, payload_header,
@@ -1035,8 +1109,65 @@ bool PayloadManager::PendingPayload::IsClosed() {
   return close_event_.Await(absl::ZeroDuration()).result();
 }
 
-void PayloadManager::RunOnStatusUpdateThread(std::function<void()> runnable) {
-  payload_status_update_executor_.Execute(std::move(runnable));
+void PayloadManager::RunOnStatusUpdateThread(Payload::Priority priority,
+                                             std::function<void()> runnable) {
+  {
+    MutexLock lock(&status_updates_mutex_);
+    status_updates_.Push(priority, std::move(runnable));
+  }
+  payload_status_update_executor_.Execute([this]() {
+    std::function<void()> next;
+    {
+      MutexLock lock(&status_updates_mutex_);
+      // Run already, by RunAllStatusUpdates().
+      if (status_updates_.Empty()) return;
+      next = status_updates_.Pop();
+    }
+    next();
+  });
+}
+
+void PayloadManager::RunOnStatusUpdateThreadAfterAll(
+    std::function<void()> runnable) {
+  // The priority lanes may let it through ahead of less urgent runnables, so
+  // it runs all those that are still queued first.
+  RunOnStatusUpdateThread(Payload::Priority::kBulk,
+                          [this, runnable = std::move(runnable)]() {
+                            RunAllStatusUpdates();
+                            runnable();
+                          });
+}
+
+void PayloadManager::RunAllStatusUpdates() {
+  while (true) {
+    std::function<void()> next;
+    {
+      MutexLock lock(&status_updates_mutex_);
+      if (status_updates_.Empty()) return;
+      next = status_updates_.Pop();
+    }
+    next();
+  }
+}
+
+//////////////////////////// OutgoingPayloadExecutor ///////////////////////////
+
+void PayloadManager::OutgoingPayloadExecutor::Execute(
+    Payload::Priority priority, std::function<void()> runnable) {
+  {
+    MutexLock lock(&mutex_);
+    waiting_.Push(priority, std::move(runnable));
+  }
+  // Runs whichever payload is most urgent once it is this task's turn, which
+  // need not be the one pushed above.
+  executor_.Execute([this]() {
+    std::function<void()> next;
+    {
+      MutexLock lock(&mutex_);
+      next = waiting_.Pop();
+    }
+    next();
+  });
 }
 
 /////////////////////////////// PendingPayloads ///////////////////////////////
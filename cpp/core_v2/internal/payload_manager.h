@@ -16,6 +16,7 @@
 #define CORE_V2_INTERNAL_PAYLOAD_MANAGER_H_
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -23,6 +24,8 @@
 #include "core_v2/internal/client_proxy.h"
 #include "core_v2/internal/endpoint_manager.h"
 #include "core_v2/internal/internal_payload.h"
+#include "core_v2/internal/internal_payload_factory.h"
+#include "core_v2/internal/priority_gate.h"
 #include "core_v2/listeners.h"
 #include "core_v2/payload.h"
 #include "core_v2/status.h"
@@ -32,6 +35,7 @@
 #include "platform_v2/public/atomic_reference.h"
 #include "platform_v2/public/count_down_latch.h"
 #include "platform_v2/public/mutex.h"
+#include "platform_v2/public/single_thread_executor.h"
 #include "proto/connections_enums.pb.h"
 #include "absl/container/flat_hash_map.h"
 
@@ -168,6 +172,20 @@ class PayloadManager : public EndpointManager::FrameProcessor {
         pending_payloads_ ABSL_GUARDED_BY(mutex_);
   };
 
+  // Sends outgoing payloads one at a time. Payloads waiting for their turn go
+  // in the order of PriorityLanes, rather than in the order they were sent.
+  class OutgoingPayloadExecutor {
+   public:
+    void Execute(Payload::Priority priority, std::function<void()> runnable)
+        ABSL_LOCKS_EXCLUDED(mutex_);
+    void Shutdown() { executor_.Shutdown(); }
+
+   private:
+    Mutex mutex_;
+    PriorityLanes<std::function<void()>> waiting_ ABSL_GUARDED_BY(mutex_);
+    SingleThreadExecutor executor_;
+  };
+
   using Endpoints = std::vector<const EndpointInfo*>;
   static std::string ToString(const EndpointIds& endpoint_ids);
   static std::string ToString(const Endpoints& endpoints);
@@ -208,8 +226,11 @@ class PayloadManager : public EndpointManager::FrameProcessor {
   PayloadTransferFrame::PayloadChunk CreatePayloadChunk(std::int64_t offset,
                                                         ByteArray body);
 
+  // Collects the data of the payload, unless sink is set; then, the data is
+  // passed to sink as it arrives.
   PendingPayload* CreateIncomingPayload(const PayloadTransferFrame& frame,
-                                        const std::string& endpoint_id)
+                                        const std::string& endpoint_id,
+                                        IncomingPayloadSink sink)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
   Payload::Id CreateOutgoingPayload(Payload payload,
@@ -268,9 +289,21 @@ class PayloadManager : public EndpointManager::FrameProcessor {
       ClientProxy* client, const std::string& endpoint_id,
       const PayloadProgressInfo& payload_transfer_update);
 
-  SingleThreadExecutor* GetOutgoingPayloadExecutor(Payload::Type payload_type);
-
-  void RunOnStatusUpdateThread(std::function<void()> runnable);
+  OutgoingPayloadExecutor* GetOutgoingPayloadExecutor(
+      Payload::Type payload_type, Payload::Priority payload_priority);
+
+  // Runs runnable on the status update thread, after the runnables queued
+  // there before it with the same or a more urgent priority.
+  void RunOnStatusUpdateThread(Payload::Priority priority,
+                               std::function<void()> runnable)
+      ABSL_LOCKS_EXCLUDED(status_updates_mutex_);
+  // Runs runnable on the status update thread, after all the runnables queued
+  // there before it, whatever their priority.
+  void RunOnStatusUpdateThreadAfterAll(std::function<void()> runnable)
+      ABSL_LOCKS_EXCLUDED(status_updates_mutex_);
+  // Runs the queued runnables, until none are left. Called on the status
+  // update thread.
+  void RunAllStatusUpdates() ABSL_LOCKS_EXCLUDED(status_updates_mutex_);
   bool NotifyShutdown() ABSL_LOCKS_EXCLUDED(mutex_);
   void DestroyPendingPayload(Payload::Id payload_id)
       ABSL_LOCKS_EXCLUDED(mutex_);
@@ -284,9 +317,17 @@ class PayloadManager : public EndpointManager::FrameProcessor {
   std::unique_ptr<CountDownLatch> shutdown_barrier_;
   int send_payload_count_ = 0;
   PendingPayloads pending_payloads_ ABSL_GUARDED_BY(mutex_);
-  SingleThreadExecutor bytes_payload_executor_;
-  SingleThreadExecutor file_payload_executor_;
-  SingleThreadExecutor stream_payload_executor_;
+  OutgoingPayloadExecutor bytes_payload_executor_;
+  OutgoingPayloadExecutor file_payload_executor_;
+  OutgoingPayloadExecutor stream_payload_executor_;
+  // Sends interactive payloads of any type, so that they do not wait for bulk
+  // transfers of the same type to complete.
+  OutgoingPayloadExecutor interactive_payload_executor_;
+  Mutex status_updates_mutex_;
+  // Runnables waiting for the status update thread; it runs one of them, in
+  // priority order, for each one queued, unless they have all run already.
+  PriorityLanes<std::function<void()>> status_updates_
+      ABSL_GUARDED_BY(status_updates_mutex_);
   SingleThreadExecutor payload_status_update_executor_;
 
   EndpointManager* endpoint_manager_;
@@ -14,8 +14,17 @@
 
 #include "core_v2/internal/payload_manager.h"
 
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "core_v2/internal/simulation_user.h"
+#include "core_v2/listeners.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/public/mutex.h"
+#include "platform_v2/public/mutex_lock.h"
 #include "platform_v2/public/pipe.h"
 #include "platform_v2/public/system_clock.h"
 #include "gmock/gmock.h"
@@ -27,6 +36,8 @@ namespace nearby {
 namespace connections {
 namespace {
 
+using ::testing::ElementsAre;
+
 constexpr absl::string_view kServiceId = "service-id";
 constexpr absl::string_view kDeviceA = "device-a";
 constexpr absl::string_view kDeviceB = "device-b";
@@ -47,6 +58,9 @@ constexpr BooleanMediumSelector kTestCases[] = {
     },
 };
 
+using PayloadChunkCallback = std::function<PayloadChunkAction(
+    const std::string& endpoint_id, const PayloadChunkInfo& chunk)>;
+
 class PayloadSimulationUser : public SimulationUser {
  public:
   explicit PayloadSimulationUser(
@@ -76,6 +90,27 @@ class PayloadSimulationUser : public SimulationUser {
     return client_.IsConnectedToEndpoint(discovered_.endpoint_id);
   }
 
+  // Like AcceptConnection(), but incoming payloads go to chunk_cb.
+  void AcceptConnectionWithSink(CountDownLatch* latch,
+                                PayloadChunkCallback chunk_cb) {
+    accept_latch_ = latch;
+    PayloadListener listener = {
+        .payload_cb =
+            [this](const std::string& endpoint_id, Payload payload) {
+              OnPayload(endpoint_id, std::move(payload));
+            },
+        .payload_progress_cb =
+            [this](const std::string& endpoint_id,
+                   const PayloadProgressInfo& info) {
+              OnPayloadProgress(endpoint_id, info);
+            },
+        .payload_chunk_cb = std::move(chunk_cb),
+    };
+    EXPECT_TRUE(mgr_.AcceptConnection(&client_, discovered_.endpoint_id,
+                                      std::move(listener))
+                    .Ok());
+  }
+
  protected:
   Payload::Id sender_payload_id_ = 0;
 };
@@ -85,8 +120,10 @@ class PayloadManagerTest
  protected:
   PayloadManagerTest() { env_.Stop(); }
 
+  // If chunk_cb is set, user_a receives payloads through it.
   bool SetupConnection(PayloadSimulationUser& user_a,
-                       PayloadSimulationUser& user_b) {
+                       PayloadSimulationUser& user_b,
+                       PayloadChunkCallback chunk_cb = nullptr) {
     user_a.StartAdvertising(std::string(kServiceId), &connection_latch_);
     user_b.StartDiscovery(std::string(kServiceId), &discovery_latch_);
     EXPECT_TRUE(discovery_latch_.Await(kDefaultTimeout).result());
@@ -101,7 +138,11 @@ class PayloadManagerTest
     NEARBY_LOG(INFO, "EP-A: [discovered] %s",
                user_a.GetDiscovered().endpoint_id.c_str());
     NEARBY_LOG(INFO, "Both users discovered their peers.");
-    user_a.AcceptConnection(&accept_latch_);
+    if (chunk_cb) {
+      user_a.AcceptConnectionWithSink(&accept_latch_, std::move(chunk_cb));
+    } else {
+      user_a.AcceptConnection(&accept_latch_);
+    }
     user_b.AcceptConnection(&accept_latch_);
     EXPECT_TRUE(accept_latch_.Await(kDefaultTimeout).result());
     NEARBY_LOG(INFO, "Both users reached connected state.");
@@ -311,6 +352,152 @@ TEST_P(PayloadManagerTest, CanCancelPayloadOnSenderSide) {
   env_.Stop();
 }
 
+TEST_P(PayloadManagerTest, SinkReceivesPayloadChunks) {
+  env_.Start();
+  PayloadSimulationUser user_a(kDeviceA, GetParam());
+  PayloadSimulationUser user_b(kDeviceB, GetParam());
+  Mutex mutex;
+  std::string received;
+  bool got_last_chunk = false;
+  CountDownLatch last_chunk_latch(1);
+  ASSERT_TRUE(SetupConnection(
+      user_a, user_b,
+      [&](const std::string& endpoint_id, const PayloadChunkInfo& chunk) {
+        MutexLock lock(&mutex);
+        EXPECT_EQ(chunk.offset, static_cast<std::int64_t>(received.size()));
+        EXPECT_EQ(chunk.type, Payload::Type::kBytes);
+        received.append(chunk.data.data(), chunk.data.size());
+        if (chunk.is_last) {
+          got_last_chunk = true;
+          last_chunk_latch.CountDown();
+        }
+        return PayloadChunkAction::kContinue;
+      }));
+
+  user_a.ExpectPayload(payload_latch_);
+  user_b.SendPayload(Payload(ByteArray{std::string(kMessage)}));
+  EXPECT_TRUE(last_chunk_latch.Await(kDefaultTimeout).result());
+  {
+    MutexLock lock(&mutex);
+    EXPECT_TRUE(got_last_chunk);
+    EXPECT_EQ(received, kMessage);
+  }
+  EXPECT_TRUE(user_a.WaitForProgress(
+      [status = PayloadProgressInfo::Status::kSuccess](
+          const PayloadProgressInfo& info) { return info.status == status; },
+      kProgressTimeout));
+  // Payloads received by the sink are not passed to payload_cb.
+  EXPECT_FALSE(payload_latch_.Await(absl::Milliseconds(100)).result());
+  NEARBY_LOG(INFO, "Test completed.");
+
+  user_a.Stop();
+  user_b.Stop();
+  env_.Stop();
+}
+
+TEST_P(PayloadManagerTest, SinkCanCancelPayload) {
+  env_.Start();
+  PayloadSimulationUser user_a(kDeviceA, GetParam());
+  PayloadSimulationUser user_b(kDeviceB, GetParam());
+  ASSERT_TRUE(SetupConnection(
+      user_a, user_b,
+      [](const std::string& endpoint_id, const PayloadChunkInfo& chunk) {
+        return PayloadChunkAction::kCancel;
+      }));
+
+  auto pipe = std::make_shared<Pipe>();
+  OutputStream& tx = pipe->GetOutputStream();
+  const ByteArray message{std::string(kMessage)};
+  tx.Write(message);
+
+  user_b.SendPayload(Payload([pipe]() -> InputStream& {
+    return pipe->GetInputStream();  // NOLINT
+  }));
+
+  // Sender will only handle cancel event if it is sending.
+  // Once cancel is handled, write will fail.
+  int count = 0;
+  while (true) {
+    if (!tx.Write(message).Ok()) break;
+    SystemClock::Sleep(kDefaultTimeout);
+    count++;
+  }
+  ASSERT_LE(count, 10);
+
+  EXPECT_TRUE(user_a.WaitForProgress(
+      [status = PayloadProgressInfo::Status::kCanceled](
+          const PayloadProgressInfo& info) { return info.status == status; },
+      kProgressTimeout));
+  NEARBY_LOG(INFO, "Stream cancelation received.");
+
+  tx.Close();
+
+  NEARBY_LOG(INFO, "Test completed.");
+  user_a.Stop();
+  user_b.Stop();
+  env_.Stop();
+}
+
+TEST_P(PayloadManagerTest, NormalPayloadOvertakesQueuedBulkPayload) {
+  env_.Start();
+  PayloadSimulationUser user_a(kDeviceA, GetParam());
+  PayloadSimulationUser user_b(kDeviceB, GetParam());
+  Mutex mutex;
+  std::vector<Payload::Id> started;
+  CountDownLatch first_started(1);
+  CountDownLatch all_done(3);
+  ASSERT_TRUE(SetupConnection(
+      user_a, user_b,
+      [&](const std::string& endpoint_id, const PayloadChunkInfo& chunk) {
+        MutexLock lock(&mutex);
+        if (chunk.offset == 0) {
+          started.push_back(chunk.payload_id);
+          first_started.CountDown();
+        }
+        if (chunk.is_last) all_done.CountDown();
+        return PayloadChunkAction::kContinue;
+      }));
+  const ByteArray message{std::string(kMessage)};
+  std::vector<std::shared_ptr<Pipe>> pipes;
+  auto make_stream_payload = [&pipes, &message](Payload::Priority priority) {
+    auto pipe = std::make_shared<Pipe>();
+    pipe->GetOutputStream().Write(message);
+    pipes.push_back(pipe);
+    Payload payload([pipe]() -> InputStream& {
+      return pipe->GetInputStream();  // NOLINT
+    });
+    payload.SetPriority(priority);
+    return payload;
+  };
+
+  // Keeps the stream payloads of user_b busy until its pipe is closed.
+  Payload running = make_stream_payload(Payload::Priority::kBulk);
+  Payload::Id running_id = running.GetId();
+  user_b.SendPayload(std::move(running));
+  ASSERT_TRUE(first_started.Await(kDefaultTimeout).result());
+
+  Payload bulk = make_stream_payload(Payload::Priority::kBulk);
+  Payload::Id bulk_id = bulk.GetId();
+  pipes.back()->GetOutputStream().Close();
+  user_b.SendPayload(std::move(bulk));
+  Payload normal = make_stream_payload(Payload::Priority::kNormal);
+  Payload::Id normal_id = normal.GetId();
+  pipes.back()->GetOutputStream().Close();
+  user_b.SendPayload(std::move(normal));
+
+  pipes.front()->GetOutputStream().Close();
+  EXPECT_TRUE(all_done.Await(kDefaultTimeout).result());
+  {
+    MutexLock lock(&mutex);
+    EXPECT_THAT(started, ElementsAre(running_id, normal_id, bulk_id));
+  }
+  NEARBY_LOG(INFO, "Test completed.");
+
+  user_a.Stop();
+  user_b.Stop();
+  env_.Stop();
+}
+
 INSTANTIATE_TEST_SUITE_P(ParametrisedPayloadManagerTest, PayloadManagerTest,
                          ::testing::ValuesIn(kTestCases));
 
@@ -52,33 +52,37 @@ Status PcpManager::StartAdvertising(ClientProxy* client,
                                     const string& service_id,
                                     const ConnectionOptions& options,
                                     const ConnectionRequestInfo& info) {
-  if (!SetCurrentPcpHandler(options.strategy)) {
+  PcpHandler* current = SetCurrentPcpHandler(options.strategy);
+  if (!current) {
     return {Status::kError};
   }
 
-  return current_->StartAdvertising(client, service_id, options, info);
+  return current->StartAdvertising(client, service_id, options, info);
 }
 
 void PcpManager::StopAdvertising(ClientProxy* client) {
-  if (current_) {
-    current_->StopAdvertising(client);
+  PcpHandler* current = current_;
+  if (current) {
+    current->StopAdvertising(client);
   }
 }
 
 Status PcpManager::StartDiscovery(ClientProxy* client, const string& service_id,
                                   const ConnectionOptions& options,
                                   DiscoveryListener listener) {
-  if (!SetCurrentPcpHandler(options.strategy)) {
+  PcpHandler* current = SetCurrentPcpHandler(options.strategy);
+  if (!current) {
     return {Status::kError};
   }
 
-  return current_->StartDiscovery(client, service_id, options,
-                                  std::move(listener));
+  return current->StartDiscovery(client, service_id, options,
+                                 std::move(listener));
 }
 
 void PcpManager::StopDiscovery(ClientProxy* client) {
-  if (current_) {
-    current_->StopDiscovery(client);
+  PcpHandler* current = current_;
+  if (current) {
+    current->StopDiscovery(client);
   }
 }
 
@@ -86,41 +90,45 @@ Status PcpManager::RequestConnection(ClientProxy* client,
                                      const string& endpoint_id,
                                      const ConnectionRequestInfo& info,
                                      const ConnectionOptions& options) {
-  if (!current_) {
+  PcpHandler* current = current_;
+  if (!current) {
     return {Status::kOutOfOrderApiCall};
   }
 
-  return current_->RequestConnection(client, endpoint_id, info, options);
+  return current->RequestConnection(client, endpoint_id, info, options);
 }
 
 Status PcpManager::AcceptConnection(ClientProxy* client,
                                     const string& endpoint_id,
                                     const PayloadListener& payload_listener) {
-  if (!current_) {
+  PcpHandler* current = current_;
+  if (!current) {
     return {Status::kOutOfOrderApiCall};
   }
 
-  return current_->AcceptConnection(client, endpoint_id, payload_listener);
+  return current->AcceptConnection(client, endpoint_id, payload_listener);
 }
 
 Status PcpManager::RejectConnection(ClientProxy* client,
                                     const string& endpoint_id) {
-  if (!current_) {
+  PcpHandler* current = current_;
+  if (!current) {
     return {Status::kOutOfOrderApiCall};
   }
 
-  return current_->RejectConnection(client, endpoint_id);
+  return current->RejectConnection(client, endpoint_id);
 }
 
-bool PcpManager::SetCurrentPcpHandler(Strategy strategy) {
-  current_ = GetPcpHandler(StrategyToPcp(strategy));
+PcpHandler* PcpManager::SetCurrentPcpHandler(Strategy strategy) {
+  PcpHandler* current = GetPcpHandler(StrategyToPcp(strategy));
+  current_ = current;
 
-  if (!current_) {
+  if (!current) {
     NEARBY_LOG(ERROR, "Failed to set current PCP handler: strategy=%s",
                strategy.GetName().c_str());
   }
 
-  return current_;
+  return current;
 }
 
 PcpHandler* PcpManager::GetPcpHandler(Pcp pcp) const {
@@ -15,6 +15,7 @@
 #ifndef CORE_V2_INTERNAL_PCP_MANAGER_H_
 #define CORE_V2_INTERNAL_PCP_MANAGER_H_
 
+#include <atomic>
 #include <string>
 
 #include "core_v2/internal/base_pcp_handler.h"
@@ -68,12 +69,15 @@ class PcpManager {
   void DisconnectFromEndpointManager();
 
  private:
-  bool SetCurrentPcpHandler(Strategy strategy);
+  // Returns the new current handler, or nullptr if strategy has none.
+  PcpHandler* SetCurrentPcpHandler(Strategy strategy);
   PcpHandler* GetPcpHandler(Pcp pcp) const;
 
   AtomicBoolean shutdown_{false};
   absl::flat_hash_map<Pcp, std::unique_ptr<BasePcpHandler>> handlers_;
-  PcpHandler* current_ = nullptr;
+  // Set by StartAdvertising() and StartDiscovery(), which may run
+  // concurrently with requests about endpoints.
+  std::atomic<PcpHandler*> current_{nullptr};
 };
 
 }  // namespace connections
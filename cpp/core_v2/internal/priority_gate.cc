@@ -0,0 +1,47 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/priority_gate.h"
+
+#include "platform_v2/public/mutex_lock.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+void PriorityGate::Enter(Payload::Priority priority) {
+  MutexLock lock(&mutex_);
+  if (!busy_) {
+    busy_ = true;
+    return;
+  }
+  std::int64_t ticket = next_ticket_++;
+  waiting_.Push(priority, ticket);
+  while (admitted_ticket_ != ticket) turn_changed_.Wait();
+}
+
+void PriorityGate::Leave() {
+  MutexLock lock(&mutex_);
+  if (waiting_.Empty()) {
+    busy_ = false;
+    return;
+  }
+  // The gate stays busy; the turn passes straight to the next caller.
+  admitted_ticket_ = waiting_.Pop();
+  turn_changed_.Notify();
+}
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,136 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_V2_INTERNAL_PRIORITY_GATE_H_
+#define CORE_V2_INTERNAL_PRIORITY_GATE_H_
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+#include "core_v2/payload.h"
+#include "platform_v2/public/condition_variable.h"
+#include "platform_v2/public/mutex.h"
+#include "absl/base/thread_annotations.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+// How many times an item may be passed over by more urgent ones, before it
+// goes next regardless.
+constexpr int kDefaultMaxBypasses = 8;
+
+// Items queued by Payload::Priority. Items are popped most urgent first, and
+// in the order they were pushed within a priority; except that the first item
+// of a priority goes next once more urgent items have been popped ahead of it
+// max_bypasses times, so that a steady flow of urgent items does not starve
+// the rest.
+//
+// Not thread-safe.
+template <typename T>
+class PriorityLanes {
+ public:
+  explicit PriorityLanes(int max_bypasses = kDefaultMaxBypasses)
+      : max_bypasses_(max_bypasses) {}
+
+  bool Empty() const {
+    for (const auto& lane : lanes_) {
+      if (!lane.empty()) return false;
+    }
+    return true;
+  }
+
+  void Push(Payload::Priority priority, T item) {
+    lanes_[static_cast<int>(priority)].push_back({std::move(item), 0});
+  }
+
+  // Must not be called when Empty().
+  T Pop() {
+    int next = kLanes;
+    for (int i = 0; i < kLanes; i++) {
+      if (lanes_[i].empty()) continue;
+      if (next == kLanes) {
+        next = i;
+      } else if (lanes_[i].front().bypasses >= max_bypasses_) {
+        next = i;
+        break;
+      }
+    }
+    for (int i = next + 1; i < kLanes; i++) {
+      if (!lanes_[i].empty()) lanes_[i].front().bypasses++;
+    }
+    T item = std::move(lanes_[next].front().item);
+    lanes_[next].pop_front();
+    return item;
+  }
+
+ private:
+  // Payload::Priority::kBulk is the least urgent priority.
+  static constexpr int kLanes = static_cast<int>(Payload::Priority::kBulk) + 1;
+
+  struct Entry {
+    T item;
+    // Times a more urgent item was popped while this one was first in line.
+    int bypasses;
+  };
+
+  const int max_bypasses_;
+  std::deque<Entry> lanes_[kLanes];
+};
+
+// Lets one caller through at a time. When busy, waiting callers are let
+// through in the order of PriorityLanes.
+class PriorityGate {
+ public:
+  explicit PriorityGate(int max_bypasses = kDefaultMaxBypasses)
+      : waiting_(max_bypasses) {}
+  PriorityGate(const PriorityGate&) = delete;
+  PriorityGate& operator=(const PriorityGate&) = delete;
+
+  // Blocks until it is the caller's turn.
+  void Enter(Payload::Priority priority) ABSL_LOCKS_EXCLUDED(mutex_);
+  // Ends the turn of the caller, and lets the next one through.
+  void Leave() ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  Mutex mutex_;
+  ConditionVariable turn_changed_{&mutex_};
+  bool busy_ ABSL_GUARDED_BY(mutex_) = false;
+  std::int64_t next_ticket_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Ticket of the waiting caller whose turn it is.
+  std::int64_t admitted_ticket_ ABSL_GUARDED_BY(mutex_) = -1;
+  PriorityLanes<std::int64_t> waiting_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Holds a turn of a PriorityGate for as long as it exists.
+class PriorityGateLock {
+ public:
+  PriorityGateLock(PriorityGate* gate, Payload::Priority priority)
+      : gate_(gate) {
+    gate_->Enter(priority);
+  }
+  ~PriorityGateLock() { gate_->Leave(); }
+  PriorityGateLock(const PriorityGateLock&) = delete;
+  PriorityGateLock& operator=(const PriorityGateLock&) = delete;
+
+ private:
+  PriorityGate* gate_;
+};
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+#endif  // CORE_V2_INTERNAL_PRIORITY_GATE_H_
@@ -0,0 +1,118 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/priority_gate.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "platform_v2/public/multi_thread_executor.h"
+#include "platform_v2/public/mutex.h"
+#include "platform_v2/public/mutex_lock.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+using ::testing::ElementsAre;
+using Priority = Payload::Priority;
+
+std::vector<std::string> PopAll(PriorityLanes<std::string>& lanes) {
+  std::vector<std::string> items;
+  while (!lanes.Empty()) items.push_back(lanes.Pop());
+  return items;
+}
+
+TEST(PriorityLanesTest, PopsMostUrgentFirst) {
+  PriorityLanes<std::string> lanes;
+  lanes.Push(Priority::kBulk, "b1");
+  lanes.Push(Priority::kNormal, "n1");
+  lanes.Push(Priority::kInteractive, "i1");
+  lanes.Push(Priority::kBulk, "b2");
+  lanes.Push(Priority::kInteractive, "i2");
+
+  EXPECT_THAT(PopAll(lanes), ElementsAre("i1", "i2", "n1", "b1", "b2"));
+}
+
+TEST(PriorityLanesTest, BypassedItemGoesNext) {
+  PriorityLanes<std::string> lanes(/*max_bypasses=*/2);
+  lanes.Push(Priority::kBulk, "b1");
+  lanes.Push(Priority::kBulk, "b2");
+  for (int i = 1; i <= 5; i++) {
+    lanes.Push(Priority::kInteractive, "i" + std::to_string(i));
+  }
+
+  EXPECT_THAT(PopAll(lanes),
+              ElementsAre("i1", "i2", "b1", "i3", "i4", "b2", "i5"));
+}
+
+TEST(PriorityGateTest, LetsOneCallerThroughAtATime) {
+  constexpr int kCallers = 8;
+  constexpr int kTurns = 100;
+  PriorityGate gate;
+  std::atomic_int inside{0};
+  std::atomic_int max_inside{0};
+  {
+    MultiThreadExecutor executor(kCallers);
+    for (int i = 0; i < kCallers; i++) {
+      auto priority = static_cast<Priority>(i % 3);
+      executor.Execute([&gate, &inside, &max_inside, priority]() {
+        for (int j = 0; j < kTurns; j++) {
+          PriorityGateLock lock(&gate, priority);
+          int now = ++inside;
+          if (now > max_inside) max_inside = now;
+          --inside;
+        }
+      });
+    }
+  }
+
+  EXPECT_EQ(max_inside, 1);
+}
+
+TEST(PriorityGateTest, LetsMostUrgentWaiterThroughFirst) {
+  PriorityGate gate;
+  Mutex mutex;
+  std::vector<std::string> order;
+  {
+    MultiThreadExecutor executor(2);
+    gate.Enter(Priority::kNormal);
+    auto enter = [&gate, &mutex, &order](Priority priority,
+                                         const std::string& name) {
+      PriorityGateLock lock(&gate, priority);
+      MutexLock order_lock(&mutex);
+      order.push_back(name);
+    };
+    executor.Execute([&enter]() { enter(Priority::kBulk, "bulk"); });
+    // Let the bulk caller start waiting first.
+    absl::SleepFor(absl::Milliseconds(100));
+    executor.Execute(
+        [&enter]() { enter(Priority::kInteractive, "interactive"); });
+    absl::SleepFor(absl::Milliseconds(100));
+    gate.Leave();
+  }
+
+  EXPECT_THAT(order, ElementsAre("interactive", "bulk"));
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
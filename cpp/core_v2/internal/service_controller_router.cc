@@ -23,7 +23,10 @@
 #include "core_v2/options.h"
 #include "core_v2/params.h"
 #include "core_v2/payload.h"
+#include "platform_v2/public/count_down_latch.h"
 #include "platform_v2/public/logging.h"
+#include "platform_v2/public/mutex_lock.h"
+#include "absl/strings/str_cat.h"
 #include "absl/time/clock.h"
 
 namespace location {
@@ -31,18 +34,28 @@ namespace nearby {
 namespace connections {
 
 ServiceControllerRouter::~ServiceControllerRouter() {
+  // Moved from.
+  if (!state_) return;
   NEARBY_LOG(INFO, "ServiceControllerRouter going down.");
 
+  // Activities waiting for their turn are not known to serializer yet.
+  {
+    MutexLock lock(&state_->mutex);
+    while (!state_->activities.empty()) state_->idle.Wait();
+  }
+
   // And make sure that cleanup is the last thing we do.
-  serializer_.Shutdown();
+  state_->serializer.Shutdown();
+  state_->payload_serializer.Shutdown();
 }
 
 void ServiceControllerRouter::StartAdvertising(
     ClientProxy* client, absl::string_view service_id,
     const ConnectionOptions& options, const ConnectionRequestInfo& info,
     const ResultCallback& callback) {
-  RouteToServiceController([this, client, service_id = std::string(service_id),
-                            options, info, callback]() {
+  RouteToServiceController(client, [this, client,
+                                    service_id = std::string(service_id),
+                                    options, info, callback]() {
     Status status = AcquireServiceControllerForClient(client, options.strategy);
     if (!status.Ok()) {
       callback.result_cb(status);
@@ -54,17 +67,19 @@ void ServiceControllerRouter::StartAdvertising(
       return;
     }
 
-    status = service_controller_->StartAdvertising(client, service_id, options,
-                                                   info);
+    ServiceControllerLease service_controller(this, client);
+    status =
+        service_controller->StartAdvertising(client, service_id, options, info);
     callback.result_cb(status);
   });
 }
 
 void ServiceControllerRouter::StopAdvertising(ClientProxy* client,
                                               const ResultCallback& callback) {
-  RouteToServiceController([this, client, callback]() {
-    if (ClientHasAcquiredServiceController(client) && client->IsAdvertising()) {
-      service_controller_->StopAdvertising(client);
+  RouteToServiceController(client, [this, client, callback]() {
+    ServiceControllerLease service_controller(this, client);
+    if (service_controller && client->IsAdvertising()) {
+      service_controller->StopAdvertising(client);
     }
     callback.result_cb({Status::kSuccess});
   });
@@ -75,8 +90,9 @@ void ServiceControllerRouter::StartDiscovery(ClientProxy* client,
                                              const ConnectionOptions& options,
                                              const DiscoveryListener& listener,
                                              const ResultCallback& callback) {
-  RouteToServiceController([this, client, service_id = std::string(service_id),
-                            options, listener, callback]() {
+  RouteToServiceController(client, [this, client,
+                                    service_id = std::string(service_id),
+                                    options, listener, callback]() {
     Status status = AcquireServiceControllerForClient(client, options.strategy);
     if (!status.Ok()) {
       callback.result_cb(status);
@@ -88,17 +104,19 @@ void ServiceControllerRouter::StartDiscovery(ClientProxy* client,
       return;
     }
 
-    status = service_controller_->StartDiscovery(client, service_id, options,
-                                                 listener);
+    ServiceControllerLease service_controller(this, client);
+    status = service_controller->StartDiscovery(client, service_id, options,
+                                                listener);
     callback.result_cb(status);
   });
 }
 
 void ServiceControllerRouter::StopDiscovery(ClientProxy* client,
                                             const ResultCallback& callback) {
-  RouteToServiceController([this, client, callback]() {
-    if (ClientHasAcquiredServiceController(client) && client->IsDiscovering()) {
-      service_controller_->StopDiscovery(client);
+  RouteToServiceController(client, [this, client, callback]() {
+    ServiceControllerLease service_controller(this, client);
+    if (service_controller && client->IsDiscovering()) {
+      service_controller->StopDiscovery(client);
     }
     callback.result_cb({Status::kSuccess});
   });
@@ -108,62 +126,68 @@ void ServiceControllerRouter::RequestConnection(
     ClientProxy* client, absl::string_view endpoint_id,
     const ConnectionRequestInfo& info, const ConnectionOptions& options,
     const ResultCallback& callback) {
-  RouteToServiceController([this, client,
-                            endpoint_id = std::string(endpoint_id), info,
-                            options, callback]() {
-    if (!ClientHasAcquiredServiceController(client)) {
-      callback.result_cb({Status::kOutOfOrderApiCall});
-      return;
-    }
+  RouteToServiceController(
+      client, std::string(endpoint_id),
+      [this, client, endpoint_id = std::string(endpoint_id), info, options,
+       callback]() {
+        ServiceControllerLease service_controller(this, client);
+        if (!service_controller) {
+          callback.result_cb({Status::kOutOfOrderApiCall});
+          return;
+        }
 
-    if (client->HasPendingConnectionToEndpoint(endpoint_id) ||
-        client->IsConnectedToEndpoint(endpoint_id)) {
-      callback.result_cb({Status::kAlreadyConnectedToEndpoint});
-      return;
-    }
+        if (client->HasPendingConnectionToEndpoint(endpoint_id) ||
+            client->IsConnectedToEndpoint(endpoint_id)) {
+          callback.result_cb({Status::kAlreadyConnectedToEndpoint});
+          return;
+        }
 
-    callback.result_cb(service_controller_->RequestConnection(
-        client, endpoint_id, info, options));
-  });
+        callback.result_cb(service_controller->RequestConnection(
+            client, endpoint_id, info, options));
+      });
 }
 
 void ServiceControllerRouter::AcceptConnection(ClientProxy* client,
                                                absl::string_view endpoint_id,
                                                const PayloadListener& listener,
                                                const ResultCallback& callback) {
-  RouteToServiceController([this, client,
-                            endpoint_id = std::string(endpoint_id), listener,
-                            callback]() {
-    if (!ClientHasAcquiredServiceController(client)) {
-      callback.result_cb({Status::kOutOfOrderApiCall});
-      return;
-    }
+  RouteToServiceController(
+      client, std::string(endpoint_id),
+      [this, client, endpoint_id = std::string(endpoint_id), listener,
+       callback]() {
+        ServiceControllerLease service_controller(this, client);
+        if (!service_controller) {
+          callback.result_cb({Status::kOutOfOrderApiCall});
+          return;
+        }
 
-    if (client->IsConnectedToEndpoint(endpoint_id)) {
-      callback.result_cb({Status::kAlreadyConnectedToEndpoint});
-      return;
-    }
+        if (client->IsConnectedToEndpoint(endpoint_id)) {
+          callback.result_cb({Status::kAlreadyConnectedToEndpoint});
+          return;
+        }
 
-    if (client->HasLocalEndpointResponded(endpoint_id)) {
-      NEARBY_LOG(INFO,
-                 "[ServiceControllerRouter:Accept]: Client has local "
-                 "endpoint responded; id=%s",
-                 endpoint_id.c_str());
-      callback.result_cb({Status::kOutOfOrderApiCall});
-      return;
-    }
+        if (client->HasLocalEndpointResponded(endpoint_id)) {
+          NEARBY_LOG(INFO,
+                     "[ServiceControllerRouter:Accept]: Client has local "
+                     "endpoint responded; id=%s",
+                     endpoint_id.c_str());
+          callback.result_cb({Status::kOutOfOrderApiCall});
+          return;
+        }
 
-    callback.result_cb(
-        service_controller_->AcceptConnection(client, endpoint_id, listener));
-  });
+        callback.result_cb(service_controller->AcceptConnection(
+            client, endpoint_id, listener));
+      });
 }
 
 void ServiceControllerRouter::RejectConnection(ClientProxy* client,
                                                absl::string_view endpoint_id,
                                                const ResultCallback& callback) {
   RouteToServiceController(
+      client, std::string(endpoint_id),
       [this, client, endpoint_id = std::string(endpoint_id), callback]() {
-        if (!ClientHasAcquiredServiceController(client)) {
+        ServiceControllerLease service_controller(this, client);
+        if (!service_controller) {
           callback.result_cb({Status::kOutOfOrderApiCall});
           return;
         }
@@ -183,7 +207,7 @@ void ServiceControllerRouter::RejectConnection(ClientProxy* client,
         }
 
         callback.result_cb(
-            service_controller_->RejectConnection(client, endpoint_id));
+            service_controller->RejectConnection(client, endpoint_id));
       });
 }
 
@@ -191,14 +215,16 @@ void ServiceControllerRouter::InitiateBandwidthUpgrade(
     ClientProxy* client, absl::string_view endpoint_id,
     const ResultCallback& callback) {
   RouteToServiceController(
+      client, std::string(endpoint_id),
       [this, client, endpoint_id = std::string(endpoint_id), callback]() {
-        if (!ClientHasAcquiredServiceController(client) ||
+        ServiceControllerLease service_controller(this, client);
+        if (!service_controller ||
             !client->IsConnectedToEndpoint(endpoint_id)) {
           callback.result_cb({Status::kOutOfOrderApiCall});
           return;
         }
 
-        service_controller_->InitiateBandwidthUpgrade(client, endpoint_id);
+        service_controller->InitiateBandwidthUpgrade(client, endpoint_id);
 
         // Operation is triggered; the caller can listen to
         // ConnectionListener::OnBandwidthChanged() to determine its success.
@@ -219,9 +245,10 @@ void ServiceControllerRouter::SendPayload(
   const std::vector<std::string> endpoints =
       std::vector<std::string>(endpoint_ids.begin(), endpoint_ids.end());
 
-  RouteToServiceController(
+  RouteToPayloadManager(
       [this, client, shared_payload, endpoints, callback]() {
-        if (!ClientHasAcquiredServiceController(client)) {
+        ServiceControllerLease service_controller(this, client);
+        if (!service_controller) {
           callback.result_cb({Status::kOutOfOrderApiCall});
           return;
         }
@@ -231,8 +258,8 @@ void ServiceControllerRouter::SendPayload(
           return;
         }
 
-        service_controller_->SendPayload(client, endpoints,
-                                         std::move(*shared_payload));
+        service_controller->SendPayload(client, endpoints,
+                                        std::move(*shared_payload));
 
         // At this point, we've queued up the send Payload request with the
         // ServiceController; any further failures (e.g. one of the endpoints is
@@ -245,13 +272,14 @@ void ServiceControllerRouter::SendPayload(
 void ServiceControllerRouter::CancelPayload(ClientProxy* client,
                                             std::uint64_t payload_id,
                                             const ResultCallback& callback) {
-  RouteToServiceController([this, client, payload_id, callback]() {
-    if (!ClientHasAcquiredServiceController(client)) {
+  RouteToPayloadManager([this, client, payload_id, callback]() {
+    ServiceControllerLease service_controller(this, client);
+    if (!service_controller) {
       callback.result_cb({Status::kOutOfOrderApiCall});
       return;
     }
 
-    callback.result_cb(service_controller_->CancelPayload(client, payload_id));
+    callback.result_cb(service_controller->CancelPayload(client, payload_id));
   });
 }
 
@@ -259,14 +287,16 @@ void ServiceControllerRouter::DisconnectFromEndpoint(
     ClientProxy* client, absl::string_view endpoint_id,
     const ResultCallback& callback) {
   RouteToServiceController(
+      client, std::string(endpoint_id),
       [this, client, endpoint_id = std::string(endpoint_id), callback]() {
-        if (ClientHasAcquiredServiceController(client)) {
+        ServiceControllerLease service_controller(this, client);
+        if (service_controller) {
           if (!client->IsConnectedToEndpoint(endpoint_id) &&
               !client->HasPendingConnectionToEndpoint(endpoint_id)) {
             callback.result_cb({Status::kOutOfOrderApiCall});
             return;
           }
-          service_controller_->DisconnectFromEndpoint(client, endpoint_id);
+          service_controller->DisconnectFromEndpoint(client, endpoint_id);
           callback.result_cb({Status::kSuccess});
         }
       });
@@ -274,19 +304,24 @@ void ServiceControllerRouter::DisconnectFromEndpoint(
 
 void ServiceControllerRouter::StopAllEndpoints(ClientProxy* client,
                                                const ResultCallback& callback) {
-  RouteToServiceController([this, client, callback]() {
-    if (ClientHasAcquiredServiceController(client)) {
-      DoneWithStrategySessionForClient(client);
-    }
+  RouteToServiceController(client, [this, client, callback]() {
+    DoneWithStrategySessionForClient(client);
     callback.result_cb({Status::kSuccess});
   });
 }
 
 void ServiceControllerRouter::ClientDisconnecting(
     ClientProxy* client, const ResultCallback& callback) {
-  RouteToServiceController([this, client, callback]() {
-    if (ClientHasAcquiredServiceController(client)) {
-      DoneWithStrategySessionForClient(client);
+  // Moved from; there is nothing to disconnect.
+  if (!state_) {
+    callback.result_cb({Status::kSuccess});
+    return;
+  }
+  RouteToServiceController(client, [this, client, callback]() {
+    // The client is going away; none of its activities may outlive it. Its
+    // other activities ran before this one.
+    WaitForPayloadActivities();
+    if (DoneWithStrategySessionForClient(client)) {
       NEARBY_LOG(INFO,
                  "[ServiceControllerRouter:Disconnect]: Client has completed "
                  "the client's connection");
@@ -295,9 +330,25 @@ void ServiceControllerRouter::ClientDisconnecting(
   });
 }
 
+ServiceControllerRouter::ServiceControllerLease::ServiceControllerLease(
+    ServiceControllerRouter* router, ClientProxy* client)
+    : router_(router) {
+  MutexLock lock(&router_->state_->mutex);
+  if (!router_->ClientHasAcquiredServiceController(client)) return;
+  controller_ = router_->state_->service_controller.get();
+  router_->state_->leases++;
+}
+
+ServiceControllerRouter::ServiceControllerLease::~ServiceControllerLease() {
+  if (!controller_) return;
+  MutexLock lock(&router_->state_->mutex);
+  if (--router_->state_->leases == 0) router_->state_->done.Notify();
+}
+
 Status ServiceControllerRouter::AcquireServiceControllerForClient(
     ClientProxy* client, Strategy strategy) {
-  if (current_strategy_.IsNone()) {
+  MutexLock lock(&state_->mutex);
+  if (state_->current_strategy.IsNone()) {
     // Case 1: There is no existing Strategy at all.
 
     // Set everything up for the first time.
@@ -305,14 +356,14 @@ Status ServiceControllerRouter::AcquireServiceControllerForClient(
     if (!status.Ok()) {
       return status;
     }
-    clients_.insert(client);
+    state_->clients.insert(client);
     return {Status::kSuccess};
-  } else if (strategy == current_strategy_) {
+  } else if (strategy == state_->current_strategy) {
     // Case 2: The existing Strategy matches.
 
     // The new client just needs to be added to the set of clients using the
     // current ServiceController.
-    clients_.insert(client);
+    state_->clients.insert(client);
     return {Status::kSuccess};
   } else {
     // Case 3: The existing Strategy doesn't match.
@@ -320,7 +371,7 @@ Status ServiceControllerRouter::AcquireServiceControllerForClient(
     // It's only safe for a client to cause a switch if it's the only client
     // using the current ServiceController.
     bool is_the_only_client_of_service_controller =
-        clients_.size() == 1 && ClientHasAcquiredServiceController(client);
+        state_->clients.size() == 1 && ClientHasAcquiredServiceController(client);
     if (!is_the_only_client_of_service_controller) {
       NEARBY_LOG(INFO,
                  "[ServiceControllerRouter:AcquireServiceControllerForClient]: "
@@ -337,6 +388,16 @@ Status ServiceControllerRouter::AcquireServiceControllerForClient(
       return {Status::kOutOfOrderApiCall};
     }
 
+    // The current ServiceController may only be replaced once its payload
+    // activities are done with it. Other clients may acquire it meanwhile.
+    WaitForServiceControllerUnused();
+    if (state_->clients.size() != 1) {
+      NEARBY_LOG(INFO,
+                 "[ServiceControllerRouter:AcquireServiceControllerForClient]: "
+                 "Client has already active strategy.");
+      return {Status::kAlreadyHaveActiveStrategy};
+    }
+
     // By this point, it's safe to switch the Strategy and ServiceController
     // (and since it's the only client, there's no need to add it to the set of
     // clients using the current ServiceController).
@@ -346,42 +407,128 @@ Status ServiceControllerRouter::AcquireServiceControllerForClient(
 
 bool ServiceControllerRouter::ClientHasAcquiredServiceController(
     ClientProxy* client) const {
-  return clients_.contains(client);
+  return state_->clients.contains(client);
 }
 
 void ServiceControllerRouter::ReleaseServiceControllerForClient(
     ClientProxy* client) {
-  clients_.erase(client);
-
-  if (clients_.empty()) {
-    service_controller_.reset();
-    current_strategy_ = Strategy{};
+  MutexLock lock(&state_->mutex);
+  state_->clients.erase(client);
+
+  if (state_->clients.empty()) {
+    WaitForServiceControllerUnused();
+    // Another client may have acquired it meanwhile.
+    if (!state_->clients.empty()) return;
+    state_->service_controller.reset();
+    state_->current_strategy = Strategy{};
   }
 }
 
 /** Clean up all state for this client. The client is now free to switch
  * strategies. */
-void ServiceControllerRouter::DoneWithStrategySessionForClient(
+bool ServiceControllerRouter::DoneWithStrategySessionForClient(
     ClientProxy* client) {
-  // Disconnect from all the connected endpoints tied to this clientProxy.
-  for (auto& endpoint_id : client->GetPendingConnectedEndpoints()) {
-    service_controller_->DisconnectFromEndpoint(client, endpoint_id);
+  {
+    ServiceControllerLease service_controller(this, client);
+    if (!service_controller) return false;
+
+    // Disconnect from all the connected endpoints tied to this clientProxy.
+    for (auto& endpoint_id : client->GetPendingConnectedEndpoints()) {
+      service_controller->DisconnectFromEndpoint(client, endpoint_id);
+    }
+
+    for (auto& endpoint_id : client->GetConnectedEndpoints()) {
+      service_controller->DisconnectFromEndpoint(client, endpoint_id);
+    }
+
+    // Stop any advertising and discovery that may be underway due to this
+    // clientProxy.
+    service_controller->StopAdvertising(client);
+    service_controller->StopDiscovery(client);
+  }
+
+  ReleaseServiceControllerForClient(client);
+  return true;
+}
+
+void ServiceControllerRouter::RouteToServiceController(ClientProxy* client,
+                                                       Runnable runnable) {
+  RouteToServiceController(
+      client, {
+                  .key = absl::StrCat(client->GetClientId()),
+                  .client_wide = true,
+                  .runnable = std::move(runnable),
+              });
+}
+
+void ServiceControllerRouter::RouteToServiceController(
+    ClientProxy* client, const std::string& endpoint_id, Runnable runnable) {
+  std::string key = absl::StrCat(client->GetClientId(), ":", endpoint_id);
+  RouteToServiceController(client, {
+                                       .key = std::move(key),
+                                       .client_wide = false,
+                                       .runnable = std::move(runnable),
+                                   });
+}
+
+void ServiceControllerRouter::RouteToServiceController(ClientProxy* client,
+                                                       Activity activity) {
+  MutexLock lock(&state_->mutex);
+  ClientActivities& activities = state_->activities[client];
+  activities.waiting.push_back(std::move(activity));
+  AdmitActivities(client, activities);
+}
+
+void ServiceControllerRouter::AdmitActivities(ClientProxy* client,
+                                              ClientActivities& activities) {
+  while (!activities.waiting.empty() && !activities.client_activity_admitted) {
+    Activity& activity = activities.waiting.front();
+    if (activity.client_wide) {
+      if (activities.endpoint_activities_admitted > 0) return;
+      activities.client_activity_admitted = true;
+    } else {
+      activities.endpoint_activities_admitted++;
+    }
+    state_->serializer.Execute(
+        activity.key, [this, client, client_wide = activity.client_wide,
+                       runnable = std::move(activity.runnable)]() {
+          runnable();
+          OnActivityDone(client, client_wide);
+        });
+    activities.waiting.pop_front();
   }
+}
 
-  for (auto& endpoint_id : client->GetConnectedEndpoints()) {
-    service_controller_->DisconnectFromEndpoint(client, endpoint_id);
+void ServiceControllerRouter::OnActivityDone(ClientProxy* client,
+                                             bool client_wide) {
+  MutexLock lock(&state_->mutex);
+  auto item = state_->activities.find(client);
+  ClientActivities& activities = item->second;
+  if (client_wide) {
+    activities.client_activity_admitted = false;
+  } else {
+    activities.endpoint_activities_admitted--;
+  }
+  AdmitActivities(client, activities);
+  if (activities.waiting.empty() && !activities.client_activity_admitted &&
+      activities.endpoint_activities_admitted == 0) {
+    state_->activities.erase(item);
+    if (state_->activities.empty()) state_->idle.Notify();
   }
+}
 
-  // Stop any advertising and discovery that may be underway due to this
-  // clientProxy.
-  service_controller_->StopAdvertising(client);
-  service_controller_->StopDiscovery(client);
+void ServiceControllerRouter::RouteToPayloadManager(Runnable runnable) {
+  state_->payload_serializer.Execute(std::move(runnable));
+}
 
-  ReleaseServiceControllerForClient(client);
+void ServiceControllerRouter::WaitForPayloadActivities() {
+  CountDownLatch latch(1);
+  state_->payload_serializer.Execute([&latch]() { latch.CountDown(); });
+  latch.Await();
 }
 
-void ServiceControllerRouter::RouteToServiceController(Runnable runnable) {
-  serializer_.Execute(std::move(runnable));
+void ServiceControllerRouter::WaitForServiceControllerUnused() {
+  while (state_->leases > 0) state_->done.Wait();
 }
 
 bool ServiceControllerRouter::ClientHasConnectionToAtLeastOneEndpoint(
@@ -401,8 +548,8 @@ Status ServiceControllerRouter::UpdateCurrentServiceControllerAndStrategy(
     return {Status::kError};
   }
 
-  service_controller_.reset(service_controller_factory_());
-  current_strategy_ = strategy;
+  state_->service_controller.reset(service_controller_factory_());
+  state_->current_strategy = strategy;
 
   return {Status::kSuccess};
 }
@@ -15,16 +15,22 @@
 #ifndef CORE_V2_INTERNAL_SERVICE_CONTROLLER_ROUTER_H_
 #define CORE_V2_INTERNAL_SERVICE_CONTROLLER_ROUTER_H_
 
+#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "core_v2/internal/client_proxy.h"
+#include "core_v2/internal/keyed_executor.h"
 #include "core_v2/internal/service_controller.h"
 #include "core_v2/options.h"
 #include "core_v2/params.h"
 #include "platform_v2/base/runnable.h"
+#include "platform_v2/public/condition_variable.h"
+#include "platform_v2/public/mutex.h"
 #include "platform_v2/public/single_thread_executor.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
@@ -47,10 +53,21 @@ namespace connections {
 //
 // Every activity is handled the same way:
 // 1) all the arguments to the call are captured by value;
-// 2) the actual processing is scheduled on a private single-threaded executor,
-//    which makes locking unnecessary, when internal data is being manipulated.
+// 2) the actual processing is scheduled on a private executor. Activities
+//    that change the state of the whole client (advertising, discovery,
+//    stopping all endpoints, disconnecting) run one at a time, after the
+//    earlier activities of that client. Activities of one endpoint run after
+//    the earlier activities of that endpoint, and the earlier activities of
+//    the whole client, but concurrently with those of other endpoints; so a
+//    connection request that takes a while only holds up the later
+//    activities of its endpoint, and those of the whole client;
 // 3) activity handlers are delegating much of their work to an implementation
 //    of a ServiceController interface, which does the actual job.
+//
+// Payload activities only queue work with the ServiceController. They are
+// scheduled on an executor of their own, so that they never wait for
+// connections to be set up, or for advertising and discovery to start or
+// stop.
 class ServiceControllerRouter {
  public:
   explicit ServiceControllerRouter(std::function<ServiceController*()> factory)
@@ -100,23 +117,113 @@ class ServiceControllerRouter {
 
  private:
   friend class ServiceControllerRouterTest;
+  // Keeps the service controller from being replaced or released for as long
+  // as it lives, so that it may be used without holding the mutex. Holds null
+  // if the client has not acquired the service controller.
+  class ServiceControllerLease {
+   public:
+    ServiceControllerLease(ServiceControllerRouter* router,
+                           ClientProxy* client);
+    ~ServiceControllerLease();
+    ServiceControllerLease(const ServiceControllerLease&) = delete;
+    ServiceControllerLease& operator=(const ServiceControllerLease&) = delete;
+
+    explicit operator bool() const { return controller_ != nullptr; }
+    ServiceController* operator->() const { return controller_; }
+
+   private:
+    ServiceControllerRouter* router_;
+    ServiceController* controller_ = nullptr;
+  };
+
   static bool ClientHasConnectionToAtLeastOneEndpoint(
       ClientProxy* client, const std::vector<std::string>& remote_endpoint_ids);
 
-  void RouteToServiceController(Runnable runnable);
+  // Runs runnable after the earlier activities of client.
+  void RouteToServiceController(ClientProxy* client, Runnable runnable)
+      ABSL_LOCKS_EXCLUDED(state_->mutex);
+  // Runs runnable after the earlier activities of endpoint_id, and those of
+  // the whole client.
+  void RouteToServiceController(ClientProxy* client,
+                                const std::string& endpoint_id,
+                                Runnable runnable)
+      ABSL_LOCKS_EXCLUDED(state_->mutex);
+  // Runs runnable after the earlier payload activities.
+  void RouteToPayloadManager(Runnable runnable);
+  // Waits for the payload activities scheduled so far to complete. Payload
+  // activities never wait for others, so activities of clients may wait for
+  // them.
+  void WaitForPayloadActivities();
 
   Status AcquireServiceControllerForClient(ClientProxy* client,
-                                           Strategy strategy);
-  bool ClientHasAcquiredServiceController(ClientProxy* client) const;
-  void ReleaseServiceControllerForClient(ClientProxy* client);
-  void DoneWithStrategySessionForClient(ClientProxy* client);
-  Status UpdateCurrentServiceControllerAndStrategy(Strategy strategy);
+                                           Strategy strategy)
+      ABSL_LOCKS_EXCLUDED(state_->mutex);
+  bool ClientHasAcquiredServiceController(ClientProxy* client) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(state_->mutex);
+  void ReleaseServiceControllerForClient(ClientProxy* client)
+      ABSL_LOCKS_EXCLUDED(state_->mutex);
+  // Returns false if the client has not acquired the service controller.
+  bool DoneWithStrategySessionForClient(ClientProxy* client)
+      ABSL_LOCKS_EXCLUDED(state_->mutex);
+  Status UpdateCurrentServiceControllerAndStrategy(Strategy strategy)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(state_->mutex);
+  // Waits for all the leases of service_controller to end. Leases are only
+  // held by activities that are running, and those never wait for
+  // activities queued behind them, so this does not deadlock.
+  void WaitForServiceControllerUnused()
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(state_->mutex);
+
+  // An activity of a client, waiting for its turn.
+  struct Activity {
+    // Key of serializer to run on.
+    std::string key;
+    // True if it changes the state of the whole client.
+    bool client_wide;
+    Runnable runnable;
+  };
+  // Activities of a client. The ones of the whole client are admitted to
+  // serializer one at a time, once the ones admitted before are done; those of
+  // endpoints are admitted together, once no activity of the whole client
+  // is. Nothing waits on a thread for its turn.
+  struct ClientActivities {
+    std::deque<Activity> waiting;
+    bool client_activity_admitted = false;
+    int endpoint_activities_admitted = 0;
+  };
+
+  void RouteToServiceController(ClientProxy* client, Activity activity)
+      ABSL_LOCKS_EXCLUDED(state_->mutex);
+  // Admits the waiting activities of client whose turn it is.
+  void AdmitActivities(ClientProxy* client, ClientActivities& activities)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(state_->mutex);
+  void OnActivityDone(ClientProxy* client, bool client_wide)
+      ABSL_LOCKS_EXCLUDED(state_->mutex);
+
+  // Most activities run at once.
+  static constexpr int kMaxConcurrentActivities = 4;
+
+  // Held by pointer, so that we stay movable.
+  struct State {
+    mutable Mutex mutex;
+    // Signaled when the number of leases goes down.
+    ConditionVariable done{&mutex};
+    // Signaled when activities becomes empty.
+    ConditionVariable idle{&mutex};
+    absl::flat_hash_set<ClientProxy*> clients ABSL_GUARDED_BY(mutex);
+    std::unique_ptr<ServiceController> service_controller
+        ABSL_GUARDED_BY(mutex);
+    Strategy current_strategy ABSL_GUARDED_BY(mutex);
+    // Number of ServiceControllerLeases alive.
+    int leases ABSL_GUARDED_BY(mutex) = 0;
+    // Clients with activities waiting or admitted.
+    absl::flat_hash_map<ClientProxy*, ClientActivities> activities
+        ABSL_GUARDED_BY(mutex);
+    KeyedExecutor serializer{kMaxConcurrentActivities};
+    SingleThreadExecutor payload_serializer;
+  };
 
-  absl::flat_hash_set<ClientProxy*> clients_;
   std::function<ServiceController*()> service_controller_factory_;
-  std::unique_ptr<ServiceController> service_controller_;
-  Strategy current_strategy_;
-  SingleThreadExecutor serializer_;
+  std::unique_ptr<State> state_ = std::make_unique<State>();
 };
 
 }  // namespace connections
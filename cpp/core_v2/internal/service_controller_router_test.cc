@@ -26,6 +26,7 @@
 #include "core_v2/params.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/public/condition_variable.h"
+#include "platform_v2/public/count_down_latch.h"
 #include "platform_v2/public/mutex.h"
 #include "platform_v2/public/mutex_lock.h"
 #include "gmock/gmock.h"
@@ -39,6 +40,8 @@ namespace nearby {
 namespace connections {
 
 namespace {
+using ::testing::_;
+using ::testing::InvokeWithoutArgs;
 using ::testing::Return;
 }  // namespace
 
@@ -48,7 +51,7 @@ class ServiceControllerRouterTest : public testing::Test {
  public:
   ServiceControllerRouterTest() = default;
   ~ServiceControllerRouterTest() override {
-    router_.service_controller_.release();
+    router_.state_->service_controller.release();
   }
 
   void StartAdvertising(ClientProxy* client, std::string service_id,
@@ -386,6 +389,117 @@ TEST_F(ServiceControllerRouterTest, DisconnectFromEndpointCalled) {
   DisconnectFromEndpoint(&client_, kRemoteEndpointId, kCallback);
 }
 
+TEST_F(ServiceControllerRouterTest, SendPayloadDoesNotWaitForEndpoint) {
+  StartDiscovery(&client_, kServiceId, kConnectionOptions, discovery_listener_,
+                 kCallback);
+  RequestConnection(&client_, kRemoteEndpointId, kConnectionRequestInfo,
+                    kCallback);
+  AcceptConnection(&client_, kRemoteEndpointId, payload_listener_, kCallback);
+  // Keep the client busy with a disconnect that does not return.
+  auto release = std::make_shared<CountDownLatch>(1);
+  EXPECT_CALL(mock_, DisconnectFromEndpoint)
+      .WillOnce(InvokeWithoutArgs([release]() { release->Await(); }));
+  router_.DisconnectFromEndpoint(&client_, kRemoteEndpointId, {});
+
+  SendPayload(&client_, std::vector<std::string>{kRemoteEndpointId},
+              Payload{ByteArray("data")}, kCallback);
+  release->CountDown();
+}
+
+TEST_F(ServiceControllerRouterTest, RequestConnectionFollowsAdvertising) {
+  // Keep advertising from starting until the connection request is queued.
+  auto release = std::make_shared<CountDownLatch>(1);
+  EXPECT_CALL(mock_, StartAdvertising)
+      .WillOnce(InvokeWithoutArgs([release]() {
+        release->Await();
+        return Status{Status::kSuccess};
+      }));
+  EXPECT_CALL(mock_, RequestConnection)
+      .WillOnce(Return(Status{Status::kSuccess}));
+  CountDownLatch done(2);
+  Status advertising_status;
+  Status connection_status;
+  router_.StartAdvertising(
+      &client_, kServiceId, kConnectionOptions, kConnectionRequestInfo,
+      {.result_cb = [&](Status status) {
+        advertising_status = status;
+        done.CountDown();
+      }});
+  router_.RequestConnection(&client_, kRemoteEndpointId,
+                            kConnectionRequestInfo, kConnectionOptions,
+                            {.result_cb = [&](Status status) {
+                              connection_status = status;
+                              done.CountDown();
+                            }});
+  release->CountDown();
+  EXPECT_TRUE(done.Await(absl::Seconds(10)).result());
+  EXPECT_EQ(advertising_status, Status{Status::kSuccess});
+  EXPECT_EQ(connection_status, Status{Status::kSuccess});
+}
+
+TEST_F(ServiceControllerRouterTest, StopAllEndpointsThenClientDisconnecting) {
+  // Another client keeps the service controller in use.
+  ClientProxy other_client;
+  StartDiscovery(&other_client, kServiceId, kConnectionOptions,
+                 discovery_listener_, kCallback);
+  StartDiscovery(&client_, kServiceId, kConnectionOptions, discovery_listener_,
+                 kCallback);
+  CountDownLatch done(2);
+  ResultCallback callback{
+      .result_cb = [&done](Status status) { done.CountDown(); },
+  };
+  router_.StopAllEndpoints(&client_, callback);
+  router_.ClientDisconnecting(&client_, callback);
+  EXPECT_TRUE(done.Await(absl::Seconds(10)).result());
+}
+
+TEST_F(ServiceControllerRouterTest, EndpointsDoNotWaitForEachOther) {
+  StartDiscovery(&client_, kServiceId, kConnectionOptions, discovery_listener_,
+                 kCallback);
+  // Keep the request to one endpoint from returning.
+  const std::string kSlowEndpointId = "slow endpoint id";
+  auto release = std::make_shared<CountDownLatch>(1);
+  EXPECT_CALL(mock_, RequestConnection(_, kSlowEndpointId, _, _))
+      .WillOnce(InvokeWithoutArgs([release]() {
+        release->Await();
+        return Status{Status::kSuccess};
+      }));
+  EXPECT_CALL(mock_, RequestConnection(_, kRemoteEndpointId, _, _))
+      .WillOnce(Return(Status{Status::kSuccess}));
+  CountDownLatch slow_done(1);
+  router_.RequestConnection(
+      &client_, kSlowEndpointId, kConnectionRequestInfo, kConnectionOptions,
+      {.result_cb = [&slow_done](Status status) { slow_done.CountDown(); }});
+
+  CountDownLatch done(1);
+  router_.RequestConnection(
+      &client_, kRemoteEndpointId, kConnectionRequestInfo, kConnectionOptions,
+      {.result_cb = [&done](Status status) { done.CountDown(); }});
+  EXPECT_TRUE(done.Await(absl::Seconds(10)).result());
+  release->CountDown();
+  EXPECT_TRUE(slow_done.Await(absl::Seconds(10)).result());
+}
+
+TEST_F(ServiceControllerRouterTest, ClientActivityWaitsForEndpoints) {
+  StartDiscovery(&client_, kServiceId, kConnectionOptions, discovery_listener_,
+                 kCallback);
+  auto release = std::make_shared<CountDownLatch>(1);
+  EXPECT_CALL(mock_, RequestConnection)
+      .WillOnce(InvokeWithoutArgs([release]() {
+        release->Await();
+        return Status{Status::kSuccess};
+      }));
+  EXPECT_CALL(mock_, StopDiscovery).Times(1);
+  router_.RequestConnection(&client_, kRemoteEndpointId,
+                            kConnectionRequestInfo, kConnectionOptions, {});
+  CountDownLatch done(1);
+  router_.StopDiscovery(
+      &client_, {.result_cb = [&done](Status status) { done.CountDown(); }});
+  EXPECT_FALSE(done.Await(absl::Milliseconds(100)).result());
+  release->CountDown();
+  EXPECT_TRUE(done.Await(absl::Seconds(10)).result());
+}
+
 }  // namespace
 }  // namespace connections
 }  // namespace nearby
@@ -0,0 +1,92 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/service_id_hash_table.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "core_v2/internal/mediums/utils.h"
+#include "absl/strings/string_view.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+ServiceIdHashTable::ServiceIdHashTable(std::vector<size_t> hash_lengths)
+    : hash_lengths_(std::move(hash_lengths)) {
+  std::sort(hash_lengths_.begin(), hash_lengths_.end());
+  hash_lengths_.erase(std::unique(hash_lengths_.begin(), hash_lengths_.end()),
+                      hash_lengths_.end());
+}
+
+ByteArray ServiceIdHashTable::ComputeHash(const std::string& service_id,
+                                          size_t length) {
+  return Utils::Sha256Hash(service_id, length);
+}
+
+void ServiceIdHashTable::Add(const std::string& service_id) {
+  Entry& entry = entries_[service_id];
+  if (entry.ref_count++ > 0) return;
+
+  if (hash_lengths_.empty()) return;
+  // All the hashes are prefixes of the same SHA-256 digest, so it is enough to
+  // compute the longest one.
+  ByteArray longest = ComputeHash(service_id, hash_lengths_.back());
+  entry.hashes.reserve(hash_lengths_.size());
+  for (size_t length : hash_lengths_) {
+    ByteArray hash(longest.data(), length);
+    service_ids_by_hash_[std::string(hash)].insert(service_id);
+    entry.hashes.push_back(std::move(hash));
+  }
+}
+
+void ServiceIdHashTable::Remove(const std::string& service_id) {
+  auto item = entries_.find(service_id);
+  if (item == entries_.end()) return;
+  Entry& entry = item->second;
+  if (--entry.ref_count > 0) return;
+
+  for (const ByteArray& hash : entry.hashes) {
+    auto by_hash = service_ids_by_hash_.find(std::string(hash));
+    if (by_hash == service_ids_by_hash_.end()) continue;
+    by_hash->second.erase(service_id);
+    if (by_hash->second.empty()) service_ids_by_hash_.erase(by_hash);
+  }
+  entries_.erase(item);
+}
+
+ByteArray ServiceIdHashTable::GetHash(const std::string& service_id,
+                                      size_t length) const {
+  auto item = entries_.find(service_id);
+  if (item != entries_.end()) {
+    const Entry& entry = item->second;
+    for (size_t i = 0; i < hash_lengths_.size(); i++) {
+      if (hash_lengths_[i] == length) return entry.hashes[i];
+    }
+  }
+  return ComputeHash(service_id, length);
+}
+
+bool ServiceIdHashTable::Matches(const std::string& service_id,
+                                 const ByteArray& service_id_hash) const {
+  auto item = service_ids_by_hash_.find(
+      absl::string_view(service_id_hash.data(), service_id_hash.size()));
+  if (item == service_ids_by_hash_.end()) return false;
+  return item->second.contains(service_id);
+}
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
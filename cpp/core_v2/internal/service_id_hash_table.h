@@ -0,0 +1,88 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_V2_INTERNAL_SERVICE_ID_HASH_TABLE_H_
+#define CORE_V2_INTERNAL_SERVICE_ID_HASH_TABLE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "platform_v2/base/byte_array.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+// Table of truncated SHA-256 hashes of service ids, as they are embedded in
+// BluetoothDeviceName, BleAdvertisement and WifiLanServiceInfo.
+//
+// Hashes are computed once, when a service id is added, for every hash length
+// the table was created with. Matching a discovered hash against the service
+// ids of interest is then a hash table lookup, instead of a SHA-256 run per
+// discovered device.
+//
+// This class is not thread-safe; callers are expected to serialize access
+// (PcpHandler does so by running on its own thread).
+class ServiceIdHashTable {
+ public:
+  explicit ServiceIdHashTable(std::vector<size_t> hash_lengths);
+  ServiceIdHashTable(const ServiceIdHashTable&) = delete;
+  ServiceIdHashTable& operator=(const ServiceIdHashTable&) = delete;
+  ~ServiceIdHashTable() = default;
+
+  // Computes and stores hashes of service_id. Service ids are reference
+  // counted: every call to Add() must be balanced by a call to Remove().
+  void Add(const std::string& service_id);
+
+  // Drops a reference to service_id; once the last one is gone, its hashes are
+  // removed from the table.
+  void Remove(const std::string& service_id);
+
+  // Returns a hash of service_id of a given length. If service_id is not in
+  // the table, or length is not one the table was created with, the hash is
+  // computed on the spot.
+  ByteArray GetHash(const std::string& service_id, size_t length) const;
+
+  // Returns true if service_id_hash is a hash of service_id, and service_id is
+  // in the table.
+  bool Matches(const std::string& service_id,
+               const ByteArray& service_id_hash) const;
+
+ private:
+  struct Entry {
+    int ref_count = 0;
+    // Hashes of service id; one per length in hash_lengths_, in the same order.
+    std::vector<ByteArray> hashes;
+  };
+
+  static ByteArray ComputeHash(const std::string& service_id, size_t length);
+
+  // Distinct hash lengths, in ascending order.
+  std::vector<size_t> hash_lengths_;
+  // service id -> Entry.
+  absl::flat_hash_map<std::string, Entry> entries_;
+  // Hash bytes -> service ids having this hash. Hashes of different lengths
+  // never collide, since their keys are of different size.
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>
+      service_ids_by_hash_;
+};
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+#endif  // CORE_V2_INTERNAL_SERVICE_ID_HASH_TABLE_H_
@@ -0,0 +1,89 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/service_id_hash_table.h"
+
+#include "core_v2/internal/mediums/utils.h"
+#include "gtest/gtest.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+constexpr size_t kShortHashLength = 3;
+constexpr size_t kLongHashLength = 6;
+
+TEST(ServiceIdHashTableTest, HashesMatchSha256) {
+  ServiceIdHashTable table({kShortHashLength, kLongHashLength});
+  table.Add("service");
+
+  EXPECT_EQ(table.GetHash("service", kShortHashLength),
+            Utils::Sha256Hash(std::string("service"), kShortHashLength));
+  EXPECT_EQ(table.GetHash("service", kLongHashLength),
+            Utils::Sha256Hash(std::string("service"), kLongHashLength));
+}
+
+TEST(ServiceIdHashTableTest, GetHashComputesUnknownServiceId) {
+  ServiceIdHashTable table({kShortHashLength});
+
+  EXPECT_EQ(table.GetHash("service", kShortHashLength),
+            Utils::Sha256Hash(std::string("service"), kShortHashLength));
+}
+
+TEST(ServiceIdHashTableTest, MatchesOnlyKnownServiceIds) {
+  ServiceIdHashTable table({kShortHashLength});
+  table.Add("service-a");
+  ByteArray hash_a = Utils::Sha256Hash(std::string("service-a"),
+                                       kShortHashLength);
+  ByteArray hash_b = Utils::Sha256Hash(std::string("service-b"),
+                                       kShortHashLength);
+
+  EXPECT_TRUE(table.Matches("service-a", hash_a));
+  EXPECT_FALSE(table.Matches("service-b", hash_b));
+  EXPECT_FALSE(table.Matches("service-b", hash_a));
+}
+
+TEST(ServiceIdHashTableTest, SupportsSeveralServiceIds) {
+  ServiceIdHashTable table({kShortHashLength, kLongHashLength});
+  table.Add("service-a");
+  table.Add("service-b");
+
+  EXPECT_TRUE(table.Matches(
+      "service-a", Utils::Sha256Hash(std::string("service-a"), kLongHashLength)));
+  EXPECT_TRUE(table.Matches(
+      "service-b",
+      Utils::Sha256Hash(std::string("service-b"), kShortHashLength)));
+  EXPECT_FALSE(table.Matches(
+      "service-a",
+      Utils::Sha256Hash(std::string("service-b"), kShortHashLength)));
+}
+
+TEST(ServiceIdHashTableTest, RemoveIsReferenceCounted) {
+  ServiceIdHashTable table({kShortHashLength});
+  ByteArray hash = Utils::Sha256Hash(std::string("service"), kShortHashLength);
+  table.Add("service");
+  table.Add("service");
+
+  table.Remove("service");
+  EXPECT_TRUE(table.Matches("service", hash));
+
+  table.Remove("service");
+  EXPECT_FALSE(table.Matches("service", hash));
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,184 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/tracing.h"
+
+#include <algorithm>
+
+#include "platform_v2/public/mutex_lock.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+namespace {
+
+// Chunk the innermost span of the calling thread works on.
+struct Chunk {
+  std::int64_t payload_id = 0;
+  std::int64_t offset = 0;
+};
+thread_local Chunk t_chunk;
+
+}  // namespace
+
+std::atomic_bool Tracer::enabled_{false};
+
+// Events of one thread. Only written to by that thread, so its mutex is only
+// contended while events are being collected.
+class Tracer::Buffer {
+ public:
+  Buffer(std::int64_t generation, int thread)
+      : generation_(generation), thread_(thread) {}
+
+  std::int64_t generation() const { return generation_; }
+
+  void Add(const Event& event) ABSL_LOCKS_EXCLUDED(mutex_) {
+    MutexLock lock(&mutex_);
+    if (events_.size() >= kMaxEventsPerThread) {
+      dropped_++;
+      return;
+    }
+    events_.push_back(event);
+    events_.back().thread = thread_;
+  }
+
+  void AppendTo(std::vector<Event>* events) const ABSL_LOCKS_EXCLUDED(mutex_) {
+    MutexLock lock(&mutex_);
+    events->insert(events->end(), events_.begin(), events_.end());
+  }
+
+  std::int64_t dropped() const ABSL_LOCKS_EXCLUDED(mutex_) {
+    MutexLock lock(&mutex_);
+    return dropped_;
+  }
+
+ private:
+  const std::int64_t generation_;
+  const int thread_;
+  mutable Mutex mutex_;
+  std::vector<Event> events_ ABSL_GUARDED_BY(mutex_);
+  std::int64_t dropped_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+Tracer& Tracer::Instance() {
+  static Tracer* tracer = new Tracer();
+  return *tracer;
+}
+
+void Tracer::Start() {
+  MutexLock lock(&mutex_);
+  // Threads notice the new generation and start new buffers.
+  generation_++;
+  buffers_.clear();
+  next_thread_ = 1;
+  origin_nanos_ = absl::GetCurrentTimeNanos();
+  enabled_ = true;
+}
+
+void Tracer::Stop() { enabled_ = false; }
+
+std::vector<Tracer::Event> Tracer::GetEvents() const {
+  std::vector<std::shared_ptr<Buffer>> buffers;
+  {
+    MutexLock lock(&mutex_);
+    buffers = buffers_;
+  }
+  std::vector<Event> events;
+  for (const auto& buffer : buffers) buffer->AppendTo(&events);
+  std::stable_sort(events.begin(), events.end(),
+                   [](const Event& a, const Event& b) {
+                     return a.start_nanos < b.start_nanos;
+                   });
+  return events;
+}
+
+std::int64_t Tracer::GetDroppedCount() const {
+  MutexLock lock(&mutex_);
+  std::int64_t dropped = 0;
+  for (const auto& buffer : buffers_) dropped += buffer->dropped();
+  return dropped;
+}
+
+std::string Tracer::ExportChromeTrace() const {
+  std::string json = R"({"displayTimeUnit":"ns","traceEvents":[)";
+  bool first = true;
+  for (const Event& event : GetEvents()) {
+    if (!first) json += ",";
+    first = false;
+    absl::StrAppend(&json, R"({"name":")", event.name,
+                    R"(","cat":"nearby","ph":"X","pid":1,"tid":)", event.thread,
+                    absl::StrFormat(R"(,"ts":%.3f,"dur":%.3f)",
+                                    event.start_nanos / 1e3,
+                                    event.duration_nanos / 1e3));
+    if (event.payload_id != 0) {
+      // Payload ids use all 64 bits, more than a JSON number keeps.
+      absl::StrAppend(&json, R"(,"args":{"payload_id":")",
+                      absl::Hex(event.payload_id, absl::kZeroPad16),
+                      R"(","offset":)", event.offset, "}");
+    }
+    json += "}";
+  }
+  json += "]}\n";
+  return json;
+}
+
+void Tracer::Record(const char* name, std::int64_t start_nanos,
+                    std::int64_t end_nanos, std::int64_t payload_id,
+                    std::int64_t offset) {
+  // Spans that outlive Stop() are dropped.
+  if (!IsEnabled()) return;
+  std::int64_t origin = origin_nanos_;
+  GetBuffer().Add({name, start_nanos - origin, end_nanos - start_nanos,
+                   payload_id, offset, 0});
+}
+
+Tracer::Buffer& Tracer::GetBuffer() {
+  static thread_local std::shared_ptr<Buffer> buffer;
+  if (!buffer || buffer->generation() != generation_) {
+    MutexLock lock(&mutex_);
+    buffer = std::make_shared<Buffer>(generation_, next_thread_++);
+    buffers_.push_back(buffer);
+  }
+  return *buffer;
+}
+
+void TraceSpan::Begin() {
+  payload_id_ = t_chunk.payload_id;
+  offset_ = t_chunk.offset;
+  start_nanos_ = absl::GetCurrentTimeNanos();
+}
+
+void TraceSpan::Begin(std::int64_t payload_id, std::int64_t offset) {
+  restore_chunk_ = true;
+  outer_payload_id_ = t_chunk.payload_id;
+  outer_offset_ = t_chunk.offset;
+  t_chunk = {payload_id, offset};
+  payload_id_ = payload_id;
+  offset_ = offset;
+  start_nanos_ = absl::GetCurrentTimeNanos();
+}
+
+void TraceSpan::End() {
+  Tracer::Instance().Record(name_, start_nanos_, absl::GetCurrentTimeNanos(),
+                            payload_id_, offset_);
+  if (restore_chunk_) t_chunk = {outer_payload_id_, outer_offset_};
+}
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
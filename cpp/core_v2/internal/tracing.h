@@ -0,0 +1,151 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_V2_INTERNAL_TRACING_H_
+#define CORE_V2_INTERNAL_TRACING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "platform_v2/public/mutex.h"
+#include "absl/base/thread_annotations.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+
+// Opt-in tracing of where the time of payload transfers goes: reading the
+// next chunk, encoding, encrypting and writing frames on the sender, and
+// reading, decrypting, decoding and attaching chunks on the receiver.
+//
+// Spans are recorded by the thread they run on, into a buffer of its own.
+// While tracing is off, a span costs one relaxed atomic load.
+//
+// Usage:
+//   Tracer::Instance().Start();
+//   ... transfer payloads ...
+//   Tracer::Instance().Stop();
+//   std::string json = Tracer::Instance().ExportChromeTrace();
+//
+// The JSON can be loaded in chrome://tracing or https://ui.perfetto.dev.
+class Tracer {
+ public:
+  // A span that has ended.
+  struct Event {
+    // Static string; see TraceSpan.
+    const char* name;
+    // Since the call to Start().
+    std::int64_t start_nanos;
+    std::int64_t duration_nanos;
+    // Chunk the span worked on, if known; 0 otherwise.
+    std::int64_t payload_id;
+    std::int64_t offset;
+    // Small number identifying the thread that recorded the span.
+    int thread;
+  };
+
+  // Most events kept for one thread; later ones are dropped, and counted.
+  static constexpr int kMaxEventsPerThread = 1 << 16;
+
+  static Tracer& Instance();
+
+  static bool IsEnabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Drops everything recorded so far, and starts recording.
+  void Start() ABSL_LOCKS_EXCLUDED(mutex_);
+  // Stops recording; what has been recorded is kept.
+  void Stop();
+
+  // Returns the events recorded since Start(), of all threads, in the order
+  // they started.
+  std::vector<Event> GetEvents() const ABSL_LOCKS_EXCLUDED(mutex_);
+  // Returns the number of events dropped since Start() for lack of room.
+  std::int64_t GetDroppedCount() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns GetEvents() in the Chrome trace-event JSON format, as complete
+  // ("ph":"X") events with timestamps in microseconds.
+  std::string ExportChromeTrace() const;
+
+  // Adds an event of the calling thread. Used by TraceSpan.
+  void Record(const char* name, std::int64_t start_nanos,
+              std::int64_t end_nanos, std::int64_t payload_id,
+              std::int64_t offset) ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  class Buffer;
+
+  Tracer() = default;
+  Buffer& GetBuffer() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  static std::atomic_bool enabled_;
+  std::atomic<std::int64_t> origin_nanos_{0};
+
+  mutable Mutex mutex_;
+  // One per thread that has recorded something since Start(); shared with
+  // the thread.
+  std::vector<std::shared_ptr<Buffer>> buffers_ ABSL_GUARDED_BY(mutex_);
+  int next_thread_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Bumped by Start(); a thread whose buffer is of an older generation
+  // starts a new one.
+  std::atomic<std::int64_t> generation_{0};
+};
+
+// Records the time from its construction to its destruction as an event
+// named name, which must be a string literal (it is kept by pointer, and
+// written to JSON as is).
+//
+// A span given a payload_id and offset marks the chunk it works on; spans
+// nested in it on the same thread, that don't know it, are attributed to
+// the same chunk.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name)
+      : name_(Tracer::IsEnabled() ? name : nullptr) {
+    if (name_) Begin();
+  }
+  TraceSpan(const char* name, std::int64_t payload_id, std::int64_t offset)
+      : name_(Tracer::IsEnabled() ? name : nullptr) {
+    if (name_) Begin(payload_id, offset);
+  }
+  ~TraceSpan() {
+    if (name_) End();
+  }
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  void Begin();
+  void Begin(std::int64_t payload_id, std::int64_t offset);
+  void End();
+
+  const char* const name_;
+  std::int64_t start_nanos_ = 0;
+  std::int64_t payload_id_ = 0;
+  std::int64_t offset_ = 0;
+  // Chunk of the enclosing span, to restore when this one ends.
+  bool restore_chunk_ = false;
+  std::int64_t outer_payload_id_ = 0;
+  std::int64_t outer_offset_ = 0;
+};
+
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
+
+#endif  // CORE_V2_INTERNAL_TRACING_H_
@@ -0,0 +1,119 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_v2/internal/tracing.h"
+
+#include <string>
+#include <vector>
+
+#include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/multi_thread_executor.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace location {
+namespace nearby {
+namespace connections {
+namespace {
+
+using ::testing::HasSubstr;
+
+class TracingTest : public ::testing::Test {
+ protected:
+  ~TracingTest() override { tracer_.Stop(); }
+
+  Tracer& tracer_{Tracer::Instance()};
+};
+
+TEST_F(TracingTest, RecordsNothingWhenStopped) {
+  tracer_.Start();
+  tracer_.Stop();
+
+  { TraceSpan span("Span"); }
+
+  EXPECT_TRUE(tracer_.GetEvents().empty());
+}
+
+TEST_F(TracingTest, NestedSpansInheritChunk) {
+  tracer_.Start();
+
+  {
+    TraceSpan outer("Outer", 42, 1024);
+    TraceSpan inner("Inner");
+  }
+  { TraceSpan after("After"); }
+
+  std::vector<Tracer::Event> events = tracer_.GetEvents();
+  ASSERT_EQ(events.size(), 3);
+  EXPECT_STREQ(events[0].name, "Outer");
+  EXPECT_STREQ(events[1].name, "Inner");
+  EXPECT_STREQ(events[2].name, "After");
+  EXPECT_EQ(events[1].payload_id, 42);
+  EXPECT_EQ(events[1].offset, 1024);
+  EXPECT_LE(events[1].duration_nanos, events[0].duration_nanos);
+  // The chunk is forgotten once its span ends.
+  EXPECT_EQ(events[2].payload_id, 0);
+}
+
+TEST_F(TracingTest, StartDropsEarlierEvents) {
+  tracer_.Start();
+  { TraceSpan span("First"); }
+
+  tracer_.Start();
+  { TraceSpan span("Second"); }
+
+  std::vector<Tracer::Event> events = tracer_.GetEvents();
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_STREQ(events[0].name, "Second");
+}
+
+TEST_F(TracingTest, CollectsAllThreads) {
+  constexpr int kThreads = 4;
+  constexpr int kSpans = 100;
+  tracer_.Start();
+
+  CountDownLatch latch(kThreads);
+  MultiThreadExecutor executor(kThreads);
+  for (int i = 0; i < kThreads; i++) {
+    executor.Execute([&latch]() {
+      for (int j = 0; j < kSpans; j++) TraceSpan span("Span");
+      latch.CountDown();
+    });
+  }
+  latch.Await();
+
+  std::vector<Tracer::Event> events = tracer_.GetEvents();
+  EXPECT_EQ(events.size(), kThreads * kSpans);
+  for (int i = 1; i < events.size(); i++) {
+    EXPECT_LE(events[i - 1].start_nanos, events[i].start_nanos);
+  }
+}
+
+TEST_F(TracingTest, ExportsChromeTrace) {
+  tracer_.Start();
+  { TraceSpan span("Write", 0xABC, 64); }
+  tracer_.Stop();
+
+  std::string json = tracer_.ExportChromeTrace();
+
+  EXPECT_THAT(json, HasSubstr(R"("traceEvents":[{"name":"Write")"));
+  EXPECT_THAT(json, HasSubstr(R"("ph":"X")"));
+  EXPECT_THAT(json, HasSubstr(R"("args":{"payload_id":"0000000000000abc",)"
+                              R"("offset":64})"));
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
+}  // namespace location
@@ -32,6 +32,7 @@
 #include "core_v2/status.h"
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/listeners.h"
+#include "absl/strings/string_view.h"
 
 namespace location {
 namespace nearby {
@@ -160,6 +161,32 @@ struct DiscoveryListener {
           DefaultCallback<const std::string&, DistanceInfo>();
 };
 
+// A chunk of the data of an incoming Payload; see
+// PayloadListener::payload_chunk_cb.
+struct PayloadChunkInfo {
+  Payload::Id payload_id = 0;
+  Payload::Type type = Payload::Type::kUnknown;
+  Payload::Priority priority = Payload::Priority::kNormal;
+  // Total size of the Payload, or -1 if it is not known in advance, as is the
+  // case for streams.
+  std::int64_t total_size = 0;
+  // Offset of data within the Payload.
+  std::int64_t offset = 0;
+  // Only valid for the duration of the callback.
+  absl::string_view data;
+  // True for the last chunk of the Payload, which has no data.
+  bool is_last = false;
+};
+
+// Returned by PayloadListener::payload_chunk_cb, to tell whether to go on
+// receiving the Payload.
+enum class PayloadChunkAction {
+  kContinue,
+  // Stops receiving the Payload. The sender is told it was canceled, and
+  // payload_progress_cb reports PayloadProgressInfo::Status::kCanceled.
+  kCancel,
+};
+
 struct PayloadListener {
   // Called when a Payload is received from a remote endpoint. Depending
   // on the type of the Payload, all of the data may or may not have been
@@ -183,6 +210,22 @@ struct PayloadListener {
                      const PayloadProgressInfo& info)>
       payload_progress_cb =
           DefaultCallback<const std::string&, const PayloadProgressInfo&>();
+
+  // Optional. If set, the data of incoming Payloads is passed here chunk by
+  // chunk, in order, as it is read from the connection, instead of being
+  // collected into a ByteArray, a stream or a file; payload_cb is not called
+  // for them. Progress is reported to payload_progress_cb as usual.
+  //
+  // It is called on the thread that reads from the remote endpoint, so other
+  // data from that endpoint waits while it runs; blocking here slows down the
+  // sender, which can be used for flow control.
+  //
+  // endpoint_id - The identifier for the remote endpoint that sent the
+  //               payload.
+  // chunk       - The next chunk of the payload.
+  std::function<PayloadChunkAction(const std::string& endpoint_id,
+                                   const PayloadChunkInfo& chunk)>
+      payload_chunk_cb;
 };
 
 }  // namespace connections
@@ -42,6 +42,11 @@ class Payload {
   using Content = absl::variant<absl::monostate, ByteArray,
                                 std::function<InputStream&()>, InputFile>;
   enum class Type { kUnknown = 0, kBytes = 1, kStream = 2, kFile = 3 };
+  // How urgently a Payload is to be delivered, relative to the other Payloads
+  // of the same connection. Urgent ones go ahead of less urgent ones, both
+  // when sent and when received, but less urgent ones still make progress.
+  // Values are ordered from the most urgent to the least.
+  enum class Priority { kInteractive = 0, kNormal = 1, kBulk = 2 };
 
   Payload(Payload&& other) = default;
   ~Payload() = default;
@@ -89,6 +94,11 @@ class Payload {
   // Returns Payload type.
   Type GetType() const { return type_; }
 
+  // Returns Payload priority; kNormal, unless set otherwise.
+  Priority GetPriority() const { return priority_; }
+  // Sets Payload priority; to be called before the Payload is sent.
+  void SetPriority(Priority priority) { priority_ = priority; }
+
   // Generate Payload Id; to be passed to outgoing file constructor.
   static Id GenerateId() { return Prng().NextInt64(); }
 
@@ -100,6 +110,7 @@ class Payload {
   Content content_;
   Id id_{GenerateId()};
   Type type_{FindType(content_)};
+  Priority priority_{Priority::kNormal};
 };
 
 }  // namespace connections
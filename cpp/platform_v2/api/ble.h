@@ -17,6 +17,7 @@
 
 #include "platform_v2/api/bluetooth_classic.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/base/input_stream.h"
 #include "platform_v2/base/output_stream.h"
 
@@ -109,11 +110,13 @@ class BleMedium {
       const std::string& service_id, AcceptedConnectionCallback callback) = 0;
   virtual bool StopAcceptingConnections(const std::string& service_id) = 0;
 
-  // Connects to a BLE peripheral.
+  // Connects to a BLE peripheral. Gives up once cancellation_flag is set, if
+  // it is not null.
   // On success, returns a new BleSocket.
   // On error, returns nullptr.
-  virtual std::unique_ptr<BleSocket> Connect(BlePeripheral& peripheral,
-                                             const std::string& service_id) = 0;
+  virtual std::unique_ptr<BleSocket> Connect(
+      BlePeripheral& peripheral, const std::string& service_id,
+      CancellationFlag* cancellation_flag) = 0;
 };
 
 }  // namespace api
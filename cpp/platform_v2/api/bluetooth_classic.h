@@ -19,6 +19,7 @@
 #include <string>
 
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/base/exception.h"
 #include "platform_v2/base/input_stream.h"
 #include "platform_v2/base/listeners.h"
@@ -133,10 +134,13 @@ class BluetoothClassicMedium {
   // (https://en.wikipedia.org/wiki/Universally_unique_identifier#Versions_3_and_5_(namespace_name-based))
   // UUID.
   //
+  // Gives up once cancellation_flag is set, if it is not null.
+  //
   // On success, returns a new BluetoothSocket.
   // On error, returns nullptr.
   virtual std::unique_ptr<BluetoothSocket> ConnectToService(
-      BluetoothDevice& remote_device, const std::string& service_uuid) = 0;
+      BluetoothDevice& remote_device, const std::string& service_uuid,
+      CancellationFlag* cancellation_flag) = 0;
 
   // https://developer.android.com/reference/android/bluetooth/BluetoothAdapter.html#listenUsingInsecureRfcommWithServiceRecord
   //
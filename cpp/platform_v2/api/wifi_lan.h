@@ -18,6 +18,7 @@
 #include <string>
 
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/base/input_stream.h"
 #include "platform_v2/base/listeners.h"
 #include "platform_v2/base/output_stream.h"
@@ -109,11 +110,13 @@ class WifiLanMedium {
       const std::string& service_id, AcceptedConnectionCallback callback) = 0;
   virtual bool StopAcceptingConnections(const std::string& service_id) = 0;
 
-  // Connects to a WifiLan service.
+  // Connects to a WifiLan service. Gives up once cancellation_flag is set, if
+  // it is not null.
   // On success, returns a new WifiLanSocket.
   // On error, returns nullptr.
   virtual std::unique_ptr<WifiLanSocket> Connect(
-      WifiLanService& service, const std::string& service_id) = 0;
+      WifiLanService& service, const std::string& service_id,
+      CancellationFlag* cancellation_flag) = 0;
 
   virtual WifiLanService* FindRemoteService(const std::string& ip_address,
                                             int port) = 0;
@@ -14,6 +14,9 @@
 
 #include "platform_v2/base/base_pipe.h"
 
+#include <memory>
+#include <utility>
+
 #include "platform_v2/base/base_mutex_lock.h"
 #include "platform_v2/base/input_stream.h"
 #include "platform_v2/base/output_stream.h"
@@ -31,8 +34,18 @@ ExceptionOr<ByteArray> BasePipe::Read(size_t size) {
     return ExceptionOr<ByteArray>{ByteArray{}};
   }
 
-  while (buffer_.empty() && !input_stream_closed_) {
-    Exception wait_exception = cond_->Wait();
+  while (!input_stream_closed_) {
+    Exception wait_exception{Exception::kSuccess};
+    if (buffer_.empty()) {
+      wait_exception = cond_->Wait();
+    } else if (link_ == nullptr) {
+      break;
+    } else {
+      // Wait for the first chunk to cross the link.
+      absl::Duration until_arrival = buffer_.front().arrival - absl::Now();
+      if (until_arrival <= absl::ZeroDuration()) break;
+      wait_exception = cond_->Wait(until_arrival);
+    }
 
     if (wait_exception.Raised()) {
       return ExceptionOr<ByteArray>{wait_exception};
@@ -43,7 +56,8 @@ ExceptionOr<ByteArray> BasePipe::Read(size_t size) {
     return ExceptionOr<ByteArray>{Exception::kIo};
   }
 
-  ByteArray first_chunk{buffer_.front()};
+  ByteArray first_chunk{std::move(buffer_.front().data)};
+  absl::Time arrival = buffer_.front().arrival;
   buffer_.pop_front();
 
   // If we received our sentinel chunk, mark the fact that there cannot
@@ -65,15 +79,32 @@ ExceptionOr<ByteArray> BasePipe::Read(size_t size) {
     // the queue, to be served up in the next call to read().
     ByteArray next_chunk(first_chunk.data(), size);
     buffer_.push_front(
-        ByteArray(first_chunk.data() + size, first_chunk.size() - size));
+        {ByteArray(first_chunk.data() + size, first_chunk.size() - size),
+         arrival});
     return ExceptionOr<ByteArray>{next_chunk};
   }
 }
 
 Exception BasePipe::Write(const ByteArray& data) {
+  absl::Duration backlog;
+  {
+    BaseMutexLock lock(mutex_.get());
+
+    Exception write_exception = WriteLocked(data);
+    if (write_exception.Raised() || link_ == nullptr) return write_exception;
+    backlog = link_->Backlog(absl::Now());
+  }
+  // Hold the writer back while the link catches up, the way a socket with a
+  // full send buffer does.
+  if (backlog > absl::ZeroDuration()) absl::SleepFor(backlog);
+  return {Exception::kSuccess};
+}
+
+void BasePipe::SetLinkProfile(const LinkProfile& profile, std::uint64_t seed) {
   BaseMutexLock lock(mutex_.get());
 
-  return WriteLocked(data);
+  if (profile.IsIdeal()) return;
+  link_ = std::make_unique<LinkEmulator>(profile, seed);
 }
 
 void BasePipe::MarkInputStreamClosed() {
@@ -98,7 +129,13 @@ Exception BasePipe::WriteLocked(const ByteArray& data) {
     return {Exception::kIo};
   }
 
-  buffer_.push_back(data);
+  if (link_ == nullptr) {
+    buffer_.push_back({data, absl::InfinitePast()});
+  } else {
+    for (auto& segment : link_->Send(data, absl::Now())) {
+      buffer_.push_back({std::move(segment.data), segment.arrival});
+    }
+  }
   // Trigger cond_ to unblock a potentially-blocked call to read(), now that
   // there's more data for it to consume.
   cond_->Notify();
@@ -24,8 +24,11 @@
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/exception.h"
 #include "platform_v2/base/input_stream.h"
+#include "platform_v2/base/link_emulator.h"
+#include "platform_v2/base/link_profile.h"
 #include "platform_v2/base/output_stream.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/time/time.h"
 
 namespace location {
 namespace nearby {
@@ -62,6 +65,14 @@ class BasePipe {
   InputStream& GetInputStream() { return input_stream_; }
   OutputStream& GetOutputStream() { return output_stream_; }
 
+  // Makes the pipe behave as one direction of a network link: data becomes
+  // readable once it has crossed a link shaped by profile, and writes block
+  // while the link is backed up. seed drives the random decisions of the
+  // link. Has no effect for an ideal profile. Must be called before the pipe
+  // is used.
+  void SetLinkProfile(const LinkProfile& profile, std::uint64_t seed)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
  protected:
   BasePipe() = default;
 
@@ -128,7 +139,15 @@ class BasePipe {
   bool output_stream_closed_ ABSL_GUARDED_BY(mutex_) = false;
   bool read_all_chunks_ ABSL_GUARDED_BY(mutex_) = false;
 
-  std::deque<ByteArray> ABSL_GUARDED_BY(mutex_) buffer_;
+  struct Chunk {
+    ByteArray data;
+    // When the chunk becomes readable.
+    absl::Time arrival;
+  };
+
+  std::deque<Chunk> ABSL_GUARDED_BY(mutex_) buffer_;
+  // Set if the pipe emulates a link.
+  std::unique_ptr<LinkEmulator> link_ ABSL_GUARDED_BY(mutex_);
   std::unique_ptr<api::Mutex> mutex_;
   std::unique_ptr<api::ConditionVariable> cond_;
 
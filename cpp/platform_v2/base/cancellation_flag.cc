@@ -0,0 +1,55 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/base/cancellation_flag.h"
+
+#include <utility>
+
+namespace location {
+namespace nearby {
+
+void CancellationFlag::Cancel() {
+  absl::MutexLock lock(&mutex_);
+  if (cancelled_) return;
+  cancelled_ = true;
+  for (const std::function<void()>* listener : listeners_) {
+    (*listener)();
+  }
+}
+
+bool CancellationFlag::Cancelled() const {
+  absl::MutexLock lock(&mutex_);
+  return cancelled_;
+}
+
+CancellationFlagListener::CancellationFlagListener(
+    CancellationFlag* flag, std::function<void()> on_cancel)
+    : flag_(flag), on_cancel_(std::move(on_cancel)) {
+  if (flag_ == nullptr) return;
+  absl::MutexLock lock(&flag_->mutex_);
+  if (flag_->cancelled_) {
+    on_cancel_();
+  } else {
+    flag_->listeners_.insert(&on_cancel_);
+  }
+}
+
+CancellationFlagListener::~CancellationFlagListener() {
+  if (flag_ == nullptr) return;
+  absl::MutexLock lock(&flag_->mutex_);
+  flag_->listeners_.erase(&on_cancel_);
+}
+
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,72 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_BASE_CANCELLATION_FLAG_H_
+#define PLATFORM_V2_BASE_CANCELLATION_FLAG_H_
+
+#include <functional>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+
+namespace location {
+namespace nearby {
+
+// Tells a long running operation, such as connecting to a remote device, to
+// give up. Operations that block register a CancellationFlagListener, to be
+// woken up once the flag is set; others check Cancelled() between steps.
+//
+// Thread-safe.
+class CancellationFlag {
+ public:
+  CancellationFlag() = default;
+  ~CancellationFlag() = default;
+  CancellationFlag(const CancellationFlag&) = delete;
+  CancellationFlag& operator=(const CancellationFlag&) = delete;
+
+  // Sets the flag, and calls the listeners. Does nothing if it is set already.
+  void Cancel() ABSL_LOCKS_EXCLUDED(mutex_);
+  bool Cancelled() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  friend class CancellationFlagListener;
+
+  mutable absl::Mutex mutex_;
+  bool cancelled_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::flat_hash_set<const std::function<void()>*> listeners_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+// Calls on_cancel once flag is set, for as long as it lives; right away, if
+// flag is set already. Does nothing if flag is null. on_cancel must not block,
+// nor use flag.
+class CancellationFlagListener {
+ public:
+  CancellationFlagListener(CancellationFlag* flag,
+                           std::function<void()> on_cancel);
+  // Waits for on_cancel to return, if it runs.
+  ~CancellationFlagListener();
+  CancellationFlagListener(const CancellationFlagListener&) = delete;
+  CancellationFlagListener& operator=(const CancellationFlagListener&) = delete;
+
+ private:
+  CancellationFlag* flag_;
+  std::function<void()> on_cancel_;
+};
+
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_BASE_CANCELLATION_FLAG_H_
@@ -0,0 +1,81 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/base/cancellation_flag.h"
+
+#include "gtest/gtest.h"
+
+namespace location {
+namespace nearby {
+namespace {
+
+TEST(CancellationFlagTest, IsNotCancelledAtFirst) {
+  CancellationFlag flag;
+
+  EXPECT_FALSE(flag.Cancelled());
+}
+
+TEST(CancellationFlagTest, CancelSetsFlag) {
+  CancellationFlag flag;
+  flag.Cancel();
+  flag.Cancel();
+
+  EXPECT_TRUE(flag.Cancelled());
+}
+
+TEST(CancellationFlagTest, CancelCallsListenerOnce) {
+  CancellationFlag flag;
+  int calls = 0;
+  CancellationFlagListener listener(&flag, [&calls]() { calls++; });
+  EXPECT_EQ(calls, 0);
+
+  flag.Cancel();
+  flag.Cancel();
+
+  EXPECT_EQ(calls, 1);
+}
+
+TEST(CancellationFlagTest, ListenerOfCancelledFlagIsCalledRightAway) {
+  CancellationFlag flag;
+  flag.Cancel();
+  int calls = 0;
+
+  CancellationFlagListener listener(&flag, [&calls]() { calls++; });
+
+  EXPECT_EQ(calls, 1);
+}
+
+TEST(CancellationFlagTest, ListenerIsNotCalledOnceGone) {
+  CancellationFlag flag;
+  int calls = 0;
+  {
+    CancellationFlagListener listener(&flag, [&calls]() { calls++; });
+  }
+
+  flag.Cancel();
+
+  EXPECT_EQ(calls, 0);
+}
+
+TEST(CancellationFlagTest, ListenerOfNoFlagIsNeverCalled) {
+  int calls = 0;
+
+  CancellationFlagListener listener(nullptr, [&calls]() { calls++; });
+
+  EXPECT_EQ(calls, 0);
+}
+
+}  // namespace
+}  // namespace nearby
+}  // namespace location
@@ -15,7 +15,9 @@
 #ifndef PLATFORM_V2_BASE_INPUT_STREAM_H_
 #define PLATFORM_V2_BASE_INPUT_STREAM_H_
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 
 #include "platform_v2/base/byte_array.h"
 #include "platform_v2/base/exception.h"
@@ -32,6 +34,20 @@ class InputStream {
 
   // throws Exception::kIo
   virtual ExceptionOr<ByteArray> Read(std::int64_t size) = 0;
+  // Reads at most size bytes into data, and returns how many were read; 0
+  // once the stream has ended. Streams that can fill data directly override
+  // this, to spare the copy out of what Read() returns.
+  // throws Exception::kIo
+  virtual ExceptionOr<std::int64_t> ReadInto(char* data, std::int64_t size) {
+    ExceptionOr<ByteArray> read_bytes = Read(size);
+    if (!read_bytes.ok()) {
+      return ExceptionOr<std::int64_t>(read_bytes.exception());
+    }
+    const ByteArray& bytes = read_bytes.result();
+    std::int64_t count = std::min<std::int64_t>(bytes.size(), size);
+    std::memcpy(data, bytes.data(), count);
+    return ExceptionOr<std::int64_t>(count);
+  }
   // throws Exception::kIo
   virtual Exception Close() = 0;
 };
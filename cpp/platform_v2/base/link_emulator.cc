@@ -0,0 +1,87 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/base/link_emulator.h"
+
+#include <algorithm>
+
+namespace location {
+namespace nearby {
+
+namespace {
+
+absl::Duration TransmitTime(std::int64_t size, std::int64_t bandwidth) {
+  if (bandwidth <= 0) return absl::ZeroDuration();
+  return absl::Seconds(1) * size / bandwidth;
+}
+
+}  // namespace
+
+LinkEmulator::LinkEmulator(const LinkProfile& profile, std::uint64_t seed)
+    : profile_(profile), state_(seed) {}
+
+std::vector<LinkEmulator::Segment> LinkEmulator::Send(const ByteArray& data,
+                                                      absl::Time now) {
+  std::vector<Segment> segments;
+  const std::int64_t total = data.size();
+  const std::int64_t mtu = profile_.mtu > 0 ? profile_.mtu : total;
+  if (total <= mtu) {
+    segments.push_back({data, Transmit(total, now)});
+    return segments;
+  }
+  segments.reserve((total + mtu - 1) / mtu);
+  for (std::int64_t offset = 0; offset < total; offset += mtu) {
+    std::int64_t size = std::min(mtu, total - offset);
+    segments.push_back(
+        {ByteArray(data.data() + offset, size), Transmit(size, now)});
+  }
+  return segments;
+}
+
+absl::Duration LinkEmulator::Backlog(absl::Time now) const {
+  absl::Duration backlog =
+      link_free_ - now - TransmitTime(profile_.send_buffer, profile_.bandwidth);
+  return std::max(backlog, absl::ZeroDuration());
+}
+
+absl::Time LinkEmulator::Transmit(std::int64_t size, absl::Time now) {
+  link_free_ = std::max(link_free_, now);
+  if (profile_.stall_rate > 0 && NextUniform() < profile_.stall_rate) {
+    link_free_ += profile_.stall_duration;
+  }
+  link_free_ += TransmitTime(size, profile_.bandwidth);
+
+  absl::Duration delay = profile_.delay;
+  if (profile_.jitter > absl::ZeroDuration()) {
+    delay += profile_.jitter * NextUniform();
+  }
+  if (profile_.loss_rate > 0 && NextUniform() < profile_.loss_rate) {
+    delay += profile_.retransmit_delay;
+  }
+  last_arrival_ = std::max(last_arrival_, link_free_ + delay);
+  return last_arrival_;
+}
+
+double LinkEmulator::NextUniform() {
+  // splitmix64; unlike the <random> distributions, it gives the same
+  // sequence everywhere.
+  std::uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return (z >> 11) * 0x1.0p-53;
+}
+
+}  // namespace nearby
+}  // namespace location
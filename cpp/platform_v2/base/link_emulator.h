@@ -0,0 +1,71 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_BASE_LINK_EMULATOR_H_
+#define PLATFORM_V2_BASE_LINK_EMULATOR_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/link_profile.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+
+// Computes when the data written to one direction of a link, shaped by a
+// LinkProfile, reaches the other side. It only does the bookkeeping; the
+// caller holds the data back until then.
+//
+// Random decisions (jitter, losses, stalls) come from a generator seeded by
+// the caller, so the same seed and writes give the same schedule.
+//
+// Not thread-safe.
+class LinkEmulator {
+ public:
+  struct Segment {
+    ByteArray data;
+    // When the segment reaches the other side. Never earlier than the
+    // arrival of the previous segment.
+    absl::Time arrival;
+  };
+
+  LinkEmulator(const LinkProfile& profile, std::uint64_t seed);
+
+  // Splits data, written at now, into segments of at most profile.mtu bytes,
+  // and schedules their arrival. Empty data (an end of stream) is scheduled
+  // as a single empty segment.
+  std::vector<Segment> Send(const ByteArray& data, absl::Time now);
+
+  // Returns how long a writer has to wait after now for the link to have no
+  // more than profile.send_buffer bytes left to transmit.
+  absl::Duration Backlog(absl::Time now) const;
+
+ private:
+  absl::Time Transmit(std::int64_t size, absl::Time now);
+  // Returns a random number in [0, 1).
+  double NextUniform();
+
+  const LinkProfile profile_;
+  std::uint64_t state_;
+  // When the link is done transmitting what it was given so far.
+  absl::Time link_free_ = absl::InfinitePast();
+  absl::Time last_arrival_ = absl::InfinitePast();
+};
+
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_BASE_LINK_EMULATOR_H_
@@ -0,0 +1,133 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/base/link_emulator.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace {
+
+const absl::Time kStart = absl::FromUnixSeconds(1000);
+
+std::vector<absl::Time> Arrivals(LinkEmulator& link, int count,
+                                 std::int64_t size) {
+  std::vector<absl::Time> arrivals;
+  for (int i = 0; i < count; i++) {
+    for (const auto& segment :
+         link.Send(ByteArray(std::string(size, 'x')), kStart)) {
+      arrivals.push_back(segment.arrival);
+    }
+  }
+  return arrivals;
+}
+
+TEST(LinkEmulatorTest, IdealLinkDeliversRightAway) {
+  LinkEmulator link(LinkProfile{}, 0);
+  auto segments = link.Send(ByteArray("data"), kStart);
+  ASSERT_EQ(segments.size(), 1);
+  EXPECT_EQ(std::string(segments[0].data), "data");
+  EXPECT_EQ(segments[0].arrival, kStart);
+  EXPECT_EQ(link.Backlog(kStart), absl::ZeroDuration());
+}
+
+TEST(LinkEmulatorTest, SplitsWritesIntoSegments) {
+  LinkEmulator link(LinkProfile{.mtu = 4}, 0);
+  auto segments = link.Send(ByteArray("0123456789"), kStart);
+  ASSERT_EQ(segments.size(), 3);
+  EXPECT_EQ(std::string(segments[0].data), "0123");
+  EXPECT_EQ(std::string(segments[1].data), "4567");
+  EXPECT_EQ(std::string(segments[2].data), "89");
+
+  segments = link.Send(ByteArray(), kStart);
+  ASSERT_EQ(segments.size(), 1);
+  EXPECT_TRUE(segments[0].data.Empty());
+}
+
+TEST(LinkEmulatorTest, AddsDelayAndTransmitTime) {
+  LinkEmulator link(
+      LinkProfile{.bandwidth = 1000, .delay = absl::Milliseconds(50)}, 0);
+  // 100 bytes at 1000 bytes/s take 100ms to transmit, one after the other.
+  auto arrivals = Arrivals(link, 2, 100);
+  ASSERT_EQ(arrivals.size(), 2);
+  EXPECT_EQ(arrivals[0], kStart + absl::Milliseconds(150));
+  EXPECT_EQ(arrivals[1], kStart + absl::Milliseconds(250));
+}
+
+TEST(LinkEmulatorTest, ReportsBacklogBeyondSendBuffer) {
+  LinkEmulator link(LinkProfile{.bandwidth = 1000, .send_buffer = 100}, 0);
+  link.Send(ByteArray(std::string(300, 'x')), kStart);
+  // 300ms to transmit, of which the send buffer absorbs 100ms.
+  EXPECT_EQ(link.Backlog(kStart), absl::Milliseconds(200));
+  EXPECT_EQ(link.Backlog(kStart + absl::Milliseconds(250)),
+            absl::ZeroDuration());
+}
+
+TEST(LinkEmulatorTest, KeepsSegmentsInOrderDespiteJitter) {
+  LinkEmulator link(LinkProfile{.delay = absl::Milliseconds(10),
+                                .jitter = absl::Milliseconds(10)},
+                    42);
+  auto arrivals = Arrivals(link, 100, 10);
+  for (std::size_t i = 0; i < arrivals.size(); i++) {
+    EXPECT_GE(arrivals[i], kStart + absl::Milliseconds(10));
+    EXPECT_LE(arrivals[i], kStart + absl::Milliseconds(20));
+    if (i > 0) {
+      EXPECT_GE(arrivals[i], arrivals[i - 1]);
+    }
+  }
+  EXPECT_GT(arrivals.back(), arrivals.front());
+}
+
+TEST(LinkEmulatorTest, LossesDelaySegments) {
+  LinkEmulator link(LinkProfile{.loss_rate = 1,
+                                .retransmit_delay = absl::Milliseconds(200)},
+                    0);
+  auto arrivals = Arrivals(link, 1, 10);
+  ASSERT_EQ(arrivals.size(), 1);
+  EXPECT_EQ(arrivals[0], kStart + absl::Milliseconds(200));
+}
+
+TEST(LinkEmulatorTest, StallsHoldTheLink) {
+  LinkEmulator link(LinkProfile{.stall_rate = 1,
+                                .stall_duration = absl::Seconds(1),
+                                .send_buffer = 0},
+                    0);
+  auto arrivals = Arrivals(link, 2, 10);
+  ASSERT_EQ(arrivals.size(), 2);
+  EXPECT_EQ(arrivals[0], kStart + absl::Seconds(1));
+  EXPECT_EQ(arrivals[1], kStart + absl::Seconds(2));
+  EXPECT_EQ(link.Backlog(kStart), absl::Seconds(2));
+}
+
+TEST(LinkEmulatorTest, SameSeedGivesSameSchedule) {
+  LinkProfile profile = LinkProfile::Bluetooth();
+  profile.loss_rate = 0.1;
+  LinkEmulator link_a(profile, 7);
+  LinkEmulator link_b(profile, 7);
+  LinkEmulator link_c(profile, 8);
+  auto arrivals_a = Arrivals(link_a, 20, 2000);
+  EXPECT_EQ(arrivals_a, Arrivals(link_b, 20, 2000));
+  EXPECT_NE(arrivals_a, Arrivals(link_c, 20, 2000));
+}
+
+}  // namespace
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,94 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_BASE_LINK_PROFILE_H_
+#define PLATFORM_V2_BASE_LINK_PROFILE_H_
+
+#include <cstdint>
+
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+
+// Characteristics of an emulated network link, in one direction.
+//
+// Links stay reliable and ordered, like the sockets they stand for: a lost
+// segment is sent again, and holds back the segments behind it. The default
+// profile is an ideal link, that delivers data as soon as it is written.
+struct LinkProfile {
+  // Bytes per second the link carries; 0 for no limit.
+  std::int64_t bandwidth = 0;
+  // Time it takes a segment to cross the link, once transmitted.
+  absl::Duration delay = absl::ZeroDuration();
+  // Upper bound of a random delay added to every segment.
+  absl::Duration jitter = absl::ZeroDuration();
+  // Probability that a segment is lost, and arrives retransmit_delay late.
+  double loss_rate = 0;
+  absl::Duration retransmit_delay = absl::Milliseconds(200);
+  // Probability that the link stops transmitting for stall_duration, drawn
+  // for every segment.
+  double stall_rate = 0;
+  absl::Duration stall_duration = absl::Seconds(1);
+  // Largest segment the link carries, in bytes; writes are split into
+  // segments of at most mtu bytes. 0 for no limit.
+  std::int64_t mtu = 0;
+  // Bytes a writer may have waiting for transmission before writes block.
+  std::int64_t send_buffer = 64 * 1024;
+
+  bool IsIdeal() const {
+    return bandwidth == 0 && delay == absl::ZeroDuration() &&
+           jitter == absl::ZeroDuration() && loss_rate == 0 &&
+           stall_rate == 0 && mtu == 0;
+  }
+
+  // Typical links of the mediums, for benchmarks and tests that care about
+  // timing.
+
+  // Bluetooth Classic RFCOMM channel.
+  static LinkProfile Bluetooth() {
+    return {
+        .bandwidth = 200 * 1024,
+        .delay = absl::Milliseconds(15),
+        .jitter = absl::Milliseconds(10),
+        .mtu = 990,
+    };
+  }
+
+  // BLE L2CAP/GATT channel.
+  static LinkProfile Ble() {
+    return {
+        .bandwidth = 12 * 1024,
+        .delay = absl::Milliseconds(30),
+        .jitter = absl::Milliseconds(15),
+        .mtu = 512,
+    };
+  }
+
+  // TCP over a WiFi access point.
+  static LinkProfile WifiLan() {
+    return {
+        .bandwidth = 10 * 1024 * 1024,
+        .delay = absl::Milliseconds(2),
+        .jitter = absl::Milliseconds(1),
+        .mtu = 1460,
+        .send_buffer = 256 * 1024,
+    };
+  }
+};
+
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_BASE_LINK_PROFILE_H_
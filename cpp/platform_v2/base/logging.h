@@ -15,8 +15,12 @@
 #ifndef PLATFORM_V2_BASE_LOGGING_H_
 #define PLATFORM_V2_BASE_LOGGING_H_
 
+#include <atomic>
+#include <cstdint>
+
 #include "platform_v2/api/log_message.h"
 #include "platform_v2/api/platform.h"
+#include "absl/time/clock.h"
 
 namespace location {
 namespace nearby {
@@ -32,6 +36,27 @@ class LogMessageVoidify {
   void operator&(std::ostream&) {}
 };
 
+// Lets through at most one message per interval; see NEARBY_LOG_EVERY_N_SEC.
+class LogRateLimiter {
+ public:
+  constexpr explicit LogRateLimiter(double seconds)
+      : interval_nanos_(static_cast<std::int64_t>(seconds * 1e9)) {}
+
+  // Returns true if a message may be logged now.
+  bool Allow() {
+    std::int64_t now = absl::GetCurrentTimeNanos();
+    std::int64_t next = next_nanos_.load(std::memory_order_relaxed);
+    if (now < next) return false;
+    // Of the threads that get here at once, only one wins.
+    return next_nanos_.compare_exchange_strong(next, now + interval_nanos_,
+                                               std::memory_order_relaxed);
+  }
+
+ private:
+  const std::int64_t interval_nanos_;
+  std::atomic<std::int64_t> next_nanos_{0};
+};
+
 }  // namespace nearby
 }  // namespace location
 
@@ -51,10 +76,30 @@ class LogMessageVoidify {
 #endif  // defined(_WIN32)
 #define NEARBY_SEVERITY(severity) NEARBY_SEVERITY_##severity
 
+// Compile-time severity threshold
+// Logging below NEARBY_LOG_MIN_SEVERITY is compiled out, arguments and all;
+// build with e.g. -DNEARBY_LOG_MIN_SEVERITY=1 to keep INFO logging out of
+// the binary. 0 is INFO, 1 WARNING, 2 ERROR. FATAL is always kept.
+#ifndef NEARBY_LOG_MIN_SEVERITY
+#define NEARBY_LOG_MIN_SEVERITY 0
+#endif
+#define NEARBY_SEVERITY_LEVEL_INFO 0
+#define NEARBY_SEVERITY_LEVEL_WARNING 1
+#define NEARBY_SEVERITY_LEVEL_ERROR 2
+#define NEARBY_SEVERITY_LEVEL_FATAL 3
+#if defined(_WIN32)
+#define NEARBY_SEVERITY_LEVEL_0 NEARBY_SEVERITY_LEVEL_ERROR
+#endif  // defined(_WIN32)
+#define NEARBY_SEVERITY_LEVEL(severity) NEARBY_SEVERITY_LEVEL_##severity
+#define NEARBY_LOG_IS_COMPILED_IN(severity)                      \
+  (NEARBY_SEVERITY_LEVEL(severity) >= NEARBY_LOG_MIN_SEVERITY || \
+   NEARBY_SEVERITY_LEVEL(severity) == NEARBY_SEVERITY_LEVEL_FATAL)
+
 // Log enabling
-#define NEARBY_LOG_IS_ON(severity)                           \
-  location::nearby::api::LogMessage::ShouldCreateLogMessage( \
-      NEARBY_SEVERITY(severity))
+#define NEARBY_LOG_IS_ON(severity)                             \
+  (NEARBY_LOG_IS_COMPILED_IN(severity) &&                      \
+   location::nearby::api::LogMessage::ShouldCreateLogMessage( \
+       NEARBY_SEVERITY(severity)))
 
 #define NEARBY_LOG_SET_SEVERITY(severity)               \
   location::nearby::api::LogMessage::SetMinLogSeverity( \
@@ -76,4 +121,15 @@ class LogMessageVoidify {
   NEARBY_LOG_IS_ON(severity)      \
   ? NEARBY_LOG_MESSAGE(severity)->Print(__VA_ARGS__) : (void)0
 
+// Like NEARBY_LOG, but logs at most once every |seconds| from this call site.
+// For messages on paths that may run many times a second.
+#define NEARBY_LOG_EVERY_N_SEC(severity, seconds, ...)                   \
+  do {                                                                   \
+    static location::nearby::LogRateLimiter nearby_log_rate_limiter{     \
+        seconds};                                                        \
+    if (NEARBY_LOG_IS_ON(severity) && nearby_log_rate_limiter.Allow()) { \
+      NEARBY_LOG_MESSAGE(severity)->Print(__VA_ARGS__);                  \
+    }                                                                    \
+  } while (false)
+
 #endif  // PLATFORM_V2_BASE_LOGGING_H_
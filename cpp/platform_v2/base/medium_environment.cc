@@ -14,21 +14,51 @@
 
 #include "platform_v2/base/medium_environment.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
 #include <new>
+#include <thread>  // NOLINT
 #include <type_traits>
+#include <utility>
 
 #include "platform_v2/api/ble.h"
 #include "platform_v2/api/bluetooth_adapter.h"
 #include "platform_v2/api/bluetooth_classic.h"
 #include "platform_v2/api/wifi_lan.h"
 #include "platform_v2/base/logging.h"
-#include "platform_v2/public/count_down_latch.h"
+#include "platform_v2/public/mutex_lock.h"
+#include "absl/hash/hash.h"
 
 namespace location {
 namespace nearby {
 
+namespace {
+
+// Upper bound on the number of dispatch threads.
+constexpr int kMaxShards = 16;
+
+int ShardCount() {
+  int cores = std::thread::hardware_concurrency();
+  return std::clamp(cores, 2, kMaxShards);
+}
+
+template <typename Key>
+std::size_t KeyOf(const Key& key) {
+  return absl::Hash<Key>{}(key);
+}
+
+template <typename Index, typename Medium>
+void RemoveFromIndex(Index& index, const std::string& service_id,
+                     Medium* medium) {
+  auto item = index.find(service_id);
+  if (item == index.end()) return;
+  item->second.erase(medium);
+  if (item->second.empty()) index.erase(item);
+}
+
+}  // namespace
+
 MediumEnvironment& MediumEnvironment::Instance() {
   static std::aligned_storage_t<sizeof(MediumEnvironment),
                                 alignof(MediumEnvironment)>
@@ -37,6 +67,14 @@ MediumEnvironment& MediumEnvironment::Instance() {
   return *env;
 }
 
+MediumEnvironment::MediumEnvironment() {
+  int count = ShardCount();
+  shards_.reserve(count);
+  for (int i = 0; i < count; i++) {
+    shards_.push_back(std::make_unique<SingleThreadExecutor>());
+  }
+}
+
 void MediumEnvironment::Start(EnvironmentConfig config) {
   if (!enabled_.exchange(true)) {
     NEARBY_LOG(INFO, "MediumEnvironment::Start()");
@@ -53,68 +91,85 @@ void MediumEnvironment::Stop() {
 }
 
 void MediumEnvironment::Reset() {
-  RunOnMediumEnvironmentThread([this]() {
+  link_count_ = 0;
+  {
+    MutexLock lock(&mutex_);
     NEARBY_LOG(INFO, "MediumEnvironment::Reset()");
     bluetooth_adapters_.clear();
     bluetooth_mediums_.clear();
     ble_mediums_.clear();
+    ble_advertisers_.clear();
+    ble_scanners_.clear();
     wifi_lan_mediums_.clear();
-  });
+    wifi_lan_services_.clear();
+  }
   Sync();
 }
 
 void MediumEnvironment::Sync(bool enable_notifications) {
   enable_notifications_ = enable_notifications;
   NEARBY_LOG(INFO, "MediumEnvironment::sync(%d)", enable_notifications);
-  int count = 0;
-  do {
-    CountDownLatch latch(1);
-    count = job_count_ + 1;
-    // We are about to schedule one last job.
-    // When it is done, counter must be equal to count.
-    // However, if pending jobs schedule anything else,
-    // it will be pending after us.
-    // If we want to ensure we are completely idle, then we have to
-    // repeat sync, until this becomes true.
-    RunOnMediumEnvironmentThread([&latch]() { latch.CountDown(); });
-    latch.Await();
-  } while (count < job_count_);
-  NEARBY_LOG(INFO, "MediumEnvironment::Sync(): done [count=%d]", count);
+  // A notification that schedules more notifications does so before it is
+  // done, so the count only drops to 0 once everything has settled.
+  MutexLock lock(&pending_mutex_);
+  while (pending_jobs_ > 0) idle_.Wait();
+  NEARBY_LOG(INFO, "MediumEnvironment::Sync(): done");
 }
 
 const EnvironmentConfig& MediumEnvironment::GetEnvironmentConfig() {
   return config_;
 }
 
+void MediumEnvironment::ConfigureLink(LinkMedium medium, BasePipe& pipe) {
+  const LinkProfile* profile = nullptr;
+  switch (medium) {
+    case LinkMedium::kBluetooth:
+      profile = &config_.bluetooth_link;
+      break;
+    case LinkMedium::kBle:
+      profile = &config_.ble_link;
+      break;
+    case LinkMedium::kWifiLan:
+      profile = &config_.wifi_lan_link;
+      break;
+  }
+  if (profile->IsIdeal()) return;
+  // Spread consecutive link numbers over the whole seed space.
+  std::uint64_t seed =
+      config_.link_seed ^ ((link_count_++ + 1) * 0xd1342543de82ef95ULL);
+  pipe.SetLinkProfile(*profile, seed);
+}
+
 void MediumEnvironment::OnBluetoothAdapterChangedState(
     api::BluetoothAdapter& adapter, api::BluetoothDevice& adapter_device,
     std::string name, bool enabled, api::BluetoothAdapter::ScanMode mode) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &adapter, &adapter_device,
-                                name = std::move(name), enabled, mode]() {
-    NEARBY_LOG(INFO,
-               "[adapter=%p, device=%p] update: name=%s, enabled=%d, mode=%d",
-               &adapter, &adapter_device, name.c_str(), enabled, mode);
-    for (auto& medium_info : bluetooth_mediums_) {
-      auto& info = medium_info.second;
-      // Do not send notification to medium that owns this adapter.
-      if (info.adapter == &adapter) continue;
-      NEARBY_LOG(INFO, "[adapter=%p, device=%p] notify: adapter=%p", &adapter,
-                 &adapter_device, info.adapter);
-      OnBluetoothDeviceStateChanged(info, adapter_device, name, mode, enabled);
-    }
-    // We don't care if there is an adapter already since all we store is a
-    // pointer. Pointer must remain valid for the duration of a Core session
-    // (since it is owned by the correspoinding Medium, and mediums lifetime
-    // matches Core lifetime).
-    bluetooth_adapters_.emplace(&adapter, &adapter_device);
-  });
+  MutexLock lock(&mutex_);
+  NEARBY_LOG(INFO,
+             "[adapter=%p, device=%p] update: name=%s, enabled=%d, mode=%d",
+             &adapter, &adapter_device, name.c_str(), enabled, mode);
+  // Classic discovery is not scoped to a service; every medium may see the
+  // device.
+  for (auto& medium_info : bluetooth_mediums_) {
+    auto& info = medium_info.second;
+    // Do not send notification to medium that owns this adapter.
+    if (info.adapter == &adapter) continue;
+    NEARBY_LOG(INFO, "[adapter=%p, device=%p] notify: adapter=%p", &adapter,
+               &adapter_device, info.adapter);
+    OnBluetoothDeviceStateChanged(*medium_info.first, info, adapter_device,
+                                  name, mode, enabled);
+  }
+  // We don't care if there is an adapter already since all we store is a
+  // pointer. Pointer must remain valid for the duration of a Core session
+  // (since it is owned by the correspoinding Medium, and mediums lifetime
+  // matches Core lifetime).
+  bluetooth_adapters_.emplace(&adapter, &adapter_device);
 }
 
 void MediumEnvironment::OnBluetoothDeviceStateChanged(
-    BluetoothMediumContext& info, api::BluetoothDevice& device,
-    const std::string& name, api::BluetoothAdapter::ScanMode mode,
-    bool enabled) {
+    api::BluetoothClassicMedium& medium, BluetoothMediumContext& info,
+    api::BluetoothDevice& device, const std::string& name,
+    api::BluetoothAdapter::ScanMode mode, bool enabled) {
   if (!enabled_) return;
   auto item = info.devices.find(&device);
   if (item == info.devices.end()) {
@@ -128,8 +183,10 @@ void MediumEnvironment::OnBluetoothDeviceStateChanged(
       // Store device name, and report it as discovered.
       info.devices.emplace(&device, name);
       if (enable_notifications_) {
-        RunOnMediumEnvironmentThread(
-            [&info, &device]() { info.callback.device_discovered_cb(device); });
+        NotifyBluetoothMedium(medium,
+                              [&device](BluetoothDiscoveryCallback& callback) {
+                                callback.device_discovered_cb(device);
+                              });
       }
     }
   } else {
@@ -145,16 +202,18 @@ void MediumEnvironment::OnBluetoothDeviceStateChanged(
         // Store device name, and report it as renamed.
         item->second = name;
         if (enable_notifications_) {
-          RunOnMediumEnvironmentThread([&info, &device]() {
-            info.callback.device_name_changed_cb(device);
-          });
+          NotifyBluetoothMedium(
+              medium, [&device](BluetoothDiscoveryCallback& callback) {
+                callback.device_name_changed_cb(device);
+              });
         }
       } else {
         // Device is in discovery mode, so we are reporting it anyway.
         if (enable_notifications_) {
-          RunOnMediumEnvironmentThread([&info, &device]() {
-            info.callback.device_discovered_cb(device);
-          });
+          NotifyBluetoothMedium(
+              medium, [&device](BluetoothDiscoveryCallback& callback) {
+                callback.device_discovered_cb(device);
+              });
         }
       }
     }
@@ -162,8 +221,10 @@ void MediumEnvironment::OnBluetoothDeviceStateChanged(
       // Known device is turned off.
       // Erase it from the map, and report as lost.
       if (enable_notifications_) {
-        RunOnMediumEnvironmentThread(
-            [&info, &device]() { info.callback.device_lost_cb(device); });
+        NotifyBluetoothMedium(medium,
+                              [&device](BluetoothDiscoveryCallback& callback) {
+                                callback.device_lost_cb(device);
+                              });
       }
       info.devices.erase(item);
     }
@@ -172,184 +233,240 @@ void MediumEnvironment::OnBluetoothDeviceStateChanged(
 
 api::BluetoothDevice* MediumEnvironment::FindBluetoothDevice(
     const std::string& mac_address) {
-  api::BluetoothDevice* device = nullptr;
-  CountDownLatch latch(1);
-  RunOnMediumEnvironmentThread([this, &device, &latch, &mac_address]() {
-    for (auto& item : bluetooth_mediums_) {
-      auto* adapter = item.second.adapter;
-      if (!adapter) continue;
-      if (adapter->GetMacAddress() == mac_address) {
-        device = bluetooth_adapters_[adapter];
-        break;
-      }
+  MutexLock lock(&mutex_);
+  for (auto& item : bluetooth_mediums_) {
+    auto* adapter = item.second.adapter;
+    if (!adapter) continue;
+    if (adapter->GetMacAddress() == mac_address) {
+      auto device = bluetooth_adapters_.find(adapter);
+      return device != bluetooth_adapters_.end() ? device->second : nullptr;
     }
-    latch.CountDown();
-  });
-  latch.Await();
-  return device;
+  }
+  return nullptr;
 }
 
 void MediumEnvironment::OnBlePeripheralStateChanged(
-    BleMediumContext& info, api::BlePeripheral& peripheral,
+    api::BleMedium& medium, api::BlePeripheral& peripheral,
     const std::string& service_id, bool fast_advertisement, bool enabled) {
   if (!enabled_) return;
   NEARBY_LOG(INFO,
-             "G3 OnBleServiceStateChanged [peripheral impl=%p]; context=%p; "
+             "G3 OnBleServiceStateChanged [peripheral impl=%p]; medium=%p; "
              "service_id=%s; notify=%d",
-             &peripheral, &info, service_id.c_str(),
+             &peripheral, &medium, service_id.c_str(),
              enable_notifications_.load());
   if (!enable_notifications_) return;
-  RunOnMediumEnvironmentThread([&info, enabled, &peripheral, service_id,
-                                fast_advertisement]() {
+  NotifyBleMedium(medium, [&medium, enabled, &peripheral, service_id,
+                           fast_advertisement](BleMediumContext& context) {
     NEARBY_LOG(INFO,
                "G3 [Run] OnBlePeripheralStateChanged [peripheral impl=%p]; "
-               "context=%p; service_id=%s; enabled=%d",
-               &peripheral, &info, service_id.c_str(), enabled);
+               "medium=%p; service_id=%s; enabled=%d",
+               &peripheral, &medium, service_id.c_str(), enabled);
     if (enabled) {
-      info.discovery_callback.peripheral_discovered_cb(peripheral, service_id,
-                                                       fast_advertisement);
+      context.discovery_callback.peripheral_discovered_cb(
+          peripheral, service_id, fast_advertisement);
     } else {
-      info.discovery_callback.peripheral_lost_cb(peripheral, service_id);
+      context.discovery_callback.peripheral_lost_cb(peripheral, service_id);
     }
   });
 }
 
 void MediumEnvironment::OnWifiLanServiceStateChanged(
-    WifiLanMediumContext& info, api::WifiLanService& service,
+    api::WifiLanMedium& medium, api::WifiLanService& service,
     const std::string& service_id, bool enabled) {
   if (!enabled_) return;
   NEARBY_LOG(INFO,
-             "G3 OnWifiLanServiceStateChanged [service impl=%p]; context=%p; "
+             "G3 OnWifiLanServiceStateChanged [service impl=%p]; medium=%p; "
              "service_id=%s; notify=%d",
-             &service, &info, service_id.c_str(), enable_notifications_.load());
+             &service, &medium, service_id.c_str(),
+             enable_notifications_.load());
   if (!enable_notifications_) return;
-  RunOnMediumEnvironmentThread([&info, enabled, &service, service_id]() {
-    NEARBY_LOG(INFO,
-               "G3 [Run] OnWifiLanServiceStateChanged [service impl=%p]; "
-               "context=%p; service_id=%s; enabled=%d",
-               &service, &info, service_id.c_str(), enabled);
-    auto service_id_context = info.services.find(service_id);
-    if (service_id_context == info.services.end()) return;
+  NotifyWifiLanMedium(
+      medium, service_id,
+      [&medium, enabled, &service,
+       service_id](WifiLanServiceIdContext& context) {
+        NEARBY_LOG(INFO,
+                   "G3 [Run] OnWifiLanServiceStateChanged [service impl=%p]; "
+                   "medium=%p; service_id=%s; enabled=%d",
+                   &service, &medium, service_id.c_str(), enabled);
+        if (enabled) {
+          context.discovery_callback.service_discovered_cb(service,
+                                                           service_id);
+        } else {
+          context.discovery_callback.service_lost_cb(service, service_id);
+        }
+      });
+}
 
-    if (enabled) {
-      service_id_context->second.discovery_callback.service_discovered_cb(
-          service, service_id);
-    } else {
-      service_id_context->second.discovery_callback.service_lost_cb(service,
-                                                                    service_id);
-    }
-  });
+void MediumEnvironment::NotifyBluetoothMedium(
+    api::BluetoothClassicMedium& medium,
+    std::function<void(BluetoothDiscoveryCallback&)> notify) {
+  RunOnMediumEnvironmentThread(
+      KeyOf(&medium), [this, &medium, notify = std::move(notify)]() {
+        BluetoothDiscoveryCallback callback;
+        {
+          MutexLock lock(&mutex_);
+          auto item = bluetooth_mediums_.find(&medium);
+          if (item == bluetooth_mediums_.end()) return;
+          callback = item->second.callback;
+        }
+        notify(callback);
+      });
+}
+
+void MediumEnvironment::NotifyBleMedium(
+    api::BleMedium& medium, std::function<void(BleMediumContext&)> notify) {
+  RunOnMediumEnvironmentThread(
+      KeyOf(&medium), [this, &medium, notify = std::move(notify)]() {
+        BleMediumContext context;
+        {
+          MutexLock lock(&mutex_);
+          auto item = ble_mediums_.find(&medium);
+          if (item == ble_mediums_.end()) {
+            NEARBY_LOG(INFO, "Notification dropped; medium=%p is gone",
+                       &medium);
+            return;
+          }
+          context = item->second;
+        }
+        notify(context);
+      });
+}
+
+void MediumEnvironment::NotifyWifiLanMedium(
+    api::WifiLanMedium& medium, const std::string& service_id,
+    std::function<void(WifiLanServiceIdContext&)> notify) {
+  RunOnMediumEnvironmentThread(
+      KeyOf(&medium),
+      [this, &medium, service_id, notify = std::move(notify)]() {
+        WifiLanServiceIdContext context;
+        {
+          MutexLock lock(&mutex_);
+          auto item = wifi_lan_mediums_.find(&medium);
+          if (item == wifi_lan_mediums_.end()) {
+            NEARBY_LOG(INFO, "Notification dropped; medium=%p is gone",
+                       &medium);
+            return;
+          }
+          auto service_id_context = item->second.services.find(service_id);
+          if (service_id_context == item->second.services.end()) return;
+          context = service_id_context->second;
+        }
+        notify(context);
+      });
 }
 
 void MediumEnvironment::RunOnMediumEnvironmentThread(
-    std::function<void()> runnable) {
-  job_count_++;
-  executor_.Execute(std::move(runnable));
+    std::size_t key, std::function<void()> runnable) {
+  {
+    MutexLock lock(&pending_mutex_);
+    pending_jobs_++;
+  }
+  shards_[key % shards_.size()]->Execute(
+      [this, runnable = std::move(runnable)]() {
+        runnable();
+        MutexLock lock(&pending_mutex_);
+        if (--pending_jobs_ == 0) idle_.Notify();
+      });
 }
 
 void MediumEnvironment::RegisterBluetoothMedium(
     api::BluetoothClassicMedium& medium,
     api::BluetoothAdapter& medium_adapter) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium, &medium_adapter]() {
-    auto& context = bluetooth_mediums_
-                        .insert({&medium,
-                                 BluetoothMediumContext{
-                                     .adapter = &medium_adapter,
-                                 }})
-                        .first->second;
-    auto* owned_adapter = context.adapter;
-    NEARBY_LOG(INFO, "Registered: medium=%p; adapter=%p", &medium,
-               owned_adapter);
-    for (auto& adapter_device : bluetooth_adapters_) {
-      auto& adapter = adapter_device.first;
-      auto& device = adapter_device.second;
-      if (adapter == nullptr) continue;
-      OnBluetoothDeviceStateChanged(context, *device, adapter->GetName(),
-                                    adapter->GetScanMode(),
-                                    adapter->IsEnabled());
-    }
-  });
+  MutexLock lock(&mutex_);
+  auto& context = bluetooth_mediums_
+                      .insert({&medium,
+                               BluetoothMediumContext{
+                                   .adapter = &medium_adapter,
+                               }})
+                      .first->second;
+  auto* owned_adapter = context.adapter;
+  NEARBY_LOG(INFO, "Registered: medium=%p; adapter=%p", &medium,
+             owned_adapter);
+  for (auto& adapter_device : bluetooth_adapters_) {
+    auto& adapter = adapter_device.first;
+    auto& device = adapter_device.second;
+    if (adapter == nullptr) continue;
+    OnBluetoothDeviceStateChanged(medium, context, *device, adapter->GetName(),
+                                  adapter->GetScanMode(), adapter->IsEnabled());
+  }
 }
 
 void MediumEnvironment::UpdateBluetoothMedium(
     api::BluetoothClassicMedium& medium, BluetoothDiscoveryCallback callback) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium,
-                                callback = std::move(callback)]() {
-    auto item = bluetooth_mediums_.find(&medium);
-    if (item == bluetooth_mediums_.end()) return;
-    auto& context = item->second;
-    context.callback = std::move(callback);
-    auto* owned_adapter = context.adapter;
-    NEARBY_LOG(
-        INFO,
-        "Updated: this=%p; medium=%p; adapter=%p; name=%s; enabled=%d; mode=%d",
-        this, &medium, owned_adapter, owned_adapter->GetName().c_str(),
-        owned_adapter->IsEnabled(), owned_adapter->GetScanMode());
-    for (auto& adapter_device : bluetooth_adapters_) {
-      auto& adapter = adapter_device.first;
-      auto& device = adapter_device.second;
-      if (adapter == nullptr) continue;
-      OnBluetoothDeviceStateChanged(context, *device, adapter->GetName(),
-                                    adapter->GetScanMode(),
-                                    adapter->IsEnabled());
-    }
-  });
+  MutexLock lock(&mutex_);
+  auto item = bluetooth_mediums_.find(&medium);
+  if (item == bluetooth_mediums_.end()) return;
+  auto& context = item->second;
+  context.callback = std::move(callback);
+  auto* owned_adapter = context.adapter;
+  NEARBY_LOG(
+      INFO,
+      "Updated: this=%p; medium=%p; adapter=%p; name=%s; enabled=%d; mode=%d",
+      this, &medium, owned_adapter, owned_adapter->GetName().c_str(),
+      owned_adapter->IsEnabled(), owned_adapter->GetScanMode());
+  for (auto& adapter_device : bluetooth_adapters_) {
+    auto& adapter = adapter_device.first;
+    auto& device = adapter_device.second;
+    if (adapter == nullptr) continue;
+    OnBluetoothDeviceStateChanged(medium, context, *device, adapter->GetName(),
+                                  adapter->GetScanMode(), adapter->IsEnabled());
+  }
 }
 
 void MediumEnvironment::UnregisterBluetoothMedium(
     api::BluetoothClassicMedium& medium) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium]() {
-    auto item = bluetooth_mediums_.extract(&medium);
-    if (item.empty()) return;
-    auto& context = item.mapped();
-    NEARBY_LOG(INFO, "Unregistered medium for device=%s",
-               context.adapter->GetName().c_str());
-  });
+  MutexLock lock(&mutex_);
+  auto item = bluetooth_mediums_.extract(&medium);
+  if (item.empty()) return;
+  auto& context = item.mapped();
+  NEARBY_LOG(INFO, "Unregistered medium for device=%s",
+             context.adapter->GetName().c_str());
 }
 
 void MediumEnvironment::RegisterBleMedium(api::BleMedium& medium) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium]() {
-    ble_mediums_.insert({&medium, BleMediumContext{}});
-    NEARBY_LOG(INFO, "Registered: medium=%p", &medium);
-  });
+  MutexLock lock(&mutex_);
+  ble_mediums_.insert({&medium, BleMediumContext{}});
+  NEARBY_LOG(INFO, "Registered: medium=%p", &medium);
 }
 
 void MediumEnvironment::UpdateBleMediumForAdvertising(
     api::BleMedium& medium, api::BlePeripheral& peripheral,
     const std::string& service_id, bool fast_advertisement, bool enabled) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread(
-      [this, &medium, &peripheral, service_id, fast_advertisement, enabled]() {
-        auto item = ble_mediums_.find(&medium);
-        if (item == ble_mediums_.end()) {
-          NEARBY_LOG(INFO,
-                     "UpdateBleMediumForAdvertising failed. There is no medium "
-                     "registered.");
-          return;
-        }
-        auto& context = item->second;
-        context.ble_peripheral = &peripheral;
-        context.advertising = enabled;
-        context.fast_advertisement = fast_advertisement;
-        NEARBY_LOG(
-            INFO,
-            "Update Ble medium for advertising: this=%p; medium=%p; "
-            "service_id=%s; name=%s; fast_advertisement=%d; enabled=%d; ",
-            this, &medium, service_id.c_str(), peripheral.GetName().c_str(),
-            fast_advertisement, enabled);
-        for (auto& medium_info : ble_mediums_) {
-          auto& local_medium = medium_info.first;
-          auto& info = medium_info.second;
-          // Do not send notification to the same medium.
-          if (local_medium == &medium) continue;
-          OnBlePeripheralStateChanged(info, peripheral, service_id,
-                                      fast_advertisement, enabled);
-        }
-      });
+  MutexLock lock(&mutex_);
+  auto item = ble_mediums_.find(&medium);
+  if (item == ble_mediums_.end()) {
+    NEARBY_LOG(INFO,
+               "UpdateBleMediumForAdvertising failed. There is no medium "
+               "registered.");
+    return;
+  }
+  auto& context = item->second;
+  if (context.advertising) {
+    RemoveFromIndex(ble_advertisers_, context.advertising_service_id, &medium);
+  }
+  context.ble_peripheral = &peripheral;
+  context.advertising = enabled;
+  context.fast_advertisement = fast_advertisement;
+  context.advertising_service_id = service_id;
+  if (enabled) ble_advertisers_[service_id].insert(&medium);
+  NEARBY_LOG(INFO,
+             "Update Ble medium for advertising: this=%p; medium=%p; "
+             "service_id=%s; name=%s; fast_advertisement=%d; enabled=%d; ",
+             this, &medium, service_id.c_str(), peripheral.GetName().c_str(),
+             fast_advertisement, enabled);
+  auto scanners = ble_scanners_.find(service_id);
+  if (scanners == ble_scanners_.end()) return;
+  for (auto* scanner : scanners->second) {
+    // Do not send notification to the same medium.
+    if (scanner == &medium) continue;
+    OnBlePeripheralStateChanged(*scanner, peripheral, service_id,
+                                fast_advertisement, enabled);
+  }
 }
 
 void MediumEnvironment::UpdateBleMediumForScanning(
@@ -357,121 +474,119 @@ void MediumEnvironment::UpdateBleMediumForScanning(
     const std::string& fast_advertisement_service_uuid,
     BleDiscoveredPeripheralCallback callback, bool enabled) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread(
-      [this, &medium, service_id, fast_advertisement_service_uuid,
-       callback = std::move(callback), enabled]() {
-        auto item = ble_mediums_.find(&medium);
-        if (item == ble_mediums_.end()) {
-          NEARBY_LOG(INFO,
-                     "UpdateBleMediumFoScanning failed. There is no medium "
-                     "registered.");
-          return;
-        }
-        auto& context = item->second;
-        context.discovery_callback = std::move(callback);
-        NEARBY_LOG(
-            INFO,
-            "Update Ble medium for scanning: this=%p; medium=%p; "
-            "service_id=%s; fast_advertisement_service_uuid=%s; enabled=%d ;",
-            this, &medium, service_id.c_str(),
-            fast_advertisement_service_uuid.c_str(), enabled);
-        for (auto& medium_info : ble_mediums_) {
-          auto& local_medium = medium_info.first;
-          auto& info = medium_info.second;
-          // Do not send notification to the same medium.
-          if (local_medium == &medium) continue;
-          // Search advertising mediums and send notification.
-          if (info.advertising && enabled) {
-            OnBlePeripheralStateChanged(context, *(info.ble_peripheral),
-                                        service_id, info.fast_advertisement,
-                                        enabled);
-          }
-        }
-      });
+  MutexLock lock(&mutex_);
+  auto item = ble_mediums_.find(&medium);
+  if (item == ble_mediums_.end()) {
+    NEARBY_LOG(INFO,
+               "UpdateBleMediumFoScanning failed. There is no medium "
+               "registered.");
+    return;
+  }
+  auto& context = item->second;
+  context.discovery_callback = std::move(callback);
+  if (context.scanning) {
+    RemoveFromIndex(ble_scanners_, context.scanning_service_id, &medium);
+  }
+  context.scanning = enabled;
+  context.scanning_service_id = service_id;
+  if (enabled) ble_scanners_[service_id].insert(&medium);
+  NEARBY_LOG(INFO,
+             "Update Ble medium for scanning: this=%p; medium=%p; "
+             "service_id=%s; fast_advertisement_service_uuid=%s; enabled=%d ;",
+             this, &medium, service_id.c_str(),
+             fast_advertisement_service_uuid.c_str(), enabled);
+  if (!enabled) return;
+  auto advertisers = ble_advertisers_.find(service_id);
+  if (advertisers == ble_advertisers_.end()) return;
+  // Search advertising mediums and send notification.
+  for (auto* advertiser : advertisers->second) {
+    // Do not send notification to the same medium.
+    if (advertiser == &medium) continue;
+    auto& info = ble_mediums_[advertiser];
+    OnBlePeripheralStateChanged(medium, *(info.ble_peripheral), service_id,
+                                info.fast_advertisement, enabled);
+  }
 }
 
 void MediumEnvironment::UpdateBleMediumForAcceptedConnection(
     api::BleMedium& medium, const std::string& service_id,
     BleAcceptedConnectionCallback callback) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread(
-      [this, &medium, service_id, callback = std::move(callback)]() {
-        auto item = ble_mediums_.find(&medium);
-        if (item == ble_mediums_.end()) {
-          NEARBY_LOG(
-              INFO, "Update Ble medium failed. There is no medium registered.");
-          return;
-        }
-        auto& context = item->second;
-        context.accepted_connection_callback = std::move(callback);
-        NEARBY_LOG(INFO,
-                   "Update Ble medium for accepted callback: this=%p; "
-                   "medium=%p; service_id=%s; ",
-                   this, &medium, service_id.c_str());
-      });
+  MutexLock lock(&mutex_);
+  auto item = ble_mediums_.find(&medium);
+  if (item == ble_mediums_.end()) {
+    NEARBY_LOG(INFO,
+               "Update Ble medium failed. There is no medium registered.");
+    return;
+  }
+  auto& context = item->second;
+  context.accepted_connection_callback = std::move(callback);
+  NEARBY_LOG(INFO,
+             "Update Ble medium for accepted callback: this=%p; "
+             "medium=%p; service_id=%s; ",
+             this, &medium, service_id.c_str());
 }
 
 void MediumEnvironment::UnregisterBleMedium(api::BleMedium& medium) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium]() {
-    auto item = ble_mediums_.extract(&medium);
-    if (item.empty()) return;
-    NEARBY_LOG(INFO, "Unregistered Ble medium");
-  });
+  MutexLock lock(&mutex_);
+  auto item = ble_mediums_.extract(&medium);
+  if (item.empty()) return;
+  auto& context = item.mapped();
+  if (context.advertising) {
+    RemoveFromIndex(ble_advertisers_, context.advertising_service_id, &medium);
+  }
+  if (context.scanning) {
+    RemoveFromIndex(ble_scanners_, context.scanning_service_id, &medium);
+  }
+  NEARBY_LOG(INFO, "Unregistered Ble medium");
 }
 
 void MediumEnvironment::CallBleAcceptedConnectionCallback(
     api::BleMedium& medium, api::BleSocket& socket,
     const std::string& service_id) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium, &socket, service_id]() {
-    auto item = ble_mediums_.find(&medium);
-    if (item == ble_mediums_.end()) {
-      NEARBY_LOG(INFO,
-                 "Call AcceptedConnectionCallback failed.. There is no medium "
-                 "registered.");
-      return;
-    }
-    auto& info = item->second;
-    info.accepted_connection_callback.accepted_cb(socket, service_id);
+  NotifyBleMedium(medium, [&socket, service_id](BleMediumContext& context) {
+    context.accepted_connection_callback.accepted_cb(socket, service_id);
   });
 }
 
 void MediumEnvironment::RegisterWebRtcSignalingMessenger(
     absl::string_view self_id, OnSignalingMessageCallback callback) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread(
-      [this, self_id{std::string(self_id)}, callback{std::move(callback)}]() {
-        webrtc_signaling_callback_[self_id] = std::move(callback);
-        NEARBY_LOG(INFO, "Registered signaling message callback for id = %s",
-                   self_id.c_str());
-      });
+  MutexLock lock(&mutex_);
+  webrtc_signaling_callback_[self_id] = std::move(callback);
+  NEARBY_LOG(INFO, "Registered signaling message callback for id = %s",
+             std::string(self_id).c_str());
 }
 
 void MediumEnvironment::UnregisterWebRtcSignalingMessenger(
     absl::string_view self_id) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, self_id{std::string(self_id)}]() {
-    auto item = webrtc_signaling_callback_.extract(self_id);
-    if (item.empty()) return;
-    NEARBY_LOG(INFO, "Unregistered signaling message callback for id = %s",
-               self_id.c_str());
-  });
+  MutexLock lock(&mutex_);
+  auto item = webrtc_signaling_callback_.extract(self_id);
+  if (item.empty()) return;
+  NEARBY_LOG(INFO, "Unregistered signaling message callback for id = %s",
+             std::string(self_id).c_str());
 }
 
 void MediumEnvironment::SendWebRtcSignalingMessage(absl::string_view peer_id,
                                                    const ByteArray& message) {
   if (!enabled_) return;
   RunOnMediumEnvironmentThread(
-      [this, peer_id{std::string(peer_id)}, message]() {
-        auto item = webrtc_signaling_callback_.find(peer_id);
-        if (item == webrtc_signaling_callback_.end()) {
-          NEARBY_LOG(WARNING, "No callback registered for peer id = %s",
-                     peer_id.c_str());
-          return;
+      KeyOf(peer_id), [this, peer_id{std::string(peer_id)}, message]() {
+        OnSignalingMessageCallback callback;
+        {
+          MutexLock lock(&mutex_);
+          auto item = webrtc_signaling_callback_.find(peer_id);
+          if (item == webrtc_signaling_callback_.end()) {
+            NEARBY_LOG(WARNING, "No callback registered for peer id = %s",
+                       peer_id.c_str());
+            return;
+          }
+          callback = item->second;
         }
-
-        item->second(message);
+        callback(message);
       });
 }
 
@@ -486,176 +601,127 @@ bool MediumEnvironment::GetUseValidPeerConnection() {
 
 void MediumEnvironment::RegisterWifiLanMedium(api::WifiLanMedium& medium) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium]() {
-    wifi_lan_mediums_.insert({&medium, WifiLanMediumContext{}});
-    NEARBY_LOG(INFO, "Registered: medium=%p", &medium);
-  });
+  MutexLock lock(&mutex_);
+  wifi_lan_mediums_.insert({&medium, WifiLanMediumContext{}});
+  NEARBY_LOG(INFO, "Registered: medium=%p", &medium);
 }
 
 void MediumEnvironment::UpdateWifiLanMediumForAdvertising(
     api::WifiLanMedium& medium, api::WifiLanService& service,
     const std::string& service_id, bool enabled) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium, &service, service_id,
-                                enabled]() {
-    auto item = wifi_lan_mediums_.find(&medium);
-    if (item == wifi_lan_mediums_.end()) {
-      NEARBY_LOG(INFO,
-                 "UpdateWifiLanMediumForAdvertising failed. There is no medium "
-                 "registered.");
-      return;
-    }
-    auto& context = item->second;
-    context.wifi_lan_service = &service;
-    auto service_id_context = context.services.find(service_id);
-    if (service_id_context == context.services.end()) {
-      WifiLanServiceIdContext id_context{
-          .advertising = enabled,
-      };
-      context.services.emplace(service_id, std::move(id_context));
-    } else {
-      service_id_context->second.advertising = enabled;
-    }
+  MutexLock lock(&mutex_);
+  auto item = wifi_lan_mediums_.find(&medium);
+  if (item == wifi_lan_mediums_.end()) {
     NEARBY_LOG(INFO,
-               "Update WifiLan medium for advertising: this=%p; medium=%p; "
-               "service_id=%s; name=%s; "
-               "enabled=%d",
-               this, &medium, service_id.c_str(), service.GetName().c_str(),
-               enabled);
-    for (auto& medium_info : wifi_lan_mediums_) {
-      auto& local_medium = medium_info.first;
-      auto& info = medium_info.second;
-      // Do not send notification to the same medium.
-      if (local_medium == &medium) continue;
-      OnWifiLanServiceStateChanged(info, service, service_id, enabled);
-    }
-  });
+               "UpdateWifiLanMediumForAdvertising failed. There is no medium "
+               "registered.");
+    return;
+  }
+  auto& context = item->second;
+  context.wifi_lan_service = &service;
+  context.services[service_id].advertising = enabled;
+  wifi_lan_services_[service_id].insert(&medium);
+  NEARBY_LOG(INFO,
+             "Update WifiLan medium for advertising: this=%p; medium=%p; "
+             "service_id=%s; name=%s; "
+             "enabled=%d",
+             this, &medium, service_id.c_str(), service.GetName().c_str(),
+             enabled);
+  for (auto* local_medium : wifi_lan_services_[service_id]) {
+    // Do not send notification to the same medium.
+    if (local_medium == &medium) continue;
+    OnWifiLanServiceStateChanged(*local_medium, service, service_id, enabled);
+  }
 }
 
 void MediumEnvironment::UpdateWifiLanMediumForDiscovery(
     api::WifiLanMedium& medium, const std::string& service_id,
     WifiLanDiscoveredServiceCallback callback, bool enabled) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium, service_id,
-                                callback = std::move(callback), enabled]() {
-    auto item = wifi_lan_mediums_.find(&medium);
-    if (item == wifi_lan_mediums_.end()) {
-      NEARBY_LOG(INFO,
-                 "UpdateWifiLanMediumForDiscovery failed. There is no medium "
-                 "registered.");
-      return;
-    }
-    auto& context = item->second;
-    auto service_id_context = context.services.find(service_id);
-    if (service_id_context == context.services.end()) {
-      WifiLanServiceIdContext id_context{
-          .discovery_callback = std::move(callback),
-      };
-      context.services.emplace(service_id, std::move(id_context));
-    } else {
-      service_id_context->second.discovery_callback = std::move(callback);
-    }
+  MutexLock lock(&mutex_);
+  auto item = wifi_lan_mediums_.find(&medium);
+  if (item == wifi_lan_mediums_.end()) {
     NEARBY_LOG(INFO,
-               "Update WifiLan medium for discovery: this=%p; medium=%p; "
-               "service_id=%s; enabled=%d; ",
-               this, &medium, service_id.c_str(), enabled);
-    for (auto& medium_info : wifi_lan_mediums_) {
-      auto& local_medium = medium_info.first;
-      auto& info = medium_info.second;
-      // Do not send notification to the same medium.
-      if (local_medium == &medium) continue;
-      // Search advertising mediums and send notification.
-      for (auto& service_id_context : info.services) {
-        auto& service_id = service_id_context.first;
-        auto& id_context = service_id_context.second;
-        if (id_context.advertising && enabled) {
-          OnWifiLanServiceStateChanged(context, *(info.wifi_lan_service),
-                                       service_id, enabled);
-        }
-      }
+               "UpdateWifiLanMediumForDiscovery failed. There is no medium "
+               "registered.");
+    return;
+  }
+  auto& context = item->second;
+  context.services[service_id].discovery_callback = std::move(callback);
+  wifi_lan_services_[service_id].insert(&medium);
+  NEARBY_LOG(INFO,
+             "Update WifiLan medium for discovery: this=%p; medium=%p; "
+             "service_id=%s; enabled=%d; ",
+             this, &medium, service_id.c_str(), enabled);
+  if (!enabled) return;
+  // Search advertising mediums and send notification.
+  for (auto* remote_medium : wifi_lan_services_[service_id]) {
+    // Do not send notification to the same medium.
+    if (remote_medium == &medium) continue;
+    auto& info = wifi_lan_mediums_[remote_medium];
+    if (info.services[service_id].advertising) {
+      OnWifiLanServiceStateChanged(medium, *(info.wifi_lan_service),
+                                   service_id, enabled);
     }
-  });
+  }
 }
 
 void MediumEnvironment::UpdateWifiLanMediumForAcceptedConnection(
     api::WifiLanMedium& medium, const std::string& service_id,
     WifiLanAcceptedConnectionCallback callback) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium, service_id,
-                                callback = std::move(callback)]() {
-    auto item = wifi_lan_mediums_.find(&medium);
-    if (item == wifi_lan_mediums_.end()) {
-      NEARBY_LOG(
-          INFO, "Update WifiLan medium failed. There is no medium registered.");
-      return;
-    }
-    auto& context = item->second;
-    auto service_id_context = context.services.find(service_id);
-    if (service_id_context == context.services.end()) {
-      WifiLanServiceIdContext id_context{
-          .accepted_connection_callback = std::move(callback),
-      };
-      context.services.emplace(service_id, std::move(id_context));
-    } else {
-      service_id_context->second.accepted_connection_callback =
-          std::move(callback);
-    }
+  MutexLock lock(&mutex_);
+  auto item = wifi_lan_mediums_.find(&medium);
+  if (item == wifi_lan_mediums_.end()) {
     NEARBY_LOG(INFO,
-               "Update WifiLan medium for accepted callback: this=%p; "
-               "medium=%p; service_id=%s; ",
-               this, &medium, service_id.c_str());
-  });
+               "Update WifiLan medium failed. There is no medium registered.");
+    return;
+  }
+  auto& context = item->second;
+  context.services[service_id].accepted_connection_callback =
+      std::move(callback);
+  wifi_lan_services_[service_id].insert(&medium);
+  NEARBY_LOG(INFO,
+             "Update WifiLan medium for accepted callback: this=%p; "
+             "medium=%p; service_id=%s; ",
+             this, &medium, service_id.c_str());
 }
 
 void MediumEnvironment::UnregisterWifiLanMedium(api::WifiLanMedium& medium) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium]() {
-    auto item = wifi_lan_mediums_.extract(&medium);
-    if (item.empty()) return;
-    NEARBY_LOG(INFO, "Unregistered WifiLan medium");
-  });
+  MutexLock lock(&mutex_);
+  auto item = wifi_lan_mediums_.extract(&medium);
+  if (item.empty()) return;
+  for (const auto& service_id_context : item.mapped().services) {
+    RemoveFromIndex(wifi_lan_services_, service_id_context.first, &medium);
+  }
+  NEARBY_LOG(INFO, "Unregistered WifiLan medium");
 }
 
 void MediumEnvironment::CallWifiLanAcceptedConnectionCallback(
     api::WifiLanMedium& medium, api::WifiLanSocket& socket,
     const std::string& service_id) {
   if (!enabled_) return;
-  RunOnMediumEnvironmentThread([this, &medium, &socket, service_id]() {
-    auto item = wifi_lan_mediums_.find(&medium);
-    if (item == wifi_lan_mediums_.end()) {
-      NEARBY_LOG(INFO,
-                 "Call AcceptedConnectionCallback failed.. There is no medium "
-                 "registered.");
-      return;
-    }
-    auto& info = item->second;
-    auto service_id_context = info.services.find(service_id);
-    if (service_id_context != info.services.end()) {
-      service_id_context->second.accepted_connection_callback.accepted_cb(
-          socket, service_id);
-    }
-  });
+  NotifyWifiLanMedium(
+      medium, service_id,
+      [&socket, service_id](WifiLanServiceIdContext& context) {
+        context.accepted_connection_callback.accepted_cb(socket, service_id);
+      });
 }
 
 api::WifiLanService* MediumEnvironment::FindWifiLanService(
     const std::string& ip_address, int port) {
-  api::WifiLanService* remote_service = nullptr;
-  CountDownLatch latch(1);
-  RunOnMediumEnvironmentThread(
-      [this, &remote_service, &ip_address, port, &latch]() {
-        for (auto& item : wifi_lan_mediums_) {
-          auto* service = item.second.wifi_lan_service;
-          if (!service) continue;
-          auto addr = remote_service->GetServiceAddress();
-          if (addr.first == ip_address && addr.second == port) {
-            remote_service = service;
-            break;
-          }
-        }
-        latch.CountDown();
-      });
-  latch.Await();
-  return remote_service;
+  MutexLock lock(&mutex_);
+  for (auto& item : wifi_lan_mediums_) {
+    auto* service = item.second.wifi_lan_service;
+    if (!service) continue;
+    auto addr = service->GetServiceAddress();
+    if (addr.first == ip_address && addr.second == port) {
+      return service;
+    }
+  }
+  return nullptr;
 }
 
 }  // namespace nearby
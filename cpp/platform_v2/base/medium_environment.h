@@ -16,14 +16,26 @@
 #define PLATFORM_V2_BASE_MEDIUM_ENVIRONMENT_H_
 
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "platform_v2/api/bluetooth_adapter.h"
 #include "platform_v2/api/bluetooth_classic.h"
 #include "platform_v2/api/webrtc.h"
+#include "platform_v2/base/base_pipe.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/link_profile.h"
 #include "platform_v2/base/listeners.h"
+#include "platform_v2/public/condition_variable.h"
+#include "platform_v2/public/mutex.h"
 #include "platform_v2/public/single_thread_executor.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 
 namespace location {
@@ -36,12 +48,29 @@ struct EnvironmentConfig {
   // This is currently set to false, due to http://b/139734036 that would lead
   // to flaky tests.
   bool webrtc_enabled = false;
+
+  // Links emulated by the sockets of the simulated mediums, in each
+  // direction. Ideal (infinitely fast, lossless) by default.
+  LinkProfile bluetooth_link;
+  LinkProfile ble_link;
+  LinkProfile wifi_lan_link;
+  // Seeds the random decisions of the links, so that runs with the same
+  // seed and traffic see the same jitter, losses and stalls.
+  std::uint64_t link_seed = 0;
 };
 
 // MediumEnvironment is a simulated environment which allows multiple instances
 // of simulated HW devices to "work" together as if they are physical.
 // For each medium type it provides necessary methods to implement
 // advertising, discovery and establishment of a data link.
+//
+// Registrations and updates take effect right away, under a lock.
+// Notifications (discovery, accepted connections, signaling messages) are
+// delivered asynchronously, on one of several dispatch threads picked by the
+// receiving medium: notifications to one medium are delivered in order, while
+// different mediums are notified in parallel. Advertisers and discoverers are
+// indexed by service id, so that an update only reaches the mediums that care
+// about it.
 // NOTE: this code depends on public:types target.
 class MediumEnvironment {
  public:
@@ -58,6 +87,9 @@ class MediumEnvironment {
   using WifiLanAcceptedConnectionCallback =
       api::WifiLanMedium::AcceptedConnectionCallback;
 
+  // Mediums whose simulated sockets emulate links.
+  enum class LinkMedium { kBluetooth, kBle, kWifiLan };
+
   MediumEnvironment(const MediumEnvironment&) = delete;
   MediumEnvironment& operator=(const MediumEnvironment&) = delete;
 
@@ -77,11 +109,12 @@ class MediumEnvironment {
   // Clears state. No notifications are sent.
   void Reset();
 
-  // Waits for all previously scheduled jobs to finish.
+  // Waits for all previously scheduled notifications to be delivered.
   // This method works as a barrier that guarantees that after it returns, all
   // the activities that started before it was called, or while it was running
   // are ended. This means that system is at the state of relaxation when this
   // code returns. It requires external stimulus to get out of relaxation state.
+  // Must not be called from a notification callback.
   //
   // If enable_notifications is true (default), simulation environment
   // will send all future notification events to all registered objects,
@@ -126,6 +159,12 @@ class MediumEnvironment {
 
   const EnvironmentConfig& GetEnvironmentConfig();
 
+  // Makes pipe, which carries the data written to one side of a simulated
+  // socket of medium, emulate the link configured for medium. Every pipe gets
+  // a seed of its own, derived from the configured seed and from the order
+  // pipes are set up in since the last Reset().
+  void ConfigureLink(LinkMedium medium, BasePipe& pipe);
+
   // Registers |callback| to receive messages sent to device with id |self_id|.
   void RegisterWebRtcSignalingMessenger(absl::string_view self_id,
                                         OnSignalingMessageCallback callback);
@@ -243,6 +282,9 @@ class MediumEnvironment {
     api::BlePeripheral* ble_peripheral = nullptr;
     bool advertising = false;
     bool fast_advertisement = false;
+    std::string advertising_service_id;
+    bool scanning = false;
+    std::string scanning_service_id;
   };
 
   struct WifiLanServiceIdContext {
@@ -256,52 +298,87 @@ class MediumEnvironment {
     absl::flat_hash_map<std::string, WifiLanServiceIdContext> services;
   };
 
+  // Mediums of one kind, by the service id they advertise or discover.
+  template <typename Medium>
+  using ServiceIndex =
+      absl::flat_hash_map<std::string, absl::flat_hash_set<Medium*>>;
+
   // This is a singleton object, for which destructor will never be called.
   // Constructor will be invoked once from Instance() static method.
   // Object is create in-place (with a placement new) to guarantee that
   // destructor is not scheduled for execution at exit.
-  MediumEnvironment() = default;
+  MediumEnvironment();
   ~MediumEnvironment() = default;
 
-  void OnBluetoothDeviceStateChanged(BluetoothMediumContext& info,
+  void OnBluetoothDeviceStateChanged(api::BluetoothClassicMedium& medium,
+                                     BluetoothMediumContext& info,
                                      api::BluetoothDevice& device,
                                      const std::string& name,
                                      api::BluetoothAdapter::ScanMode mode,
-                                     bool enabled);
+                                     bool enabled)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  void OnBlePeripheralStateChanged(BleMediumContext& info,
+  void OnBlePeripheralStateChanged(api::BleMedium& medium,
                                    api::BlePeripheral& peripheral,
                                    const std::string& service_id,
                                    bool fast_advertisement, bool enabled);
 
-  void OnWifiLanServiceStateChanged(WifiLanMediumContext& info,
+  void OnWifiLanServiceStateChanged(api::WifiLanMedium& medium,
                                     api::WifiLanService& service,
                                     const std::string& service_id,
                                     bool enabled);
 
-  void RunOnMediumEnvironmentThread(std::function<void()> runnable);
+  // Schedules notify to be called on the dispatch thread of medium, with the
+  // callbacks medium has at that time. Nothing is called if medium is no
+  // longer registered by then.
+  void NotifyBluetoothMedium(
+      api::BluetoothClassicMedium& medium,
+      std::function<void(BluetoothDiscoveryCallback&)> notify);
+  void NotifyBleMedium(api::BleMedium& medium,
+                       std::function<void(BleMediumContext&)> notify);
+  void NotifyWifiLanMedium(api::WifiLanMedium& medium,
+                           const std::string& service_id,
+                           std::function<void(WifiLanServiceIdContext&)> notify);
+
+  // Runs runnable on a dispatch thread. key is a hash of whatever receives
+  // the notification; runnables with the same key run in order.
+  void RunOnMediumEnvironmentThread(std::size_t key,
+                                    std::function<void()> runnable);
 
   std::atomic_bool enabled_ = true;
-  std::atomic_int job_count_ = 0;
+  // Number of pipes set up by ConfigureLink() since the last Reset().
+  std::atomic<std::uint64_t> link_count_ = 0;
   std::atomic_bool enable_notifications_ = false;
-  SingleThreadExecutor executor_;
   EnvironmentConfig config_;
 
-  // The following data members are accessed in the context of a private
-  // executor_ thread.
+  // Dispatch threads; a key always maps to the same one.
+  std::vector<std::unique_ptr<SingleThreadExecutor>> shards_;
+  // Notifications scheduled and not yet delivered; Sync() waits for it to
+  // drop to 0.
+  Mutex pending_mutex_;
+  ConditionVariable idle_{&pending_mutex_};
+  std::int64_t pending_jobs_ ABSL_GUARDED_BY(pending_mutex_) = 0;
+
+  // Guards the registry below. Never held while calling into a callback.
+  Mutex mutex_;
   absl::flat_hash_map<api::BluetoothAdapter*, api::BluetoothDevice*>
-      bluetooth_adapters_;
+      bluetooth_adapters_ ABSL_GUARDED_BY(mutex_);
   absl::flat_hash_map<api::BluetoothClassicMedium*, BluetoothMediumContext>
-      bluetooth_mediums_;
+      bluetooth_mediums_ ABSL_GUARDED_BY(mutex_);
 
-  absl::flat_hash_map<api::BleMedium*, BleMediumContext> ble_mediums_;
+  absl::flat_hash_map<api::BleMedium*, BleMediumContext> ble_mediums_
+      ABSL_GUARDED_BY(mutex_);
+  ServiceIndex<api::BleMedium> ble_advertisers_ ABSL_GUARDED_BY(mutex_);
+  ServiceIndex<api::BleMedium> ble_scanners_ ABSL_GUARDED_BY(mutex_);
 
   // Maps peer id to callback for receiving signaling messages.
   absl::flat_hash_map<std::string, OnSignalingMessageCallback>
-      webrtc_signaling_callback_;
+      webrtc_signaling_callback_ ABSL_GUARDED_BY(mutex_);
 
   absl::flat_hash_map<api::WifiLanMedium*, WifiLanMediumContext>
-      wifi_lan_mediums_;
+      wifi_lan_mediums_ ABSL_GUARDED_BY(mutex_);
+  // Mediums that have a WifiLanServiceIdContext for the service id.
+  ServiceIndex<api::WifiLanMedium> wifi_lan_services_ ABSL_GUARDED_BY(mutex_);
 
   bool use_valid_peer_connection_ = true;
 };
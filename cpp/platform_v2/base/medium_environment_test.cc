@@ -0,0 +1,222 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/base/medium_environment.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "platform_v2/api/wifi_lan.h"
+#include "platform_v2/public/mutex.h"
+#include "platform_v2/public/mutex_lock.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/memory/memory.h"
+
+namespace location {
+namespace nearby {
+namespace {
+
+constexpr char kServiceId[] = "service";
+constexpr char kOtherServiceId[] = "other-service";
+
+class FakeWifiLanService : public api::WifiLanService {
+ public:
+  explicit FakeWifiLanService(int port) : port_(port) {}
+
+  std::string GetName() const override { return "fake"; }
+  std::pair<std::string, int> GetServiceAddress() const override {
+    return {"127.0.0.1", port_};
+  }
+
+ private:
+  int port_;
+};
+
+// Registers with the environment, and records what it gets notified of.
+class FakeWifiLanMedium : public api::WifiLanMedium {
+ public:
+  explicit FakeWifiLanMedium(int port) : service_(port) {
+    MediumEnvironment::Instance().RegisterWifiLanMedium(*this);
+  }
+  ~FakeWifiLanMedium() override {
+    MediumEnvironment::Instance().UnregisterWifiLanMedium(*this);
+  }
+
+  bool StartAdvertising(const std::string& service_id,
+                        const std::string& service_info_name) override {
+    MediumEnvironment::Instance().UpdateWifiLanMediumForAdvertising(
+        *this, service_, service_id, true);
+    return true;
+  }
+  bool StopAdvertising(const std::string& service_id) override {
+    MediumEnvironment::Instance().UpdateWifiLanMediumForAdvertising(
+        *this, service_, service_id, false);
+    return true;
+  }
+  bool StartDiscovery(const std::string& service_id,
+                      DiscoveredServiceCallback callback) override {
+    MediumEnvironment::Instance().UpdateWifiLanMediumForDiscovery(
+        *this, service_id, std::move(callback), true);
+    return true;
+  }
+  bool StopDiscovery(const std::string& service_id) override {
+    MediumEnvironment::Instance().UpdateWifiLanMediumForDiscovery(
+        *this, service_id, {}, false);
+    return true;
+  }
+  bool StartAcceptingConnections(const std::string& service_id,
+                                 AcceptedConnectionCallback callback) override {
+    return false;
+  }
+  bool StopAcceptingConnections(const std::string& service_id) override {
+    return false;
+  }
+  std::unique_ptr<api::WifiLanSocket> Connect(
+      api::WifiLanService& service, const std::string& service_id,
+      CancellationFlag* cancellation_flag) override {
+    return nullptr;
+  }
+  api::WifiLanService* FindRemoteService(const std::string& ip_address,
+                                         int port) override {
+    return MediumEnvironment::Instance().FindWifiLanService(ip_address, port);
+  }
+
+  // Starts discovery of service_id, recording the ports of what is found.
+  void Discover(const std::string& service_id) {
+    StartDiscovery(service_id,
+                   {
+                       .service_discovered_cb =
+                           [this](api::WifiLanService& service,
+                                  const std::string&) {
+                             MutexLock lock(&mutex_);
+                             found_.push_back(service.GetServiceAddress().second);
+                             history_ += 'f';
+                           },
+                       .service_lost_cb =
+                           [this](api::WifiLanService& service,
+                                  const std::string&) {
+                             MutexLock lock(&mutex_);
+                             history_ += 'l';
+                           },
+                   });
+  }
+
+  std::vector<int> Found() {
+    MutexLock lock(&mutex_);
+    return found_;
+  }
+
+  // Notifications in the order they came in; 'f' for found, 'l' for lost.
+  std::string History() {
+    MutexLock lock(&mutex_);
+    return history_;
+  }
+
+  FakeWifiLanService& service() { return service_; }
+
+ private:
+  FakeWifiLanService service_;
+  Mutex mutex_;
+  std::vector<int> found_;
+  std::string history_;
+};
+
+class MediumEnvironmentTest : public ::testing::Test {
+ protected:
+  MediumEnvironmentTest() {
+    env_.Stop();
+    env_.Start();
+  }
+  ~MediumEnvironmentTest() override { env_.Stop(); }
+
+  MediumEnvironment& env_{MediumEnvironment::Instance()};
+};
+
+TEST_F(MediumEnvironmentTest, DiscoveryOnlyReachesSameServiceId) {
+  FakeWifiLanMedium advertiser(1);
+  FakeWifiLanMedium other_advertiser(2);
+  FakeWifiLanMedium discoverer(3);
+  FakeWifiLanMedium other_discoverer(4);
+  advertiser.StartAdvertising(kServiceId, "");
+  other_advertiser.StartAdvertising(kOtherServiceId, "");
+  discoverer.Discover(kServiceId);
+  other_discoverer.Discover(kOtherServiceId);
+  env_.Sync();
+
+  EXPECT_THAT(discoverer.Found(), testing::ElementsAre(1));
+  EXPECT_THAT(other_discoverer.Found(), testing::ElementsAre(2));
+}
+
+TEST_F(MediumEnvironmentTest, DeliversNotificationsToMediumInOrder) {
+  FakeWifiLanMedium advertiser(1);
+  FakeWifiLanMedium discoverer(2);
+  discoverer.Discover(kServiceId);
+  for (int i = 0; i < 100; i++) {
+    advertiser.StartAdvertising(kServiceId, "");
+    advertiser.StopAdvertising(kServiceId);
+  }
+  env_.Sync();
+
+  std::string expected;
+  for (int i = 0; i < 100; i++) expected += "fl";
+  EXPECT_EQ(discoverer.History(), expected);
+}
+
+TEST_F(MediumEnvironmentTest, StoppedDiscoveryGetsNoMoreNotifications) {
+  FakeWifiLanMedium advertiser(1);
+  FakeWifiLanMedium discoverer(2);
+  discoverer.Discover(kServiceId);
+  discoverer.StopDiscovery(kServiceId);
+  advertiser.StartAdvertising(kServiceId, "");
+  env_.Sync();
+
+  EXPECT_TRUE(discoverer.Found().empty());
+}
+
+TEST_F(MediumEnvironmentTest, FindsServiceByAddress) {
+  FakeWifiLanMedium advertiser(1);
+  FakeWifiLanMedium discoverer(2);
+  advertiser.StartAdvertising(kServiceId, "");
+
+  EXPECT_EQ(discoverer.FindRemoteService("127.0.0.1", 1),
+            &advertiser.service());
+  EXPECT_EQ(discoverer.FindRemoteService("127.0.0.1", 3), nullptr);
+}
+
+TEST_F(MediumEnvironmentTest, SyncWaitsForVenueScaleDiscovery) {
+  constexpr int kDevices = 500;
+  constexpr int kServices = 10;
+  std::vector<std::unique_ptr<FakeWifiLanMedium>> mediums;
+  for (int i = 0; i < kDevices; i++) {
+    mediums.push_back(absl::make_unique<FakeWifiLanMedium>(i));
+  }
+  for (int i = 0; i < kDevices; i++) {
+    std::string service_id = std::to_string(i % kServices);
+    mediums[i]->Discover(service_id);
+    mediums[i]->StartAdvertising(service_id, "");
+  }
+  env_.Sync();
+
+  // Every device finds the others with the same service id, once.
+  for (int i = 0; i < kDevices; i++) {
+    EXPECT_EQ(mediums[i]->Found().size(), kDevices / kServices - 1);
+  }
+}
+
+}  // namespace
+}  // namespace nearby
+}  // namespace location
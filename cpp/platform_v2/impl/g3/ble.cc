@@ -36,6 +36,9 @@ void BleSocket::Connect(BleSocket& other) {
   absl::MutexLock lock(&mutex_);
   remote_socket_ = &other;
   input_ = other.output_;
+  // Our output pipe is the link towards the other side.
+  MediumEnvironment::Instance().ConfigureLink(
+      MediumEnvironment::LinkMedium::kBle, *output_);
 }
 
 InputStream& BleSocket::GetInputStream() {
@@ -317,7 +320,8 @@ bool BleMedium::StopAcceptingConnections(const std::string& service_id) {
 }
 
 std::unique_ptr<api::BleSocket> BleMedium::Connect(
-    api::BlePeripheral& remote_peripheral, const std::string& service_id) {
+    api::BlePeripheral& remote_peripheral, const std::string& service_id,
+    CancellationFlag* cancellation_flag) {
   NEARBY_LOG(INFO,
              "G3 Ble Connect [self]: medium=%p, adapter=%p, peripheral=%p, "
              "service_id=%s",
@@ -328,6 +332,7 @@ std::unique_ptr<api::BleSocket> BleMedium::Connect(
   auto* medium = static_cast<BleMedium*>(adapter.GetBleMedium());
 
   if (!medium) return {};  // Can't find medium. Bail out.
+  if (cancellation_flag && cancellation_flag->Cancelled()) return {};
 
   BleServerSocket* remote_server_socket = nullptr;
   NEARBY_LOG(INFO,
@@ -36,6 +36,9 @@ void BluetoothSocket::Connect(BluetoothSocket& other) {
   absl::MutexLock lock(&mutex_);
   remote_socket_ = &other;
   input_ = other.output_;
+  // Our output pipe is the link towards the other side.
+  MediumEnvironment::Instance().ConfigureLink(
+      MediumEnvironment::LinkMedium::kBluetooth, *output_);
 }
 
 bool BluetoothSocket::IsConnected() const {
@@ -199,7 +202,8 @@ bool BluetoothClassicMedium::StopDiscovery() {
 }
 
 std::unique_ptr<api::BluetoothSocket> BluetoothClassicMedium::ConnectToService(
-    api::BluetoothDevice& remote_device, const std::string& service_uuid) {
+    api::BluetoothDevice& remote_device, const std::string& service_uuid,
+    CancellationFlag* cancellation_flag) {
   NEARBY_LOG(INFO,
              "G3 ConnectToService [self]: medium=%p, adapter=%p, device=%p",
              this, &GetAdapter(), &GetAdapter().GetDevice());
@@ -209,6 +213,7 @@ std::unique_ptr<api::BluetoothSocket> BluetoothClassicMedium::ConnectToService(
       static_cast<BluetoothClassicMedium*>(adapter.GetBluetoothClassicMedium());
 
   if (!medium) return {};  // Adapter is not bound to medium. Bail out.
+  if (cancellation_flag && cancellation_flag->Cancelled()) return {};
 
   BluetoothServerSocket* server_socket = nullptr;
   NEARBY_LOG(
@@ -37,6 +37,9 @@ void WifiLanSocket::Connect(WifiLanSocket& other) {
   absl::MutexLock lock(&mutex_);
   remote_socket_ = &other;
   input_ = other.output_;
+  // Our output pipe is the link towards the other side.
+  MediumEnvironment::Instance().ConfigureLink(
+      MediumEnvironment::LinkMedium::kWifiLan, *output_);
 }
 
 InputStream& WifiLanSocket::GetInputStream() {
@@ -320,7 +323,8 @@ bool WifiLanMedium::StopAcceptingConnections(const std::string& service_id) {
 }
 
 std::unique_ptr<api::WifiLanSocket> WifiLanMedium::Connect(
-    api::WifiLanService& remote_service, const std::string& service_id) {
+    api::WifiLanService& remote_service, const std::string& service_id,
+    CancellationFlag* cancellation_flag) {
   NEARBY_LOG(INFO,
              "G3 WifiLan Connect: medium=%p, service=%p, service_info_name=%s, "
              "service_id=%s",
@@ -330,6 +334,7 @@ std::unique_ptr<api::WifiLanSocket> WifiLanMedium::Connect(
   auto* medium = static_cast<WifiLanService&>(remote_service).GetMedium();
 
   if (!medium) return {};  // Can't find medium. Bail out.
+  if (cancellation_flag && cancellation_flag->Cancelled()) return {};
 
   WifiLanServerSocket* remote_server_socket = nullptr;
   NEARBY_LOG(INFO,
@@ -209,8 +209,9 @@ class WifiLanMedium : public api::WifiLanMedium {
   // On success, returns a new WifiLanSocket.
   // On error, returns nullptr.
   std::unique_ptr<api::WifiLanSocket> Connect(
-      api::WifiLanService& remote_service,
-      const std::string& service_id) override ABSL_LOCKS_EXCLUDED(mutex_);
+      api::WifiLanService& remote_service, const std::string& service_id,
+      CancellationFlag* cancellation_flag) override
+      ABSL_LOCKS_EXCLUDED(mutex_);
 
   api::WifiLanService* FindRemoteService(const std::string& ip_address,
                                          int port) override;
@@ -0,0 +1,79 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_BLUETOOTH_ADAPTER_H_
+#define PLATFORM_V2_IMPL_LINUX_BLUETOOTH_ADAPTER_H_
+
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "platform_v2/api/bluetooth_adapter.h"
+#include "absl/strings/string_view.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// A BluetoothAdapter with no radio behind it. It keeps the state it is given,
+// so that code managing the adapter works, but no Bluetooth mediums are
+// created on top of it.
+class BluetoothAdapter : public api::BluetoothAdapter {
+ public:
+  using Status = api::BluetoothAdapter::Status;
+  using ScanMode = api::BluetoothAdapter::ScanMode;
+
+  BluetoothAdapter() = default;
+  ~BluetoothAdapter() override = default;
+
+  bool SetStatus(Status status) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_ = status == Status::kEnabled;
+    return true;
+  }
+  bool IsEnabled() const override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return enabled_;
+  }
+  ScanMode GetScanMode() const override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return mode_;
+  }
+  bool SetScanMode(ScanMode mode) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    mode_ = mode;
+    return true;
+  }
+  std::string GetName() const override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return name_;
+  }
+  bool SetName(absl::string_view name) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    name_ = std::string(name);
+    return true;
+  }
+  std::string GetMacAddress() const override { return {}; }
+
+ private:
+  mutable std::mutex mutex_;
+  bool enabled_ = true;              // Guarded by mutex_.
+  ScanMode mode_ = ScanMode::kNone;  // Guarded by mutex_.
+  std::string name_ = "linux";       // Guarded by mutex_.
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_BLUETOOTH_ADAPTER_H_
@@ -0,0 +1,63 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_CONDITION_VARIABLE_H_
+#define PLATFORM_V2_IMPL_LINUX_CONDITION_VARIABLE_H_
+
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+
+#include "platform_v2/api/condition_variable.h"
+#include "platform_v2/base/exception.h"
+#include "platform_v2/impl/linux/mutex.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// See documentation in
+// cpp/platform_v2/api/condition_variable.h
+class ConditionVariable : public api::ConditionVariable {
+ public:
+  explicit ConditionVariable(linux_impl::Mutex* mutex)
+      : mutex_(&mutex->mutex_) {}
+  ~ConditionVariable() override = default;
+
+  // Callers hold mutex_ already; the unique_lock only borrows it for the
+  // duration of the wait.
+  Exception Wait() override {
+    std::unique_lock<std::mutex> lock(*mutex_, std::adopt_lock);
+    cond_var_.wait(lock);
+    lock.release();
+    return {Exception::kSuccess};
+  }
+  Exception Wait(absl::Duration timeout) override {
+    std::unique_lock<std::mutex> lock(*mutex_, std::adopt_lock);
+    cond_var_.wait_for(lock, absl::ToChronoNanoseconds(timeout));
+    lock.release();
+    return {Exception::kSuccess};
+  }
+  void Notify() override { cond_var_.notify_all(); }
+
+ private:
+  std::mutex* mutex_;
+  std::condition_variable cond_var_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_CONDITION_VARIABLE_H_
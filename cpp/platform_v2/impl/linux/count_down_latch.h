@@ -0,0 +1,68 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_COUNT_DOWN_LATCH_H_
+#define PLATFORM_V2_IMPL_LINUX_COUNT_DOWN_LATCH_H_
+
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+
+#include "platform_v2/api/count_down_latch.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// A synchronization aid that allows one or more threads to wait until a set of
+// operations being performed in other threads completes.
+//
+// https://docs.oracle.com/javase/8/docs/api/java/util/concurrent/CountDownLatch.html
+class CountDownLatch final : public api::CountDownLatch {
+ public:
+  explicit CountDownLatch(int count) : count_(count) {}
+  CountDownLatch(const CountDownLatch&) = delete;
+  CountDownLatch& operator=(const CountDownLatch&) = delete;
+  CountDownLatch(CountDownLatch&&) = delete;
+  CountDownLatch& operator=(CountDownLatch&&) = delete;
+
+  ExceptionOr<bool> Await(absl::Duration timeout) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool released = cond_.wait_for(lock, absl::ToChronoNanoseconds(timeout),
+                                   [this]() { return count_ <= 0; });
+    return ExceptionOr<bool>(released);
+  }
+  Exception Await() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]() { return count_ <= 0; });
+    return {Exception::kSuccess};
+  }
+  void CountDown() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ > 0 && --count_ == 0) {
+      cond_.notify_all();
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  int count_;  // When zero, latch releases all waiters. Guarded by mutex_.
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_COUNT_DOWN_LATCH_H_
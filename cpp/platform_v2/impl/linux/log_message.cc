@@ -0,0 +1,103 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/log_message.h"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+namespace {
+
+std::atomic<api::LogMessage::Severity> g_min_log_severity{
+    api::LogMessage::Severity::kInfo};
+
+}  // namespace
+
+LogMessage::LogMessage(const char* file, int line, Severity severity)
+    : file_(file), line_(line), severity_(severity), time_(absl::Now()) {}
+
+LogMessage::~LogMessage() {
+  absl::string_view text =
+      overflow_.empty() ? absl::string_view(buffer_, size_) : overflow_;
+  std::string streamed;
+  if (stream_) {
+    streamed = absl::StrCat(text, stream_->str());
+    text = streamed;
+  }
+  LogSink::Instance().Submit(severity_, file_, line_, time_, text);
+  if (severity_ == Severity::kFatal) {
+    std::fflush(stderr);
+    std::abort();
+  }
+}
+
+void LogMessage::Print(const char* format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  va_list ap_copy;
+  va_copy(ap_copy, ap);
+  if (overflow_.empty()) {
+    int room = sizeof(buffer_) - size_;
+    int size = std::vsnprintf(buffer_ + size_, room, format, ap);
+    if (size >= room) {
+      // Does not fit; move everything to overflow_.
+      overflow_.assign(buffer_, size_);
+      overflow_.resize(size_ + size);
+      std::vsnprintf(&overflow_[size_], size + 1, format, ap_copy);
+    } else if (size > 0) {
+      size_ += size;
+    }
+  } else {
+    int size = std::vsnprintf(nullptr, 0, format, ap);
+    if (size > 0) {
+      std::size_t offset = overflow_.size();
+      overflow_.resize(offset + size);
+      std::vsnprintf(&overflow_[offset], size + 1, format, ap_copy);
+    }
+  }
+  va_end(ap_copy);
+  va_end(ap);
+}
+
+std::ostream& LogMessage::Stream() {
+  if (!stream_) stream_.emplace();
+  return *stream_;
+}
+
+}  // namespace linux_impl
+
+namespace api {
+
+void LogMessage::SetMinLogSeverity(Severity severity) {
+  linux_impl::g_min_log_severity = severity;
+}
+
+bool LogMessage::ShouldCreateLogMessage(Severity severity) {
+  return severity >= linux_impl::g_min_log_severity;
+}
+
+}  // namespace api
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,60 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_LOG_MESSAGE_H_
+#define PLATFORM_V2_IMPL_LINUX_LOG_MESSAGE_H_
+
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include "platform_v2/api/log_message.h"
+#include "platform_v2/impl/linux/log_sink.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// See documentation in cpp/platform_v2/api/log_message.h
+//
+// Collects the text of a message, and hands it to LogSink::Instance() when
+// destroyed. Formatting the rest of the line is left to the sink.
+class LogMessage : public api::LogMessage {
+ public:
+  LogMessage(const char* file, int line, Severity severity);
+  ~LogMessage() override;
+
+  void Print(const char* format, ...) override;
+
+  std::ostream& Stream() override;
+
+ private:
+  const char* file_;
+  int line_;
+  Severity severity_;
+  absl::Time time_;
+  // Text from Print(); it spills over to overflow_ if longer than buffer_.
+  char buffer_[LogSink::kMaxText];
+  int size_ = 0;
+  std::string overflow_;
+  // Only set up on the first call to Stream().
+  std::optional<std::ostringstream> stream_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_LOG_MESSAGE_H_
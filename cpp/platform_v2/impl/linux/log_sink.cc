@@ -0,0 +1,265 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/log_sink.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "platform_v2/impl/linux/thread_pool.h"
+#include "absl/strings/str_cat.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+namespace {
+
+// How long a message may wait in a ring that is not filling up.
+constexpr std::chrono::milliseconds kWriteInterval{20};
+
+std::atomic<std::uint64_t> g_next_sink_id{0};
+
+// Set when the thread-local state of the calling thread is destroyed; what
+// it logs after that is written right away.
+thread_local bool t_exiting = false;
+
+int GetCachedTid() {
+  thread_local int tid = GetCurrentTid();
+  return tid;
+}
+
+char GetSeverityChar(api::LogMessage::Severity severity) {
+  switch (severity) {
+    case api::LogMessage::Severity::kInfo:
+      return 'I';
+    case api::LogMessage::Severity::kWarning:
+      return 'W';
+    case api::LogMessage::Severity::kError:
+      return 'E';
+    case api::LogMessage::Severity::kFatal:
+      return 'F';
+  }
+  return 'U';
+}
+
+absl::string_view GetBaseName(absl::string_view path) {
+  auto pos = path.find_last_of('/');
+  return pos == absl::string_view::npos ? path : path.substr(pos + 1);
+}
+
+}  // namespace
+
+// Single-producer, single-consumer queue of records: the thread that owns
+// it adds records, the writer removes them.
+class LogSink::Ring {
+ public:
+  static constexpr std::uint32_t kSize = 64;
+
+  // Producer side. Returns the slot to fill, or nullptr if the ring is full.
+  Record* BeginWrite() {
+    std::uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == kSize) return nullptr;
+    return &slots_[head % kSize];
+  }
+  // Publishes the slot returned by BeginWrite(). Returns the number of
+  // records in the ring.
+  std::uint32_t EndWrite() {
+    std::uint32_t head = head_.load(std::memory_order_relaxed) + 1;
+    head_.store(head, std::memory_order_release);
+    return head - tail_.load(std::memory_order_relaxed);
+  }
+
+  // Consumer side.
+  std::uint32_t Size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_relaxed);
+  }
+  const Record& At(std::uint32_t index) const {
+    return slots_[(tail_.load(std::memory_order_relaxed) + index) % kSize];
+  }
+  void Pop(std::uint32_t count) {
+    tail_.store(tail_.load(std::memory_order_relaxed) + count,
+                std::memory_order_release);
+  }
+
+  // Marks the ring as no longer written to; the writer drops it once empty.
+  void Close() { closed_ = true; }
+  bool IsClosed() const { return closed_; }
+
+ private:
+  std::atomic<std::uint32_t> head_{0};
+  std::atomic<std::uint32_t> tail_{0};
+  std::atomic_bool closed_{false};
+  Record slots_[kSize];
+};
+
+// Rings of the calling thread, one per sink it logged to.
+struct LogSink::ThreadRings {
+  ~ThreadRings() {
+    t_exiting = true;
+    for (auto& entry : rings) entry.second->Close();
+  }
+
+  std::vector<std::pair<std::uint64_t, std::shared_ptr<Ring>>> rings;
+};
+
+LogSink& LogSink::Instance() {
+  static LogSink* sink = []() {
+    auto* sink = new LogSink([](absl::string_view text) {
+      std::fwrite(text.data(), 1, text.size(), stderr);
+    });
+    std::atexit([]() { Instance().Flush(); });
+    return sink;
+  }();
+  return *sink;
+}
+
+LogSink::LogSink(Output output)
+    : id_(g_next_sink_id++),
+      output_(std::move(output)),
+      time_zone_(absl::LocalTimeZone()),
+      writer_(&LogSink::RunWriter, this) {}
+
+LogSink::~LogSink() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  Flush();
+}
+
+void LogSink::Submit(api::LogMessage::Severity severity, const char* file,
+                     int line, absl::Time time, absl::string_view text) {
+  Ring* ring = nullptr;
+  Record* record = nullptr;
+  if (severity != api::LogMessage::Severity::kFatal && text.size() <= kMaxText &&
+      !t_exiting) {
+    ring = &GetRing();
+    record = ring->BeginWrite();
+  }
+
+  if (record == nullptr) {
+    Record header{absl::ToUnixNanos(time), GetCachedTid(), severity, file,
+                  line, 0, {}};
+    std::string out;
+    AppendLine(header, text, &out);
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    Drain();
+    output_(out);
+    return;
+  }
+
+  record->time_nanos = absl::ToUnixNanos(time);
+  record->tid = GetCachedTid();
+  record->severity = severity;
+  record->file = file;
+  record->line = line;
+  record->size = text.size();
+  std::memcpy(record->text, text.data(), text.size());
+  if (ring->EndWrite() >= Ring::kSize / 2 &&
+      !wake_requested_.exchange(true)) {
+    wake_.notify_one();
+  }
+}
+
+void LogSink::Flush() {
+  std::lock_guard<std::mutex> lock(drain_mutex_);
+  Drain();
+}
+
+LogSink::Ring& LogSink::GetRing() {
+  static thread_local ThreadRings thread_rings;
+  for (auto& entry : thread_rings.rings) {
+    if (entry.first == id_) return *entry.second;
+  }
+  auto ring = std::make_shared<Ring>();
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.push_back(ring);
+  }
+  thread_rings.rings.emplace_back(id_, ring);
+  return *ring;
+}
+
+void LogSink::RunWriter() {
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  while (!stop_) {
+    wake_.wait_for(lock, kWriteInterval,
+                   [this]() { return stop_ || wake_requested_; });
+    wake_requested_ = false;
+    lock.unlock();
+    Flush();
+    lock.lock();
+  }
+}
+
+void LogSink::Drain() {
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings = rings_;
+  }
+
+  // Take what is in the rings now, and write it out in time order.
+  std::vector<std::uint32_t> counts;
+  std::vector<const Record*> records;
+  counts.reserve(rings.size());
+  for (const auto& ring : rings) {
+    std::uint32_t count = ring->Size();
+    counts.push_back(count);
+    for (std::uint32_t i = 0; i < count; i++) records.push_back(&ring->At(i));
+  }
+  if (!records.empty()) {
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record* a, const Record* b) {
+                       return a->time_nanos < b->time_nanos;
+                     });
+    std::string out;
+    for (const Record* record : records) {
+      AppendLine(*record, absl::string_view(record->text, record->size), &out);
+    }
+    output_(out);
+    for (size_t i = 0; i < rings.size(); i++) rings[i]->Pop(counts[i]);
+  }
+
+  // Forget the rings of threads that are gone.
+  std::lock_guard<std::mutex> lock(rings_mutex_);
+  rings_.erase(std::remove_if(rings_.begin(), rings_.end(),
+                              [](const std::shared_ptr<Ring>& ring) {
+                                return ring->IsClosed() && ring->Size() == 0;
+                              }),
+               rings_.end());
+}
+
+void LogSink::AppendLine(const Record& record, absl::string_view text,
+                         std::string* out) {
+  // Like glog: "I1231 23:59:59.999999  1234 file.cc:42] message".
+  out->push_back(GetSeverityChar(record.severity));
+  out->append(absl::FormatTime("%m%d %H:%M:%E6S",
+                               absl::FromUnixNanos(record.time_nanos),
+                               time_zone_));
+  absl::StrAppend(out, " ", record.tid, " ", GetBaseName(record.file), ":",
+                  record.line, "] ", text, "\n");
+}
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,112 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_LOG_SINK_H_
+#define PLATFORM_V2_IMPL_LINUX_LOG_SINK_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "platform_v2/api/log_message.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// Writes log lines to an output from a background thread.
+//
+// Every thread that logs gets a lock-free ring of its own, that only it
+// writes to and only the writer thread reads from. Submit() copies the
+// message text into the ring; turning the timestamp into text, building the
+// line and writing it out are left to the writer thread, which wakes up
+// every few milliseconds, or sooner if a ring fills up.
+//
+// Messages too long for a ring slot, messages that find their ring full,
+// and FATAL messages are written right away, after everything submitted
+// before them.
+class LogSink {
+ public:
+  using Output = std::function<void(absl::string_view)>;
+
+  // Longest message text carried by a ring slot.
+  static constexpr int kMaxText = 480;
+
+  // Returns the sink of the process, writing to stderr. Flushed at exit.
+  static LogSink& Instance();
+
+  explicit LogSink(Output output);
+  // Writes out everything submitted so far.
+  ~LogSink();
+  LogSink(const LogSink&) = delete;
+  LogSink& operator=(const LogSink&) = delete;
+
+  // Queues a message logged at time by the calling thread. text is copied.
+  void Submit(api::LogMessage::Severity severity, const char* file, int line,
+              absl::Time time, absl::string_view text);
+
+  // Writes out everything submitted so far.
+  void Flush();
+
+ private:
+  struct Record {
+    std::int64_t time_nanos;
+    int tid;
+    api::LogMessage::Severity severity;
+    const char* file;
+    int line;
+    int size;
+    char text[kMaxText];
+  };
+  class Ring;
+  struct ThreadRings;
+
+  Ring& GetRing();
+  void RunWriter();
+  // Writes out all the records in the rings. Requires drain_mutex_.
+  void Drain();
+  // Appends the line for record, with text as the message, to out.
+  void AppendLine(const Record& record, absl::string_view text,
+                  std::string* out);
+
+  const std::uint64_t id_;
+  const Output output_;
+  const absl::TimeZone time_zone_;
+
+  std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<Ring>> rings_;  // Guarded by rings_mutex_.
+
+  // Serializes Drain(), and with it, writes to output_.
+  std::mutex drain_mutex_;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool stop_ = false;  // Guarded by wake_mutex_.
+  std::atomic_bool wake_requested_{false};
+  std::thread writer_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_LOG_SINK_H_
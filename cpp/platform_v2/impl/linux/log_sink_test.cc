@@ -0,0 +1,151 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/log_sink.h"
+
+#include <mutex>   // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/clock.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+namespace {
+
+using Severity = api::LogMessage::Severity;
+
+// Collects what a sink writes, as lines.
+class Output {
+ public:
+  LogSink::Output Get() {
+    return [this](absl::string_view text) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      text_.append(text.data(), text.size());
+    };
+  }
+
+  std::vector<std::string> Lines() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return absl::StrSplit(text_, '\n', absl::SkipEmpty());
+  }
+
+ private:
+  std::mutex mutex_;
+  std::string text_;
+};
+
+// Returns what follows "] " in line.
+std::string Message(const std::string& line) {
+  return line.substr(line.find("] ") + 2);
+}
+
+TEST(LogSinkTest, WritesLinesOnFlush) {
+  Output output;
+  LogSink sink(output.Get());
+
+  sink.Submit(Severity::kWarning, "path/to/file.cc", 42, absl::Now(),
+              "hello");
+  sink.Flush();
+
+  auto lines = output.Lines();
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(lines[0][0], 'W');
+  EXPECT_THAT(lines[0], testing::HasSubstr(" file.cc:42] hello"));
+}
+
+TEST(LogSinkTest, WritesInBackground) {
+  Output output;
+  LogSink sink(output.Get());
+
+  sink.Submit(Severity::kInfo, "file.cc", 1, absl::Now(), "hello");
+  absl::Time deadline = absl::Now() + absl::Seconds(10);
+  while (output.Lines().empty() && absl::Now() < deadline) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+
+  EXPECT_EQ(output.Lines().size(), 1);
+}
+
+TEST(LogSinkTest, DestructorWritesEverything) {
+  Output output;
+  {
+    LogSink sink(output.Get());
+    for (int i = 0; i < 10; i++) {
+      sink.Submit(Severity::kInfo, "file.cc", 1, absl::Now(), "hello");
+    }
+  }
+
+  EXPECT_EQ(output.Lines().size(), 10);
+}
+
+TEST(LogSinkTest, KeepsLongMessages) {
+  Output output;
+  LogSink sink(output.Get());
+  std::string message(LogSink::kMaxText * 3, 'x');
+
+  sink.Submit(Severity::kInfo, "file.cc", 1, absl::Now(), "first");
+  sink.Submit(Severity::kInfo, "file.cc", 2, absl::Now(), message);
+  sink.Flush();
+
+  auto lines = output.Lines();
+  ASSERT_EQ(lines.size(), 2);
+  EXPECT_EQ(Message(lines[0]), "first");
+  EXPECT_EQ(Message(lines[1]), message);
+}
+
+TEST(LogSinkTest, KeepsOrderOfEachThreadUnderLoad) {
+  constexpr int kThreads = 8;
+  constexpr int kMessages = 2000;
+  Output output;
+  {
+    LogSink sink(output.Get());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+      threads.emplace_back([&sink, t]() {
+        for (int i = 0; i < kMessages; i++) {
+          sink.Submit(Severity::kInfo, "file.cc", 1, absl::Now(),
+                      absl::StrCat(t, " ", i));
+        }
+      });
+    }
+    for (auto& thread : threads) thread.join();
+  }
+
+  // Nothing is lost, even with the rings overflowing, and every thread's
+  // messages come out in the order it logged them.
+  auto lines = output.Lines();
+  EXPECT_EQ(lines.size(), kThreads * kMessages);
+  std::vector<int> next(kThreads, 0);
+  for (const auto& line : lines) {
+    std::vector<std::string> parts = absl::StrSplit(Message(line), ' ');
+    ASSERT_EQ(parts.size(), 2);
+    int thread, index;
+    ASSERT_TRUE(absl::SimpleAtoi(parts[0], &thread));
+    ASSERT_TRUE(absl::SimpleAtoi(parts[1], &index));
+    EXPECT_EQ(index, next[thread]++);
+  }
+}
+
+}  // namespace
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,65 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_MUTEX_H_
+#define PLATFORM_V2_IMPL_LINUX_MUTEX_H_
+
+#include <mutex>  // NOLINT
+
+#include "platform_v2/api/mutex.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// std::mutex does not detect double locks, so kRegular and kRegularNoCheck
+// produce the same mutex.
+class ABSL_LOCKABLE Mutex : public api::Mutex {
+ public:
+  Mutex() = default;
+  ~Mutex() override = default;
+  Mutex(Mutex&&) = delete;
+  Mutex& operator=(Mutex&&) = delete;
+  Mutex(const Mutex&) = delete;
+  Mutex& operator=(const Mutex&) = delete;
+
+  void Lock() ABSL_EXCLUSIVE_LOCK_FUNCTION() override { mutex_.lock(); }
+  void Unlock() ABSL_UNLOCK_FUNCTION() override { mutex_.unlock(); }
+
+ private:
+  friend class ConditionVariable;
+  std::mutex mutex_;
+};
+
+class ABSL_LOCKABLE RecursiveMutex : public api::Mutex {
+ public:
+  RecursiveMutex() = default;
+  ~RecursiveMutex() override = default;
+  RecursiveMutex(RecursiveMutex&&) = delete;
+  RecursiveMutex& operator=(RecursiveMutex&&) = delete;
+  RecursiveMutex(const RecursiveMutex&) = delete;
+  RecursiveMutex& operator=(const RecursiveMutex&) = delete;
+
+  void Lock() ABSL_EXCLUSIVE_LOCK_FUNCTION() override { mutex_.lock(); }
+  void Unlock() ABSL_UNLOCK_FUNCTION() override { mutex_.unlock(); }
+
+ private:
+  std::recursive_mutex mutex_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_MUTEX_H_
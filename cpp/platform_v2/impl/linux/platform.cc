@@ -0,0 +1,166 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/api/platform.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "platform_v2/api/atomic_boolean.h"
+#include "platform_v2/api/atomic_reference.h"
+#include "platform_v2/api/ble_v2.h"
+#include "platform_v2/api/bluetooth_adapter.h"
+#include "platform_v2/api/bluetooth_classic.h"
+#include "platform_v2/api/condition_variable.h"
+#include "platform_v2/api/count_down_latch.h"
+#include "platform_v2/api/log_message.h"
+#include "platform_v2/api/mutex.h"
+#include "platform_v2/api/scheduled_executor.h"
+#include "platform_v2/api/server_sync.h"
+#include "platform_v2/api/submittable_executor.h"
+#include "platform_v2/api/webrtc.h"
+#include "platform_v2/api/wifi.h"
+#include "platform_v2/impl/linux/atomic_boolean.h"
+#include "platform_v2/impl/linux/atomic_reference.h"
+#include "platform_v2/impl/linux/bluetooth_adapter.h"
+#include "platform_v2/impl/linux/condition_variable.h"
+#include "platform_v2/impl/linux/count_down_latch.h"
+#include "platform_v2/impl/linux/log_message.h"
+#include "platform_v2/impl/linux/multi_thread_executor.h"
+#include "platform_v2/impl/linux/mutex.h"
+#include "platform_v2/impl/linux/scheduled_executor.h"
+#include "platform_v2/impl/linux/single_thread_executor.h"
+#include "platform_v2/impl/linux/thread_pool.h"
+#include "platform_v2/impl/linux/wifi_lan.h"
+#include "platform_v2/impl/shared/file.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace location {
+namespace nearby {
+namespace api {
+
+namespace {
+std::string GetPayloadPath(PayloadId payload_id) {
+  const char* tmp_dir = std::getenv("TMPDIR");
+  return absl::StrCat(tmp_dir != nullptr && *tmp_dir ? tmp_dir : "/tmp", "/",
+                      payload_id);
+}
+}  // namespace
+
+int GetCurrentTid() { return linux_impl::GetCurrentTid(); }
+
+std::unique_ptr<SubmittableExecutor>
+ImplementationPlatform::CreateSingleThreadExecutor() {
+  return absl::make_unique<linux_impl::SingleThreadExecutor>();
+}
+
+std::unique_ptr<SubmittableExecutor>
+ImplementationPlatform::CreateMultiThreadExecutor(int max_concurrency) {
+  return absl::make_unique<linux_impl::MultiThreadExecutor>(max_concurrency);
+}
+
+std::unique_ptr<ScheduledExecutor>
+ImplementationPlatform::CreateScheduledExecutor() {
+  return absl::make_unique<linux_impl::ScheduledExecutor>();
+}
+
+std::unique_ptr<AtomicUint32>
+ImplementationPlatform::CreateAtomicUint32(std::uint32_t value) {
+  return absl::make_unique<linux_impl::AtomicUint32>(value);
+}
+
+std::unique_ptr<BluetoothAdapter>
+ImplementationPlatform::CreateBluetoothAdapter() {
+  return absl::make_unique<linux_impl::BluetoothAdapter>();
+}
+
+std::unique_ptr<CountDownLatch> ImplementationPlatform::CreateCountDownLatch(
+    std::int32_t count) {
+  return absl::make_unique<linux_impl::CountDownLatch>(count);
+}
+
+std::unique_ptr<AtomicBoolean> ImplementationPlatform::CreateAtomicBoolean(
+    bool initial_value) {
+  return absl::make_unique<linux_impl::AtomicBoolean>(initial_value);
+}
+
+std::unique_ptr<InputFile> ImplementationPlatform::CreateInputFile(
+    PayloadId payload_id, std::int64_t total_size) {
+  return absl::make_unique<shared::InputFile>(GetPayloadPath(payload_id),
+                                              total_size);
+}
+
+std::unique_ptr<OutputFile> ImplementationPlatform::CreateOutputFile(
+    PayloadId payload_id) {
+  return absl::make_unique<shared::OutputFile>(GetPayloadPath(payload_id));
+}
+
+std::unique_ptr<LogMessage> ImplementationPlatform::CreateLogMessage(
+    const char* file, int line, LogMessage::Severity severity) {
+  return absl::make_unique<linux_impl::LogMessage>(file, line, severity);
+}
+
+// There are no radio mediums on Linux yet; the mediums below report
+// themselves as unavailable.
+std::unique_ptr<BluetoothClassicMedium>
+ImplementationPlatform::CreateBluetoothClassicMedium(
+    api::BluetoothAdapter&) {
+  return nullptr;
+}
+
+std::unique_ptr<BleMedium> ImplementationPlatform::CreateBleMedium(
+    api::BluetoothAdapter&) {
+  return nullptr;
+}
+
+std::unique_ptr<ble_v2::BleMedium> ImplementationPlatform::CreateBleV2Medium(
+    api::BluetoothAdapter&) {
+  return nullptr;
+}
+
+std::unique_ptr<ServerSyncMedium>
+ImplementationPlatform::CreateServerSyncMedium() {
+  return nullptr;
+}
+
+std::unique_ptr<WifiMedium> ImplementationPlatform::CreateWifiMedium() {
+  return nullptr;
+}
+
+std::unique_ptr<WifiLanMedium> ImplementationPlatform::CreateWifiLanMedium() {
+  return absl::make_unique<linux_impl::WifiLanMedium>();
+}
+
+std::unique_ptr<WebRtcMedium> ImplementationPlatform::CreateWebRtcMedium() {
+  return nullptr;
+}
+
+std::unique_ptr<Mutex> ImplementationPlatform::CreateMutex(Mutex::Mode mode) {
+  if (mode == Mutex::Mode::kRecursive)
+    return absl::make_unique<linux_impl::RecursiveMutex>();
+  else
+    return absl::make_unique<linux_impl::Mutex>();
+}
+
+std::unique_ptr<ConditionVariable>
+ImplementationPlatform::CreateConditionVariable(Mutex* mutex) {
+  return std::unique_ptr<ConditionVariable>(new linux_impl::ConditionVariable(
+      static_cast<linux_impl::Mutex*>(mutex)));
+}
+
+}  // namespace api
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,150 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/scheduled_executor.h"
+
+#include <chrono>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "platform_v2/impl/linux/thread_pool.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+namespace {
+
+// Time on the steady clock, so that delayed commands neither fire early nor
+// stall when the wall clock is set.
+absl::Time SteadyNow() {
+  return absl::FromUnixNanos(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+}  // namespace
+
+// Cancels a delayed command by taking it out of the wheel.
+class ScheduledExecutor::Alarm : public api::Cancelable {
+ public:
+  explicit Alarm(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+  bool Cancel() override {
+    Runnable runnable;  // Destroyed outside of the lock.
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->wheel.Cancel(timer_, &runnable);
+  }
+
+  void SetTimer(TimerWheel::Timer timer) { timer_ = timer; }
+
+ private:
+  const std::shared_ptr<State> state_;
+  TimerWheel::Timer timer_;  // Guarded by state_->mutex.
+};
+
+ScheduledExecutor::ScheduledExecutor()
+    : origin_(SteadyNow()),
+      state_(std::make_shared<State>()),
+      thread_(&ScheduledExecutor::Run, this) {}
+
+ScheduledExecutor::~ScheduledExecutor() {
+  Shutdown();
+  thread_.join();
+  std::vector<Runnable> dropped;
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  dropped = state_->wheel.Clear();
+}
+
+void ScheduledExecutor::Execute(Runnable&& runnable) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->shutdown) return;
+    state_->queue.push_back(std::move(runnable));
+  }
+  state_->changed.notify_one();
+}
+
+std::shared_ptr<api::Cancelable> ScheduledExecutor::Schedule(
+    Runnable&& runnable, absl::Duration delay) {
+  auto alarm = std::make_shared<Alarm>(state_);
+  std::int64_t tick = ToTick(SteadyNow() + delay);
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->shutdown) return alarm;
+    alarm->SetTimer(state_->wheel.Add(tick, std::move(runnable)));
+    // Only wake the thread if it would otherwise sleep past the new command.
+    wake = state_->wake_tick > tick;
+  }
+  if (wake) state_->changed.notify_one();
+  return alarm;
+}
+
+void ScheduledExecutor::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->shutdown = true;
+  }
+  state_->changed.notify_all();
+}
+
+std::int64_t ScheduledExecutor::ToTick(absl::Time time) const {
+  absl::Duration remainder;
+  std::int64_t tick = absl::IDivDuration(time - origin_, kTick, &remainder);
+  return remainder > absl::ZeroDuration() ? tick + 1 : tick;
+}
+
+void ScheduledExecutor::Run() {
+  tid_ = GetCurrentTid();
+  State& state = *state_;
+  std::unique_lock<std::mutex> lock(state.mutex);
+  while (true) {
+    Runnable runnable;
+    if (!state.queue.empty()) {
+      runnable = std::move(state.queue.front());
+      state.queue.pop_front();
+    } else if (state.shutdown) {
+      // Delayed commands are dropped once shut down.
+      return;
+    } else {
+      absl::Time now = SteadyNow();
+      // A tick is due once it has started.
+      absl::Duration unused;
+      state.wheel.Advance(absl::IDivDuration(now - origin_, kTick, &unused));
+      if (!state.wheel.PopExpired(&runnable)) {
+        std::int64_t next_tick = state.wheel.NextEventTick();
+        state.wake_tick = next_tick;
+        if (next_tick == TimerWheel::kNever) {
+          state.changed.wait(lock);
+        } else {
+          state.changed.wait_for(
+              lock, absl::ToChronoNanoseconds(ToTime(next_tick) - now));
+        }
+        state.wake_tick = -1;
+        continue;
+      }
+    }
+    lock.unlock();
+    if (runnable) runnable();
+    runnable = nullptr;
+    lock.lock();
+  }
+}
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
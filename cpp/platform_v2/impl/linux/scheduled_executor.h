@@ -0,0 +1,92 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_SCHEDULED_EXECUTOR_H_
+#define PLATFORM_V2_IMPL_LINUX_SCHEDULED_EXECUTOR_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+
+#include "platform_v2/api/cancelable.h"
+#include "platform_v2/api/scheduled_executor.h"
+#include "platform_v2/base/runnable.h"
+#include "platform_v2/impl/linux/timer_wheel.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// An Executor that runs commands on a single thread, either immediately or
+// after a given delay.
+//
+// Delayed commands are kept in a TimerWheel with a resolution of kTick, so
+// scheduling and canceling them is O(1) no matter how many are pending, and
+// canceled commands are dropped right away rather than when they fall due.
+// Commands due in the same tick run in the order they were scheduled.
+class ScheduledExecutor final : public api::ScheduledExecutor {
+ public:
+  static constexpr absl::Duration kTick = absl::Milliseconds(1);
+
+  ScheduledExecutor();
+  // Runs the commands passed to Execute() that are still pending, drops
+  // pending delayed commands, and joins the thread.
+  ~ScheduledExecutor() override;
+
+  void Execute(Runnable&& runnable) override;
+  std::shared_ptr<api::Cancelable> Schedule(Runnable&& runnable,
+                                            absl::Duration delay) override;
+  void Shutdown() override;
+
+  int GetTid(int index) const override { return index == 0 ? tid_.load() : 0; }
+
+  bool InShutdown() const { return state_->shutdown; }
+
+ private:
+  class Alarm;
+
+  // Shared with the Alarm handles, which may outlive the executor.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable changed;
+    // Guarded by mutex.
+    std::deque<Runnable> queue;
+    TimerWheel wheel;
+    // Tick the thread sleeps until, or -1 if it is not sleeping.
+    std::int64_t wake_tick = -1;
+    std::atomic_bool shutdown{false};
+  };
+
+  // Returns the first tick that starts at or after time.
+  std::int64_t ToTick(absl::Time time) const;
+  absl::Time ToTime(std::int64_t tick) const { return origin_ + tick * kTick; }
+  void Run();
+
+  // Times are on the steady clock.
+  const absl::Time origin_;
+  const std::shared_ptr<State> state_;
+  std::atomic_int tid_{0};
+  std::thread thread_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_SCHEDULED_EXECUTOR_H_
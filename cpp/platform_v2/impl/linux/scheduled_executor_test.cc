@@ -0,0 +1,105 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/scheduled_executor.h"
+
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+namespace {
+
+using ::testing::ElementsAre;
+
+TEST(ScheduledExecutorTest, RunsTasksInDeadlineOrder) {
+  ScheduledExecutor executor;
+  absl::Mutex mutex;
+  std::vector<int> order;
+  absl::Notification done;
+  auto append = [&](int value) {
+    return [&, value]() {
+      absl::MutexLock lock(&mutex);
+      order.push_back(value);
+    };
+  };
+
+  executor.Schedule(append(3), absl::Milliseconds(100));
+  executor.Schedule(append(1), absl::Milliseconds(10));
+  executor.Schedule(append(2), absl::Milliseconds(10));
+  executor.Execute(append(0));
+  executor.Schedule([&done]() { done.Notify(); }, absl::Milliseconds(200));
+  done.WaitForNotification();
+
+  absl::MutexLock lock(&mutex);
+  EXPECT_THAT(order, ElementsAre(0, 1, 2, 3));
+}
+
+TEST(ScheduledExecutorTest, ShutdownDropsDelayedTasks) {
+  bool ran = false;
+  {
+    ScheduledExecutor executor;
+    executor.Schedule([&ran]() { ran = true; }, absl::Hours(1));
+    executor.Shutdown();
+    EXPECT_TRUE(executor.InShutdown());
+  }
+
+  EXPECT_FALSE(ran);
+}
+
+TEST(ScheduledExecutorTest, CancelsPendingTasks) {
+  constexpr int kTasks = 10000;
+  ScheduledExecutor executor;
+  std::vector<std::shared_ptr<api::Cancelable>> cancelables;
+  for (int i = 0; i < kTasks; i++) {
+    cancelables.push_back(executor.Schedule([]() { FAIL(); }, absl::Hours(1)));
+  }
+
+  for (auto& cancelable : cancelables) {
+    EXPECT_TRUE(cancelable->Cancel());
+    EXPECT_FALSE(cancelable->Cancel());
+  }
+}
+
+TEST(ScheduledExecutorTest, FailsToCancelTaskThatRan) {
+  ScheduledExecutor executor;
+  absl::Notification done;
+  auto cancelable =
+      executor.Schedule([&done]() { done.Notify(); }, absl::Milliseconds(1));
+  done.WaitForNotification();
+
+  EXPECT_FALSE(cancelable->Cancel());
+}
+
+TEST(ScheduledExecutorTest, CancelOutlivesExecutor) {
+  std::shared_ptr<api::Cancelable> cancelable;
+  {
+    ScheduledExecutor executor;
+    cancelable = executor.Schedule([]() { FAIL(); }, absl::Hours(1));
+  }
+
+  EXPECT_FALSE(cancelable->Cancel());
+}
+
+}  // namespace
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,58 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_SINGLE_THREAD_EXECUTOR_H_
+#define PLATFORM_V2_IMPL_LINUX_SINGLE_THREAD_EXECUTOR_H_
+
+#include <utility>
+
+#include "platform_v2/api/submittable_executor.h"
+#include "platform_v2/base/runnable.h"
+#include "platform_v2/impl/linux/thread_pool.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// An Executor that uses a single worker thread operating off an unbounded
+// queue.
+//
+// Unlike MultiThreadExecutor, work runs in the order it was submitted, no
+// matter which thread submitted it.
+class SingleThreadExecutor final : public api::SubmittableExecutor {
+ public:
+  SingleThreadExecutor() : thread_pool_(1) {}
+  ~SingleThreadExecutor() override = default;
+
+  void Execute(Runnable&& runnable) override {
+    thread_pool_.Schedule(std::move(runnable));
+  }
+  bool DoSubmit(Runnable&& runnable) override {
+    return thread_pool_.Schedule(std::move(runnable));
+  }
+  void Shutdown() override { thread_pool_.Shutdown(); }
+
+  int GetTid(int index) const override { return thread_pool_.GetTid(index); }
+
+  bool InShutdown() const { return thread_pool_.InShutdown(); }
+
+ private:
+  ThreadPool thread_pool_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_SINGLE_THREAD_EXECUTOR_H_
@@ -0,0 +1,86 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/thread_pool.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+int GetCurrentTid() { return static_cast<int>(syscall(SYS_gettid)); }
+
+ThreadPool::ThreadPool(int num_threads)
+    : tids_(new std::atomic_int[num_threads > 0 ? num_threads : 1]) {
+  if (num_threads < 1) num_threads = 1;
+  threads_.reserve(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    tids_[i] = 0;
+    threads_.emplace_back(&ThreadPool::RunWorker, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  Shutdown();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+bool ThreadPool::Schedule(Runnable&& runnable) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutdown_) return false;
+    queue_.push_back(std::move(runnable));
+  }
+  work_available_.notify_one();
+  return true;
+}
+
+void ThreadPool::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  work_available_.notify_all();
+}
+
+int ThreadPool::GetTid(int index) const {
+  if (index < 0 || index >= static_cast<int>(threads_.size())) return 0;
+  return tids_[index];
+}
+
+void ThreadPool::RunWorker(int index) {
+  tids_[index] = GetCurrentTid();
+  while (true) {
+    Runnable runnable;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(lock,
+                           [this]() { return shutdown_ || !queue_.empty(); });
+      if (queue_.empty()) return;  // Shut down, and nothing left to do.
+      runnable = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    if (runnable) runnable();
+  }
+}
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,73 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_THREAD_POOL_H_
+#define PLATFORM_V2_IMPL_LINUX_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <memory>
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "platform_v2/base/runnable.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// Returns the kernel thread id of the calling thread.
+int GetCurrentTid();
+
+// A fixed number of std::thread workers operating off a shared unbounded FIFO
+// queue.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  // Stops accepting new work, runs all the work already scheduled, and joins
+  // the workers. Must not be called from one of the workers.
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Queues runnable to be run by one of the workers. Returns false, and drops
+  // runnable, if the pool is shut down.
+  bool Schedule(Runnable&& runnable);
+
+  // Stops accepting new work. Work already scheduled still runs.
+  void Shutdown();
+  bool InShutdown() const { return shutdown_; }
+
+  // Returns kernel thread id of the index-th worker, or 0 if there is no such
+  // worker or it has not started yet.
+  int GetTid(int index) const;
+
+ private:
+  void RunWorker(int index);
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::deque<Runnable> queue_;  // Guarded by mutex_.
+  std::atomic_bool shutdown_{false};
+  std::unique_ptr<std::atomic_int[]> tids_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_THREAD_POOL_H_
@@ -0,0 +1,76 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/thread_pool.h"
+
+#include <atomic>
+
+#include "gtest/gtest.h"
+#include "absl/synchronization/notification.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+namespace {
+
+TEST(ThreadPoolTest, RunsScheduledWork) {
+  ThreadPool pool(4);
+  absl::Notification done;
+
+  EXPECT_TRUE(pool.Schedule([&done]() { done.Notify(); }));
+
+  done.WaitForNotification();
+}
+
+TEST(ThreadPoolTest, DestructorRunsPendingWork) {
+  std::atomic_int count = 0;
+  {
+    ThreadPool pool(2);
+    for (int i = 0; i < 100; i++) {
+      pool.Schedule([&count]() { count++; });
+    }
+  }
+
+  EXPECT_EQ(count, 100);
+}
+
+TEST(ThreadPoolTest, RejectsWorkAfterShutdown) {
+  ThreadPool pool(1);
+  pool.Shutdown();
+
+  EXPECT_TRUE(pool.InShutdown());
+  EXPECT_FALSE(pool.Schedule([]() { FAIL(); }));
+}
+
+TEST(ThreadPoolTest, ReportsWorkerTids) {
+  ThreadPool pool(1);
+  std::atomic_int tid = 0;
+  absl::Notification done;
+
+  pool.Schedule([&]() {
+    tid = GetCurrentTid();
+    done.Notify();
+  });
+  done.WaitForNotification();
+
+  EXPECT_NE(tid, 0);
+  EXPECT_NE(tid, GetCurrentTid());
+  EXPECT_EQ(pool.GetTid(0), tid);
+  EXPECT_EQ(pool.GetTid(1), 0);
+}
+
+}  // namespace
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,236 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/timer_wheel.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+namespace {
+
+constexpr int kChunkSize = 256;
+
+// Number of ticks spanned by the whole wheel of level `level`.
+constexpr std::int64_t LevelSpan(int level) {
+  return std::int64_t{1} << (TimerWheel::kSlotBits * (level + 1));
+}
+
+// Returns the distance, in 1..64, from slot `from` to the next set bit of
+// `occupied`, wrapping around; 64 means `from` itself.
+int DistanceToNextSlot(std::uint64_t occupied, int from) {
+  int shift = (from + 1) & (TimerWheel::kSlots - 1);
+  std::uint64_t rotated =
+      shift == 0 ? occupied : (occupied >> shift) | (occupied << (64 - shift));
+  return __builtin_ctzll(rotated) + 1;
+}
+
+}  // namespace
+
+class TimerWheel::Node {
+ public:
+  Node* prev = nullptr;
+  Node* next = nullptr;
+  // List the node is linked in; nullptr if the node is free.
+  List* list = nullptr;
+  std::int64_t tick = 0;
+  std::uint64_t sequence = 0;
+  std::uint64_t generation = 0;
+  Runnable runnable;
+};
+
+TimerWheel::TimerWheel(std::int64_t current_tick)
+    : current_tick_(current_tick) {}
+
+TimerWheel::~TimerWheel() = default;
+
+TimerWheel::Timer TimerWheel::Add(std::int64_t tick, Runnable&& runnable) {
+  Node* node = Allocate();
+  node->tick = tick;
+  node->sequence = next_sequence_++;
+  node->runnable = std::move(runnable);
+  size_++;
+  if (tick <= current_tick_) {
+    Append(&expired_, node);
+  } else {
+    Place(node);
+  }
+  return {node, node->generation};
+}
+
+bool TimerWheel::Cancel(const Timer& timer, Runnable* runnable) {
+  Node* node = timer.node;
+  if (node == nullptr || node->generation != timer.generation ||
+      node->list == nullptr) {
+    return false;
+  }
+  Unlink(node);
+  *runnable = std::move(node->runnable);
+  Release(node);
+  return true;
+}
+
+void TimerWheel::Advance(std::int64_t tick) {
+  while (true) {
+    std::int64_t next = NextEventTick();
+    if (next > tick) break;
+    current_tick_ = next;
+    ProcessTick();
+  }
+  current_tick_ = std::max(current_tick_, tick);
+}
+
+bool TimerWheel::PopExpired(Runnable* runnable) {
+  Node* node = expired_.head;
+  if (node == nullptr) return false;
+  Unlink(node);
+  *runnable = std::move(node->runnable);
+  Release(node);
+  return true;
+}
+
+std::int64_t TimerWheel::NextEventTick() const {
+  std::int64_t next = kNever;
+  for (int level = 0; level < kLevels; level++) {
+    if (occupied_[level] == 0) continue;
+    int shift = kSlotBits * level;
+    std::int64_t current_slot = current_tick_ >> shift;
+    int distance = DistanceToNextSlot(occupied_[level],
+                                      current_slot & (kSlots - 1));
+    next = std::min(next, (current_slot + distance) << shift);
+  }
+  return next;
+}
+
+std::vector<Runnable> TimerWheel::Clear() {
+  std::vector<Runnable> runnables;
+  runnables.reserve(size_);
+  auto clear_list = [&](List* list) {
+    while (Node* node = list->head) {
+      Unlink(node);
+      runnables.push_back(std::move(node->runnable));
+      Release(node);
+    }
+  };
+  for (auto& level : slots_) {
+    for (auto& slot : level) clear_list(&slot);
+  }
+  clear_list(&expired_);
+  return runnables;
+}
+
+TimerWheel::Node* TimerWheel::Allocate() {
+  if (free_nodes_ == nullptr) {
+    chunks_.push_back(std::make_unique<Node[]>(kChunkSize));
+    Node* chunk = chunks_.back().get();
+    for (int i = 0; i < kChunkSize; i++) {
+      chunk[i].next = free_nodes_;
+      free_nodes_ = &chunk[i];
+    }
+  }
+  Node* node = free_nodes_;
+  free_nodes_ = node->next;
+  node->next = nullptr;
+  return node;
+}
+
+void TimerWheel::Release(Node* node) {
+  size_--;
+  node->runnable = nullptr;
+  node->generation++;
+  node->list = nullptr;
+  node->prev = nullptr;
+  node->next = free_nodes_;
+  free_nodes_ = node;
+}
+
+void TimerWheel::Place(Node* node) {
+  std::int64_t delta = node->tick - current_tick_;
+  std::int64_t tick = node->tick;
+  int level = 0;
+  while (level < kLevels - 1 && delta >= LevelSpan(level)) level++;
+  if (delta >= LevelSpan(kLevels - 1)) {
+    // Beyond the reach of the wheels; park the timer as far out as possible.
+    tick = current_tick_ + LevelSpan(kLevels - 1) - 1;
+  }
+  int slot = (tick >> (kSlotBits * level)) & (kSlots - 1);
+  occupied_[level] |= std::uint64_t{1} << slot;
+  Append(&slots_[level][slot], node);
+}
+
+void TimerWheel::Append(List* list, Node* node) {
+  node->list = list;
+  node->prev = list->tail;
+  node->next = nullptr;
+  if (list->tail != nullptr) {
+    list->tail->next = node;
+  } else {
+    list->head = node;
+  }
+  list->tail = node;
+}
+
+void TimerWheel::Unlink(Node* node) {
+  List* list = node->list;
+  if (node->prev != nullptr) {
+    node->prev->next = node->next;
+  } else {
+    list->head = node->next;
+  }
+  if (node->next != nullptr) {
+    node->next->prev = node->prev;
+  } else {
+    list->tail = node->prev;
+  }
+  node->prev = node->next = nullptr;
+  node->list = nullptr;
+  if (list->head == nullptr && list != &expired_) {
+    int index = list - &slots_[0][0];
+    occupied_[index / kSlots] &= ~(std::uint64_t{1} << (index % kSlots));
+  }
+}
+
+void TimerWheel::ProcessTick() {
+  // Move the timers of the higher level slots starting at this tick down,
+  // placing them relative to the current tick.
+  for (int level = 1; level < kLevels; level++) {
+    int shift = kSlotBits * level;
+    if ((current_tick_ & ((std::int64_t{1} << shift) - 1)) != 0) break;
+    List* list = &slots_[level][(current_tick_ >> shift) & (kSlots - 1)];
+    while (Node* node = list->head) {
+      Unlink(node);
+      Place(node);
+    }
+  }
+
+  // Whatever is left in the level 0 slot is due now; timers get there through
+  // different levels, so restore the order they were added in.
+  List* list = &slots_[0][current_tick_ & (kSlots - 1)];
+  scratch_.clear();
+  while (Node* node = list->head) {
+    Unlink(node);
+    scratch_.push_back(node);
+  }
+  std::sort(scratch_.begin(), scratch_.end(), [](const Node* a, const Node* b) {
+    return a->sequence < b->sequence;
+  });
+  for (Node* node : scratch_) Append(&expired_, node);
+}
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,125 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_TIMER_WHEEL_H_
+#define PLATFORM_V2_IMPL_LINUX_TIMER_WHEEL_H_
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "platform_v2/base/runnable.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// A hierarchical timing wheel (Varghese and Lauck, "Hashed and Hierarchical
+// Timing Wheels"): kLevels wheels of kSlots slots each, where a slot of level
+// l spans kSlots^l ticks. Timers are kept in intrusive lists, so adding and
+// canceling a timer are O(1); a timer is moved down a level at most
+// kLevels - 1 times before it expires. Timers further out than the wheels
+// reach are parked in the last slot they can reach, and placed again from
+// there.
+//
+// Timer nodes come from a free list that grows in chunks and is never shrunk,
+// so a steady stream of timers does not allocate. Every node carries a
+// generation, bumped whenever it is released, so a Timer handle outliving its
+// node can not cancel a timer that reuses it.
+//
+// Not thread-safe.
+class TimerWheel {
+ public:
+  static constexpr int kSlotBits = 6;
+  static constexpr int kSlots = 1 << kSlotBits;
+  static constexpr int kLevels = 4;
+  static constexpr std::int64_t kNever =
+      std::numeric_limits<std::int64_t>::max();
+
+  class Node;
+
+  // Handle of an added timer.
+  struct Timer {
+    Node* node = nullptr;
+    std::uint64_t generation = 0;
+  };
+
+  explicit TimerWheel(std::int64_t current_tick = 0);
+  ~TimerWheel();
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Adds a timer running runnable at tick. A timer due at or before the
+  // current tick expires right away.
+  Timer Add(std::int64_t tick, Runnable&& runnable);
+
+  // Removes a timer that is neither popped nor canceled yet, and moves its
+  // runnable to *runnable, so that the caller can destroy it outside of its
+  // locks. Returns false if there is no such timer.
+  bool Cancel(const Timer& timer, Runnable* runnable);
+
+  // Moves the current tick forward to tick, expiring the timers due by then.
+  // Timers due at the same tick expire in the order they were added.
+  void Advance(std::int64_t tick);
+
+  // Takes the runnable of the first expired timer. Returns false if there is
+  // no expired timer.
+  bool PopExpired(Runnable* runnable);
+  bool HasExpired() const { return expired_.head != nullptr; }
+
+  // Returns the first tick at which Advance() has timers to expire or to move
+  // down a level, or kNever if there are none.
+  std::int64_t NextEventTick() const;
+
+  // Removes all timers, returning their runnables.
+  std::vector<Runnable> Clear();
+
+  std::int64_t current_tick() const { return current_tick_; }
+  // Number of timers added, and not canceled or popped yet.
+  std::int64_t size() const { return size_; }
+
+ private:
+  struct List {
+    Node* head = nullptr;
+    Node* tail = nullptr;
+  };
+
+  Node* Allocate();
+  void Release(Node* node);
+  void Place(Node* node);
+  void Append(List* list, Node* node);
+  void Unlink(Node* node);
+  void ProcessTick();
+
+  std::int64_t current_tick_;
+  std::int64_t size_ = 0;
+  std::uint64_t next_sequence_ = 0;
+
+  List slots_[kLevels][kSlots];
+  // Bit s of occupied_[l] is set if slots_[l][s] is not empty.
+  std::uint64_t occupied_[kLevels] = {};
+  List expired_;
+
+  std::vector<std::unique_ptr<Node[]>> chunks_;
+  Node* free_nodes_ = nullptr;
+  // Reused by ProcessTick() to order the timers of a slot.
+  std::vector<Node*> scratch_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_TIMER_WHEEL_H_
@@ -0,0 +1,208 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/timer_wheel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+// Adds a timer recording id into *fired when it runs.
+TimerWheel::Timer AddTimer(TimerWheel& wheel, std::int64_t tick, int id,
+                           std::vector<int>* fired) {
+  return wheel.Add(tick, [id, fired]() { fired->push_back(id); });
+}
+
+void RunExpired(TimerWheel& wheel) {
+  Runnable runnable;
+  while (wheel.PopExpired(&runnable)) runnable();
+}
+
+TEST(TimerWheelTest, ExpiresTimersInTickOrder) {
+  TimerWheel wheel;
+  std::vector<int> fired;
+  AddTimer(wheel, 5, 3, &fired);
+  AddTimer(wheel, 3, 1, &fired);
+  AddTimer(wheel, 3, 2, &fired);
+
+  EXPECT_EQ(wheel.NextEventTick(), 3);
+  wheel.Advance(2);
+  RunExpired(wheel);
+  EXPECT_THAT(fired, IsEmpty());
+
+  wheel.Advance(3);
+  RunExpired(wheel);
+  EXPECT_THAT(fired, ElementsAre(1, 2));
+
+  wheel.Advance(10);
+  RunExpired(wheel);
+  EXPECT_THAT(fired, ElementsAre(1, 2, 3));
+  EXPECT_EQ(wheel.size(), 0);
+  EXPECT_EQ(wheel.NextEventTick(), TimerWheel::kNever);
+}
+
+TEST(TimerWheelTest, ExpiresPastTimersRightAway) {
+  TimerWheel wheel(100);
+  std::vector<int> fired;
+  AddTimer(wheel, 50, 1, &fired);
+
+  EXPECT_TRUE(wheel.HasExpired());
+  RunExpired(wheel);
+  EXPECT_THAT(fired, ElementsAre(1));
+}
+
+TEST(TimerWheelTest, ExpiresFarTimersAtTheirTick) {
+  const std::vector<std::int64_t> ticks = {
+      63, 64, 4095, 4096, 300000, 16777215, 16777216, 100000000};
+  TimerWheel wheel;
+  std::vector<int> fired;
+  for (int i = 0; i < static_cast<int>(ticks.size()); i++) {
+    AddTimer(wheel, ticks[i], i, &fired);
+  }
+
+  for (int i = 0; i < static_cast<int>(ticks.size()); i++) {
+    wheel.Advance(ticks[i] - 1);
+    RunExpired(wheel);
+    EXPECT_EQ(fired.size(), i);
+    wheel.Advance(ticks[i]);
+    RunExpired(wheel);
+    EXPECT_EQ(fired.size(), i + 1);
+  }
+}
+
+TEST(TimerWheelTest, CancelRemovesTimer) {
+  TimerWheel wheel;
+  std::vector<int> fired;
+  auto timer = AddTimer(wheel, 1000, 1, &fired);
+  Runnable runnable;
+
+  EXPECT_TRUE(wheel.Cancel(timer, &runnable));
+  EXPECT_TRUE(runnable);
+  EXPECT_FALSE(wheel.Cancel(timer, &runnable));
+  EXPECT_EQ(wheel.size(), 0);
+  EXPECT_EQ(wheel.NextEventTick(), TimerWheel::kNever);
+  wheel.Advance(2000);
+  RunExpired(wheel);
+  EXPECT_THAT(fired, IsEmpty());
+}
+
+TEST(TimerWheelTest, CancelsExpiredTimerUntilPopped) {
+  TimerWheel wheel;
+  std::vector<int> fired;
+  auto expired = AddTimer(wheel, 10, 1, &fired);
+  auto popped = AddTimer(wheel, 5, 2, &fired);
+  wheel.Advance(10);
+  Runnable runnable;
+
+  ASSERT_TRUE(wheel.PopExpired(&runnable));
+  EXPECT_FALSE(wheel.Cancel(popped, &runnable));
+  EXPECT_TRUE(wheel.Cancel(expired, &runnable));
+  EXPECT_FALSE(wheel.HasExpired());
+}
+
+TEST(TimerWheelTest, StaleHandleDoesNotCancelReusedNode) {
+  TimerWheel wheel;
+  std::vector<int> fired;
+  auto stale = AddTimer(wheel, 10, 1, &fired);
+  Runnable runnable;
+  ASSERT_TRUE(wheel.Cancel(stale, &runnable));
+
+  auto timer = AddTimer(wheel, 10, 2, &fired);
+  ASSERT_EQ(timer.node, stale.node);
+
+  EXPECT_FALSE(wheel.Cancel(stale, &runnable));
+  wheel.Advance(10);
+  RunExpired(wheel);
+  EXPECT_THAT(fired, ElementsAre(2));
+}
+
+TEST(TimerWheelTest, MatchesSortedOrderUnderRandomLoad) {
+  std::mt19937 random(42);
+  TimerWheel wheel;
+  std::vector<int> fired;
+  // (tick, id) of every timer that is neither fired nor canceled, in the
+  // order they were added.
+  std::vector<std::pair<std::int64_t, int>> pending;
+  std::vector<TimerWheel::Timer> timers;
+  std::vector<int> expected;
+
+  for (int round = 0; round < 2000; round++) {
+    for (int i = 0; i < 10; i++) {
+      // Mostly short timers, with some spanning every level.
+      std::int64_t delay = random() % 4 == 0 ? random() % 20000000
+                                             : random() % 200;
+      int id = timers.size();
+      std::int64_t tick = wheel.current_tick() + delay;
+      timers.push_back(AddTimer(wheel, tick, id, &fired));
+      pending.emplace_back(tick, id);
+    }
+    if (random() % 2 == 0 && !pending.empty()) {
+      auto it = pending.begin() + random() % pending.size();
+      Runnable runnable;
+      ASSERT_TRUE(wheel.Cancel(timers[it->second], &runnable));
+      pending.erase(it);
+    }
+    std::int64_t tick = wheel.current_tick() + random() % 300;
+    if (round % 500 == 499) tick += 10000000;
+    wheel.Advance(tick);
+    RunExpired(wheel);
+
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](const auto& a, const auto& b) {
+                       return a.first < b.first;
+                     });
+    auto due = std::find_if(pending.begin(), pending.end(),
+                            [tick](const auto& p) { return p.first > tick; });
+    for (auto it = pending.begin(); it != due; ++it) {
+      expected.push_back(it->second);
+    }
+    pending.erase(pending.begin(), due);
+    // Keep pending in the order the timers were added.
+    std::sort(pending.begin(), pending.end(),
+              [](const auto& a, const auto& b) { return a.second < b.second; });
+    ASSERT_EQ(fired, expected);
+    ASSERT_EQ(wheel.size(), pending.size());
+  }
+}
+
+TEST(TimerWheelTest, ClearReturnsRunnables) {
+  TimerWheel wheel;
+  std::vector<int> fired;
+  AddTimer(wheel, 0, 1, &fired);
+  AddTimer(wheel, 100, 2, &fired);
+  AddTimer(wheel, 100000, 3, &fired);
+
+  EXPECT_EQ(wheel.Clear().size(), 3);
+  EXPECT_EQ(wheel.size(), 0);
+  EXPECT_FALSE(wheel.HasExpired());
+  EXPECT_EQ(wheel.NextEventTick(), TimerWheel::kNever);
+}
+
+}  // namespace
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
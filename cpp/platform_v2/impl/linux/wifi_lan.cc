@@ -0,0 +1,450 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/wifi_lan.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "platform_v2/base/logging.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+namespace {
+
+// 127.0.0.1, in network order.
+constexpr char kLoopbackAddress[] = {127, 0, 0, 1};
+
+sockaddr_in ToSockAddr(const std::string& ip_address, int port) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (ip_address.size() == sizeof(address.sin_addr)) {
+    std::memcpy(&address.sin_addr, ip_address.data(), ip_address.size());
+  }
+  return address;
+}
+
+std::string ToIpAddress(const sockaddr_in& address) {
+  return std::string(reinterpret_cast<const char*>(&address.sin_addr),
+                     sizeof(address.sin_addr));
+}
+
+void SetNoDelay(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Waits for events on fd. Returns false on error.
+bool WaitFor(int fd, short events, int timeout_millis = -1) {  // NOLINT
+  pollfd poll_fd{fd, events, 0};
+  while (true) {
+    int ready = poll(&poll_fd, 1, timeout_millis);
+    if (ready > 0) return true;
+    if (ready == 0) return false;  // Timed out.
+    if (errno != EINTR) return false;
+  }
+}
+
+}  // namespace
+
+std::string WifiLanService::GetName() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return service_info_name_;
+}
+
+void WifiLanService::SetName(std::string service_info_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  service_info_name_ = std::move(service_info_name);
+}
+
+WifiLanSocket::WifiLanSocket(int fd, const WifiLanService& remote_service)
+    : fd_(fd),
+      remote_service_(remote_service.GetName(),
+                      remote_service.GetServiceAddress().first,
+                      remote_service.GetServiceAddress().second) {}
+
+WifiLanSocket::~WifiLanSocket() {
+  Close();
+  close(fd_);
+}
+
+Exception WifiLanSocket::Close() {
+  read_closed_ = true;
+  write_closed_ = true;
+  // Unlike close(), shutdown() wakes up threads polling the socket, and keeps
+  // the descriptor from being reused while they may still use it.
+  shutdown(fd_, SHUT_RDWR);
+  return {Exception::kSuccess};
+}
+
+ExceptionOr<ByteArray> WifiLanSocket::SocketInputStream::Read(
+    std::int64_t size) {
+  ByteArray data(size);
+  ExceptionOr<std::int64_t> count = ReadInto(data.data(), size);
+  if (!count.ok()) return ExceptionOr<ByteArray>(count.exception());
+  if (count.result() < size) data = ByteArray(data.data(), count.result());
+  return ExceptionOr<ByteArray>(std::move(data));
+}
+
+ExceptionOr<std::int64_t> WifiLanSocket::SocketInputStream::ReadInto(
+    char* data, std::int64_t size) {
+  while (!socket_.read_closed_) {
+    ssize_t count = recv(socket_.fd_, data, size, 0);
+    if (count > 0) return ExceptionOr<std::int64_t>(count);
+    if (count == 0) {
+      // The peer is done, or the socket was shut down locally.
+      if (socket_.read_closed_) break;
+      return ExceptionOr<std::int64_t>(0);
+    }
+    if (errno == EINTR) continue;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) break;
+    if (!WaitFor(socket_.fd_, POLLIN)) break;
+  }
+  return ExceptionOr<std::int64_t>(Exception::kIo);
+}
+
+Exception WifiLanSocket::SocketInputStream::Close() {
+  socket_.read_closed_ = true;
+  shutdown(socket_.fd_, SHUT_RD);
+  return {Exception::kSuccess};
+}
+
+Exception WifiLanSocket::SocketOutputStream::Write(const ByteArray& data) {
+  const char* next = data.data();
+  size_t remaining = data.size();
+  while (remaining > 0) {
+    if (socket_.write_closed_) return {Exception::kIo};
+    ssize_t count = send(socket_.fd_, next, remaining, MSG_NOSIGNAL);
+    if (count > 0) {
+      next += count;
+      remaining -= count;
+      continue;
+    }
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      return {Exception::kIo};
+    }
+    if (!WaitFor(socket_.fd_, POLLOUT)) return {Exception::kIo};
+  }
+  return {Exception::kSuccess};
+}
+
+Exception WifiLanSocket::SocketOutputStream::Close() {
+  socket_.write_closed_ = true;
+  shutdown(socket_.fd_, SHUT_WR);
+  return {Exception::kSuccess};
+}
+
+std::unique_ptr<WifiLanServerSocket> WifiLanServerSocket::Listen(
+    const std::string& ip_address) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return nullptr;
+  sockaddr_in address = ToSockAddr(ip_address, 0);
+  socklen_t length = sizeof(address);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    NEARBY_LOG(ERROR, "Linux WifiLan: failed to listen: %s", strerror(errno));
+    close(fd);
+    return nullptr;
+  }
+  int wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (wake_fd < 0) {
+    close(fd);
+    return nullptr;
+  }
+  return std::unique_ptr<WifiLanServerSocket>(new WifiLanServerSocket(
+      fd, wake_fd, ToIpAddress(address), ntohs(address.sin_port)));
+}
+
+WifiLanServerSocket::~WifiLanServerSocket() {
+  Close();
+  close(fd_);
+  close(wake_fd_);
+}
+
+std::unique_ptr<WifiLanSocket> WifiLanServerSocket::Accept() {
+  while (!closed_) {
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    int fd = accept4(fd_, reinterpret_cast<sockaddr*>(&address), &length,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd >= 0) {
+      SetNoDelay(fd);
+      return std::make_unique<WifiLanSocket>(
+          fd,
+          WifiLanService("", ToIpAddress(address), ntohs(address.sin_port)));
+    }
+    if (errno == EINTR || errno == ECONNABORTED) continue;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      NEARBY_LOG(ERROR, "Linux WifiLan: failed to accept: %s",
+                 strerror(errno));
+      return nullptr;
+    }
+    pollfd poll_fds[] = {{fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    if (poll(poll_fds, 2, -1) < 0 && errno != EINTR) return nullptr;
+  }
+  return nullptr;
+}
+
+void WifiLanServerSocket::Close() {
+  if (closed_.exchange(true)) return;
+  // Refuses new connects right away, even while an Accept() caller is busy
+  // elsewhere; the fd itself stays open until we are destroyed.
+  shutdown(fd_, SHUT_RDWR);
+  std::uint64_t one = 1;
+  // eventfd writes of 8 bytes do not fail short of an overflow.
+  (void)write(wake_fd_, &one, sizeof(one));
+}
+
+WifiLanMedium::WifiLanMedium(WifiLanServiceRegistry& registry)
+    : registry_(registry) {}
+
+WifiLanMedium::~WifiLanMedium() {
+  std::vector<std::string> service_ids;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : watch_ids_) service_ids.push_back(item.first);
+  }
+  for (const auto& service_id : service_ids) StopDiscovery(service_id);
+  service_ids.clear();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : local_services_) service_ids.push_back(item.first);
+  }
+  for (const auto& service_id : service_ids) {
+    StopAdvertising(service_id);
+    StopAcceptingConnections(service_id);
+  }
+}
+
+bool WifiLanMedium::StartAdvertising(const std::string& service_id,
+                                     const std::string& service_info_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  LocalService& service = local_services_[service_id];
+  WifiLanServerSocket* server_socket = EnsureServerSocket(service_id, service);
+  if (server_socket == nullptr) {
+    local_services_.erase(service_id);
+    return false;
+  }
+  service.advertising = true;
+  registry_.Advertise(service_id, {service_info_name,
+                                   server_socket->GetIpAddress(),
+                                   server_socket->GetPort()});
+  NEARBY_LOG(INFO, "Linux WifiLan StartAdvertising: service_id=%s, port=%d",
+             service_id.c_str(), server_socket->GetPort());
+  return true;
+}
+
+bool WifiLanMedium::StopAdvertising(const std::string& service_id) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = local_services_.find(service_id);
+    if (it == local_services_.end() || !it->second.advertising) return false;
+    it->second.advertising = false;
+    registry_.Withdraw(service_id, it->second.server_socket->GetIpAddress(),
+                       it->second.server_socket->GetPort());
+  }
+  MaybeCloseServerSocket(service_id);
+  return true;
+}
+
+bool WifiLanMedium::StartDiscovery(const std::string& service_id,
+                                   DiscoveredServiceCallback callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (watch_ids_.contains(service_id)) return false;
+  }
+  std::int64_t watch_id = registry_.Watch(
+      service_id,
+      {
+          .found_cb =
+              [this, service_id, found_cb = callback.service_discovered_cb](
+                  const WifiLanServiceRegistry::Record& record) {
+                found_cb(*GetOrCreateRemoteService(record), service_id);
+              },
+          .lost_cb =
+              [this, service_id, lost_cb = callback.service_lost_cb](
+                  const WifiLanServiceRegistry::Record& record) {
+                lost_cb(*GetOrCreateRemoteService(record), service_id);
+              },
+      });
+  std::lock_guard<std::mutex> lock(mutex_);
+  watch_ids_[service_id] = watch_id;
+  return true;
+}
+
+bool WifiLanMedium::StopDiscovery(const std::string& service_id) {
+  std::int64_t watch_id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = watch_ids_.find(service_id);
+    if (it == watch_ids_.end()) return false;
+    watch_id = it->second;
+    watch_ids_.erase(it);
+  }
+  registry_.Unwatch(watch_id);
+  return true;
+}
+
+bool WifiLanMedium::StartAcceptingConnections(
+    const std::string& service_id, AcceptedConnectionCallback callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  LocalService& service = local_services_[service_id];
+  if (EnsureServerSocket(service_id, service) == nullptr) {
+    local_services_.erase(service_id);
+    return false;
+  }
+  service.accepting = true;
+  service.callback = std::move(callback);
+  return true;
+}
+
+bool WifiLanMedium::StopAcceptingConnections(const std::string& service_id) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = local_services_.find(service_id);
+    if (it == local_services_.end() || !it->second.accepting) return false;
+    it->second.accepting = false;
+    it->second.callback = {};
+  }
+  MaybeCloseServerSocket(service_id);
+  return true;
+}
+
+std::unique_ptr<api::WifiLanSocket> WifiLanMedium::Connect(
+    api::WifiLanService& service, const std::string&,
+    CancellationFlag* cancellation_flag) {
+  auto& remote_service = static_cast<WifiLanService&>(service);
+  auto ip_address_and_port = remote_service.GetServiceAddress();
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return nullptr;
+  sockaddr_in address =
+      ToSockAddr(ip_address_and_port.first, ip_address_and_port.second);
+  int result =
+      connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+  if (result != 0 && errno == EINPROGRESS) {
+    // Shutting the socket down aborts the pending connect, and wakes up poll.
+    CancellationFlagListener listener(cancellation_flag,
+                                      [fd]() { shutdown(fd, SHUT_RDWR); });
+    if (WaitFor(fd, POLLOUT, absl::ToInt64Milliseconds(kConnectTimeout))) {
+      int error = 0;
+      socklen_t length = sizeof(error);
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+      result = error == 0 ? 0 : -1;
+    }
+  }
+  if (result == 0 && cancellation_flag && cancellation_flag->Cancelled()) {
+    result = -1;
+  }
+  if (result != 0) {
+    NEARBY_LOG(ERROR, "Linux WifiLan Connect: failed to connect to port %d",
+               ip_address_and_port.second);
+    close(fd);
+    return nullptr;
+  }
+  SetNoDelay(fd);
+  return std::make_unique<WifiLanSocket>(fd, remote_service);
+}
+
+api::WifiLanService* WifiLanMedium::FindRemoteService(
+    const std::string& ip_address, int port) {
+  WifiLanServiceRegistry::Record record;
+  if (!registry_.Find(ip_address, port, &record)) {
+    record = {"", ip_address, port};
+  }
+  return GetOrCreateRemoteService(record);
+}
+
+WifiLanServerSocket* WifiLanMedium::EnsureServerSocket(
+    const std::string& service_id, LocalService& service) {
+  if (service.server_socket == nullptr) {
+    service.server_socket = WifiLanServerSocket::Listen(
+        std::string(kLoopbackAddress, sizeof(kLoopbackAddress)));
+    if (service.server_socket == nullptr) return nullptr;
+    service.accept_thread =
+        std::thread(&WifiLanMedium::RunAcceptLoop, this, service_id,
+                    service.server_socket);
+  }
+  return service.server_socket.get();
+}
+
+void WifiLanMedium::MaybeCloseServerSocket(const std::string& service_id) {
+  LocalService service;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = local_services_.find(service_id);
+    if (it == local_services_.end() || it->second.advertising ||
+        it->second.accepting) {
+      return;
+    }
+    service = std::move(it->second);
+    local_services_.erase(it);
+  }
+  // The accept loop may be calling back into the medium; join it unlocked.
+  // If this is the accept loop itself, it still holds the socket, and exits
+  // once the callback returns and Accept() fails on the closed socket.
+  service.server_socket->Close();
+  if (service.accept_thread.get_id() == std::this_thread::get_id()) {
+    service.accept_thread.detach();
+  } else {
+    service.accept_thread.join();
+  }
+}
+
+void WifiLanMedium::RunAcceptLoop(
+    const std::string& service_id,
+    std::shared_ptr<WifiLanServerSocket> server_socket) {
+  while (auto socket = server_socket->Accept()) {
+    AcceptedConnectionCallback callback;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = local_services_.find(service_id);
+      // Only advertising; drop the connection.
+      if (it == local_services_.end() || !it->second.accepting) continue;
+      callback = it->second.callback;
+    }
+    // The callback takes ownership of the socket.
+    callback.accepted_cb(*socket.release(), service_id);
+  }
+}
+
+WifiLanService* WifiLanMedium::GetOrCreateRemoteService(
+    const WifiLanServiceRegistry::Record& record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& service = remote_services_[{record.ip_address, record.port}];
+  if (service == nullptr) {
+    service = std::make_unique<WifiLanService>(record.service_info_name,
+                                               record.ip_address, record.port);
+  } else if (!record.service_info_name.empty()) {
+    service->SetName(record.service_info_name);
+  }
+  return service.get();
+}
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
@@ -0,0 +1,235 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_WIFI_LAN_H_
+#define PLATFORM_V2_IMPL_LINUX_WIFI_LAN_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+
+#include "platform_v2/api/wifi_lan.h"
+#include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/exception.h"
+#include "platform_v2/base/input_stream.h"
+#include "platform_v2/base/output_stream.h"
+#include "platform_v2/impl/linux/wifi_lan_service_registry.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// Opaque wrapper over a WifiLan service which contains packed
+// |WifiLanServiceInfo| string name.
+class WifiLanService : public api::WifiLanService {
+ public:
+  WifiLanService(std::string service_info_name, std::string ip_address,
+                 int port)
+      : service_info_name_(std::move(service_info_name)),
+        ip_address_(std::move(ip_address)),
+        port_(port) {}
+  ~WifiLanService() override = default;
+
+  std::string GetName() const override;
+  std::pair<std::string, int> GetServiceAddress() const override {
+    return {ip_address_, port_};
+  }
+
+  void SetName(std::string service_info_name);
+
+ private:
+  mutable std::mutex mutex_;
+  std::string service_info_name_;  // Guarded by mutex_.
+  const std::string ip_address_;
+  const int port_;
+};
+
+// A connected TCP socket. The file descriptor is non-blocking; reads and
+// writes wait for it with poll(), so that Close() can wake them up from any
+// thread.
+class WifiLanSocket : public api::WifiLanSocket {
+ public:
+  WifiLanSocket(int fd, const WifiLanService& remote_service);
+  // Closes the socket, and releases the file descriptor.
+  ~WifiLanSocket() override;
+
+  InputStream& GetInputStream() override { return input_stream_; }
+  OutputStream& GetOutputStream() override { return output_stream_; }
+
+  // Shuts the connection down in both directions. Blocked reads and writes
+  // return Exception::kIo.
+  Exception Close() override;
+
+  WifiLanService* GetRemoteWifiLanService() override {
+    return &remote_service_;
+  }
+
+ private:
+  class SocketInputStream : public InputStream {
+   public:
+    explicit SocketInputStream(WifiLanSocket& socket) : socket_(socket) {}
+
+    // Returns at most size bytes, blocking until at least one is available.
+    // Returns an empty ByteArray once the peer has closed its side.
+    ExceptionOr<ByteArray> Read(std::int64_t size) override;
+    // Same, straight into data.
+    ExceptionOr<std::int64_t> ReadInto(char* data, std::int64_t size) override;
+    Exception Close() override;
+
+   private:
+    WifiLanSocket& socket_;
+  };
+
+  class SocketOutputStream : public OutputStream {
+   public:
+    explicit SocketOutputStream(WifiLanSocket& socket) : socket_(socket) {}
+
+    // Blocks until all of data is handed to the kernel.
+    Exception Write(const ByteArray& data) override;
+    Exception Flush() override { return {Exception::kSuccess}; }
+    Exception Close() override;
+
+   private:
+    WifiLanSocket& socket_;
+  };
+
+  const int fd_;
+  WifiLanService remote_service_;
+  std::atomic_bool read_closed_{false};
+  std::atomic_bool write_closed_{false};
+  SocketInputStream input_stream_{*this};
+  SocketOutputStream output_stream_{*this};
+};
+
+// A TCP socket listening on the loopback interface.
+class WifiLanServerSocket {
+ public:
+  // Listens on an ephemeral port of ip_address (4 bytes, network order).
+  // Returns nullptr on error.
+  static std::unique_ptr<WifiLanServerSocket> Listen(
+      const std::string& ip_address);
+
+  ~WifiLanServerSocket();
+  WifiLanServerSocket(const WifiLanServerSocket&) = delete;
+  WifiLanServerSocket& operator=(const WifiLanServerSocket&) = delete;
+
+  // Blocks until a connection comes in, or the server socket is closed.
+  // Returns nullptr once closed.
+  std::unique_ptr<WifiLanSocket> Accept();
+
+  // Makes pending and future Accept() calls return nullptr.
+  void Close();
+
+  const std::string& GetIpAddress() const { return ip_address_; }
+  int GetPort() const { return port_; }
+
+ private:
+  WifiLanServerSocket(int fd, int wake_fd, std::string ip_address, int port)
+      : fd_(fd),
+        wake_fd_(wake_fd),
+        ip_address_(std::move(ip_address)),
+        port_(port) {}
+
+  const int fd_;
+  // eventfd signaled by Close().
+  const int wake_fd_;
+  const std::string ip_address_;
+  const int port_;
+  std::atomic_bool closed_{false};
+};
+
+// Container of operations that can be performed over the WifiLan medium, on
+// top of TCP over the loopback interface.
+//
+// Every service id being advertised or accepting connections gets its own
+// server socket; services are advertised and discovered through
+// WifiLanServiceRegistry.
+class WifiLanMedium : public api::WifiLanMedium {
+ public:
+  // How long Connect() waits for the TCP handshake.
+  static constexpr absl::Duration kConnectTimeout = absl::Seconds(5);
+
+  explicit WifiLanMedium(
+      WifiLanServiceRegistry& registry = WifiLanServiceRegistry::Instance());
+  ~WifiLanMedium() override;
+
+  bool StartAdvertising(const std::string& service_id,
+                        const std::string& service_info_name) override;
+  bool StopAdvertising(const std::string& service_id) override;
+
+  bool StartDiscovery(const std::string& service_id,
+                      DiscoveredServiceCallback callback) override;
+  bool StopDiscovery(const std::string& service_id) override;
+
+  bool StartAcceptingConnections(const std::string& service_id,
+                                 AcceptedConnectionCallback callback) override;
+  bool StopAcceptingConnections(const std::string& service_id) override;
+
+  std::unique_ptr<api::WifiLanSocket> Connect(
+      api::WifiLanService& service, const std::string& service_id,
+      CancellationFlag* cancellation_flag) override;
+
+  api::WifiLanService* FindRemoteService(const std::string& ip_address,
+                                         int port) override;
+
+ private:
+  // State of a local service id.
+  struct LocalService {
+    // Shared with the accept loop, which may outlive the service when its
+    // callback stops accepting connections.
+    std::shared_ptr<WifiLanServerSocket> server_socket;
+    std::thread accept_thread;
+    bool advertising = false;
+    bool accepting = false;
+    AcceptedConnectionCallback callback;
+  };
+
+  // Returns the server socket of service, opening it and starting its accept
+  // loop if needed.
+  WifiLanServerSocket* EnsureServerSocket(const std::string& service_id,
+                                          LocalService& service);
+  // Closes the server socket of service_id once it is neither advertised nor
+  // accepting connections, and forgets about the service.
+  void MaybeCloseServerSocket(const std::string& service_id);
+  void RunAcceptLoop(const std::string& service_id,
+                     std::shared_ptr<WifiLanServerSocket> server_socket);
+  // Returns the service known for an address, creating it if needed. Services
+  // live as long as the medium, since callers keep pointers to them.
+  WifiLanService* GetOrCreateRemoteService(
+      const WifiLanServiceRegistry::Record& record);
+
+  WifiLanServiceRegistry& registry_;
+
+  std::mutex mutex_;
+  // Guarded by mutex_.
+  absl::flat_hash_map<std::string, LocalService> local_services_;
+  // Service id -> registry watch id. Guarded by mutex_.
+  absl::flat_hash_map<std::string, std::int64_t> watch_ids_;
+  // Guarded by mutex_.
+  absl::flat_hash_map<std::pair<std::string, int>,
+                      std::unique_ptr<WifiLanService>>
+      remote_services_;
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_WIFI_LAN_H_
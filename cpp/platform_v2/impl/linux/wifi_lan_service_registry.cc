@@ -0,0 +1,120 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/wifi_lan_service_registry.h"
+
+#include <condition_variable>  // NOLINT
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+WifiLanServiceRegistry& WifiLanServiceRegistry::Instance() {
+  static WifiLanServiceRegistry* const instance = new WifiLanServiceRegistry();
+  return *instance;
+}
+
+void WifiLanServiceRegistry::Advertise(const std::string& service_id,
+                                       const Record& record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  records_[service_id][{record.ip_address, record.port}] = record;
+  for (const auto& item : watchers_) {
+    if (item.second.service_id == service_id) {
+      Deliver(item.first, record, /*found=*/true);
+    }
+  }
+}
+
+void WifiLanServiceRegistry::Withdraw(const std::string& service_id,
+                                      const std::string& ip_address,
+                                      int port) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto records = records_.find(service_id);
+  if (records == records_.end()) return;
+  auto it = records->second.find({ip_address, port});
+  if (it == records->second.end()) return;
+  Record record = std::move(it->second);
+  records->second.erase(it);
+  if (records->second.empty()) records_.erase(records);
+  for (const auto& item : watchers_) {
+    if (item.second.service_id == service_id) {
+      Deliver(item.first, record, /*found=*/false);
+    }
+  }
+}
+
+std::int64_t WifiLanServiceRegistry::Watch(const std::string& service_id,
+                                           Listener listener) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::int64_t watch_id = next_watch_id_++;
+  watchers_.emplace(watch_id, Watcher{service_id, std::move(listener)});
+  auto records = records_.find(service_id);
+  if (records != records_.end()) {
+    for (const auto& item : records->second) {
+      Deliver(watch_id, item.second, /*found=*/true);
+    }
+  }
+  return watch_id;
+}
+
+void WifiLanServiceRegistry::Unwatch(std::int64_t watch_id) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    watchers_.erase(watch_id);
+  }
+  if (GetCurrentTid() == delivery_thread_.GetTid(0)) return;
+  // Wait for a delivery that may have looked the watcher up already.
+  std::mutex flush_mutex;
+  std::condition_variable flushed_cond;
+  bool flushed = false;
+  delivery_thread_.Schedule([&]() {
+    std::lock_guard<std::mutex> lock(flush_mutex);
+    flushed = true;
+    flushed_cond.notify_one();
+  });
+  std::unique_lock<std::mutex> lock(flush_mutex);
+  flushed_cond.wait(lock, [&flushed]() { return flushed; });
+}
+
+bool WifiLanServiceRegistry::Find(const std::string& ip_address, int port,
+                                  Record* record) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& records : records_) {
+    auto it = records.second.find({ip_address, port});
+    if (it != records.second.end()) {
+      *record = it->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WifiLanServiceRegistry::Deliver(std::int64_t watch_id,
+                                     const Record& record, bool found) {
+  delivery_thread_.Schedule([this, watch_id, record, found]() {
+    std::function<void(const Record&)> callback;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = watchers_.find(watch_id);
+      if (it == watchers_.end()) return;
+      callback = found ? it->second.listener.found_cb
+                       : it->second.listener.lost_cb;
+    }
+    if (callback) callback(record);
+  });
+}
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
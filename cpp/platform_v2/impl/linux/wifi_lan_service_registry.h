@@ -0,0 +1,100 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_WIFI_LAN_SERVICE_REGISTRY_H_
+#define PLATFORM_V2_IMPL_LINUX_WIFI_LAN_SERVICE_REGISTRY_H_
+
+#include <cstdint>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+
+#include "platform_v2/impl/linux/thread_pool.h"
+#include "absl/container/flat_hash_map.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// Stands in for mDNS between the WifiLanMedium instances of one process:
+// services advertised for a service id are reported to everybody watching
+// that service id, and withdrawn services are reported lost.
+//
+// Listeners are called on a single delivery thread, in the order the
+// changes were made, and never while the registry lock is held.
+class WifiLanServiceRegistry {
+ public:
+  struct Record {
+    std::string service_info_name;
+    // IPv4 address, as 4 bytes in network order.
+    std::string ip_address;
+    int port = 0;
+  };
+
+  struct Listener {
+    std::function<void(const Record& record)> found_cb;
+    std::function<void(const Record& record)> lost_cb;
+  };
+
+  static WifiLanServiceRegistry& Instance();
+
+  WifiLanServiceRegistry() = default;
+  WifiLanServiceRegistry(const WifiLanServiceRegistry&) = delete;
+  WifiLanServiceRegistry& operator=(const WifiLanServiceRegistry&) = delete;
+
+  // Advertises record for service_id, replacing the record previously
+  // advertised at the same address.
+  void Advertise(const std::string& service_id, const Record& record);
+  void Withdraw(const std::string& service_id, const std::string& ip_address,
+                int port);
+
+  // Reports the records advertised for service_id, now and from now on, to
+  // listener. Returns an id to pass to Unwatch().
+  std::int64_t Watch(const std::string& service_id, Listener listener);
+  // Once this returns, the listener is not called any more, unless this is
+  // called by the listener itself.
+  void Unwatch(std::int64_t watch_id);
+
+  // Looks up the record advertised at an address, for any service id.
+  // Returns false if there is none.
+  bool Find(const std::string& ip_address, int port, Record* record) const;
+
+ private:
+  using Address = std::pair<std::string, int>;
+
+  struct Watcher {
+    std::string service_id;
+    Listener listener;
+  };
+
+  // Calls the found or lost callback of a watcher on the delivery thread, if
+  // the watcher still exists by then.
+  void Deliver(std::int64_t watch_id, const Record& record, bool found);
+
+  mutable std::mutex mutex_;
+  // Service id -> records advertised for it. Guarded by mutex_.
+  absl::flat_hash_map<std::string, absl::flat_hash_map<Address, Record>>
+      records_;
+  // Guarded by mutex_.
+  absl::flat_hash_map<std::int64_t, Watcher> watchers_;
+  std::int64_t next_watch_id_ = 1;  // Guarded by mutex_.
+  ThreadPool delivery_thread_{1};
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_WIFI_LAN_SERVICE_REGISTRY_H_
@@ -0,0 +1,322 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/wifi_lan.h"
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "platform_v2/impl/linux/wifi_lan_service_registry.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+namespace {
+
+constexpr char kServiceId[] = "com.google.location.nearby.apps.test";
+constexpr char kServiceInfoName[] = "service info name";
+
+using DiscoveredServiceCallback = api::WifiLanMedium::DiscoveredServiceCallback;
+using AcceptedConnectionCallback =
+    api::WifiLanMedium::AcceptedConnectionCallback;
+
+class WifiLanTest : public ::testing::Test {
+ protected:
+  // Every test gets a registry of its own, so that it does not see the
+  // services of others.
+  WifiLanServiceRegistry registry_;
+  WifiLanMedium medium_a_{registry_};
+  WifiLanMedium medium_b_{registry_};
+};
+
+TEST_F(WifiLanTest, DiscoversAdvertisedService) {
+  absl::Notification found;
+  absl::Notification lost;
+  api::WifiLanService* found_service = nullptr;
+  ASSERT_TRUE(medium_a_.StartAdvertising(kServiceId, kServiceInfoName));
+  ASSERT_TRUE(medium_b_.StartDiscovery(
+      kServiceId,
+      DiscoveredServiceCallback{
+          .service_discovered_cb =
+              [&](api::WifiLanService& service, const std::string&) {
+                found_service = &service;
+                found.Notify();
+              },
+          .service_lost_cb =
+              [&](api::WifiLanService& service, const std::string&) {
+                EXPECT_EQ(&service, found_service);
+                lost.Notify();
+              },
+      }));
+  ASSERT_TRUE(found.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  EXPECT_EQ(found_service->GetName(), kServiceInfoName);
+  EXPECT_EQ(found_service->GetServiceAddress().first,
+            std::string({127, 0, 0, 1}));
+  EXPECT_GT(found_service->GetServiceAddress().second, 0);
+
+  EXPECT_TRUE(medium_a_.StopAdvertising(kServiceId));
+  EXPECT_TRUE(lost.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  EXPECT_TRUE(medium_b_.StopDiscovery(kServiceId));
+}
+
+TEST_F(WifiLanTest, DoesNotDiscoverOtherServiceIds) {
+  absl::Notification found;
+  ASSERT_TRUE(medium_a_.StartAdvertising("other", kServiceInfoName));
+  ASSERT_TRUE(medium_b_.StartDiscovery(
+      kServiceId, DiscoveredServiceCallback{
+                      .service_discovered_cb =
+                          [&](api::WifiLanService&, const std::string&) {
+                            found.Notify();
+                          },
+                  }));
+  EXPECT_FALSE(found.WaitForNotificationWithTimeout(absl::Milliseconds(100)));
+}
+
+TEST_F(WifiLanTest, FindsRemoteServiceByAddress) {
+  absl::Notification found;
+  api::WifiLanService* found_service = nullptr;
+  ASSERT_TRUE(medium_a_.StartAdvertising(kServiceId, kServiceInfoName));
+  ASSERT_TRUE(medium_b_.StartDiscovery(
+      kServiceId, DiscoveredServiceCallback{
+                      .service_discovered_cb =
+                          [&](api::WifiLanService& service,
+                              const std::string&) {
+                            found_service = &service;
+                            found.Notify();
+                          },
+                  }));
+  ASSERT_TRUE(found.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  auto address = found_service->GetServiceAddress();
+
+  EXPECT_EQ(medium_b_.FindRemoteService(address.first, address.second),
+            found_service);
+  api::WifiLanService* service =
+      medium_a_.FindRemoteService(address.first, address.second);
+  ASSERT_NE(service, nullptr);
+  EXPECT_EQ(service->GetName(), kServiceInfoName);
+}
+
+TEST_F(WifiLanTest, ConnectsAndTransfersData) {
+  absl::Notification found;
+  absl::Notification accepted;
+  api::WifiLanService* found_service = nullptr;
+  std::unique_ptr<api::WifiLanSocket> server_socket;
+  ASSERT_TRUE(medium_a_.StartAdvertising(kServiceId, kServiceInfoName));
+  ASSERT_TRUE(medium_a_.StartAcceptingConnections(
+      kServiceId, AcceptedConnectionCallback{
+                      .accepted_cb =
+                          [&](api::WifiLanSocket& socket, const std::string&) {
+                            server_socket.reset(&socket);
+                            accepted.Notify();
+                          },
+                  }));
+  ASSERT_TRUE(medium_b_.StartDiscovery(
+      kServiceId, DiscoveredServiceCallback{
+                      .service_discovered_cb =
+                          [&](api::WifiLanService& service,
+                              const std::string&) {
+                            found_service = &service;
+                            found.Notify();
+                          },
+                  }));
+  ASSERT_TRUE(found.WaitForNotificationWithTimeout(absl::Seconds(5)));
+
+  std::unique_ptr<api::WifiLanSocket> client_socket =
+      medium_b_.Connect(*found_service, kServiceId, nullptr);
+  ASSERT_NE(client_socket, nullptr);
+  ASSERT_TRUE(accepted.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  EXPECT_EQ(client_socket->GetRemoteWifiLanService()->GetName(),
+            kServiceInfoName);
+
+  // Bigger than the socket buffers, so that writes have to wait for reads.
+  std::string message(4 * 1024 * 1024, 'x');
+  std::thread writer([&]() {
+    EXPECT_TRUE(
+        client_socket->GetOutputStream().Write(ByteArray(message)).Ok());
+    EXPECT_TRUE(client_socket->GetOutputStream().Close().Ok());
+  });
+  std::string received;
+  while (true) {
+    ExceptionOr<ByteArray> data =
+        server_socket->GetInputStream().Read(64 * 1024);
+    ASSERT_TRUE(data.ok());
+    if (data.result().Empty()) break;
+    received += std::string(data.result());
+  }
+  writer.join();
+  EXPECT_EQ(received, message);
+
+  EXPECT_TRUE(medium_a_.StopAcceptingConnections(kServiceId));
+}
+
+TEST_F(WifiLanTest, CloseUnblocksRead) {
+  absl::Notification accepted;
+  std::unique_ptr<api::WifiLanSocket> server_socket;
+  ASSERT_TRUE(medium_a_.StartAcceptingConnections(
+      kServiceId, AcceptedConnectionCallback{
+                      .accepted_cb =
+                          [&](api::WifiLanSocket& socket, const std::string&) {
+                            server_socket.reset(&socket);
+                            accepted.Notify();
+                          },
+                  }));
+  ASSERT_TRUE(medium_a_.StartAdvertising(kServiceId, kServiceInfoName));
+  absl::Notification found;
+  api::WifiLanService* found_service = nullptr;
+  ASSERT_TRUE(medium_b_.StartDiscovery(
+      kServiceId, DiscoveredServiceCallback{
+                      .service_discovered_cb =
+                          [&](api::WifiLanService& service,
+                              const std::string&) {
+                            found_service = &service;
+                            found.Notify();
+                          },
+                  }));
+  ASSERT_TRUE(found.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  std::unique_ptr<api::WifiLanSocket> client_socket =
+      medium_b_.Connect(*found_service, kServiceId, nullptr);
+  ASSERT_NE(client_socket, nullptr);
+  ASSERT_TRUE(accepted.WaitForNotificationWithTimeout(absl::Seconds(5)));
+
+  std::thread closer([&]() {
+    absl::SleepFor(absl::Milliseconds(50));
+    client_socket->Close();
+  });
+  ExceptionOr<ByteArray> data = client_socket->GetInputStream().Read(1);
+  closer.join();
+  EXPECT_EQ(data.exception(), Exception::kIo);
+  EXPECT_EQ(client_socket->GetOutputStream().Write(ByteArray("x")).value,
+            Exception::kIo);
+}
+
+TEST_F(WifiLanTest, ReadIntoFillsCallerBuffer) {
+  absl::Notification accepted;
+  std::unique_ptr<api::WifiLanSocket> server_socket;
+  ASSERT_TRUE(medium_a_.StartAcceptingConnections(
+      kServiceId, AcceptedConnectionCallback{
+                      .accepted_cb =
+                          [&](api::WifiLanSocket& socket, const std::string&) {
+                            server_socket.reset(&socket);
+                            accepted.Notify();
+                          },
+                  }));
+  ASSERT_TRUE(medium_a_.StartAdvertising(kServiceId, kServiceInfoName));
+  absl::Notification found;
+  api::WifiLanService* found_service = nullptr;
+  ASSERT_TRUE(medium_b_.StartDiscovery(
+      kServiceId, DiscoveredServiceCallback{
+                      .service_discovered_cb =
+                          [&](api::WifiLanService& service,
+                              const std::string&) {
+                            found_service = &service;
+                            found.Notify();
+                          },
+                  }));
+  ASSERT_TRUE(found.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  std::unique_ptr<api::WifiLanSocket> client_socket =
+      medium_b_.Connect(*found_service, kServiceId, nullptr);
+  ASSERT_NE(client_socket, nullptr);
+  ASSERT_TRUE(accepted.WaitForNotificationWithTimeout(absl::Seconds(5)));
+
+  const std::string message = "message";
+  EXPECT_TRUE(client_socket->GetOutputStream().Write(ByteArray(message)).Ok());
+  EXPECT_TRUE(client_socket->GetOutputStream().Close().Ok());
+  std::string received(message.size() + 1, '\0');
+  std::int64_t current_pos = 0;
+  while (true) {
+    ExceptionOr<std::int64_t> count = server_socket->GetInputStream().ReadInto(
+        &received[current_pos], received.size() - current_pos);
+    ASSERT_TRUE(count.ok());
+    if (count.result() == 0) break;
+    current_pos += count.result();
+  }
+  received.resize(current_pos);
+  EXPECT_EQ(received, message);
+
+  EXPECT_TRUE(medium_a_.StopAcceptingConnections(kServiceId));
+}
+
+TEST_F(WifiLanTest, StopsFromAcceptedCallback) {
+  absl::Notification accepted;
+  std::unique_ptr<api::WifiLanSocket> server_socket;
+  ASSERT_TRUE(medium_a_.StartAdvertising(kServiceId, kServiceInfoName));
+  ASSERT_TRUE(medium_a_.StartAcceptingConnections(
+      kServiceId, AcceptedConnectionCallback{
+                      .accepted_cb =
+                          [&](api::WifiLanSocket& socket, const std::string&) {
+                            server_socket.reset(&socket);
+                            // Closes the server socket from its accept loop.
+                            EXPECT_TRUE(
+                                medium_a_.StopAcceptingConnections(kServiceId));
+                            EXPECT_TRUE(medium_a_.StopAdvertising(kServiceId));
+                            accepted.Notify();
+                          },
+                  }));
+  absl::Notification found;
+  api::WifiLanService* found_service = nullptr;
+  ASSERT_TRUE(medium_b_.StartDiscovery(
+      kServiceId, DiscoveredServiceCallback{
+                      .service_discovered_cb =
+                          [&](api::WifiLanService& service,
+                              const std::string&) {
+                            found_service = &service;
+                            found.Notify();
+                          },
+                  }));
+  ASSERT_TRUE(found.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  std::unique_ptr<api::WifiLanSocket> client_socket =
+      medium_b_.Connect(*found_service, kServiceId, nullptr);
+  ASSERT_NE(client_socket, nullptr);
+  ASSERT_TRUE(accepted.WaitForNotificationWithTimeout(absl::Seconds(5)));
+
+  EXPECT_EQ(medium_b_.Connect(*found_service, kServiceId, nullptr), nullptr);
+}
+
+TEST_F(WifiLanTest, ConnectFailsWithoutListener) {
+  WifiLanService service("", std::string({127, 0, 0, 1}), 1);
+  EXPECT_EQ(medium_a_.Connect(service, kServiceId, nullptr), nullptr);
+}
+
+TEST_F(WifiLanTest, ConnectGivesUpOnceCancelled) {
+  // Nothing answers at a TEST-NET-1 address, so connect() stays pending.
+  WifiLanService service("", std::string({'\xc0', 0, 2, 1}), 1);
+  CancellationFlag cancellation_flag;
+  std::thread canceller([&cancellation_flag]() {
+    absl::SleepFor(absl::Milliseconds(100));
+    cancellation_flag.Cancel();
+  });
+  absl::Time start = absl::Now();
+  EXPECT_EQ(medium_a_.Connect(service, kServiceId, &cancellation_flag),
+            nullptr);
+  EXPECT_LT(absl::Now() - start, WifiLanMedium::kConnectTimeout);
+  canceller.join();
+}
+
+TEST_F(WifiLanTest, StopsOnlyStartedOperations) {
+  EXPECT_FALSE(medium_a_.StopAdvertising(kServiceId));
+  EXPECT_FALSE(medium_a_.StopDiscovery(kServiceId));
+  EXPECT_FALSE(medium_a_.StopAcceptingConnections(kServiceId));
+  EXPECT_TRUE(medium_a_.StartDiscovery(kServiceId, {}));
+  EXPECT_FALSE(medium_a_.StartDiscovery(kServiceId, {}));
+}
+
+}  // namespace
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
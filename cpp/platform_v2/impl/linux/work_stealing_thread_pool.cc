@@ -0,0 +1,351 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/work_stealing_thread_pool.h"
+
+#include <thread>  // NOLINT
+#include <utility>
+
+#include "platform_v2/impl/linux/thread_pool.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+namespace {
+
+// Must be a power of two.
+constexpr std::int64_t kInitialDequeCapacity = 256;
+// Workers look at the injection queue before their own deque every that many
+// tasks, so that a worker feeding itself cannot starve external submitters.
+constexpr std::uint32_t kInjectionPollInterval = 61;
+// Maximum number of tasks a worker moves from the injection queue to its deque
+// at a time, where the other workers can steal them.
+constexpr int kInjectionBatchSize = 32;
+// Number of times an idle worker looks for work before going to sleep.
+constexpr int kIdleSpins = 16;
+
+struct CurrentWorker {
+  const void* pool = nullptr;
+  int index = 0;
+};
+
+thread_local CurrentWorker current_worker;
+
+}  // namespace
+
+struct WorkStealingThreadPool::Task {
+  explicit Task(Runnable&& runnable) : runnable(std::move(runnable)) {}
+
+  Runnable runnable;
+  // Next task in the injection queue.
+  std::atomic<Task*> next{nullptr};
+};
+
+// A growable circular array of tasks (Chase and Lev, "Dynamic Circular
+// Work-Stealing Deque"). Only the owning worker pushes, at the bottom; every
+// thread, owner included, takes from the top, so tasks pushed by a worker run
+// in the order they were pushed.
+class WorkStealingThreadPool::TaskDeque {
+ public:
+  TaskDeque() {
+    buffers_.push_back(std::make_unique<Buffer>(kInitialDequeCapacity));
+    buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+  }
+
+  // Must only be called by the owning worker.
+  void Push(Task* task) {
+    std::int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    std::int64_t top = top_.load(std::memory_order_acquire);
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    if (bottom - top >= buffer->capacity) {
+      // Thieves may still be reading the old buffer, so it is kept around
+      // until the deque goes away.
+      buffers_.push_back(std::make_unique<Buffer>(buffer->capacity * 2));
+      Buffer* grown = buffers_.back().get();
+      for (std::int64_t i = top; i < bottom; i++) grown->Put(i, buffer->Get(i));
+      buffer = grown;
+      buffer_.store(buffer, std::memory_order_release);
+    }
+    buffer->Put(bottom, task);
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  // Returns the oldest task, or nullptr if the deque is empty.
+  Task* Take() {
+    std::int64_t top = top_.load(std::memory_order_acquire);
+    while (true) {
+      std::int64_t bottom = bottom_.load(std::memory_order_acquire);
+      if (top >= bottom) return nullptr;
+      Task* task = buffer_.load(std::memory_order_acquire)->Get(top);
+      // On failure somebody else took the task, and top is reloaded.
+      if (top_.compare_exchange_weak(top, top + 1, std::memory_order_acq_rel,
+                                     std::memory_order_acquire)) {
+        return task;
+      }
+    }
+  }
+
+  bool Empty() const {
+    return top_.load(std::memory_order_acquire) >=
+           bottom_.load(std::memory_order_acquire);
+  }
+
+ private:
+  struct Buffer {
+    explicit Buffer(std::int64_t capacity)
+        : capacity(capacity), slots(new std::atomic<Task*>[capacity]) {}
+
+    Task* Get(std::int64_t index) const {
+      return slots[index & (capacity - 1)].load(std::memory_order_relaxed);
+    }
+    void Put(std::int64_t index, Task* task) {
+      slots[index & (capacity - 1)].store(task, std::memory_order_relaxed);
+    }
+
+    const std::int64_t capacity;
+    std::unique_ptr<std::atomic<Task*>[]> slots;
+  };
+
+  alignas(64) std::atomic<std::int64_t> top_{0};
+  alignas(64) std::atomic<std::int64_t> bottom_{0};
+  std::atomic<Buffer*> buffer_{nullptr};
+  // Every buffer the deque has used; only touched by the owner.
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+// An intrusive multi-producer, single-consumer queue (Vyukov). Push() is a
+// single atomic exchange; Pop() callers must serialize with TryLock().
+class WorkStealingThreadPool::InjectionQueue {
+ public:
+  InjectionQueue() : head_(&stub_), tail_(&stub_) {}
+
+  void Push(Task* task) {
+    size_.fetch_add(1, std::memory_order_relaxed);
+    task->next.store(nullptr, std::memory_order_relaxed);
+    Link(task);
+  }
+
+  // Returns the oldest task, or nullptr if the queue is empty or the oldest
+  // task is still being pushed.
+  Task* Pop() {
+    Task* tail = tail_;
+    Task* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (next == nullptr) return nullptr;
+      tail_ = tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next == nullptr) {
+      if (tail != head_.load(std::memory_order_acquire)) return nullptr;
+      // tail is the last task; put the stub behind it so it can be unlinked.
+      stub_.next.store(nullptr, std::memory_order_relaxed);
+      Link(&stub_);
+      next = tail->next.load(std::memory_order_acquire);
+      if (next == nullptr) return nullptr;
+    }
+    tail_ = next;
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return tail;
+  }
+
+  // Counts tasks from the start of their Push(), so a queue with a push in
+  // progress is not empty.
+  bool Empty() const { return size_.load(std::memory_order_relaxed) == 0; }
+
+  bool TryLock() {
+    return !consumer_locked_.test_and_set(std::memory_order_acquire);
+  }
+  void Unlock() { consumer_locked_.clear(std::memory_order_release); }
+
+ private:
+  void Link(Task* task) {
+    Task* prev = head_.exchange(task, std::memory_order_acq_rel);
+    prev->next.store(task, std::memory_order_release);
+  }
+
+  alignas(64) std::atomic<Task*> head_;
+  std::atomic<std::int64_t> size_{0};
+  alignas(64) Task* tail_;  // Only touched by the consumer.
+  std::atomic_flag consumer_locked_ = ATOMIC_FLAG_INIT;
+  Task stub_{nullptr};
+};
+
+struct WorkStealingThreadPool::Worker {
+  explicit Worker(int index) : random_state(index * 2654435761u + 1) {}
+
+  TaskDeque deque;
+  std::atomic_int tid{0};
+  // State of the xorshift generator picking victims to steal from.
+  std::uint32_t random_state;
+  std::thread thread;
+};
+
+WorkStealingThreadPool::WorkStealingThreadPool(int num_threads)
+    : injection_queue_(std::make_unique<InjectionQueue>()) {
+  if (num_threads < 1) num_threads = 1;
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    workers_.push_back(std::make_unique<Worker>(i));
+  }
+  // Workers steal from each other, so none may start before all exist.
+  for (int i = 0; i < num_threads; i++) {
+    workers_[i]->thread = std::thread(&WorkStealingThreadPool::RunWorker, this,
+                                      i);
+  }
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool() {
+  Shutdown();
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+  // A Schedule() racing with Shutdown() may have queued work after the
+  // workers left; it was accepted, so it still runs.
+  while (Task* task = injection_queue_->Pop()) Run(task);
+  for (auto& worker : workers_) {
+    while (Task* task = worker->deque.Take()) Run(task);
+  }
+}
+
+bool WorkStealingThreadPool::Schedule(Runnable&& runnable) {
+  if (shutdown_.load(std::memory_order_acquire)) return false;
+  auto* task = new Task(std::move(runnable));
+  if (current_worker.pool == this) {
+    workers_[current_worker.index]->deque.Push(task);
+  } else {
+    injection_queue_->Push(task);
+  }
+  WakeWorker();
+  return true;
+}
+
+void WorkStealingThreadPool::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  work_available_.notify_all();
+}
+
+int WorkStealingThreadPool::GetTid(int index) const {
+  if (index < 0 || index >= static_cast<int>(workers_.size())) return 0;
+  return workers_[index]->tid;
+}
+
+void WorkStealingThreadPool::RunWorker(int index) {
+  Worker& worker = *workers_[index];
+  worker.tid = GetCurrentTid();
+  current_worker = {this, index};
+  std::uint32_t tick = 0;
+  while (true) {
+    Task* task = FindTask(worker, ++tick);
+    if (task != nullptr) {
+      Run(task);
+    } else if (!WaitForWork()) {
+      return;
+    }
+  }
+}
+
+WorkStealingThreadPool::Task* WorkStealingThreadPool::FindTask(
+    Worker& worker, std::uint32_t tick) {
+  Task* task = nullptr;
+  if (tick % kInjectionPollInterval == 0) task = TakeInjected(worker);
+  if (task == nullptr) task = worker.deque.Take();
+  if (task == nullptr) task = TakeInjected(worker);
+  if (task == nullptr) task = Steal(worker);
+  return task;
+}
+
+WorkStealingThreadPool::Task* WorkStealingThreadPool::TakeInjected(
+    Worker& worker) {
+  if (injection_queue_->Empty() || !injection_queue_->TryLock()) {
+    return nullptr;
+  }
+  Task* task = injection_queue_->Pop();
+  if (task != nullptr) {
+    for (int i = 1; i < kInjectionBatchSize; i++) {
+      Task* next = injection_queue_->Pop();
+      if (next == nullptr) break;
+      worker.deque.Push(next);
+    }
+  }
+  injection_queue_->Unlock();
+  return task;
+}
+
+WorkStealingThreadPool::Task* WorkStealingThreadPool::Steal(Worker& worker) {
+  int num_workers = static_cast<int>(workers_.size());
+  if (num_workers < 2) return nullptr;
+  worker.random_state ^= worker.random_state << 13;
+  worker.random_state ^= worker.random_state >> 17;
+  worker.random_state ^= worker.random_state << 5;
+  int start = worker.random_state % num_workers;
+  for (int i = 0; i < num_workers; i++) {
+    Worker& victim = *workers_[(start + i) % num_workers];
+    if (&victim == &worker) continue;
+    if (Task* task = victim.deque.Take()) return task;
+  }
+  return nullptr;
+}
+
+bool WorkStealingThreadPool::HasWork() const {
+  if (!injection_queue_->Empty()) return true;
+  for (const auto& worker : workers_) {
+    if (!worker->deque.Empty()) return true;
+  }
+  return false;
+}
+
+bool WorkStealingThreadPool::WaitForWork() {
+  for (int i = 0; i < kIdleSpins; i++) {
+    if (HasWork()) return true;
+    std::this_thread::yield();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::int64_t epoch = wake_epoch_;
+  // Announcing the worker as idle, and then looking for work again, pairs
+  // with WakeWorker() publishing work, and then looking for idle workers:
+  // either this worker sees the work, or the scheduler sees the idle worker.
+  num_idle_.fetch_add(1, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool has_work = HasWork();
+  if (!has_work && !shutdown_) {
+    work_available_.wait(
+        lock, [this, epoch]() { return wake_epoch_ != epoch || shutdown_; });
+    has_work = true;  // Or shut down; in both cases look again.
+  }
+  num_idle_.fetch_sub(1, std::memory_order_relaxed);
+  return has_work;
+}
+
+void WorkStealingThreadPool::WakeWorker() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_idle_.load(std::memory_order_relaxed) == 0) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_epoch_++;
+  }
+  work_available_.notify_one();
+}
+
+void WorkStealingThreadPool::Run(Task* task) {
+  if (task->runnable) task->runnable();
+  delete task;
+}
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
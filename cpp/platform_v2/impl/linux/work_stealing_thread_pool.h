@@ -0,0 +1,95 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_V2_IMPL_LINUX_WORK_STEALING_THREAD_POOL_H_
+#define PLATFORM_V2_IMPL_LINUX_WORK_STEALING_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "platform_v2/base/runnable.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+
+// A fixed number of std::thread workers, each with its own lock-free deque.
+//
+// Work scheduled by a worker goes to that worker's deque; work scheduled by
+// any other thread goes to a shared lock-free injection queue, which workers
+// drain in batches into their deques. A worker that runs out of work steals
+// from the deques of the others before going to sleep, so Schedule() never
+// takes a lock unless a worker has to be woken up.
+//
+// Work is run in FIFO order per deque, but there is no ordering between work
+// scheduled from different threads; use ThreadPool if that matters.
+class WorkStealingThreadPool {
+ public:
+  explicit WorkStealingThreadPool(int num_threads);
+  // Stops accepting new work, runs all the work already scheduled, and joins
+  // the workers. Must not be called from one of the workers.
+  ~WorkStealingThreadPool();
+  WorkStealingThreadPool(const WorkStealingThreadPool&) = delete;
+  WorkStealingThreadPool& operator=(const WorkStealingThreadPool&) = delete;
+
+  // Queues runnable to be run by one of the workers. Returns false, and drops
+  // runnable, if the pool is shut down.
+  bool Schedule(Runnable&& runnable);
+
+  // Stops accepting new work. Work already scheduled still runs.
+  void Shutdown();
+  bool InShutdown() const { return shutdown_; }
+
+  // Returns kernel thread id of the index-th worker, or 0 if there is no such
+  // worker or it has not started yet.
+  int GetTid(int index) const;
+
+ private:
+  struct Task;
+  class TaskDeque;
+  class InjectionQueue;
+  struct Worker;
+
+  void RunWorker(int index);
+  Task* FindTask(Worker& worker, std::uint32_t tick);
+  Task* TakeInjected(Worker& worker);
+  Task* Steal(Worker& worker);
+  bool HasWork() const;
+  // Blocks until there may be work to do. Returns false if the pool is shut
+  // down and there is no work left.
+  bool WaitForWork();
+  void WakeWorker();
+  static void Run(Task* task);
+
+  std::unique_ptr<InjectionQueue> injection_queue_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic_bool shutdown_{false};
+
+  // Workers sleep on work_available_; num_idle_ lets Schedule() skip the
+  // wake-up when all workers are busy.
+  std::atomic_int num_idle_{0};
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::int64_t wake_epoch_ = 0;  // Guarded by mutex_.
+};
+
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
+
+#endif  // PLATFORM_V2_IMPL_LINUX_WORK_STEALING_THREAD_POOL_H_
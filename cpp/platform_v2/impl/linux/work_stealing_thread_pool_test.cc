@@ -0,0 +1,139 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "platform_v2/impl/linux/work_stealing_thread_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "platform_v2/impl/linux/thread_pool.h"
+#include "gtest/gtest.h"
+#include "absl/synchronization/notification.h"
+
+namespace location {
+namespace nearby {
+namespace linux_impl {
+namespace {
+
+TEST(WorkStealingThreadPoolTest, RunsScheduledWork) {
+  WorkStealingThreadPool pool(4);
+  absl::Notification done;
+
+  EXPECT_TRUE(pool.Schedule([&done]() { done.Notify(); }));
+
+  done.WaitForNotification();
+}
+
+TEST(WorkStealingThreadPoolTest, DestructorRunsPendingWork) {
+  std::atomic_int count = 0;
+  {
+    WorkStealingThreadPool pool(2);
+    for (int i = 0; i < 1000; i++) {
+      pool.Schedule([&count]() { count++; });
+    }
+  }
+
+  EXPECT_EQ(count, 1000);
+}
+
+TEST(WorkStealingThreadPoolTest, RunsWorkFromManySubmitters) {
+  constexpr int kSubmitters = 8;
+  constexpr int kTasksPerSubmitter = 10000;
+  std::atomic_int count = 0;
+  {
+    WorkStealingThreadPool pool(4);
+    std::vector<std::thread> submitters;
+    for (int i = 0; i < kSubmitters; i++) {
+      submitters.emplace_back([&pool, &count]() {
+        for (int j = 0; j < kTasksPerSubmitter; j++) {
+          pool.Schedule([&count]() { count++; });
+        }
+      });
+    }
+    for (auto& submitter : submitters) submitter.join();
+  }
+
+  EXPECT_EQ(count, kSubmitters * kTasksPerSubmitter);
+}
+
+TEST(WorkStealingThreadPoolTest, RunsWorkScheduledFromWorkers) {
+  std::atomic_int count = 0;
+  {
+    WorkStealingThreadPool pool(4);
+    // Every task schedules two more, down to depth 12: 8191 tasks in total,
+    // most of them pushed to the scheduling worker's own deque.
+    std::function<void(int)> fan_out = [&](int depth) {
+      count++;
+      if (depth == 0) return;
+      pool.Schedule([&fan_out, depth]() { fan_out(depth - 1); });
+      pool.Schedule([&fan_out, depth]() { fan_out(depth - 1); });
+    };
+    pool.Schedule([&fan_out]() { fan_out(12); });
+    while (count < 8191) std::this_thread::yield();
+  }
+
+  EXPECT_EQ(count, 8191);
+}
+
+TEST(WorkStealingThreadPoolTest, StealsWorkFromBusyWorker) {
+  constexpr int kTasks = 100;
+  WorkStealingThreadPool pool(2);
+  std::atomic_int count = 0;
+  absl::Notification done;
+
+  // The tasks land on the deque of a worker that then waits for them, so
+  // they can only run if the other worker steals them.
+  pool.Schedule([&]() {
+    for (int i = 0; i < kTasks; i++) {
+      pool.Schedule([&count]() { count++; });
+    }
+    while (count < kTasks) std::this_thread::yield();
+    done.Notify();
+  });
+
+  done.WaitForNotification();
+  EXPECT_EQ(count, kTasks);
+}
+
+TEST(WorkStealingThreadPoolTest, RejectsWorkAfterShutdown) {
+  WorkStealingThreadPool pool(1);
+  pool.Shutdown();
+
+  EXPECT_TRUE(pool.InShutdown());
+  EXPECT_FALSE(pool.Schedule([]() { FAIL(); }));
+}
+
+TEST(WorkStealingThreadPoolTest, ReportsWorkerTids) {
+  WorkStealingThreadPool pool(1);
+  std::atomic_int tid = 0;
+  absl::Notification done;
+
+  pool.Schedule([&]() {
+    tid = GetCurrentTid();
+    done.Notify();
+  });
+  done.WaitForNotification();
+
+  EXPECT_NE(tid, 0);
+  EXPECT_NE(tid, GetCurrentTid());
+  EXPECT_EQ(pool.GetTid(0), tid);
+  EXPECT_EQ(pool.GetTid(1), 0);
+}
+
+}  // namespace
+}  // namespace linux_impl
+}  // namespace nearby
+}  // namespace location
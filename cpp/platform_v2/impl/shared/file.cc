@@ -15,6 +15,7 @@
 #include "platform_v2/impl/shared/file.h"
 
 #include <cstddef>
+#include <cstdio>
 #include <memory>
 
 #include "platform_v2/base/exception.h"
@@ -62,7 +63,13 @@ Exception InputFile::Close() {
 
 // OutputFile
 
-OutputFile::OutputFile(absl::string_view path) : file_(std::string(path)) {}
+OutputFile::OutputFile(absl::string_view path) {
+  // Replace the file, rather than truncate it, so that whoever still reads it
+  // keeps its content; that is the case of the sender of a file transferred
+  // between two endpoints of the same process.
+  std::remove(std::string(path).c_str());
+  file_.open(std::string(path));
+}
 
 Exception OutputFile::Write(const ByteArray& data) {
   if (!file_.is_open()) {
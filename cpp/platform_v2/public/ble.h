@@ -18,6 +18,7 @@
 #include "platform_v2/api/ble.h"
 #include "platform_v2/api/platform.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/base/input_stream.h"
 #include "platform_v2/base/output_stream.h"
 #include "platform_v2/public/bluetooth_adapter.h"
@@ -136,8 +137,9 @@ class BleMedium final {
   bool StopAcceptingConnections(const std::string& service_id);
 
   // Returns a new BleSocket. On Success, BleSocket::IsValid()
-  // returns true.
-  BleSocket Connect(BlePeripheral& peripheral, const std::string& service_id);
+  // returns true. Gives up once cancellation_flag is set, if it is not null.
+  BleSocket Connect(BlePeripheral& peripheral, const std::string& service_id,
+                    CancellationFlag* cancellation_flag = nullptr);
 
   bool IsValid() const { return impl_ != nullptr; }
 
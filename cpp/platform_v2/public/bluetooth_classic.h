@@ -21,6 +21,7 @@
 #include "platform_v2/api/bluetooth_classic.h"
 #include "platform_v2/api/platform.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/base/exception.h"
 #include "platform_v2/base/input_stream.h"
 #include "platform_v2/base/listeners.h"
@@ -176,10 +177,13 @@ class BluetoothClassicMedium final {
   // (https://en.wikipedia.org/wiki/Universally_unique_identifier#Versions_3_and_5_(namespace_name-based))
   // UUID.
   //
+  // Gives up once cancellation_flag is set, if it is not null.
+  //
   // Returns a new BluetoothSocket. On Success, BluetoothSocket::IsValid()
   // returns true.
-  BluetoothSocket ConnectToService(BluetoothDevice& remote_device,
-                                   const std::string& service_uuid);
+  BluetoothSocket ConnectToService(
+      BluetoothDevice& remote_device, const std::string& service_uuid,
+      CancellationFlag* cancellation_flag = nullptr);
 
   // https://developer.android.com/reference/android/bluetooth/BluetoothAdapter.html#listenUsingInsecureRfcommWithServiceRecord
   //
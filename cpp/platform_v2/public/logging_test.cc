@@ -49,4 +49,22 @@ TEST(LoggingTest, CanStream_LoggingDisabled) {
   EXPECT_EQ(num, 42);
 }
 
+TEST(LoggingTest, CanLogEveryNSec) {
+  NEARBY_LOG_SET_SEVERITY(INFO);
+  int num = 42;
+  for (int i = 0; i < 10; i++) {
+    NEARBY_LOG_EVERY_N_SEC(INFO, 3600, "The answer to everything: %d", num++);
+  }
+  // Only the first message gets through, and evaluates num++.
+  EXPECT_EQ(num, 43);
+}
+
+TEST(LoggingTest, CanLogEveryNSec_LoggingDisabled) {
+  NEARBY_LOG_SET_SEVERITY(ERROR);
+  int num = 42;
+  NEARBY_LOG_EVERY_N_SEC(INFO, 1, "The answer to everything: %d", num++);
+  // num++ should not be evaluated
+  EXPECT_EQ(num, 42);
+}
+
 }  // namespace
@@ -23,6 +23,8 @@
 #include "platform_v2/base/prng.h"
 #include "platform_v2/base/runnable.h"
 #include "gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 
 namespace location {
 namespace nearby {
@@ -342,5 +344,39 @@ TEST(PipeTest, ConcurrentWriteAndRead) {
   reader_thread.Join();
 }
 
+TEST(PipeTest, LinkProfileDelaysAndSplitsData) {
+  Pipe pipe;
+  pipe.SetLinkProfile({.delay = absl::Milliseconds(100), .mtu = 2},
+                      /*seed=*/0);
+  InputStream& input_stream{pipe.GetInputStream()};
+  OutputStream& output_stream{pipe.GetOutputStream()};
+
+  absl::Time start = absl::Now();
+  EXPECT_TRUE(output_stream.Write(ByteArray("ABCD")).Ok());
+  EXPECT_TRUE(output_stream.Close().Ok());
+
+  ExceptionOr<ByteArray> read_data = input_stream.Read(Pipe::kChunkSize);
+  EXPECT_GE(absl::Now() - start, absl::Milliseconds(100));
+  ASSERT_TRUE(read_data.ok());
+  EXPECT_EQ(std::string(read_data.result()), "AB");
+  read_data = input_stream.Read(Pipe::kChunkSize);
+  ASSERT_TRUE(read_data.ok());
+  EXPECT_EQ(std::string(read_data.result()), "CD");
+  read_data = input_stream.Read(Pipe::kChunkSize);
+  ASSERT_TRUE(read_data.ok());
+  EXPECT_TRUE(read_data.result().Empty());
+}
+
+TEST(PipeTest, LinkProfileBlocksWriterOnFullLink) {
+  Pipe pipe;
+  pipe.SetLinkProfile({.bandwidth = 1000, .send_buffer = 100}, /*seed=*/0);
+  OutputStream& output_stream{pipe.GetOutputStream()};
+
+  absl::Time start = absl::Now();
+  // 300ms of transmission, of which the send buffer takes 100ms.
+  EXPECT_TRUE(output_stream.Write(ByteArray(std::string(300, 'x'))).Ok());
+  EXPECT_GE(absl::Now() - start, absl::Milliseconds(200));
+}
+
 }  // namespace nearby
 }  // namespace location
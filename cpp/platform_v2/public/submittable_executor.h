@@ -15,9 +15,12 @@
 #ifndef PLATFORM_V2_PUBLIC_SUBMITTABLE_EXECUTOR_H_
 #define PLATFORM_V2_PUBLIC_SUBMITTABLE_EXECUTOR_H_
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <thread>  // NOLINT
 #include <utility>
 
 #include "platform_v2/api/executor.h"
@@ -36,6 +39,10 @@ inline int GetCurrentTid() { return api::GetCurrentTid(); }
 // Main interface to be used by platform as a base class for
 // - MultiThreadExecutor
 // - SingleThreadExecutor
+//
+// Execute(), Submit() and GetTid() do not take any lock: they only register in
+// calls_ for as long as they use impl_, so that Shutdown() knows when impl_ may
+// be released.
 class SubmittableExecutor : public api::SubmittableExecutor {
  public:
   ~SubmittableExecutor() override {
@@ -43,23 +50,29 @@ class SubmittableExecutor : public api::SubmittableExecutor {
     DoShutdown();
   }
   SubmittableExecutor(SubmittableExecutor&& other) { *this = std::move(other); }
+  // Must not race with any other call on either executor.
   SubmittableExecutor& operator=(SubmittableExecutor&& other)
       ABSL_LOCKS_EXCLUDED(mutex_) {
     MutexLock lock(&mutex_);
     {
       MutexLock other_lock(&other.mutex_);
       impl_ = std::move(other.impl_);
+      calls_.store(other.calls_.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
     }
     return *this;
   }
-  void Execute(Runnable&& runnable) ABSL_LOCKS_EXCLUDED(mutex_) override {
-    MutexLock lock(&mutex_);
+  void Execute(Runnable&& runnable) override {
+    if (!EnterCall()) return;
     if (impl_) impl_->Execute(std::move(runnable));
+    LeaveCall();
   }
 
-  int GetTid(int index) const ABSL_LOCKS_EXCLUDED(mutex_) override {
-    MutexLock lock(&mutex_);
-    return impl_ ? impl_->GetTid(index) : 0;
+  int GetTid(int index) const override {
+    if (!EnterCall()) return 0;
+    int tid = impl_ ? impl_->GetTid(index) : 0;
+    LeaveCall();
+    return tid;
   }
 
   void Shutdown() ABSL_LOCKS_EXCLUDED(mutex_) override {
@@ -71,9 +84,7 @@ class SubmittableExecutor : public api::SubmittableExecutor {
   // When execution completes, return value is assigned to the passed future.
   // Future must outlive the whole execution chain.
   template <typename T>
-  bool Submit(Callable<T>&& callable, Future<T>* future)
-      ABSL_LOCKS_EXCLUDED(mutex_) {
-    MutexLock lock(&mutex_);
+  bool Submit(Callable<T>&& callable, Future<T>* future) {
     bool submitted = DoSubmit([callable{std::move(callable)}, future]() {
       ExceptionOr<T> result = callable();
       if (result.ok()) {
@@ -94,7 +105,26 @@ class SubmittableExecutor : public api::SubmittableExecutor {
       : impl_(std::move(impl)) {}
 
  private:
+  // Set in calls_ once DoShutdown() starts; the lower bits count the calls
+  // using impl_.
+  static constexpr std::int64_t kShutdownBit = std::int64_t{1} << 62;
+
+  // Returns false, without registering, if the executor is shutting down.
+  bool EnterCall() const {
+    if (calls_.fetch_add(1, std::memory_order_acquire) & kShutdownBit) {
+      LeaveCall();
+      return false;
+    }
+    return true;
+  }
+  void LeaveCall() const { calls_.fetch_sub(1, std::memory_order_release); }
+
   void DoShutdown() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    calls_.fetch_or(kShutdownBit, std::memory_order_acq_rel);
+    // Calls that got in first only queue work, so this wait is short.
+    while (calls_.load(std::memory_order_acquire) != kShutdownBit) {
+      std::this_thread::yield();
+    }
     if (impl_) {
       impl_->Shutdown();
       impl_.reset();
@@ -103,12 +133,19 @@ class SubmittableExecutor : public api::SubmittableExecutor {
   // Submit a callable (with no delay).
   // Returns true, if callable was submitted, false otherwise.
   // Callable is not submitted if shutdown is in progress.
-  bool DoSubmit(Runnable&& wrapped_callable)
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) override {
-    return impl_ ? impl_->DoSubmit(std::move(wrapped_callable)) : false;
+  bool DoSubmit(Runnable&& wrapped_callable) override {
+    if (!EnterCall()) return false;
+    bool submitted =
+        impl_ ? impl_->DoSubmit(std::move(wrapped_callable)) : false;
+    LeaveCall();
+    return submitted;
   }
+
+  // Serializes Shutdown() and moves.
   mutable Mutex mutex_;
-  std::unique_ptr<api::SubmittableExecutor> ABSL_GUARDED_BY(mutex_) impl_;
+  mutable std::atomic<std::int64_t> calls_{0};
+  // Only changed by moves and by DoShutdown(), once no call is using it.
+  std::unique_ptr<api::SubmittableExecutor> impl_;
 };
 
 }  // namespace nearby
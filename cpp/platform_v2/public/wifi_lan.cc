@@ -129,12 +129,14 @@ bool WifiLanMedium::StopAcceptingConnections(const std::string& service_id) {
 }
 
 WifiLanSocket WifiLanMedium::Connect(WifiLanService& service,
-                                     const std::string& service_id) {
+                                     const std::string& service_id,
+                                     CancellationFlag* cancellation_flag) {
   NEARBY_LOG(
       INFO,
       "WifiLanMedium::Connect: service=%p [impl=%p, service_info_name=%s]",
       &service, &service.GetImpl(), service.GetName().c_str());
-  return WifiLanSocket(impl_->Connect(service.GetImpl(), service_id));
+  return WifiLanSocket(
+      impl_->Connect(service.GetImpl(), service_id, cancellation_flag));
 }
 
 WifiLanService WifiLanMedium::FindRemoteService(const std::string& ip_address,
@@ -18,6 +18,7 @@
 #include "platform_v2/api/platform.h"
 #include "platform_v2/api/wifi_lan.h"
 #include "platform_v2/base/byte_array.h"
+#include "platform_v2/base/cancellation_flag.h"
 #include "platform_v2/base/input_stream.h"
 #include "platform_v2/base/output_stream.h"
 #include "platform_v2/public/mutex.h"
@@ -148,7 +149,9 @@ class WifiLanMedium final {
 
   // Returns a new WifiLanSocket. On Success, WifiLanSocket::IsValid()
   // returns true.
-  WifiLanSocket Connect(WifiLanService& service, const std::string& service_id);
+  // Gives up once cancellation_flag is set, if it is not null.
+  WifiLanSocket Connect(WifiLanService& service, const std::string& service_id,
+                        CancellationFlag* cancellation_flag = nullptr);
 
   bool IsValid() const { return impl_ != nullptr; }
 